@@ -39,6 +39,9 @@
 #include <common_port.hpp>
 #include <avbts_ostimerq.hpp>
 #include <avbts_osipc.hpp>
+#include <clock_servo.hpp>
+#include <sample_filter.hpp>
+#include <fixed_point.hpp>
 
 /**@file*/
 
@@ -50,6 +53,14 @@
 #define UPPER_FREQ_LIMIT  250.0		/*!< Upper frequency limit */
 #define LOWER_FREQ_LIMIT -250.0		/*!< Lower frequency limit */
 
+/* Fixed point forms of the above */
+#define INTEGRAL_NUM 3				/*!< INTEGRAL numerator */
+#define INTEGRAL_DEN 10000			/*!< INTEGRAL denominator */
+#define PROPORTIONAL_NUM 1			/*!< PROPORTIONAL numerator */
+#define PROPORTIONAL_DEN 1			/*!< PROPORTIONAL denominator */
+#define UPPER_FREQ_LIMIT_SCALED PPM_TO_SCALED_PPB(250)	/*!< Upper frequency limit */
+#define LOWER_FREQ_LIMIT_SCALED PPM_TO_SCALED_PPB(-250)	/*!< Lower frequency limit */
+
 #define UPPER_LIMIT_PPM 250
 #define LOWER_LIMIT_PPM -250
 #define PPM_OFFSET_TO_RATIO(ppm) ((ppm) / ((FrequencyRatio)US_PER_SEC) + 1)
@@ -62,30 +73,8 @@
 #define PHASE_ERROR_MAX_COUNT (6)
 
 /* Value returned by calcMasterLocalClockRateDifference() to indicate
-   detection of negative time jump in follow_up message */
-#define NEGATIVE_TIME_JUMP 0.0
-
-/**
- * @brief Provides the clock quality abstraction.
- * Represents the quality of the clock
- * Defined at IEEE 802.1AS-2011
- * Clause 6.3.3.8
- */
-struct ClockQuality {
-	unsigned char cq_class;				/*!< Clock Class - Clause 8.6.2.2
-										  Denotes the tracebility of the synchronized time
-										  distributed by a clock master when it is grandmaster. */
-	unsigned char clockAccuracy; 		/*!< Clock Accuracy - clause 8.6.2.3.
-										  Indicates the expected time accuracy of
-										  a clock master.*/
-	uint16_t offsetScaledLogVariance;	/*!< ::Offset Scaled log variance - Clause 8.6.2.4.
-										  Is the scaled, offset representation
-										  of an estimate of the PTP variance. The
-										  PTP variance characterizes the
-										  precision and frequency stability of the clock
-										  master. The PTP variance is the square of
-										  PTPDEV (See B.1.3.2). */
-};
+   detection of negative time jump in follow_up message (a rate ratio of 0) */
+#define NEGATIVE_TIME_JUMP (-RATE_OFFSET_ONE)
 
 /**
  * @brief Provides the 1588 clock interface
@@ -120,9 +109,8 @@ private:
 
 	ClockIdentity LastEBestIdentity;
 	bool _syntonize;
-	bool _new_syntonization_set_point;
-	float _ppm;
-	int _phase_error_violation;
+	ClockServo *servo;
+	SampleFilter offset_filter;
 
 	CommonPort *port_list[MAX_PORTS];
 
@@ -162,10 +150,19 @@ private:
 
     OSLock *timerq_lock;
 
+    /**
+     * @brief  Publishes the servo estimate, if the servo has one
+     * @param  port [in] Port the offset was measured on
+     * @return void
+     */
+    void updateServoEstimate( CommonPort *port );
+
 public:
 	
     /**
-	 * @brief  Add a new event to the timer queue
+	 * @brief  Add a new event to the timer queue. The event is armed
+	 * with the target's descriptor of e, arming it again while it is
+	 * pending moves its deadline.
 	 * @param  target EtherPort target
 	 * @param  e Event to be added
 	 * @param  time_ns Time in nanoseconds
@@ -518,9 +515,10 @@ public:
    * @brief  Calculates the master to local clock rate difference
    * @param  master_time Master time
    * @param  sync_time Local time
-   * @return The offset in ppt (parts per trillion)
+   * @return Master to local rate ratio minus one, NEGATIVE_TIME_JUMP if
+   * the master time went backwards
    */
-  FrequencyRatio calcMasterLocalClockRateDifference
+  ScaledRateOffset calcMasterLocalClockRateDifference
 	  ( Timestamp master_time, Timestamp sync_time );
 
   /**
@@ -536,7 +534,7 @@ public:
    * @brief  Sets the master offset, sintonyze and adjusts the frequency offset
    * @param  master_local_offset Master to local phase offset
    * @param  local_time Local time
-   * @param  master_local_freq_offset Master to local frequency offset
+   * @param  master_local_rate_offset Master to local rate ratio minus one
    * @param  local_system_offset Local time to system time phase offset
    * @param  system_time System time
    * @param  local_system_freq_offset Local to system frequency offset
@@ -547,7 +545,7 @@ public:
    */
   void setMasterOffset
   ( CommonPort *port, int64_t master_local_offset,
-    Timestamp local_time, FrequencyRatio master_local_freq_offset,
+    Timestamp local_time, ScaledRateOffset master_local_rate_offset,
     int64_t local_system_offset, Timestamp system_time,
     FrequencyRatio local_system_freq_offset, unsigned sync_count,
     unsigned pdelay_count, PortState port_state, bool asCapable );
@@ -574,7 +572,34 @@ public:
    * @return void
    */
   void newSyntonizationSetPoint() {
-	  _new_syntonization_set_point = true;
+	  servo->requestStep();
+  }
+
+  /**
+   * @brief  Replaces the servo adjusting the clock when syntonizing
+   * @param  servo [in] New servo, owned by the clock
+   * @return void
+   */
+  void setServo( ClockServo *servo );
+
+  /**
+   * @brief  Logs the servo statistics
+   * @return void
+   */
+  void logServoStatistics() {
+	  servo->logStatistics();
+	  offset_filter.logStatistics( "Master offset" );
+  }
+
+  /**
+   * @brief  Configures the pre-filter master offsets pass before the
+   * servo. Accepted offsets reach the servo unchanged, the window
+   * statistic is only the reference outliers are measured against.
+   * @param  config Filter configuration
+   * @return void
+   */
+  void setOffsetFilter( const sample_filter_config_t &config ) {
+	  offset_filter.configure( config );
   }
 
   /**
@@ -657,6 +682,14 @@ public:
 	  return timerq_lock->unlock();
   }
 
+  /**
+   * @brief  Logs the timer queue statistics
+   * @return void
+   */
+  void logTimerStatistics() {
+	  timerq->logStatistics();
+  }
+
   /**
    * @brief  Gets a pointer to the timer queue lock object
    * @return OSLock instance
@@ -41,6 +41,8 @@
 #include <list>
 #include <algorithm>
 
+class OSLock;
+
 /** @file **/
 
 #define PTP_CODE_STRING_LENGTH 4		/*!< PTP code string length in bytes */
@@ -126,6 +128,7 @@
 
 #define TX_TIMEOUT_BASE 1000 	/*!< Timeout base in microseconds */
 #define TX_TIMEOUT_ITER 6		/*!< Number of timeout iteractions for sending/receiving messages*/
+#define TX_TIMEOUT_TOTAL (TX_TIMEOUT_BASE*((1 << TX_TIMEOUT_ITER)-1))	/*!< Total TX timestamp wait in microseconds */
 
 /**
  * @brief Enumeration message type. IEEE 1588-2008 Clause 13.3.2.2
@@ -209,10 +212,175 @@ public:
  * @param  size [in] length of buffer in bytes
  * @param  remote [in] address from where message was received
  * @param  port [in] port object that message was recieved on
+ * @param  rx_timestamp [in] Receive timestamp delivered with the frame.
+ * If NULL, event message timestamps are requested from the port.
  * @return PTP message object
  */
 PTPMessageCommon *buildPTPMessage
-( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+  Timestamp *rx_timestamp = NULL );
+
+#define PTP_MAX_MESSAGE_LENGTH 1500	/*!< Largest message received (Ethernet MTU) */
+#define PTP_MESSAGE_POOL_SIZE 32	/*!< Default number of message slots per port */
+
+/**
+ * @brief Fixed-capacity per-port pool backing PTPMessageCommon objects.
+ * All slots are allocated once, when the pool is created, and are sized to
+ * hold the largest PTPMessageCommon subclass. Messages allocated with
+ * new (pool) are returned to their pool by delete.
+ */
+class PTPMessagePool {
+public:
+	/**
+	 * @brief Creates the pool and allocates all of its slots
+	 * @param lock [in] Lock protecting the free list, owned by the pool
+	 * @param capacity Number of message slots
+	 */
+	PTPMessagePool( OSLock *lock, unsigned capacity = PTP_MESSAGE_POOL_SIZE );
+
+	/**
+	 * @brief Frees the slot storage and the lock
+	 */
+	~PTPMessagePool();
+
+	/**
+	 * @brief  Takes a slot from the pool, falling back to the heap when the
+	 * pool is exhausted
+	 * @param  size Object size, must not exceed the slot size
+	 * @return Pointer to storage for the object
+	 */
+	void *allocate( size_t size );
+
+	/**
+	 * @brief  Returns storage obtained from allocate() or from the heap
+	 * fallback of PTPMessageCommon::operator new
+	 * @param  ptr Pointer to the object storage
+	 * @return void
+	 */
+	static void release( void *ptr );
+
+	/**
+	 * @brief  Allocates heap storage tagged as not belonging to any pool
+	 * @param  size Object size
+	 * @return Pointer to storage for the object
+	 */
+	static void *allocateHeap( size_t size );
+
+	/**
+	 * @brief  Gets the number of allocations served by the heap because
+	 * the pool was exhausted
+	 * @return heap fallback count
+	 */
+	uint64_t getHeapAllocations() {
+		return heap_allocations;
+	}
+
+	/**
+	 * @brief  Logs pool usage statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	struct Slot;
+
+	OSLock *lock;
+	unsigned capacity;
+	size_t stride;
+	char *storage;
+	Slot *free_list;
+
+	unsigned in_use;
+	unsigned high_water;
+	uint64_t pool_allocations;
+	uint64_t heap_allocations;
+
+	void put( Slot *slot );
+};
+
+#define PTP_FRAME_TEMPLATE_SIZE 128	/*!< Largest message built from a template */
+#define PTP_FRAME_TEMPLATE_TYPES 16	/*!< One template per message type */
+#define PTP_CACHE_LINE_SIZE 64		/*!< Template alignment */
+
+/**
+ * @brief Per-port frame templates for the messages sent on the transmit
+ * path. A template holds a complete message with its common header filled
+ * in and a zeroed body. It is built the first time a message type is sent
+ * after the templates were invalidated, which the port does whenever its
+ * identity or one of its intervals changes. Sending then only copies the
+ * template and patches the sequenceId, correctionField and
+ * logMessageInterval, the caller fills in the body (timestamps). The
+ * length, flags and control of a message type must therefore not change
+ * between invalidations.
+ * Templates are cache line aligned. Each message type must be sent from a
+ * single thread, invalidate() may be called from any thread.
+ */
+class PTPFrameTemplates {
+public:
+	/**
+	 * @brief Allocates empty templates
+	 */
+	PTPFrameTemplates();
+
+	/**
+	 * @brief Frees the templates
+	 */
+	~PTPFrameTemplates();
+
+	/**
+	 * @brief  Discards all templates, each is rebuilt the next time its
+	 * message type is sent
+	 * @return void
+	 */
+	void invalidate()
+	{
+		__atomic_fetch_add( &generation, 1, __ATOMIC_RELAXED );
+	}
+
+	/**
+	 * @brief  Copies the template of a message type into buf
+	 * @param  type Message type
+	 * @param  length Message length
+	 * @param  buf [out] Message buffer, at least length bytes
+	 * @return FALSE if the template must be built with store()
+	 */
+	bool copy( MessageType type, uint16_t length, uint8_t *buf );
+
+	/**
+	 * @brief  Stores a message, with its header built and its body still
+	 * zeroed, as the template for its type. Must follow a failed copy().
+	 * @param  type Message type
+	 * @param  length Message length
+	 * @param  buf [in] Message
+	 * @return void
+	 */
+	void store( MessageType type, uint16_t length, const uint8_t *buf );
+
+	/**
+	 * @brief  Logs how many messages were built from templates
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	// Written only by the thread sending the type, read by
+	// logStatistics() from any thread. Accessed with the __atomic
+	// builtins, which stay inline in unoptimized builds.
+	struct Counters {
+		uint64_t hits;
+		uint64_t builds;
+		uint64_t oversize;
+	};
+
+	unsigned generation;
+	// Generation each template was built for, and the one a failed
+	// copy() saw, which store() records. Sending thread only.
+	unsigned built[PTP_FRAME_TEMPLATE_TYPES];
+	unsigned pending[PTP_FRAME_TEMPLATE_TYPES];
+	Counters counters[PTP_FRAME_TEMPLATE_TYPES];
+	uint8_t *storage;
+	uint8_t *frames;
+};
 
 /**
  * @brief Provides the PTPMessage common interface used during building of
@@ -224,7 +392,7 @@ protected:
 	uint16_t versionNetwork;	/*!< Network version */
 	MessageType messageType;	/*!< MessageType to be built */
 
-	PortIdentity *sourcePortIdentity;	/*!< PortIdentity from source*/
+	PortIdentity sourcePortIdentity;	/*!< PortIdentity from source*/
 
 	uint16_t sequenceId;		/*!< PTP message sequence ID*/
 	LegacyMessageType control;	/*!< Control message type of LegacyMessageType */
@@ -255,6 +423,42 @@ protected:
 	 */
 	virtual ~PTPMessageCommon(void);
 
+	/**
+	 * @brief  Allocates a message from the heap
+	 * @param  size Object size
+	 * @return Pointer to storage for the object
+	 */
+	static void *operator new( size_t size );
+
+	/**
+	 * @brief  Allocates a message from a port message pool
+	 * @param  size Object size
+	 * @param  pool [in] Pool to take the slot from, NULL to use the heap
+	 * @return Pointer to storage for the object
+	 */
+	static void *operator new( size_t size, PTPMessagePool *pool );
+
+	/**
+	 * @brief  Returns a message to its pool, or to the heap
+	 * @param  ptr Pointer to the object storage
+	 * @return void
+	 */
+	static void operator delete( void *ptr );
+
+	/**
+	 * @brief  Releases storage if a pool allocated constructor throws
+	 * @param  ptr Pointer to the object storage
+	 * @param  pool [in] Pool the storage was taken from
+	 * @return void
+	 */
+	static void operator delete( void *ptr, PTPMessagePool *pool );
+
+	/**
+	 * @brief  Gets the slot size required by the largest message class
+	 * @return Size in bytes
+	 */
+	static size_t getMaxMessageSize();
+
 	/**
 	 * @brief  Gets a pointer to the flags field within the PTP message.
 	 * @return Pointer to the flags field
@@ -396,13 +600,81 @@ protected:
 	 */
 	void buildCommonHeader(uint8_t * buf);
 
+	/**
+	 * @brief  Builds PTP common header from the port's frame template
+	 * and zeroes the message body. messageLength must be set.
+	 * @param  port [in] Port the message is sent on
+	 * @param  buf [out] PTP message
+	 * @return void
+	 */
+	void buildHeader( CommonPort *port, uint8_t *buf );
+
+	/**
+	 * @brief  Builds PTP common header from a frame template and zeroes
+	 * the message body. messageLength must be set.
+	 * @param  templates [in] Frame templates to build from
+	 * @param  buf [out] PTP message
+	 * @return void
+	 */
+	void buildHeader( PTPFrameTemplates *templates, uint8_t *buf );
+
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
+};
+
+/**
+ * @brief Scoped owner of a message. The message is returned to its pool
+ * when the handle goes out of scope, unless ownership has been handed over
+ * with release().
+ */
+class PTPMessageHandle {
+private:
+	PTPMessageCommon *msg;
+
+	PTPMessageHandle( const PTPMessageHandle & );
+	PTPMessageHandle &operator=( const PTPMessageHandle & );
+public:
+	/**
+	 * @brief Takes ownership of msg
+	 * @param msg [in] Message, may be NULL
+	 */
+	explicit PTPMessageHandle( PTPMessageCommon *msg ) : msg( msg ) { }
+
+	/**
+	 * @brief Deletes the owned message, if any
+	 */
+	~PTPMessageHandle() {
+		delete msg;
+	}
+
+	/**
+	 * @brief  Gets the owned message
+	 * @return Message pointer, NULL if empty
+	 */
+	PTPMessageCommon *get() {
+		return msg;
+	}
+
+	PTPMessageCommon *operator->() {
+		return msg;
+	}
+
+	/**
+	 * @brief  Gives up ownership without deleting the message
+	 * @return Message pointer
+	 */
+	PTPMessageCommon *release() {
+		PTPMessageCommon *ret = msg;
+		msg = NULL;
+		return ret;
+	}
 };
 
 /*Exact fit. No padding*/
 #pragma pack(push,1)
 
+#define PATH_TRACE_TLV_MAX_IDENTITIES 32	/*!< Path trace entries kept per TLV */
 #define PATH_TRACE_TLV_TYPE 0x8		/*!< This is the value that indicates the
 									  TLV is a path trace TLV, as specified in
 									  16.2.7.1 and Table 34 of IEEE Std
@@ -418,8 +690,8 @@ protected:
 class PathTraceTLV {
  private:
 	uint16_t tlvType;
-	typedef std::list<ClockIdentity> IdentityList;
-	IdentityList identityList;
+	uint16_t identityCount;
+	ClockIdentity identityList[PATH_TRACE_TLV_MAX_IDENTITIES];
  public:
 	/**
 	 * @brief Creates the PathTraceTLV interface.
@@ -427,6 +699,7 @@ class PathTraceTLV {
 	 */
 	PathTraceTLV() {
 		tlvType = PLAT_htons(PATH_TRACE_TLV_TYPE);
+		identityCount = 0;
 	}
 	/**
 	 * @brief  Parses ClockIdentity from message buffer
@@ -445,10 +718,9 @@ class PathTraceTLV {
 		}
 		length /= PTP_CLOCK_IDENTITY_LENGTH;
 
-		for(; length > 0; --length) {
-			ClockIdentity add;
-			add.set(buffer);
-			identityList.push_back(add);
+		for(; length > 0 &&
+			    identityCount < PATH_TRACE_TLV_MAX_IDENTITIES; --length) {
+			identityList[identityCount++].set(buffer);
 			buffer += PTP_CLOCK_IDENTITY_LENGTH;
 		}
 	}
@@ -459,7 +731,8 @@ class PathTraceTLV {
 	 * @return void
 	 */
 	void appendClockIdentity(ClockIdentity * id) {
-		identityList.push_back(*id);
+		if( identityCount < PATH_TRACE_TLV_MAX_IDENTITIES )
+			identityList[identityCount++] = *id;
 	}
 
 	/**
@@ -468,16 +741,13 @@ class PathTraceTLV {
 	 * @return void
 	 */
 	void toByteString(uint8_t * byte_str) {
-		IdentityList::iterator iter;
 		*((uint16_t *)byte_str) = tlvType;  // tlvType already in network byte order
 		byte_str += sizeof(tlvType);
 		*((uint16_t *)byte_str) = PLAT_htons
-			((uint16_t)identityList.size()*PTP_CLOCK_IDENTITY_LENGTH);
+			((uint16_t)(identityCount*PTP_CLOCK_IDENTITY_LENGTH));
 		byte_str += sizeof(uint16_t);
-		for
-			(iter = identityList.begin();
-			 iter != identityList.end(); ++iter) {
-			iter->getIdentityString(byte_str);
+		for( int i = 0; i < identityCount; ++i ) {
+			identityList[i].getIdentityString(byte_str);
 			byte_str += PTP_CLOCK_IDENTITY_LENGTH;
 		}
 	}
@@ -489,8 +759,8 @@ class PathTraceTLV {
 	 */
 	bool has(ClockIdentity *id) {
 		return std::find
-			(identityList.begin(), identityList.end(), *id) !=
-			identityList.end();
+			(identityList, identityList + identityCount, *id) !=
+			identityList + identityCount;
 	}
 
 	/**
@@ -501,7 +771,7 @@ class PathTraceTLV {
 	 * @return Total length
 	 */
 	int length() {
-		return (int)(2*sizeof(uint16_t) + PTP_CLOCK_IDENTITY_LENGTH*identityList.size());
+		return (int)(2*sizeof(uint16_t) + PTP_CLOCK_IDENTITY_LENGTH*identityCount);
 	}
 };
 
@@ -517,14 +787,13 @@ class PathTraceTLV {
 class PTPMessageAnnounce:public PTPMessageCommon {
  private:
 	uint8_t grandmasterIdentity[PTP_CLOCK_IDENTITY_LENGTH];
-	ClockQuality *grandmasterClockQuality;
+	ClockQuality grandmasterClockQuality;
 
 	PathTraceTLV tlv;
 
 	uint16_t currentUtcOffset;
 	unsigned char grandmasterPriority1;
 	unsigned char grandmasterPriority2;
-	ClockQuality *clockQuality;
 	uint16_t stepsRemoved;
 	unsigned char timeSource;
 
@@ -569,7 +838,7 @@ class PTPMessageAnnounce:public PTPMessageCommon {
 	 * @return Pointer to a ClockQuality object.
 	 */
 	ClockQuality *getGrandmasterClockQuality(void) {
-		return grandmasterClockQuality;
+		return &grandmasterClockQuality;
 	}
 
 	/**
@@ -613,7 +882,8 @@ class PTPMessageAnnounce:public PTPMessageCommon {
 	( CommonPort *port, PortIdentity *destIdentity);
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -622,6 +892,7 @@ class PTPMessageAnnounce:public PTPMessageCommon {
 class PTPMessageSync : public PTPMessageCommon {
  private:
 	Timestamp originTimestamp;
+	uint64_t launchTime;
 
 	PTPMessageSync();
  public:
@@ -646,6 +917,16 @@ class PTPMessageSync : public PTPMessageCommon {
 		return originTimestamp;
 	}
 
+	/**
+	 * @brief  Sets the time the message is sent at
+	 * @param  launch_time Launch time in device time nanoseconds, 0 to
+	 * send immediately
+	 * @return void
+	 */
+	void setLaunchTime( uint64_t launch_time ) {
+		launchTime = launch_time;
+	}
+
 	/**
 	 * @brief  Assembles PTPMessageSync message on the
 	 * EtherPort payload
@@ -658,7 +939,8 @@ class PTPMessageSync : public PTPMessageCommon {
 	(EtherPort *port, PortIdentity *destIdentity );
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /* Exact fit. No padding*/
@@ -926,7 +1208,8 @@ public:
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -964,6 +1247,20 @@ class PTPMessagePathDelayReq : public PTPMessageCommon {
 
 	void processMessage( CommonPort *port );
 
+	/**
+	 * @brief  Processes a received Pdelay request, answering it with a
+	 * Pdelay response and response follow up. Used directly on the
+	 * receive path, without building a request object.
+	 * @param  port EtherPort the request was received on
+	 * @param  requester [in] sourcePortIdentity of the request
+	 * @param  sequenceId sequenceId of the request
+	 * @param  receipt Request receipt timestamp
+	 * @return void
+	 */
+	static void processRequest
+	( EtherPort *port, PortIdentity *requester, uint16_t sequenceId,
+	  Timestamp receipt );
+
 	/**
 	 * @brief  Gets origin timestamp value
 	 * @return Origin Timestamp
@@ -973,7 +1270,8 @@ class PTPMessagePathDelayReq : public PTPMessageCommon {
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -981,7 +1279,7 @@ class PTPMessagePathDelayReq : public PTPMessageCommon {
  */
 class PTPMessagePathDelayResp:public PTPMessageCommon {
 private:
-	PortIdentity * requestingPortIdentity;
+	PortIdentity requestingPortIdentity;
 	Timestamp requestReceiptTimestamp;
 
 	PTPMessagePathDelayResp(void) {
@@ -1040,7 +1338,8 @@ public:
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -1049,7 +1348,7 @@ public:
 class PTPMessagePathDelayRespFollowUp:public PTPMessageCommon {
  private:
 	Timestamp responseOriginTimestamp;
-	PortIdentity *requestingPortIdentity;
+	PortIdentity requestingPortIdentity;
 
 	PTPMessagePathDelayRespFollowUp(void) { }
 
@@ -1104,11 +1403,12 @@ public:
 	 * @return Pointer to requesting PortIdentity object
 	 */
 	PortIdentity *getRequestingPortIdentity(void) {
-		return requestingPortIdentity;
+		return &requestingPortIdentity;
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /*Exact fit. No padding*/
@@ -1261,7 +1561,8 @@ public:
 	void processMessage( CommonPort *port );
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 #endif
@@ -128,6 +128,25 @@ public:
 		int8_t   log_pdelay_interval,
 		uint16_t port_number ) = 0;
 
+	/**
+	 * @brief  Updates the clock servo estimate IPC values
+	 *
+	 * @param  phase_stddev Standard deviation of the phase estimate in ns
+	 * @param  freq_stddev Standard deviation of the frequency estimate in parts per trillion
+	 * @param  link_delay Estimated link delay in ns
+	 * @param  link_delay_stddev Standard deviation of the link delay estimate in ns
+	 *
+	 * @return Implementation dependent. The default does nothing and returns true.
+	 */
+	virtual bool update_estimate(
+		uint32_t /*phase_stddev*/,
+		uint32_t /*freq_stddev*/,
+		int64_t  /*link_delay*/,
+		uint32_t /*link_delay_stddev*/ )
+	{
+		return true;
+	}
+
 	/*
 	 * Destroys IPC
 	 */
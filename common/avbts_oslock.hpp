@@ -73,6 +73,11 @@ class OSLock {
 		 * @return OSLockResult enumeration
 		 */
 		virtual OSLockResult trylock() = 0;
+
+		/*
+		 * Virtual destructor
+		 */
+		virtual ~OSLock() = 0;
 	protected:
 		/**
 		 * @brief Default constructor
@@ -87,7 +92,6 @@ class OSLock {
 		bool initialize(OSLockType type) {
 			return false;
 		}
-		virtual ~OSLock() = 0;
 };
 
 inline OSLock::~OSLock() {}
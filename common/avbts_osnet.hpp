@@ -318,6 +318,57 @@ class OSNetworkInterface {
 	 virtual net_result nrecv
 	 ( LinkLayerAddress *addr, uint8_t *payload, size_t &length ) = 0;
 
+	 /**
+	  * @brief  Receives data together with its receive timestamp, when
+	  * the interface can deliver it with the frame. The default
+	  * implementation never does; the timestamp must then be retrieved
+	  * from the timestamper.
+	  * @param  addr [out] Destination Mac Address
+	  * @param  payload [out] Payload received
+	  * @param  length [out] Received length
+	  * @param  rx_timestamp [out] Device receive timestamp
+	  * @param  rx_timestamp_valid [out] TRUE if rx_timestamp was set
+	  * @return net_result enumeration
+	  */
+	 virtual net_result nrecvTimestamped
+	 ( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+	   Timestamp & /*rx_timestamp*/, bool &rx_timestamp_valid )
+	 {
+		 rx_timestamp_valid = false;
+		 return nrecv( addr, payload, length );
+	 }
+
+	 /**
+	  * @brief  Receives data in place, when the interface keeps received
+	  * frames in memory it owns (e.g. a memory mapped receive ring). The
+	  * frame stays valid until releaseReceived() is called, which must
+	  * happen before the next receive. The default implementation
+	  * receives into buf.
+	  * @param addr [out] Destination Mac Address
+	  * @param buf [in] Buffer to receive into if the frame is copied
+	  * @param payload [out] Payload received, within buf or the
+	  * interface's memory
+	  * @param length [inout] Size of buf on input, received length on
+	  * output
+	  * @param rx_timestamp [out] Device receive timestamp
+	  * @param rx_timestamp_valid [out] TRUE if rx_timestamp was set
+	  * @return net_result enumeration
+	  */
+	 virtual net_result nrecvInPlace
+	 ( LinkLayerAddress *addr, uint8_t *buf, uint8_t *&payload,
+	   size_t &length, Timestamp &rx_timestamp, bool &rx_timestamp_valid )
+	 {
+		 payload = buf;
+		 return nrecvTimestamped
+			 ( addr, buf, length, rx_timestamp, rx_timestamp_valid );
+	 }
+
+	 /**
+	  * @brief  Releases the frame returned by nrecvInPlace()
+	  * @return void
+	  */
+	 virtual void releaseReceived() { }
+
 	 /**
 	  * @brief Get Link Layer address (mac address)
 	  * @param addr [out] Link Layer address
@@ -330,11 +381,69 @@ class OSNetworkInterface {
 	  */
 	 virtual void watchNetLink( CommonPort *pPort ) = 0;
 
+	 /**
+	  * @brief  Hands receive and link events of the port to an event
+	  * loop instead of the listening and link watch threads
+	  * @param  pPort [in] Port to drive
+	  * @return TRUE if the event loop drives the port, FALSE otherwise
+	  */
+	 virtual bool attachPort( CommonPort * /*pPort*/ )
+	 {
+		 return false;
+	 }
+
 	 /**
 	  * @brief  Provides generic method for getting the payload offset
 	  */
 	 virtual unsigned getPayloadOffset() = 0;
 
+	 /**
+	  * @brief  Logs implementation specific statistics
+	  * @return void
+	  */
+	 virtual void logStatistics() { }
+
+	 /**
+	  * @brief  Starts queuing general messages sent by the calling
+	  * thread so they can be handed to the network stack together. The
+	  * default implementation sends every message immediately.
+	  * @return void
+	  */
+	 virtual void beginSendBatch() { }
+
+	 /**
+	  * @brief  Sends the general messages queued since beginSendBatch()
+	  * @return net_succeed if all messages were sent, net_fatal otherwise
+	  */
+	 virtual net_result flushSendBatch() {
+		 return net_succeed;
+	 }
+
+	 /**
+	  * @brief  Checks whether sendAtLaunchTime() honours the launch time
+	  * @return TRUE if event messages can be scheduled, FALSE otherwise
+	  */
+	 virtual bool launchTimeEnabled() {
+		 return false;
+	 }
+
+	 /**
+	  * @brief  Sends an event message, with a TX timestamp, no earlier
+	  * than a launch time. The default implementation sends it now.
+	  * @param  addr [in] Destination link layer address
+	  * @param  etherType The EtherType of the message in host order
+	  * @param  payload [in] Data buffer
+	  * @param  length Size of data buffer
+	  * @param  launch_time Launch time in nanoseconds, in the device
+	  * (gPTP) time domain of the timestamper
+	  * @return net_succeed if the message was queued, net_fatal otherwise
+	  */
+	 virtual net_result sendAtLaunchTime
+	 ( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload,
+	   size_t length, uint64_t /*launch_time*/ ) {
+		 return send( addr, etherType, payload, length, true );
+	 }
+
 	 /**
 	  * @brief Native support for polimorphic destruction
 	  */
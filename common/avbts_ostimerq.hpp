@@ -42,6 +42,7 @@
 typedef void (*ostimerq_handler) (void *);
 
 class IEEE1588Clock;
+class CommonPort;
 
 /**
  * @brief OSTimerQueue generic interface
@@ -76,10 +77,18 @@ public:
 	/**
 	 * @brief Removes an event from the timer queue
 	 * @param type Event type
+	 * @param port Port the event was added for, NULL for all ports
 	 * @param event [inout] Pointer to the event
 	 * @return TRUE success, FALSE fail
 	 */
-	virtual bool cancelEvent(int type, unsigned *event) = 0;
+	virtual bool cancelEvent(int type, CommonPort *port, unsigned *event) = 0;
+
+	/**
+	 * @brief  Logs implementation specific statistics
+	 * @return void
+	 */
+	virtual void logStatistics() { }
+
 	virtual ~OSTimerQueue() = 0;
 };
 
@@ -0,0 +1,722 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <clock_servo.hpp>
+#include <avbts_clock.hpp>
+#include <gptp_log.hpp>
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+
+ClockServo::ClockServo()
+{
+	memset( &stats, 0, sizeof( stats ));
+	step_requested = false;
+	phase_error_violation = 0;
+	started = false;
+	sync_interval = 0;
+	locked = false;
+	lock_count = 0;
+	acquire_start = 0;
+	acquire_samples = 0;
+	stats.lock_time_min = (uint64_t)-1;
+}
+
+void ClockServo::acquire( uint64_t local_time )
+{
+	locked = false;
+	lock_count = 0;
+	acquire_start = local_time;
+	acquire_samples = 0;
+}
+
+void ClockServo::trackLock( int64_t offset, uint64_t local_time )
+{
+	bool within;
+
+	within = offset <= SERVO_LOCK_THRESHOLD &&
+		offset >= -SERVO_LOCK_THRESHOLD;
+	++acquire_samples;
+
+	// Count consecutive samples agreeing with a change of state
+	if( within != locked ) {
+		++lock_count;
+	} else {
+		lock_count = 0;
+	}
+	if( lock_count < SERVO_LOCK_SAMPLES )
+		return;
+	lock_count = 0;
+
+	if( locked ) {
+		GPTP_LOG_STATUS( "Servo %s lost lock, offset %lld",
+				 getName(), (long long) offset );
+		++stats.lock_losses;
+		acquire( local_time );
+		return;
+	}
+
+	locked = true;
+	++stats.locks;
+	stats.lock_time_last = local_time - acquire_start;
+	stats.lock_samples_last = acquire_samples;
+	stats.lock_time_total += stats.lock_time_last;
+	if( stats.lock_time_last < stats.lock_time_min )
+		stats.lock_time_min = stats.lock_time_last;
+	if( stats.lock_time_last > stats.lock_time_max )
+		stats.lock_time_max = stats.lock_time_last;
+	GPTP_LOG_STATUS( "Servo %s locked in %llu ms, %u samples", getName(),
+			 (unsigned long long) stats.lock_time_last / 1000000,
+			 acquire_samples );
+}
+
+servo_decision_t ClockServo::sample
+( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+  signed char log_sync_interval, int64_t link_delay, unsigned delay_count,
+  ScaledPpb &freq )
+{
+	std::chrono::steady_clock::time_point start;
+	servo_decision_t decision;
+	uint64_t elapsed;
+
+	start = std::chrono::steady_clock::now();
+	if( !started ) {
+		started = true;
+		sync_interval = log_sync_interval;
+		acquire( local_time );
+	} else if( log_sync_interval != sync_interval ) {
+		GPTP_LOG_STATUS( "Servo %s: sync interval %d -> %d", getName(),
+				 sync_interval, log_sync_interval );
+		// The servos rescale to the new interval themselves; the lock
+		// is kept so outlier rejection stays on across the change
+		sync_interval = log_sync_interval;
+		++stats.interval_changes;
+	}
+
+	decision = adjust
+		( offset, local_time, rate_offset, log_sync_interval, link_delay,
+		  delay_count, freq );
+
+	// The offset measured before a step says nothing about the lock
+	if( decision == SERVO_STEP ) {
+		acquire( local_time );
+	} else {
+		trackLock( offset, local_time );
+	}
+
+	elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>
+		( std::chrono::steady_clock::now() - start ).count();
+	stats.time_total += elapsed;
+	if( elapsed > stats.time_max )
+		stats.time_max = elapsed;
+
+	return decision;
+}
+
+bool ClockServo::stepNeeded()
+{
+	if( !step_requested && phase_error_violation <= PHASE_ERROR_MAX_COUNT )
+		return false;
+
+	step_requested = false;
+	phase_error_violation = 0;
+	return true;
+}
+
+bool ClockServo::inRange( int64_t offset )
+{
+	if( offset > PHASE_ERROR_THRESHOLD || offset < -PHASE_ERROR_THRESHOLD ) {
+		++phase_error_violation;
+		++stats.out_of_range;
+		return false;
+	}
+	phase_error_violation = 0;
+	return true;
+}
+
+servo_decision_t ClockServo::decide( servo_decision_t decision )
+{
+	++stats.samples;
+	switch( decision ) {
+	case SERVO_HOLD:
+		++stats.holds;
+		break;
+	case SERVO_STEP:
+		++stats.steps;
+		break;
+	case SERVO_SLEW:
+		++stats.slews;
+		break;
+	}
+
+	return decision;
+}
+
+void ClockServo::logStatistics()
+{
+	GPTP_LOG_STATUS
+		( "Servo %s: samples %llu, steps %llu, slews %llu, holds %llu, "
+		  "out of range %llu, interval changes %llu", getName(),
+		  (unsigned long long) stats.samples,
+		  (unsigned long long) stats.steps,
+		  (unsigned long long) stats.slews,
+		  (unsigned long long) stats.holds,
+		  (unsigned long long) stats.out_of_range,
+		  (unsigned long long) stats.interval_changes );
+	GPTP_LOG_STATUS
+		( "Servo %s: %s, locks %llu, lost %llu", getName(),
+		  locked ? "locked" : "unlocked",
+		  (unsigned long long) stats.locks,
+		  (unsigned long long) stats.lock_losses );
+	if( stats.locks != 0 ) {
+		GPTP_LOG_STATUS
+			( "Servo %s: time to lock last %llu ms (%u samples), "
+			  "min %llu ms, mean %llu ms, max %llu ms", getName(),
+			  (unsigned long long) stats.lock_time_last / 1000000,
+			  stats.lock_samples_last,
+			  (unsigned long long) stats.lock_time_min / 1000000,
+			  (unsigned long long)
+			  ( stats.lock_time_total / stats.locks ) / 1000000,
+			  (unsigned long long) stats.lock_time_max / 1000000 );
+	}
+	if( stats.samples != 0 ) {
+		GPTP_LOG_STATUS
+			( "Servo %s: time per sample mean %llu ns, max %llu ns",
+			  getName(),
+			  (unsigned long long)( stats.time_total / stats.samples ),
+			  (unsigned long long) stats.time_max );
+	}
+}
+
+PiClockServo::PiClockServo()
+{
+	_freq = 0;
+}
+
+servo_decision_t PiClockServo::adjust
+( int64_t offset, uint64_t /*local_time*/, ScaledRateOffset rate_offset,
+  signed char log_sync_interval, int64_t /*link_delay*/,
+  unsigned /*delay_count*/, ScaledPpb &freq )
+{
+	servo_decision_t decision = SERVO_SLEW;
+
+	if( stepNeeded() ) {
+		decision = SERVO_STEP;
+		offset = 0;
+	}
+
+	// Adjust for frequency offset
+	if( inRange( offset )) {
+		int64_t integral_num, integral_den;
+		int shift;
+
+		// INTEGRAL * syncPerSec in ScaledPpb per ns of phase error,
+		// the Sync rate is a power of two
+		shift = log_sync_interval;
+		if( shift > 16 ) shift = 16;
+		if( shift < -16 ) shift = -16;
+		integral_num = (int64_t) INTEGRAL_NUM * PPM_TO_SCALED_PPB(1);
+		integral_den = INTEGRAL_DEN;
+		if( shift < 0 ) {
+			integral_num <<= -shift;
+		} else {
+			integral_den <<= shift;
+		}
+
+		_freq += mulDiv64( -offset, integral_num, integral_den ) +
+			mulDiv64( rateOffsetToScaledPpb( rate_offset ),
+				  PROPORTIONAL_NUM, PROPORTIONAL_DEN );
+
+		GPTP_LOG_DEBUG( "phase_error = %lld, ppm = %f",
+				(long long) -offset, scaledPpbToPpm( _freq ));
+	}
+
+	if( _freq < LOWER_FREQ_LIMIT_SCALED ) _freq = LOWER_FREQ_LIMIT_SCALED;
+	if( _freq > UPPER_FREQ_LIMIT_SCALED ) _freq = UPPER_FREQ_LIMIT_SCALED;
+	freq = _freq;
+
+	return decide( decision );
+}
+
+LinregClockServo::LinregClockServo( unsigned window )
+{
+	unsigned size;
+
+	head = 0;
+	count = 0;
+	correction = 0;
+	last_time = 0;
+	delay = 0;
+	last_delay_count = 0;
+	freq_steps = 0;
+	ppm = 0;
+	started = false;
+
+	window_count = 0;
+	for( size = LINREG_WINDOW_MIN; size <= LINREG_WINDOW_MAX &&
+		     ( size <= window || window_count == 0 ); size *= 2 ) {
+		windows[window_count].size = size;
+		windows[window_count].err = -1;
+		windows[window_count].used = 0;
+		++window_count;
+	}
+	max_count = windows[window_count-1].size;
+}
+
+void LinregClockServo::reset( uint64_t local_time )
+{
+	unsigned i;
+
+	head = 0;
+	count = 0;
+	correction = 0;
+	last_time = local_time;
+	for( i = 0; i < window_count; ++i )
+		windows[i].err = -1;
+}
+
+void LinregClockServo::restart()
+{
+	unsigned i;
+
+	// Only the newest sample is on the new frequency
+	if( count > 1 )
+		count = 1;
+	for( i = 0; i < window_count; ++i )
+		windows[i].err = -1;
+	++freq_steps;
+}
+
+void LinregClockServo::add( uint64_t local_time, double y )
+{
+	points[head].x = local_time;
+	points[head].y = y;
+	head = ( head + 1 ) % LINREG_WINDOW_MAX;
+	if( count < max_count )
+		++count;
+}
+
+bool LinregClockServo::fit
+( unsigned size, double &slope, double &intercept ) const
+{
+	const point *newest, *p;
+	double x_mean = 0, y_mean = 0, sxx = 0, sxy = 0;
+	unsigned i;
+
+	if( size > count )
+		size = count;
+	if( size < 2 )
+		return false;
+
+	// Newest first; x relative to the newest sample keeps the sums
+	// well conditioned
+	newest = &points[( head + LINREG_WINDOW_MAX - 1 ) % LINREG_WINDOW_MAX];
+	for( i = 0; i < size; ++i ) {
+		p = &points[( head + LINREG_WINDOW_MAX - 1 - i ) % LINREG_WINDOW_MAX];
+		x_mean += -(double)( newest->x - p->x );
+		y_mean += p->y;
+	}
+	x_mean /= size;
+	y_mean /= size;
+	for( i = 0; i < size; ++i ) {
+		p = &points[( head + LINREG_WINDOW_MAX - 1 - i ) % LINREG_WINDOW_MAX];
+		double dx = -(double)( newest->x - p->x ) - x_mean;
+		sxx += dx * dx;
+		sxy += dx * ( p->y - y_mean );
+	}
+	if( sxx == 0 )
+		return false;
+
+	slope = sxy / sxx;
+	intercept = y_mean - slope * x_mean;
+
+	return true;
+}
+
+unsigned LinregClockServo::predict( uint64_t local_time, double y )
+{
+	const point *newest;
+	double slope, intercept, err;
+	unsigned i, best = window_count;
+
+	if( count == 0 )
+		return 0;
+	newest = &points[( head + LINREG_WINDOW_MAX - 1 ) % LINREG_WINDOW_MAX];
+
+	// Score every full window on the sample about to be added
+	for( i = 0; i < window_count && windows[i].size <= count; ++i ) {
+		if( !fit( windows[i].size, slope, intercept ))
+			continue;
+		err = intercept + slope * (double)( local_time - newest->x ) - y;
+		err *= err;
+		// The smallest window follows the frequency best, a sample
+		// far outside even its prediction means the frequency stepped
+		if( i == 0 && windows[i].err > 0 &&
+		    err > LINREG_STEP_SIGMA * LINREG_STEP_SIGMA *
+		    windows[i].err ) {
+			restart();
+			return count + 1;
+		}
+		if( windows[i].err < 0 ) {
+			windows[i].err = err;
+		} else {
+			windows[i].err += LINREG_ERR_WEIGHT *
+				( err - windows[i].err );
+		}
+		if( best == window_count || windows[i].err < windows[best].err )
+			best = i;
+	}
+
+	// Until the smallest window fills, fit what there is
+	if( best == window_count )
+		return count + 1;
+
+	++windows[best].used;
+	return windows[best].size;
+}
+
+servo_decision_t LinregClockServo::adjust
+( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+  signed char log_sync_interval, int64_t link_delay,
+  unsigned delay_count, ScaledPpb &freq )
+{
+	double slope, intercept, phase, interval, y;
+	unsigned size;
+
+	if( !started ) {
+		delay = (double) link_delay;
+	} else if( delay_count != last_delay_count ) {
+		delay += LINREG_DELAY_WEIGHT * ( link_delay - delay );
+	}
+	last_delay_count = delay_count;
+
+	// The phase is stepped on the first sample unless it is close, the
+	// regression then starts from a small offset
+	if( stepNeeded() ||
+	    ( !started && ( offset > SERVO_FIRST_STEP ||
+			    offset < -SERVO_FIRST_STEP ))) {
+		started = true;
+		reset( local_time );
+		add( local_time, (double) link_delay );
+		freq = (ScaledPpb)( PPM_TO_SCALED_PPB(1) * (double) ppm );
+		return decide( SERVO_STEP );
+	}
+	started = true;
+
+	if( !inRange( offset ))
+		return decide( SERVO_HOLD );
+
+	// Phase accumulated by the frequency applied since the last sample,
+	// (local_time - last_time) is positive as long as the clock moves
+	// forward
+	if( count != 0 )
+		correction += ppm * 1e-6 * (double)( local_time - last_time );
+	last_time = local_time;
+	y = (double)( offset + link_delay ) - correction;
+	size = predict( local_time, y );
+	add( local_time, y );
+
+	if( !fit( size, slope, intercept )) {
+		// One sample: the measured rate ratio is all there is
+		if( rate_offset == 0 )
+			return decide( SERVO_HOLD );
+		ppm += (float)( rate_offset * 1000000.0 / RATE_OFFSET_ONE );
+	} else {
+		// The intercept is the fitted offset plus link delay at the
+		// newest sample
+		phase = intercept + correction - delay;
+		interval = pow( 2.0, log_sync_interval ) * 1000000000.0 *
+			LINREG_PHASE_INTERVALS;
+		ppm = (float)( -slope * 1000000 - phase / interval * 1000000 );
+	}
+
+	if( ppm < LOWER_FREQ_LIMIT ) ppm = LOWER_FREQ_LIMIT;
+	if( ppm > UPPER_FREQ_LIMIT ) ppm = UPPER_FREQ_LIMIT;
+	freq = (ScaledPpb)( PPM_TO_SCALED_PPB(1) * (double) ppm );
+
+	GPTP_LOG_DEBUG( "offset = %lld, window = %u, ppm = %f",
+			(long long) offset, size < count ? size : count, ppm );
+
+	return decide( SERVO_SLEW );
+}
+
+void LinregClockServo::logStatistics()
+{
+	unsigned i;
+
+	ClockServo::logStatistics();
+	for( i = 0; i < window_count; ++i ) {
+		GPTP_LOG_STATUS
+			( "Servo linreg window %2u : used %llu, rms error %.1f ns",
+			  windows[i].size, (unsigned long long) windows[i].used,
+			  windows[i].err < 0 ? 0.0 : sqrt( windows[i].err ));
+	}
+	GPTP_LOG_STATUS( "Servo linreg: frequency steps detected %llu",
+			 (unsigned long long) freq_steps );
+}
+
+KalmanClockServo::KalmanClockServo()
+{
+	memset( x, 0, sizeof( x ));
+	memset( P, 0, sizeof( P ));
+	applied = 0;
+	last_time = 0;
+	last_delay_count = 0;
+	freq_steps = 0;
+	started = false;
+}
+
+void KalmanClockServo::init
+( int64_t phase, uint64_t local_time, ScaledRateOffset rate_offset,
+  signed char log_sync_interval, int64_t link_delay )
+{
+	double interval;
+
+	memset( P, 0, sizeof( P ));
+	x[0] = (double) phase;
+	P[0][0] = KALMAN_OFFSET_NOISE * KALMAN_OFFSET_NOISE;
+	x[2] = (double) link_delay;
+	P[2][2] = KALMAN_DELAY_NOISE * KALMAN_DELAY_NOISE;
+
+	// The rate ratio is measured across one Sync interval, its noise is
+	// that of two offsets over the interval
+	if( rate_offset != 0 ) {
+		interval = pow( 2.0, log_sync_interval );
+		x[1] = -rate_offset * 1000000000.0 / RATE_OFFSET_ONE - applied;
+		P[1][1] = 2.0 * KALMAN_OFFSET_NOISE * KALMAN_OFFSET_NOISE /
+			( interval * interval );
+	} else {
+		x[1] = -applied;
+		P[1][1] = (double) KALMAN_FREQ_PRIOR * KALMAN_FREQ_PRIOR;
+	}
+
+	last_time = local_time;
+	started = true;
+}
+
+void KalmanClockServo::predict( uint64_t local_time )
+{
+	double dt;
+	unsigned i;
+
+	dt = (double)( local_time - last_time ) / 1000000000.0;
+	last_time = local_time;
+
+	// x = F x + B u with F = [ 1 dt 0 ; 0 1 0 ; 0 0 1 ]
+	x[0] += ( x[1] + applied ) * dt;
+
+	// P = F P F' + Q
+	for( i = 0; i < 3; ++i )
+		P[0][i] += dt * P[1][i];
+	for( i = 0; i < 3; ++i )
+		P[i][0] += dt * P[i][1];
+	P[0][0] += KALMAN_PHASE_DIFFUSION * dt;
+	P[1][1] += KALMAN_FREQ_DIFFUSION * dt;
+	P[2][2] += KALMAN_DELAY_DIFFUSION * dt;
+}
+
+void KalmanClockServo::update( const double h[3], double z, double r )
+{
+	double ph[3], k[3], s, y;
+	double hp[3];
+	unsigned i, j;
+
+	for( i = 0; i < 3; ++i ) {
+		ph[i] = P[i][0] * h[0] + P[i][1] * h[1] + P[i][2] * h[2];
+		hp[i] = h[0] * P[0][i] + h[1] * P[1][i] + h[2] * P[2][i];
+	}
+	s = h[0] * ph[0] + h[1] * ph[1] + h[2] * ph[2] + r;
+	y = z - ( h[0] * x[0] + h[1] * x[1] + h[2] * x[2] );
+
+	for( i = 0; i < 3; ++i ) {
+		k[i] = ph[i] / s;
+		x[i] += k[i] * y;
+	}
+
+	// P = ( I - K H ) P, kept symmetric
+	for( i = 0; i < 3; ++i )
+		for( j = 0; j < 3; ++j )
+			P[i][j] -= k[i] * hp[j];
+	for( i = 0; i < 3; ++i )
+		for( j = i + 1; j < 3; ++j )
+			P[i][j] = P[j][i] = ( P[i][j] + P[j][i] ) / 2;
+}
+
+servo_decision_t KalmanClockServo::adjust
+( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+  signed char log_sync_interval, int64_t link_delay, unsigned delay_count,
+  ScaledPpb &freq )
+{
+	static const double h_sync[3] = { 1, 0, 1 };
+	static const double h_delay[3] = { 0, 0, 1 };
+	servo_decision_t decision = SERVO_SLEW;
+	bool new_delay;
+	double interval, dt, y, s, q;
+
+	new_delay = delay_count != last_delay_count;
+	last_delay_count = delay_count;
+
+	if( stepNeeded() ||
+	    ( !started && ( offset > SERVO_FIRST_STEP ||
+			    offset < -SERVO_FIRST_STEP ))) {
+		decision = SERVO_STEP;
+		offset = 0;
+	}
+
+	if( !started ) {
+		init( offset, local_time, rate_offset, log_sync_interval,
+		      link_delay );
+	} else if( decision == SERVO_STEP ) {
+		// The frequency uncertainty grew over the samples held before
+		// the step. The step takes the phase out, what is left is the
+		// uncertainty of the offset it was taken from.
+		predict( local_time );
+		x[0] = 0;
+		P[0][0] = KALMAN_OFFSET_NOISE * KALMAN_OFFSET_NOISE;
+		P[0][1] = P[1][0] = P[0][2] = P[2][0] = 0;
+	} else {
+		// The clock keeps running on the last adjustment while
+		// samples are held, the state follows it
+		dt = (double)( local_time - last_time ) / 1000000000.0;
+		predict( local_time );
+		if( !inRange( offset ))
+			return decide( SERVO_HOLD );
+
+		if( new_delay )
+			update( h_delay, (double) link_delay,
+				KALMAN_DELAY_NOISE * KALMAN_DELAY_NOISE );
+
+		// The diffusion covers a slow wander. A Sync far outside the
+		// predicted phase means the oscillator stepped: add the
+		// frequency uncertainty of the step that explains it, as it
+		// would have been predicted over the interval, so the update
+		// follows within a sample instead of walking there.
+		y = (double)( offset + link_delay ) - x[0] - x[2];
+		s = P[0][0] + 2 * P[0][2] + P[2][2] +
+			KALMAN_OFFSET_NOISE * KALMAN_OFFSET_NOISE;
+		if( dt > 0 && y * y > KALMAN_STEP_SIGMA * KALMAN_STEP_SIGMA * s )
+		{
+			q = ( y / dt ) * ( y / dt );
+			P[0][0] += dt * dt * q;
+			P[0][1] = P[1][0] = P[0][1] + dt * q;
+			P[1][1] += q;
+			++freq_steps;
+		}
+		update( h_sync, (double)( offset + link_delay ),
+			KALMAN_OFFSET_NOISE * KALMAN_OFFSET_NOISE );
+	}
+
+	interval = pow( 2.0, log_sync_interval ) * KALMAN_PHASE_INTERVALS;
+	applied = -x[1] - x[0] / interval;
+	if( applied < LOWER_FREQ_LIMIT * 1000.0 ) applied = LOWER_FREQ_LIMIT * 1000.0;
+	if( applied > UPPER_FREQ_LIMIT * 1000.0 ) applied = UPPER_FREQ_LIMIT * 1000.0;
+	freq = (ScaledPpb)( applied * SCALED_PPB_ONE );
+
+	GPTP_LOG_DEBUG( "offset = %lld, phase = %.1f +- %.1f, "
+			"freq = %.1f +- %.1f, delay = %.1f +- %.1f, ppm = %f",
+			(long long) offset, x[0], sqrt( P[0][0] ),
+			x[1], sqrt( P[1][1] ), x[2], sqrt( P[2][2] ),
+			applied / 1000 );
+
+	return decide( decision );
+}
+
+bool KalmanClockServo::getEstimate( clock_servo_estimate_t &estimate ) const
+{
+	if( !started )
+		return false;
+
+	estimate.phase = x[0];
+	estimate.phase_stddev = sqrt( P[0][0] );
+	estimate.freq = x[1];
+	estimate.freq_stddev = sqrt( P[1][1] );
+	estimate.delay = x[2];
+	estimate.delay_stddev = sqrt( P[2][2] );
+
+	return true;
+}
+
+void KalmanClockServo::logStatistics()
+{
+	clock_servo_estimate_t estimate;
+
+	ClockServo::logStatistics();
+	if( !getEstimate( estimate ))
+		return;
+	GPTP_LOG_STATUS
+		( "Servo Kalman: phase %.1f +- %.1f ns, frequency %.3f +- %.3f "
+		  "ppm, link delay %.1f +- %.1f ns",
+		  estimate.phase, estimate.phase_stddev,
+		  estimate.freq / 1000, estimate.freq_stddev / 1000,
+		  estimate.delay, estimate.delay_stddev );
+	GPTP_LOG_STATUS( "Servo Kalman: frequency steps detected %llu",
+			 (unsigned long long) freq_steps );
+}
+
+ClockServo *createClockServo( clock_servo_type_t type, unsigned window )
+{
+	switch( type ) {
+	case CLOCK_SERVO_KALMAN:
+		return new KalmanClockServo();
+	case CLOCK_SERVO_LINREG:
+		return new LinregClockServo( window );
+	case CLOCK_SERVO_PI:
+	default:
+		return new PiClockServo();
+	}
+}
+
+bool parseClockServoType( const char *name, clock_servo_type_t *type )
+{
+	if( strcasecmp( name, "pi" ) == 0 ) {
+		*type = CLOCK_SERVO_PI;
+		return true;
+	}
+	if( strcasecmp( name, "linreg" ) == 0 ) {
+		*type = CLOCK_SERVO_LINREG;
+		return true;
+	}
+	if( strcasecmp( name, "kalman" ) == 0 ) {
+		*type = CLOCK_SERVO_KALMAN;
+		return true;
+	}
+
+	return false;
+}
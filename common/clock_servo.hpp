@@ -0,0 +1,440 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef CLOCK_SERVO_HPP
+#define CLOCK_SERVO_HPP
+
+/**@file*/
+
+#include <ptptypes.hpp>
+#include <fixed_point.hpp>
+#include <stdint.h>
+
+#define LINREG_WINDOW_MIN 4		/*!< Smallest window fitted by the linear regression servo */
+#define LINREG_WINDOW_MAX 64		/*!< Largest window fitted by the linear regression servo */
+#define LINREG_WINDOW_DEFAULT 16	/*!< Default largest window */
+#define LINREG_ERR_WEIGHT 0.1		/*!< Weight of the newest prediction error in its running average */
+#define LINREG_PHASE_INTERVALS 2	/*!< Sync intervals the estimated phase error is removed over */
+#define LINREG_DELAY_WEIGHT 0.0625	/*!< Weight of a new link delay measurement in its average */
+#define LINREG_STEP_SIGMA 5		/*!< Prediction error, in standard deviations, taken as a frequency step */
+
+#define KALMAN_OFFSET_NOISE 50		/*!< Standard deviation of a Sync offset sample in ns */
+#define KALMAN_DELAY_NOISE 50		/*!< Standard deviation of a link delay sample in ns */
+#define KALMAN_PHASE_DIFFUSION 100	/*!< Phase random walk in ns^2 per second */
+#define KALMAN_FREQ_DIFFUSION 1000	/*!< Frequency random walk in ppb^2 per second */
+#define KALMAN_DELAY_DIFFUSION 1	/*!< Link delay random walk in ns^2 per second */
+#define KALMAN_FREQ_PRIOR 100000	/*!< Standard deviation of the initial frequency in ppb */
+#define KALMAN_PHASE_INTERVALS 2	/*!< Sync intervals the estimated phase error is removed over */
+#define KALMAN_STEP_SIGMA 5		/*!< Sync innovation, in standard deviations, taken as a frequency step */
+
+#define SERVO_FIRST_STEP 20000		/*!< First offset in ns above which the linear regression and Kalman servos step */
+
+#define SERVO_LOCK_THRESHOLD 1000	/*!< Offset in ns below which the servo counts as locked */
+#define SERVO_LOCK_SAMPLES 4		/*!< Consecutive samples within (or beyond) SERVO_LOCK_THRESHOLD to gain (or lose) lock */
+
+/**
+ * @brief Clock servo algorithms, selected with the servo key of the [ptp]
+ * section of gptp_cfg.ini
+ */
+typedef enum {
+	CLOCK_SERVO_PI = 0,	//!< Proportional-integral loop (default)
+	CLOCK_SERVO_LINREG,	//!< Linear regression over a window of samples
+	CLOCK_SERVO_KALMAN,	//!< Kalman filter over phase, frequency and link delay
+} clock_servo_type_t;
+
+/**
+ * @brief Adjustment a servo decided on for a sample
+ */
+typedef enum {
+	SERVO_HOLD = 0,		//!< Leave the clock alone
+	SERVO_STEP,		//!< Step the phase by -offset, then set the frequency
+	SERVO_SLEW,		//!< Set the frequency
+} servo_decision_t;
+
+/**
+ * @brief Statistics collected by ClockServo
+ */
+typedef struct {
+	uint64_t samples;	//!< Samples processed
+	uint64_t steps;		//!< Phase steps
+	uint64_t slews;		//!< Frequency adjustments
+	uint64_t holds;		//!< Samples without an adjustment
+	uint64_t out_of_range;	//!< Samples beyond PHASE_ERROR_THRESHOLD
+	uint64_t interval_changes;	//!< Sync interval renegotiations seen
+	uint64_t locks;		//!< Times lock was acquired
+	uint64_t lock_losses;	//!< Times lock was lost
+	uint64_t lock_time_last;	//!< Local time to the last lock in ns
+	uint64_t lock_time_min;		//!< Shortest time to lock in ns
+	uint64_t lock_time_max;		//!< Longest time to lock in ns
+	uint64_t lock_time_total;	//!< Sum of the times to lock in ns
+	unsigned lock_samples_last;	//!< Samples taken by the last lock
+	uint64_t time_total;	//!< Time spent computing adjustments in ns
+	uint64_t time_max;	//!< Longest time spent on a sample in ns
+} clock_servo_stats_t;
+
+/**
+ * @brief Clock state estimated by a servo, with its uncertainty
+ */
+typedef struct {
+	double phase;		//!< Local minus master time in ns
+	double phase_stddev;	//!< Standard deviation of phase in ns
+	double freq;		//!< Free running local frequency error in ppb
+	double freq_stddev;	//!< Standard deviation of freq in ppb
+	double delay;		//!< Link delay in ns
+	double delay_stddev;	//!< Standard deviation of delay in ns
+} clock_servo_estimate_t;
+
+/**
+ * @brief ClockServo: turns master offset samples into clock phase and
+ * frequency adjustments. The policy for stepping the phase is shared by
+ * all servos: a step is taken when requested (a new syntonization set
+ * point) or once more than PHASE_ERROR_MAX_COUNT consecutive offsets
+ * exceed PHASE_ERROR_THRESHOLD.
+ *
+ * The servo also measures its time to lock: the local time from the first
+ * sample, a phase step or a loss of lock until
+ * SERVO_LOCK_SAMPLES consecutive offsets are within SERVO_LOCK_THRESHOLD.
+ */
+class ClockServo {
+public:
+	/**
+	 * @brief  Default constructor
+	 */
+	ClockServo();
+
+	/**
+	 * @brief  Destroys the servo
+	 */
+	virtual ~ClockServo() { }
+
+	/**
+	 * @brief  Processes an offset sample
+	 * @param  offset Local minus master time in nanoseconds
+	 * @param  local_time Local time of the sample (Sync arrival) in
+	 * nanoseconds
+	 * @param  rate_offset Measured master to local clock rate ratio minus
+	 * one, 0 if unknown
+	 * @param  log_sync_interval Sync interval (log base 2 seconds)
+	 * @param  link_delay Link delay in nanoseconds subtracted from the
+	 * offset
+	 * @param  delay_count Number of link delay measurements so far, a
+	 * change marks link_delay as a new measurement
+	 * @param  freq [out] Frequency adjustment to apply, in ppb scaled by
+	 * 2^16, valid unless SERVO_HOLD is returned
+	 * @return Adjustment to make
+	 */
+	servo_decision_t sample
+	( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay,
+	  unsigned delay_count, ScaledPpb &freq );
+
+	/**
+	 * @brief  Gets the name of the servo
+	 * @return Name used in logs
+	 */
+	virtual const char *getName() const = 0;
+
+	/**
+	 * @brief  Makes the next sample step the phase
+	 * @return void
+	 */
+	void requestStep()
+	{
+		step_requested = true;
+	}
+
+	/**
+	 * @brief  Checks if the offset is within SERVO_LOCK_THRESHOLD
+	 * @return TRUE if locked
+	 */
+	bool isLocked() const
+	{
+		return locked;
+	}
+
+	/**
+	 * @brief  Gets the servo statistics
+	 * @return Reference to the statistics
+	 */
+	const clock_servo_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the servo statistics
+	 * @return void
+	 */
+	virtual void logStatistics();
+
+	/**
+	 * @brief  Gets the estimated clock state
+	 * @param  estimate [out] Estimate and its uncertainty
+	 * @return FALSE if the servo does not estimate the state
+	 */
+	virtual bool getEstimate( clock_servo_estimate_t & /*estimate*/ ) const
+	{
+		return false;
+	}
+
+protected:
+	clock_servo_stats_t stats;
+
+	/**
+	 * @brief  Computes the adjustment for a sample, see sample()
+	 */
+	virtual servo_decision_t adjust
+	( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay,
+	  unsigned delay_count, ScaledPpb &freq ) = 0;
+
+	/**
+	 * @brief  Applies the step policy. Call once per sample, before
+	 * inRange().
+	 * @return TRUE if the phase must be stepped
+	 */
+	bool stepNeeded();
+
+	/**
+	 * @brief  Checks an offset against PHASE_ERROR_THRESHOLD and counts
+	 * consecutive violations
+	 * @param  offset Offset in nanoseconds
+	 * @return TRUE if the offset can be used to adjust the frequency
+	 */
+	bool inRange( int64_t offset );
+
+	/**
+	 * @brief  Counts a decision
+	 * @param  decision Decision returned for the sample
+	 * @return decision
+	 */
+	servo_decision_t decide( servo_decision_t decision );
+
+private:
+	bool step_requested;
+	int phase_error_violation;
+
+	bool started;
+	signed char sync_interval;
+	bool locked;
+	unsigned lock_count;
+	uint64_t acquire_start;
+	unsigned acquire_samples;
+
+	void acquire( uint64_t local_time );
+	void trackLock( int64_t offset, uint64_t local_time );
+};
+
+/**
+ * @brief PiClockServo: the original gPTP loop. The frequency is integrated
+ * from the measured rate ratio (proportional gain PROPORTIONAL) and the
+ * phase error (integral gain INTEGRAL, scaled by the Sync rate). The loop
+ * runs in integer arithmetic, so it settles to the same adjustments on
+ * every architecture.
+ */
+class PiClockServo : public ClockServo {
+public:
+	/**
+	 * @brief  Default constructor
+	 */
+	PiClockServo();
+
+	virtual const char *getName() const
+	{
+		return "PI";
+	}
+
+protected:
+	virtual servo_decision_t adjust
+	( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay,
+	  unsigned delay_count, ScaledPpb &freq );
+
+private:
+	ScaledPpb _freq;
+};
+
+/**
+ * @brief LinregClockServo: fits offset against local time by least
+ * squares. Offsets are stored with the phase the servo's own frequency
+ * adjustments accumulated taken out, so the slope is the frequency error
+ * of the free running clock, and with the link delay they were computed
+ * with added back, so a new Pdelay measurement does not shift them. The
+ * frequency is set to that slope plus a correction removing the fitted
+ * phase error, less an average of the link delay measurements, over
+ * LINREG_PHASE_INTERVALS Sync intervals.
+ *
+ * Windows of LINREG_WINDOW_MIN, twice that and so on up to the configured
+ * size are fitted. Each keeps a running average of the error it made
+ * predicting the next sample; the window with the smallest error is used.
+ * Short windows win while the frequency moves, long ones once it is
+ * stable and noise dominates. A sample further than LINREG_STEP_SIGMA
+ * from the prediction of the smallest window is taken as a frequency
+ * step and restarts the windows from it. Samples are placed by local
+ * time, so the window stays valid when the Sync interval is renegotiated.
+ */
+class LinregClockServo : public ClockServo {
+public:
+	/**
+	 * @brief  Constructs the servo
+	 * @param  window Largest window in samples, rounded down to
+	 * LINREG_WINDOW_MIN times a power of two and limited to
+	 * LINREG_WINDOW_MAX
+	 */
+	LinregClockServo( unsigned window = LINREG_WINDOW_DEFAULT );
+
+	virtual const char *getName() const
+	{
+		return "linreg";
+	}
+
+	virtual void logStatistics();
+
+protected:
+	virtual servo_decision_t adjust
+	( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay,
+	  unsigned delay_count, ScaledPpb &freq );
+
+private:
+	/**
+	 * @brief Sample of the regression window
+	 */
+	struct point {
+		uint64_t x;	//!< Local time in nanoseconds
+		double y;	//!< Offset without the servo's own adjustments
+	};
+
+	/**
+	 * @brief Window size fitted and its prediction error
+	 */
+	struct window_fit {
+		unsigned size;		//!< Samples fitted
+		double err;		//!< Running average of the squared error
+		uint64_t used;		//!< Samples the window was chosen for
+	};
+
+	point points[LINREG_WINDOW_MAX];
+	unsigned head;
+	unsigned count;
+	unsigned max_count;
+	window_fit windows[LINREG_WINDOW_MAX/LINREG_WINDOW_MIN];
+	unsigned window_count;
+	double correction;
+	uint64_t last_time;
+	double delay;		// Average link delay in ns
+	unsigned last_delay_count;
+	uint64_t freq_steps;	// Samples taken as frequency steps
+	float ppm;
+	bool started;
+
+	void reset( uint64_t local_time );
+	void add( uint64_t local_time, double y );
+	bool fit
+	( unsigned size, double &slope, double &intercept ) const;
+	unsigned predict( uint64_t local_time, double y );
+	void restart();
+};
+
+/**
+ * @brief KalmanClockServo: estimates the phase, the free running
+ * frequency error and the link delay of the local clock with a Kalman
+ * filter. Each Sync contributes its offset with the link delay added
+ * back (phase plus delay), each new link delay measurement contributes
+ * the delay, so per-exchange delay noise is averaged with the Sync noise
+ * instead of being subtracted from every offset. The measured rate ratio
+ * only seeds the frequency: it is derived from the same timestamps as
+ * the offsets and would be counted twice. A Sync more than
+ * KALMAN_STEP_SIGMA away from the prediction is taken as an oscillator
+ * step and reopens the frequency estimate. The frequency is set to the
+ * estimated error plus a correction removing the estimated phase over
+ * KALMAN_PHASE_INTERVALS Sync intervals. The covariance is available
+ * through getEstimate().
+ */
+class KalmanClockServo : public ClockServo {
+public:
+	/**
+	 * @brief  Default constructor
+	 */
+	KalmanClockServo();
+
+	virtual const char *getName() const
+	{
+		return "Kalman";
+	}
+
+	virtual void logStatistics();
+
+	virtual bool getEstimate( clock_servo_estimate_t &estimate ) const;
+
+protected:
+	virtual servo_decision_t adjust
+	( int64_t offset, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay,
+	  unsigned delay_count, ScaledPpb &freq );
+
+private:
+	double x[3];		// phase (ns), frequency (ppb), delay (ns)
+	double P[3][3];
+	double applied;		// applied frequency adjustment in ppb
+	uint64_t last_time;
+	unsigned last_delay_count;
+	uint64_t freq_steps;	// Sync innovations taken as frequency steps
+	bool started;
+
+	void init
+	( int64_t phase, uint64_t local_time, ScaledRateOffset rate_offset,
+	  signed char log_sync_interval, int64_t link_delay );
+	void predict( uint64_t local_time );
+	void update( const double h[3], double z, double r );
+};
+
+/**
+ * @brief  Creates a clock servo
+ * @param  type Servo algorithm
+ * @param  window Largest window for CLOCK_SERVO_LINREG, ignored by others
+ * @return New servo
+ */
+ClockServo *createClockServo
+( clock_servo_type_t type, unsigned window = LINREG_WINDOW_DEFAULT );
+
+/**
+ * @brief  Parses a servo name (pi, linreg, kalman)
+ * @param  name Name from the configuration file or command line
+ * @param  type [out] Servo algorithm
+ * @return FALSE if the name is unknown
+ */
+bool parseClockServoType( const char *name, clock_servo_type_t *type );
+
+#endif/*CLOCK_SERVO_HPP*/
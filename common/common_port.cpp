@@ -37,6 +37,8 @@
 #include <common_tstamper.hpp>
 #include <gptp_cfg.hpp>
 
+#include <chrono>
+
 CommonPort::CommonPort( PortInit_t *portInit ) :
 	thread_factory( portInit->thread_factory ),
 	timer_factory( portInit->timer_factory ),
@@ -49,18 +51,22 @@ CommonPort::CommonPort( PortInit_t *portInit ) :
 {
 	one_way_delay = ONE_WAY_DELAY_DEFAULT;
 	neighbor_prop_delay_thresh = portInit->neighborPropDelayThreshold;
+	delay_filter.configure( portInit->delayFilter );
+	delay_over_thresh = 0;
 	net_label = portInit->net_label;
 	link_thread = thread_factory->createThread();
 	listening_thread = thread_factory->createThread();
 	sync_receipt_thresh = portInit->syncReceiptThreshold;
 	wrongSeqIDCounter = 0;
-	_peer_rate_offset = 1.0;
+	_peer_rate_offset = 0;
+	_peer_offset_link_delay = 0;
 	_peer_offset_init = false;
 	ifindex = portInit->index;
 	testMode = false;
 	port_state = PTP_INITIALIZING;
 	clock->registerPort(this, ifindex);
 	qualified_announce = NULL;
+	net_iface = NULL;
 	automotive_profile = portInit->automotive_profile;
 	announce_sequence_id = 0;
 	signal_sequence_id = 0;
@@ -73,11 +79,22 @@ CommonPort::CommonPort( PortInit_t *portInit ) :
 	link_speed = INVALID_LINKSPEED;
 	allow_negative_correction_field = portInit->allowNegativeCorrField;
 	memset(&counters, 0, sizeof(counters));
+	memset(&sync_receipt_timer, 0, sizeof(sync_receipt_timer));
+	memset(&announce_receipt_timer, 0, sizeof(announce_receipt_timer));
+	for( int i = 0; i < EVENT_SLOTS; ++i ) {
+		event_slots[i].port = this;
+		event_slots[i].event = (Event) i;
+	}
+	message_pool = new PTPMessagePool
+		( lock_factory->createLock( oslock_nonrecursive ));
+	frame_templates = new PTPFrameTemplates();
 }
 
 CommonPort::~CommonPort()
 {
 	delete qualified_announce;
+	delete message_pool;
+	delete frame_templates;
 }
 
 bool CommonPort::init_port( void )
@@ -96,6 +113,7 @@ bool CommonPort::init_port( void )
 
 	port_identity.setClockIdentity(clock->getClockIdentity());
 	port_identity.setPortNumber(&ifindex);
+	frame_templates->invalidate();
 
 	syncReceiptTimerLock = lock_factory->createLock(oslock_recursive);
 	syncIntervalTimerLock = lock_factory->createLock(oslock_recursive);
@@ -174,9 +192,10 @@ void CommonPort::recommendState
 bool CommonPort::serializeState( void *buf, off_t *count )
 {
 	bool ret = true;
+	FrequencyRatio peer_rate_ratio;
 
 	if( buf == NULL ) {
-		*count = sizeof(port_state)+sizeof(_peer_rate_offset)+
+		*count = sizeof(port_state)+sizeof(peer_rate_ratio)+
 			sizeof(asCapable)+sizeof(one_way_delay);
 		return true;
 	}
@@ -224,14 +243,15 @@ bool CommonPort::serializeState( void *buf, off_t *count )
 	}
 
 	/* Neighbor Rate Ratio */
-	if( ret && *count >= (off_t) sizeof( _peer_rate_offset )) {
-		memcpy( buf, &_peer_rate_offset, sizeof( _peer_rate_offset ));
-		*count -= sizeof( _peer_rate_offset );
-		buf = ((char *)buf) + sizeof( _peer_rate_offset );
+	peer_rate_ratio = rateOffsetToRatio( _peer_rate_offset );
+	if( ret && *count >= (off_t) sizeof( peer_rate_ratio )) {
+		memcpy( buf, &peer_rate_ratio, sizeof( peer_rate_ratio ));
+		*count -= sizeof( peer_rate_ratio );
+		buf = ((char *)buf) + sizeof( peer_rate_ratio );
 	} else if( ret == false ) {
-		*count += sizeof( _peer_rate_offset );
+		*count += sizeof( peer_rate_ratio );
 	} else {
-		*count = sizeof( _peer_rate_offset )-*count;
+		*count = sizeof( peer_rate_ratio )-*count;
 		ret = false;
 	}
 
@@ -243,6 +263,7 @@ bool CommonPort::restoreSerializedState
 ( void *buf, off_t *count )
 {
 	bool ret = true;
+	FrequencyRatio peer_rate_ratio;
 
 	/* asCapable */
 	if( ret && *count >= (off_t) sizeof( asCapable )) {
@@ -281,39 +302,145 @@ bool CommonPort::restoreSerializedState
 	}
 
 	/* Neighbor Rate Ratio */
-	if( ret && *count >= (off_t) sizeof( _peer_rate_offset )) {
-		memcpy( &_peer_rate_offset, buf, sizeof( _peer_rate_offset ));
-		*count -= sizeof( _peer_rate_offset );
-		buf = ((char *)buf) + sizeof( _peer_rate_offset );
+	if( ret && *count >= (off_t) sizeof( peer_rate_ratio )) {
+		memcpy( &peer_rate_ratio, buf, sizeof( peer_rate_ratio ));
+		_peer_rate_offset = rateOffsetFromRatio( peer_rate_ratio );
+		*count -= sizeof( peer_rate_ratio );
+		buf = ((char *)buf) + sizeof( peer_rate_ratio );
 	} else if( ret == false ) {
-		*count += sizeof( _peer_rate_offset );
+		*count += sizeof( peer_rate_ratio );
 	} else {
-		*count = sizeof( _peer_rate_offset )-*count;
+		*count = sizeof( peer_rate_ratio )-*count;
 		ret = false;
 	}
 
 	return ret;
 }
 
+static uint64_t receiptTimerNow( void )
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>
+		( std::chrono::steady_clock::now().time_since_epoch( )).count();
+}
+
+void CommonPort::startReceiptTimer( Event e, uint64_t waitTime )
+{
+	receipt_timer_t *timer = getReceiptTimer( e );
+	uint64_t deadline = receiptTimerNow() + waitTime;
+
+	clock->getTimerQLock();
+	++timer->restarts;
+	timer->deadline = deadline;
+
+	// A pending timer expiring no later than the new deadline is
+	// re-armed on expiry if the deadline has moved by then
+	if( timer->armed != 0 && timer->armed <= deadline ) {
+		++timer->deferred;
+		clock->putTimerQLock();
+		return;
+	}
+
+	// Moves the pending timer, if any, to the earlier deadline
+	clock->addEventTimer( this, e, waitTime );
+	timer->armed = deadline;
+	++timer->armings;
+	clock->putTimerQLock();
+}
+
+void CommonPort::stopReceiptTimer( Event e )
+{
+	receipt_timer_t *timer = getReceiptTimer( e );
+
+	// The pending timer is left to expire and is ignored then, unless a
+	// restart reuses it first
+	clock->getTimerQLock();
+	timer->deadline = 0;
+	clock->putTimerQLock();
+}
+
+bool CommonPort::receiptTimeoutExpired( Event e )
+{
+	receipt_timer_t *timer = getReceiptTimer( e );
+	uint64_t now;
+	bool expired = false;
+
+	clock->getTimerQLock();
+	timer->armed = 0;
+	now = receiptTimerNow();
+	if( timer->deadline == 0 ) {
+		++timer->stale;
+	} else if( timer->deadline > now ) {
+		clock->addEventTimer( this, e, timer->deadline - now );
+		timer->armed = timer->deadline;
+		++timer->extended;
+	} else {
+		timer->deadline = 0;
+		++timer->expired;
+		expired = true;
+	}
+	clock->putTimerQLock();
+
+	return expired;
+}
+
 void CommonPort::startSyncReceiptTimer
 ( long long unsigned int waitTime )
 {
-	clock->getTimerQLock();
 	syncReceiptTimerLock->lock();
-	clock->deleteEventTimer( this, SYNC_RECEIPT_TIMEOUT_EXPIRES );
-	clock->addEventTimer
-		( this, SYNC_RECEIPT_TIMEOUT_EXPIRES, waitTime );
+	startReceiptTimer( SYNC_RECEIPT_TIMEOUT_EXPIRES, waitTime );
 	syncReceiptTimerLock->unlock();
-	clock->putTimerQLock();
 }
 
 void CommonPort::stopSyncReceiptTimer( void )
 {
-	clock->getTimerQLock();
 	syncReceiptTimerLock->lock();
-	clock->deleteEventTimer( this, SYNC_RECEIPT_TIMEOUT_EXPIRES );
+	stopReceiptTimer( SYNC_RECEIPT_TIMEOUT_EXPIRES );
 	syncReceiptTimerLock->unlock();
-	clock->putTimerQLock();
+}
+
+void CommonPort::startAnnounceReceiptTimer( uint64_t waitTime )
+{
+	startReceiptTimer( ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES, waitTime );
+}
+
+void CommonPort::stopAnnounceReceiptTimer( void )
+{
+	stopReceiptTimer( ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES );
+}
+
+void CommonPort::logReceiptTimerStatistics( void )
+{
+	const char *name[] = { "Sync", "Announce" };
+	receipt_timer_t *timer[] =
+		{ &sync_receipt_timer, &announce_receipt_timer };
+	unsigned i;
+
+	for( i = 0; i < 2; ++i ) {
+		GPTP_LOG_STATUS
+			( "%s receipt timer: restarts %llu, deferred %llu, "
+			  "armed %llu, re-armed on expiry %llu, stale %llu, "
+			  "timeouts %llu", name[i],
+			  (unsigned long long) timer[i]->restarts,
+			  (unsigned long long) timer[i]->deferred,
+			  (unsigned long long) timer[i]->armings,
+			  (unsigned long long) timer[i]->extended,
+			  (unsigned long long) timer[i]->stale,
+			  (unsigned long long) timer[i]->expired );
+		// Each deferred restart used to cancel and add a timer; each
+		// re-arm on expiry costs one add
+		GPTP_LOG_STATUS
+			( "%s receipt timer: %lld timer queue updates avoided",
+			  name[i], (long long)
+			  ( 2 * timer[i]->deferred - timer[i]->extended ));
+	}
+}
+
+void CommonPort::logDelayFilterStatistics( void )
+{
+	delay_filter.logStatistics( "Link delay" );
+	GPTP_LOG_STATUS
+		( "Link delay beyond neighborPropDelayThresh: %llu",
+		  (unsigned long long) delay_over_thresh );
 }
 
 void CommonPort::startSyncIntervalTimer
@@ -491,9 +618,8 @@ bool CommonPort::processSyncAnnounceTimeout( Event e )
 
 	// Restart timer
 	if( e == ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES ) {
-		clock->addEventTimerLocked
-			(this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
-			 (ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER*
+		startAnnounceReceiptTimer
+			((ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER*
 			  (unsigned long long)
 			  (pow((double)2,getAnnounceInterval())*
 			   1000000000.0)));
@@ -570,8 +696,8 @@ bool CommonPort::processEvent( Event e )
 		}
 		else
 		{
-			clock->addEventTimerLocked(this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
-				(uint64_t) ( ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER * pow(2.0, getAnnounceInterval()) * 1000000000.0 ));
+			startAnnounceReceiptTimer
+				((uint64_t) ( ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER * pow(2.0, getAnnounceInterval()) * 1000000000.0 ));
 		}
 
 		// Do any media specific initialization
@@ -589,6 +715,12 @@ bool CommonPort::processEvent( Event e )
 
 	case ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES:
 	case SYNC_RECEIPT_TIMEOUT_EXPIRES:
+		// The deadline may have moved since the timer was armed
+		if( !receiptTimeoutExpired( e )) {
+			ret = true;
+			break;
+		}
+
 		if (e == ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES) {
 			incCounter_ieee8021AsPortStatAnnounceReceiptTimeouts();
 		}
@@ -611,7 +743,7 @@ bool CommonPort::processEvent( Event e )
 		if ( asCapable)
 		{
 			PTPMessageAnnounce *annc =
-				new PTPMessageAnnounce(this);
+				new (message_pool) PTPMessageAnnounce(this);
 			PortIdentity dest_id;
 			PortIdentity gmId;
 			ClockIdentity clock_id = clock->getClockIdentity();
@@ -663,7 +795,7 @@ bool CommonPort::processEvent( Event e )
 				clock->calcLocalSystemClockRateDifference
 				( device_time, system_time );
 			clock->setMasterOffset
-				( this, 0, device_time, 1.0,
+				( this, 0, device_time, 0,
 				  local_system_offset, system_time,
 				  local_system_freq_offset, getSyncCount(),
 				  pdelay_count, port_state, asCapable );
@@ -673,9 +805,7 @@ bool CommonPort::processEvent( Event e )
 		syncDone();
 
 		// Restart the timer
-		startSyncIntervalTimer
-			((uint64_t)( pow((double)2, getSyncInterval()) *
-				     1000000000.0 ));
+		startSyncIntervalTimer( getSyncIntervalWait( ));
 
 		break;
 	}
@@ -709,12 +839,12 @@ int CommonPort::getTimestampVersion()
 	return _hw_timestamper->getVersion();
 }
 
-bool CommonPort::_adjustClockRate( FrequencyRatio freq_offset )
+bool CommonPort::_adjustClockRate( ScaledPpb freq_offset )
 {
 	if( _hw_timestamper )
 	{
-		return _hw_timestamper->HWTimestamper_adjclockrate
-			((float) freq_offset );
+		return _hw_timestamper->HWTimestamper_adjclockrate_scaled
+			( freq_offset );
 	}
 
 	return false;
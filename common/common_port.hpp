@@ -41,6 +41,8 @@
 #include <avbts_ostimer.hpp>
 #include <avbts_oslock.hpp>
 #include <avbts_osnet.hpp>
+#include <sample_filter.hpp>
+#include <fixed_point.hpp>
 #include <unordered_map>
 
 #include <math.h>
@@ -51,154 +53,6 @@
 
 class IEEE1588Clock;
 
-/**
- * @brief PortIdentity interface
- * Defined at IEEE 802.1AS Clause 8.5.2
- */
-class PortIdentity {
-private:
-	ClockIdentity clock_id;
-	uint16_t portNumber;
-public:
-	/**
-	 * @brief Default Constructor
-	 */
-	PortIdentity() { };
-
-	/**
-	 * @brief  Constructs PortIdentity interface.
-	 * @param  clock_id Clock ID value as defined at IEEE 802.1AS Clause
-	 * 8.5.2.2
-	 * @param  portNumber Port Number
-	 */
-	PortIdentity(uint8_t * clock_id, uint16_t * portNumber)
-	{
-		this->portNumber = *portNumber;
-		this->portNumber = PLAT_ntohs(this->portNumber);
-		this->clock_id.set(clock_id);
-	}
-
-	/**
-	 * @brief  Implements the operator '!=' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value differs from the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator!=(const PortIdentity & cmp) const
-	{
-		return
-			!(this->clock_id == cmp.clock_id) ||
-			this->portNumber != cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '==' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value equals to the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator==(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id == cmp.clock_id &&
-			this->portNumber == cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '<' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value is lower than the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator<(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id < cmp.clock_id ?
-			true : this->clock_id == cmp.clock_id &&
-			this->portNumber < cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '>' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value is greater than the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator>(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id > cmp.clock_id ?
-			true : this->clock_id == cmp.clock_id &&
-			this->portNumber > cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Gets the ClockIdentity string
-	 * @param  id [out] Pointer to an array of octets.
-	 * @return void
-	 */
-	void getClockIdentityString(uint8_t *id)
-	{
-		clock_id.getIdentityString(id);
-	}
-
-	/**
-	 * @brief  Sets the ClockIdentity.
-	 * @param  clock_id Clock Identity to be set.
-	 * @return void
-	 */
-	void setClockIdentity(ClockIdentity clock_id)
-	{
-		this->clock_id = clock_id;
-	}
-
-	/**
-	 * @brief  Gets the clockIdentity value
-	 * @return A copy of Clock identity value.
-	 */
-	ClockIdentity getClockIdentity( void ) {
-		return this->clock_id;
-	}
-
-	/**
-	 * @brief  Gets the port number following the network byte order, i.e.
-	 * Big-Endian.
-	 * @param  id [out] Port number
-	 * @return void
-	 */
-	void getPortNumberNO(uint16_t * id)	// Network byte order
-	{
-		uint16_t portNumberNO = PLAT_htons(portNumber);
-		*id = portNumberNO;
-	}
-
-	/**
-	 * @brief  Gets the port number in the host byte order, which can be
-	 * either Big-Endian
-	 * or Little-Endian, depending on the processor where it is running.
-	 * @param  id Port number
-	 * @return void
-	 */
-	void getPortNumber(uint16_t * id)	// Host byte order
-	{
-		*id = portNumber;
-	}
-
-	/**
-	 * @brief  Sets the Port number
-	 * @param  id [in] Port number
-	 * @return void
-	 */
-	void setPortNumber(uint16_t * id)
-	{
-		portNumber = *id;
-	}
-};
-
 class phy_delay_spec_t;
 typedef std::unordered_map<uint32_t, phy_delay_spec_t> phy_delay_map_t;
 
@@ -269,12 +123,36 @@ typedef struct {
 	/* neighbor delay threshold */
 	int64_t neighborPropDelayThreshold;
 
+	/* Pre-filter for link delay samples */
+	sample_filter_config_t delayFilter;
+
 	/* Allow processing SyncFollowUp with
 	 * negative correction field */
 	bool allowNegativeCorrField;
+
+	/* Time in nanoseconds between scheduling a Sync and its launch time,
+	 * 0 sends Sync as soon as the interval timer expires */
+	uint64_t syncLaunchLead;
 } PortInit_t;
 
 
+/**
+ * @brief Receipt timeout tracked as a lazily checked deadline. Restarting
+ * the timeout only moves the deadline; the timer queue is touched when
+ * the deadline moves earlier than the pending timer, or when the pending
+ * timer expires before the deadline and has to be re-armed.
+ */
+typedef struct {
+	uint64_t deadline;	//!< Timeout, steady clock ns. 0 if stopped
+	uint64_t armed;		//!< Expiry of the pending timer, 0 if none
+	uint64_t restarts;	//!< Calls restarting the timeout
+	uint64_t deferred;	//!< Restarts that left the pending timer alone
+	uint64_t armings;	//!< Timers added to the timer queue
+	uint64_t extended;	//!< Expiries re-armed for a later deadline
+	uint64_t stale;		//!< Expiries ignored, the timeout was stopped
+	uint64_t expired;	//!< Timeouts reported to the port
+} receipt_timer_t;
+
 /**
  * @brief Structure for Port Counters
  */
@@ -317,6 +195,8 @@ private:
 	   timestamp */
 	int64_t one_way_delay;
 	int64_t neighbor_prop_delay_thresh;
+	SampleFilter delay_filter;
+	uint64_t delay_over_thresh;
 
 	InterfaceLabel *net_label;
 
@@ -342,9 +222,10 @@ private:
 	bool listening_thread_running;
 	bool link_thread_running;
 
-	FrequencyRatio _peer_rate_offset;
+	ScaledRateOffset _peer_rate_offset;
 	Timestamp _peer_offset_ts_theirs;
 	Timestamp _peer_offset_ts_mine;
+	int64_t _peer_offset_link_delay;
 	bool _peer_offset_init;
 	bool asCapable;
 	unsigned sync_count;  /* 0 for master, increment for each sync
@@ -366,6 +247,22 @@ private:
 	OSLock *syncIntervalTimerLock;
 	OSLock *announceIntervalTimerLock;
 
+	receipt_timer_t sync_receipt_timer;
+	receipt_timer_t announce_receipt_timer;
+
+	/* Timer queue arguments, one per event, reused every time the event
+	   is armed */
+	event_descriptor_t event_slots[EVENT_SLOTS];
+
+	receipt_timer_t *getReceiptTimer( Event e )
+	{
+		return e == SYNC_RECEIPT_TIMEOUT_EXPIRES ?
+			&sync_receipt_timer : &announce_receipt_timer;
+	}
+	void startReceiptTimer( Event e, uint64_t waitTime );
+	void stopReceiptTimer( Event e );
+	bool receiptTimeoutExpired( Event e );
+
 protected:
 	static const int64_t INVALID_LINKDELAY = 3600000000000;
 	static const int64_t ONE_WAY_DELAY_DEFAULT = INVALID_LINKDELAY;
@@ -380,6 +277,9 @@ protected:
 
 	phy_delay_map_t const * const phy_delay;
 
+	PTPMessagePool *message_pool;
+	PTPFrameTemplates *frame_templates;
+
 public:
 	static const int64_t NEIGHBOR_PROP_DELAY_THRESH = 800;
 	static const unsigned int DEFAULT_SYNC_RECEIPT_THRESH = 5;
@@ -450,9 +350,32 @@ public:
 			GPTP_LOG_STATUS("Link delay: %d", delay);
 		}
 
-		return (abs_delay <= neighbor_prop_delay_thresh);
+		if( abs_delay > neighbor_prop_delay_thresh ) {
+			++delay_over_thresh;
+			return false;
+		}
+		return true;
 	}
 
+	/**
+	 * @brief  Passes a link delay sample through the link delay
+	 * pre-filter. The filtered value is the one to check against
+	 * neighborPropDelayThresh and to store with setLinkDelay().
+	 * @param  delay Measured link delay
+	 * @param  filtered [out] Filtered link delay
+	 * @return False if the sample is rejected as an outlier
+	 */
+	bool filterLinkDelay( int64_t delay, int64_t &filtered )
+	{
+		return delay_filter.sample( delay, filtered );
+	}
+
+	/**
+	 * @brief  Logs the link delay filter statistics
+	 * @return void
+	 */
+	void logDelayFilterStatistics( void );
+
 	/**
 	* @brief Return frequency offset between local timestamp clock
 	*	system clock
@@ -613,17 +536,17 @@ public:
 
 	/**
 	 * @brief  Adjusts the clock frequency.
-	 * @param  freq_offset Frequency offset
+	 * @param  freq_offset Frequency offset in ppb scaled by 2^16
 	 * @return TRUE if adjusted. FALSE otherwise.
 	 */
-	bool _adjustClockRate( FrequencyRatio freq_offset );
+	bool _adjustClockRate( ScaledPpb freq_offset );
 
 	/**
 	 * @brief  Adjusts the clock frequency.
-	 * @param  freq_offset Frequency offset
+	 * @param  freq_offset Frequency offset in ppb scaled by 2^16
 	 * @return TRUE if adjusted. FALSE otherwise.
 	 */
-	bool adjustClockRate( FrequencyRatio freq_offset ) {
+	bool adjustClockRate( ScaledPpb freq_offset ) {
 		return _adjustClockRate( freq_offset );
 	}
 
@@ -933,9 +856,9 @@ public:
 	/**
 	 * @brief  Gets the Peer rate offset. Used to calculate neighbor
 	 * rate ratio.
-	 * @return FrequencyRatio peer rate offset
+	 * @return Neighbor rate ratio minus one in units of 2^-41
 	 */
-	FrequencyRatio getPeerRateOffset( void )
+	ScaledRateOffset getPeerRateOffset( void )
 	{
 		return _peer_rate_offset;
 	}
@@ -946,7 +869,7 @@ public:
 	 * @param  offset Offset to be set
 	 * @return void
 	 */
-	void setPeerRateOffset( FrequencyRatio offset ) {
+	void setPeerRateOffset( ScaledRateOffset offset ) {
 		_peer_rate_offset = offset;
 	}
 
@@ -954,11 +877,14 @@ public:
 	 * @brief  Sets peer offset timestamps
 	 * @param  mine Local timestamps
 	 * @param  theirs Remote timestamps
+	 * @param  link_delay Unfiltered link delay measured with them
 	 * @return void
 	 */
-	void setPeerOffset(Timestamp mine, Timestamp theirs) {
+	void setPeerOffset
+	( Timestamp mine, Timestamp theirs, int64_t link_delay ) {
 		_peer_offset_ts_mine = mine;
 		_peer_offset_ts_theirs = theirs;
+		_peer_offset_link_delay = link_delay;
 		_peer_offset_init = true;
 	}
 
@@ -966,12 +892,15 @@ public:
 	 * @brief  Gets peer offset timestamps
 	 * @param  mine [out] Reference to local timestamps
 	 * @param  theirs [out] Reference to remote timestamps
+	 * @param  link_delay [out] Unfiltered link delay measured with them
 	 * @return TRUE if peer offset has already been initialized. FALSE
 	 * otherwise.
 	 */
-	bool getPeerOffset(Timestamp & mine, Timestamp & theirs) {
+	bool getPeerOffset
+	( Timestamp & mine, Timestamp & theirs, int64_t & link_delay ) {
 		mine = _peer_offset_ts_mine;
 		theirs = _peer_offset_ts_theirs;
+		link_delay = _peer_offset_link_delay;
 		return _peer_offset_init;
 	}
 
@@ -992,6 +921,16 @@ public:
 		_peer_offset_init = false;
 	}
 
+	/**
+	 * @brief  Gets the timer queue argument of an event of this port
+	 * @param  e Event armed
+	 * @return Descriptor, valid for the lifetime of the port
+	 */
+	event_descriptor_t *getEventSlot( Event e )
+	{
+		return &event_slots[e];
+	}
+
 	/**
 	 * @brief  Gets a pointer to timer_factory object
 	 * @return timer_factory pointer
@@ -1012,6 +951,16 @@ public:
 		return NULL;
 	}
 
+	/**
+	 * @brief  Lets the network interface drive the port from its event
+	 * loop, if it has one
+	 * @return TRUE if no listening and link watch threads are needed
+	 */
+	bool attachToEventLoop( void )
+	{
+		return net_iface->attachPort( this );
+	}
+
 	/**
 	 * @brief Receive frame
 	 */
@@ -1024,6 +973,46 @@ public:
 		return result;
 	}
 
+	/**
+	 * @brief Receive frame along with its receive timestamp, if the
+	 * network interface delivers one inline
+	 */
+	net_result recv
+	( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+	  uint32_t &link_speed, Timestamp &rx_timestamp,
+	  bool &rx_timestamp_valid )
+	{
+		net_result result = net_iface->nrecvTimestamped
+			( addr, payload, length, rx_timestamp,
+			  rx_timestamp_valid );
+		link_speed = this->link_speed;
+		return result;
+	}
+
+	/**
+	 * @brief Receive frame in place, see
+	 * OSNetworkInterface::nrecvInPlace()
+	 */
+	net_result recvInPlace
+	( LinkLayerAddress *addr, uint8_t *buf, uint8_t *&payload,
+	  size_t &length, uint32_t &link_speed, Timestamp &rx_timestamp,
+	  bool &rx_timestamp_valid )
+	{
+		net_result result = net_iface->nrecvInPlace
+			( addr, buf, payload, length, rx_timestamp,
+			  rx_timestamp_valid );
+		link_speed = this->link_speed;
+		return result;
+	}
+
+	/**
+	 * @brief Release the frame returned by recvInPlace()
+	 */
+	void releaseReceived( void )
+	{
+		net_iface->releaseReceived();
+	}
+
 	/**
 	 * @brief Send frame
 	 */
@@ -1035,6 +1024,47 @@ public:
 		( addr, etherType, payload, length, timestamp );
 	}
 
+	/**
+	 * @brief  Send event frame at a launch time, see
+	 * OSNetworkInterface::sendAtLaunchTime()
+	 */
+	net_result sendAtLaunchTime
+	( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload,
+	  size_t length, uint64_t launch_time )
+	{
+		return net_iface->sendAtLaunchTime
+		( addr, etherType, payload, length, launch_time );
+	}
+
+	/**
+	 * @brief  Checks whether the network interface schedules event
+	 * frames at their launch time
+	 * @return TRUE if launch times are honoured
+	 */
+	bool launchTimeEnabled()
+	{
+		return net_iface->launchTimeEnabled();
+	}
+
+	/**
+	 * @brief  Starts a batch of general messages, see
+	 * OSNetworkInterface::beginSendBatch()
+	 * @return void
+	 */
+	void beginSendBatch()
+	{
+		net_iface->beginSendBatch();
+	}
+
+	/**
+	 * @brief  Sends the batch started by beginSendBatch()
+	 * @return net_succeed if all messages were sent
+	 */
+	net_result flushSendBatch()
+	{
+		return net_iface->flushSendBatch();
+	}
+
 	/**
 	 * @brief Get the payload offset inside a packet
 	 * @return 0
@@ -1044,6 +1074,36 @@ public:
 		return net_iface->getPayloadOffset();
 	}
 
+	/**
+	 * @brief  Gets the pool messages sent and received on this port are
+	 * allocated from
+	 * @return Pointer to the message pool
+	 */
+	PTPMessagePool *getMessagePool()
+	{
+		return message_pool;
+	}
+
+	/**
+	 * @brief  Gets the templates messages sent on this port are built
+	 * from
+	 * @return Pointer to the frame templates
+	 */
+	PTPFrameTemplates *getFrameTemplates()
+	{
+		return frame_templates;
+	}
+
+	/**
+	 * @brief  Logs network interface statistics
+	 * @return void
+	 */
+	void logNetworkStatistics()
+	{
+		if( net_iface != NULL )
+			net_iface->logStatistics();
+	}
+
 	/**
 	 * @brief Starts link thread
 	 * @return TRUE if ok, FALSE if error
@@ -1238,6 +1298,7 @@ public:
 	*/
 	void setPDelayInterval(signed char val) {
 		log_min_mean_pdelay_req_interval = val;
+		frame_templates->invalidate();
 	}
 
 	/**
@@ -1255,6 +1316,7 @@ public:
 	*/
 	void resetInitPDelayInterval(void) {
 		log_min_mean_pdelay_req_interval = initialLogPdelayReqInterval;
+		frame_templates->invalidate();
 	}
 
 	/**
@@ -1400,6 +1462,7 @@ public:
 	void setSyncInterval( signed char val )
 	{
 		log_mean_sync_interval = val;
+		frame_templates->invalidate();
 	}
 
 	/**
@@ -1409,6 +1472,7 @@ public:
 	void resetInitSyncInterval( void )
 	{
 		log_mean_sync_interval = initialLogSyncInterval;;
+		frame_templates->invalidate();
 	}
 
 	/**
@@ -1444,6 +1508,7 @@ public:
 	 */
 	void setAnnounceInterval(signed char val) {
 		log_mean_announce_interval = val;
+		frame_templates->invalidate();
 	}
 	/**
 	 * @brief  Start sync receipt timer
@@ -1458,6 +1523,25 @@ public:
 	 */
 	void stopSyncReceiptTimer( void );
 
+	/**
+	 * @brief  Start announce receipt timer
+	 * @param  waitTime time interval in nanoseconds
+	 * @return none
+	 */
+	void startAnnounceReceiptTimer( uint64_t waitTime );
+
+	/**
+	 * @brief  Stop announce receipt timer
+	 * @return none
+	 */
+	void stopAnnounceReceiptTimer( void );
+
+	/**
+	 * @brief  Logs the receipt timer statistics
+	 * @return void
+	 */
+	void logReceiptTimerStatistics( void );
+
 	/**
 	 * @brief  Start sync interval timer
 	 * @param  waitTime time interval in nanoseconds
@@ -1510,6 +1594,18 @@ public:
 	*/
 	virtual void syncDone() = 0;
 
+	/**
+	 * @brief  Gets the time until the next Sync should be sent. Media
+	 * scheduling Sync at a launch time override this to stay phase
+	 * locked.
+	 * @return Sync interval timer duration in nanoseconds
+	 */
+	virtual uint64_t getSyncIntervalWait()
+	{
+		return (uint64_t)( pow((double)2, getSyncInterval()) *
+				   1000000000.0 );
+	}
+
 	/**
 	* @brief Sends a general message to a port. No timestamps
 	* @param buf [in] Pointer to the data buffer
@@ -37,6 +37,7 @@
 #include <unordered_map>
 #include <stdint.h>
 #include <avbts_message.hpp>
+#include <fixed_point.hpp>
 
 #define HWTIMESTAMPER_EXTENDED_MESSAGE_SIZE 4096	/*!< Maximum size of HWTimestamper extended message */
 
@@ -81,6 +82,19 @@ public:
 	( float frequency_offset ) const
 	{ return false; }
 
+	/**
+	 * @brief  Adjusts the hardware clock frequency without floating point
+	 * conversion. The default forwards to HWTimestamper_adjclockrate().
+	 * @param  frequency_offset Frequency offset in ppb scaled by 2^16
+	 * @return TRUE if adjusted, FALSE otherwise
+	 */
+	virtual bool HWTimestamper_adjclockrate_scaled
+	( ScaledPpb frequency_offset ) const
+	{
+		return HWTimestamper_adjclockrate
+			( (float) scaledPpbToPpm( frequency_offset ));
+	}
+
 	/**
 	 * @brief  Adjusts the hardware clock phase
 	 * @param  phase_adjust Phase offset
@@ -35,6 +35,7 @@
 
 #include <ether_port.hpp>
 #include <avbts_message.hpp>
+#include <ptp_message_view.hpp>
 #include <avbts_clock.hpp>
 
 #include <avbts_oslock.hpp>
@@ -98,6 +99,25 @@ EtherPort::EtherPort( PortInit_t *portInit ) :
 	duplicate_resp_counter = 0;
 	last_invalid_seqid = 0;
 
+	sync_launch_lead = portInit->syncLaunchLead;
+	// The launch must complete within the TX timestamp wait
+	if( sync_launch_lead > TX_TIMEOUT_TOTAL * 1000ULL / 2 ) {
+		GPTP_LOG_WARNING
+			( "Sync launch lead limited to %u us", TX_TIMEOUT_TOTAL / 2 );
+		sync_launch_lead = TX_TIMEOUT_TOTAL * 1000ULL / 2;
+	}
+	sync_launch_scheduled = 0;
+	sync_launch_immediate = 0;
+
+	sync_tx_last_valid = false;
+	sync_tx_last = 0;
+	sync_tx_last_seq = 0;
+	sync_tx_last_interval = 0;
+	sync_jitter_count = 0;
+	sync_jitter_sum = 0;
+	sync_jitter_sum_sq = 0.0;
+	sync_jitter_max = 0;
+
 	operLogPdelayReqInterval = portInit->operLogPdelayReqInterval;
 	operLogSyncInterval = portInit->operLogSyncInterval;
 
@@ -212,14 +232,34 @@ void EtherPort::startSyncRateIntervalTimer()
 }
 
 void EtherPort::processMessage
-( char *buf, int length, LinkLayerAddress *remote, uint32_t link_speed )
+( char *buf, int length, LinkLayerAddress *remote, uint32_t link_speed,
+  Timestamp *rx_timestamp )
 {
 	GPTP_LOG_VERBOSE("Processing network buffer");
 
-	PTPMessageCommon *msg =
-		buildPTPMessage( buf, (int)length, remote, this );
+	PTPMessageView view( (uint8_t *) buf, length < 0 ? 0 : length );
+
+	/* Pdelay requests are answered straight from the frame */
+	if( rx_timestamp != NULL && view.isValid() &&
+	    view.getTransportSpecific() == 1 &&
+	    view.getMessageType() == PATH_DELAY_REQ_MESSAGE )
+	{
+		PortIdentity requester;
+
+		GPTP_LOG_DEBUG("*** Received PDelay Request message");
+		view.getSourcePortIdentity( requester );
+		addSockAddrMap( &requester, remote );
+		PTPMessagePathDelayReq::processRequest
+			( this, &requester, view.getSequenceId(),
+			  compensateRxTimestamp( *rx_timestamp, link_speed ));
+		return;
+	}
+
+	PTPMessageHandle msg
+		( buildPTPMessage
+		  ( buf, (int)length, remote, this, rx_timestamp ));
 
-	if (msg == NULL)
+	if (msg.get() == NULL)
 	{
 		GPTP_LOG_ERROR("Discarding invalid message");
 		return;
@@ -228,18 +268,24 @@ void EtherPort::processMessage
 
 	if( msg->isEvent() )
 	{
-		Timestamp rx_timestamp = msg->getTimestamp();
-		Timestamp phy_compensation = getRxPhyDelay( link_speed );
-		GPTP_LOG_DEBUG( "RX PHY compensation: %s sec",
-			 phy_compensation.toString().c_str() );
-		phy_compensation._version = rx_timestamp._version;
-		rx_timestamp = rx_timestamp - phy_compensation;
-		msg->setTimestamp( rx_timestamp );
+		Timestamp compensated =
+			compensateRxTimestamp( msg->getTimestamp(), link_speed );
+		msg->setTimestamp( compensated );
 	}
 
 	msg->processMessage(this);
-	if (msg->garbage())
-		delete msg;
+	if (!msg->garbage())
+		msg.release();
+}
+
+Timestamp EtherPort::compensateRxTimestamp
+( Timestamp rx_timestamp, uint32_t link_speed )
+{
+	Timestamp phy_compensation = getRxPhyDelay( link_speed );
+	GPTP_LOG_DEBUG( "RX PHY compensation: %s sec",
+		 phy_compensation.toString().c_str() );
+	phy_compensation._version = rx_timestamp._version;
+	return rx_timestamp - phy_compensation;
 }
 
 void *EtherPort::openPort( EtherPort *port )
@@ -249,30 +295,45 @@ void *EtherPort::openPort( EtherPort *port )
 	setListeningThreadRunning(true);
 
 	while ( getListeningThreadRunning() ) {
-		uint8_t buf[128];
-		LinkLayerAddress remote;
-		net_result rrecv;
-		size_t length = sizeof(buf);
-		uint32_t link_speed;
-
-		if ( ( rrecv = recv( &remote, buf, length, link_speed ))
-		     == net_succeed )
-		{
-			processMessage
-				((char *)buf, (int)length, &remote, link_speed );
-		} else if (rrecv == net_fatal) {
-			GPTP_LOG_ERROR("read from network interface failed");
-			this->processEvent(FAULT_DETECTED);
+		if( receiveMessage() == net_fatal )
 			break;
-		}
 	}
 	GPTP_LOG_DEBUG("Listening thread terminated ...");
 	return NULL;
 }
 
+net_result EtherPort::receiveMessage()
+{
+	uint8_t buf[PTP_MAX_MESSAGE_LENGTH];
+	uint8_t *payload;
+	LinkLayerAddress remote;
+	net_result rrecv;
+	size_t length = sizeof(buf);
+	uint32_t link_speed;
+	Timestamp rx_timestamp;
+	bool rx_timestamp_valid;
+
+	if ( ( rrecv = recvInPlace( &remote, buf, payload, length, link_speed,
+				    rx_timestamp, rx_timestamp_valid ))
+	     == net_succeed )
+	{
+		// The frame may still be in the receive ring, parse it there
+		// and hand it back once the message is built
+		processMessage
+			((char *)payload, (int)length, &remote, link_speed,
+			 rx_timestamp_valid ? &rx_timestamp : NULL );
+		releaseReceived();
+	} else if (rrecv == net_fatal) {
+		GPTP_LOG_ERROR("read from network interface failed");
+		this->processEvent(FAULT_DETECTED);
+	}
+
+	return rrecv;
+}
+
 net_result EtherPort::port_send
 ( uint16_t etherType, uint8_t *buf, int size, MulticastType mcast_type,
-  PortIdentity *destIdentity, bool timestamp )
+  PortIdentity *destIdentity, bool timestamp, uint64_t launch_time )
 {
 	LinkLayerAddress dest;
 
@@ -290,15 +351,20 @@ net_result EtherPort::port_send
 		mapSocketAddr(destIdentity, &dest);
 	}
 
+	if( timestamp && launch_time != 0 )
+		return sendAtLaunchTime
+			( &dest, etherType, (uint8_t *) buf, size, launch_time );
+
 	return send(&dest, etherType, (uint8_t *) buf, size, timestamp);
 }
 
 void EtherPort::sendEventPort
 ( uint16_t etherType, uint8_t *buf, int size, MulticastType mcast_type,
-  PortIdentity *destIdentity, uint32_t *link_speed )
+  PortIdentity *destIdentity, uint32_t *link_speed, uint64_t launch_time )
 {
 	net_result rtx = port_send
-		( etherType, buf, size, mcast_type, destIdentity, true );
+		( etherType, buf, size, mcast_type, destIdentity, true,
+		  launch_time );
 	if( rtx != net_succeed )
 	{
 		GPTP_LOG_ERROR("sendEventPort(): failure");
@@ -343,6 +409,11 @@ bool EtherPort::_processEvent( Event e )
 			startPDelay();
 		}
 
+		// An event loop receives on the caller's thread, no threads to
+		// start and wait for
+		if( attachToEventLoop( ))
+			goto port_ready;
+
 		port_ready_condition->wait_prelock();
 
 		if( !linkWatch(watchNetLinkWrapper, (void *)this) )
@@ -361,9 +432,13 @@ bool EtherPort::_processEvent( Event e )
 
 		port_ready_condition->wait();
 
+	port_ready:
 		if( getAutomotiveProfile( ))
 		{
 			setStationState(STATION_STATE_ETHERNET_READY);
+			// The test status and signalling messages go out
+			// together
+			beginSendBatch();
 			if (getTestMode())
 			{
 				APMessageTestStatus *testStatusMsg = new APMessageTestStatus(this);
@@ -374,7 +449,7 @@ bool EtherPort::_processEvent( Event e )
 			}
 			if (!isGM) {
 				// Send an initial signalling message
-				PTPMessageSignalling *sigMsg = new PTPMessageSignalling(this);
+				PTPMessageSignalling *sigMsg = new (message_pool) PTPMessageSignalling(this);
 				if (sigMsg) {
 					sigMsg->setintervals(PTPMessageSignalling::sigMsgInterval_NoSend, getSyncInterval(), PTPMessageSignalling::sigMsgInterval_NoSend);
 					sigMsg->sendPort(this, NULL);
@@ -386,6 +461,7 @@ bool EtherPort::_processEvent( Event e )
 					  ((double) pow((double)2, getSyncInterval()) *
 					   1000000000.0)));
 			}
+			flushSendBatch();
 		}
 
 		ret = true;
@@ -416,9 +492,8 @@ bool EtherPort::_processEvent( Event e )
 		} else if( getPortState() == PTP_MASTER ) {
 			becomeMaster( true );
 		} else {
-			clock->addEventTimerLocked
-				( this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
-				  (uint64_t)
+			startAnnounceReceiptTimer
+				( (uint64_t)
 				  ( ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER *
 				    pow( 2.0, getAnnounceInterval( )) *
 				    1000000000.0 ));
@@ -429,6 +504,9 @@ bool EtherPort::_processEvent( Event e )
 			setAsCapable( true );
 
 			setStationState(STATION_STATE_ETHERNET_READY);
+			// The test status and signalling messages go out
+			// together
+			beginSendBatch();
 			if (getTestMode())
 			{
 				APMessageTestStatus *testStatusMsg = new APMessageTestStatus(this);
@@ -444,7 +522,7 @@ bool EtherPort::_processEvent( Event e )
 
 			if (!isGM) {
 				// Send an initial signaling message
-				PTPMessageSignalling *sigMsg = new PTPMessageSignalling(this);
+				PTPMessageSignalling *sigMsg = new (message_pool) PTPMessageSignalling(this);
 				if (sigMsg) {
 					sigMsg->setintervals(PTPMessageSignalling::sigMsgInterval_NoSend, getSyncInterval(), PTPMessageSignalling::sigMsgInterval_NoSend);
 					sigMsg->sendPort(this, NULL);
@@ -456,6 +534,7 @@ bool EtherPort::_processEvent( Event e )
 					  ((double) pow((double)2, getSyncInterval()) *
 					   1000000000.0)));
 			}
+			flushSendBatch();
 
 			// Reset Sync count and pdelay count
 			setPdelayCount(0);
@@ -521,7 +600,7 @@ bool EtherPort::_processEvent( Event e )
 			Timestamp req_timestamp;
 
 			PTPMessagePathDelayReq *pdelay_req =
-			    new PTPMessagePathDelayReq(this);
+			    new (message_pool) PTPMessagePathDelayReq(this);
 			PortIdentity dest_id;
 			getPortIdentity(dest_id);
 			pdelay_req->setPortIdentity(&dest_id);
@@ -573,11 +652,12 @@ bool EtherPort::_processEvent( Event e )
 			   system time offset */
 
 			// Send a sync message and then a followup to broadcast
-			PTPMessageSync *sync = new PTPMessageSync(this);
+			PTPMessageSync *sync = new (message_pool) PTPMessageSync(this);
 			PortIdentity dest_id;
 			bool tx_succeed;
 			getPortIdentity(dest_id);
 			sync->setPortIdentity(&dest_id);
+			sync->setLaunchTime( scheduleSyncLaunch( ));
 			getTxLock();
 			tx_succeed = sync->sendPort(this, NULL);
 			GPTP_LOG_DEBUG("Sent SYNC message");
@@ -611,8 +691,10 @@ bool EtherPort::_processEvent( Event e )
 						 sync_timestamp.seconds_ls);
 				GPTP_LOG_VERBOSE("Nanoseconds: %u",
 						 sync_timestamp.nanoseconds);
+				recordSyncInterval
+					( sync_timestamp, sync->getSequenceId() );
 
-				PTPMessageFollowUp *follow_up = new PTPMessageFollowUp(this);
+				PTPMessageFollowUp *follow_up = new (message_pool) PTPMessageFollowUp(this);
 				PortIdentity dest_id;
 				getPortIdentity(dest_id);
 
@@ -693,7 +775,7 @@ bool EtherPort::_processEvent( Event e )
 			if (sendSignalMessage) {
 				if (!isGM) {
 				// Send operational signalling message
-					PTPMessageSignalling *sigMsg = new PTPMessageSignalling(this);
+					PTPMessageSignalling *sigMsg = new (message_pool) PTPMessageSignalling(this);
 					if (sigMsg) {
 						if( getAutomotiveProfile( ))
 							sigMsg->setintervals(PTPMessageSignalling::sigMsgInterval_NoChange, getSyncInterval(), PTPMessageSignalling::sigMsgInterval_NoChange);
@@ -731,7 +813,7 @@ void EtherPort::recoverPort( void )
 void EtherPort::becomeMaster( bool annc ) {
 	setPortState( PTP_MASTER );
 	// Stop announce receipt timeout timer
-	clock->deleteEventTimerLocked( this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES );
+	stopAnnounceReceiptTimer();
 
 	// Stop sync receipt timeout timer
 	stopSyncReceiptTimer();
@@ -758,9 +840,8 @@ void EtherPort::becomeSlave( bool restart_syntonization ) {
 
 	if( !getAutomotiveProfile( ))
 	{
-		clock->addEventTimerLocked
-		  (this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
-		   (ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER*
+		startAnnounceReceiptTimer
+		  ((ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER*
 			(unsigned long long)
 			(pow((double)2,getAnnounceInterval())*1000000000.0)));
 	}
@@ -797,6 +878,25 @@ int EtherPort::getTxTimestamp
 		(&identity, msg->getMessageId(), timestamp, counter_value, last);
 }
 
+int EtherPort::waitTxTimestamp
+( PTPMessageCommon *msg, Timestamp &timestamp, unsigned &counter_value,
+  unsigned timeout_us )
+{
+	PortIdentity identity;
+	EtherTimestamper *timestamper =
+		dynamic_cast<EtherTimestamper *>(_hw_timestamper);
+
+	if (timestamper)
+	{
+		msg->getPortIdentity(&identity);
+		return timestamper->HWTimestamper_txtimestampWait
+			( &identity, msg->getMessageId(), timestamp,
+			  counter_value, timeout_us );
+	}
+	timestamp = clock->getSystemTime();
+	return 0;
+}
+
 int EtherPort::getRxTimestamp
 ( PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
   bool last )
@@ -883,3 +983,106 @@ void EtherPort::syncDone() {
 		startPDelay();
 	}
 }
+
+uint64_t EtherPort::scheduleSyncLaunch()
+{
+	Timestamp system_time;
+	Timestamp device_time;
+	uint32_t local_clock, nominal_clock_rate;
+	uint64_t interval;
+	uint64_t device_now;
+	uint64_t launch;
+
+	if( sync_launch_lead == 0 || !launchTimeEnabled() )
+		return 0;
+
+	interval = CommonPort::getSyncIntervalWait();
+	getDeviceTime( system_time, device_time, local_clock, nominal_clock_rate );
+	device_now = TIMESTAMP_TO_NS( device_time );
+
+	// The timer aims at sync_launch_lead before the boundary, accept it
+	// expiring up to half of that early or late
+	launch = ( device_now + sync_launch_lead / 2 + interval - 1 ) /
+		interval * interval;
+	if( launch - device_now > sync_launch_lead + sync_launch_lead / 2 ) {
+		// Not phase locked yet, the timer is re-armed for the next
+		// boundary once this Sync is out
+		++sync_launch_immediate;
+		return 0;
+	}
+
+	++sync_launch_scheduled;
+	return launch;
+}
+
+uint64_t EtherPort::getSyncIntervalWait()
+{
+	Timestamp system_time;
+	Timestamp device_time;
+	uint32_t local_clock, nominal_clock_rate;
+	uint64_t interval;
+	uint64_t device_now;
+	uint64_t wake;
+
+	interval = CommonPort::getSyncIntervalWait();
+	if( sync_launch_lead == 0 || !launchTimeEnabled() )
+		return interval;
+
+	getDeviceTime( system_time, device_time, local_clock, nominal_clock_rate );
+	device_now = TIMESTAMP_TO_NS( device_time );
+
+	// Expire sync_launch_lead before the next boundary in gPTP time
+	wake = ( device_now + sync_launch_lead + interval ) / interval * interval -
+		sync_launch_lead;
+
+	return wake - device_now;
+}
+
+void EtherPort::recordSyncInterval
+( Timestamp tx_timestamp, uint16_t sequenceId )
+{
+	uint64_t tx = TIMESTAMP_TO_NS( tx_timestamp );
+	uint64_t interval = CommonPort::getSyncIntervalWait();
+	uint64_t jitter;
+
+	// Only consecutive Syncs sent at the same rate are compared
+	if( sync_tx_last_valid &&
+	    (uint16_t)( sync_tx_last_seq + 1 ) == sequenceId &&
+	    sync_tx_last_interval == getSyncInterval() ) {
+		jitter = tx - sync_tx_last > interval ?
+			tx - sync_tx_last - interval :
+			interval - ( tx - sync_tx_last );
+		++sync_jitter_count;
+		sync_jitter_sum += jitter;
+		sync_jitter_sum_sq += (double) jitter * jitter;
+		if( jitter > sync_jitter_max )
+			sync_jitter_max = jitter;
+	}
+
+	sync_tx_last_valid = true;
+	sync_tx_last = tx;
+	sync_tx_last_seq = sequenceId;
+	sync_tx_last_interval = getSyncInterval();
+}
+
+void EtherPort::logSyncStatistics()
+{
+	if( sync_jitter_count != 0 ) {
+		GPTP_LOG_STATUS
+			( "Sync interval jitter: %llu intervals, mean %llu ns, "
+			  "rms %.0f ns, max %llu ns",
+			  (unsigned long long) sync_jitter_count,
+			  (unsigned long long)
+			  ( sync_jitter_sum / sync_jitter_count ),
+			  sqrt( sync_jitter_sum_sq / sync_jitter_count ),
+			  (unsigned long long) sync_jitter_max );
+	}
+	if( sync_launch_lead != 0 ) {
+		GPTP_LOG_STATUS
+			( "Sync launch time: %llu scheduled, %llu sent "
+			  "immediately, lead %llu us",
+			  (unsigned long long) sync_launch_scheduled,
+			  (unsigned long long) sync_launch_immediate,
+			  (unsigned long long) ( sync_launch_lead / 1000 ));
+	}
+}
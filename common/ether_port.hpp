@@ -137,7 +137,38 @@ class EtherPort : public CommonPort
 
 	net_result port_send
 	(uint16_t etherType, uint8_t * buf, int size, MulticastType mcast_type,
-	 PortIdentity * destIdentity, bool timestamp);
+	 PortIdentity * destIdentity, bool timestamp, uint64_t launch_time = 0);
+
+	/* Sync launch time scheduling */
+	uint64_t sync_launch_lead;
+	uint64_t sync_launch_scheduled;
+	uint64_t sync_launch_immediate;
+
+	/* Sync interval jitter, measured on the TX timestamps */
+	bool sync_tx_last_valid;
+	uint64_t sync_tx_last;
+	uint16_t sync_tx_last_seq;
+	signed char sync_tx_last_interval;
+	uint64_t sync_jitter_count;
+	uint64_t sync_jitter_sum;
+	double sync_jitter_sum_sq;
+	uint64_t sync_jitter_max;
+
+	/**
+	 * @brief  Computes the launch time of the next Sync: the next
+	 * multiple of the sync interval in gPTP time
+	 * @return Launch time in device time nanoseconds, 0 to send now
+	 */
+	uint64_t scheduleSyncLaunch();
+
+	/**
+	 * @brief  Accumulates the interval between consecutive Sync TX
+	 * timestamps
+	 * @param  tx_timestamp TX timestamp of the Sync
+	 * @param  sequenceId Sequence id of the Sync
+	 * @return void
+	 */
+	void recordSyncInterval( Timestamp tx_timestamp, uint16_t sequenceId );
 
 	bool pdelay_started;
 	bool pdelay_halted;
@@ -193,6 +224,20 @@ protected:
 	 */
 	void syncDone();
 
+	/**
+	 * @brief  Gets the time until the next Sync. With launch time
+	 * scheduling the timer expires sync_launch_lead before the next
+	 * multiple of the sync interval in gPTP time.
+	 * @return Sync interval timer duration in nanoseconds
+	 */
+	uint64_t getSyncIntervalWait();
+
+	/**
+	 * @brief  Logs the Sync interval jitter and launch time statistics
+	 * @return void
+	 */
+	void logSyncStatistics();
+
 	/**
 	 * @brief Destroys a EtherPort
 	 */
@@ -223,10 +268,21 @@ protected:
 	 * @param [in] length buffer length
 	 * @param [in] remote address of sender
 	 * @param [in] link_speed of the receiving device
+	 * @param [in] rx_timestamp receive timestamp delivered with the
+	 * frame, NULL if it must be requested from the timestamper
 	 */
 	void processMessage
 	( char *buf, int length, LinkLayerAddress *remote,
-	  uint32_t link_speed );
+	  uint32_t link_speed, Timestamp *rx_timestamp );
+
+	/**
+	 * @brief Removes the receive PHY delay from an RX timestamp
+	 * @param [in] rx_timestamp device receive timestamp
+	 * @param [in] link_speed of the receiving device
+	 * @return timestamp of the frame at the network reference plane
+	 */
+	Timestamp compensateRxTimestamp
+	( Timestamp rx_timestamp, uint32_t link_speed );
 
 	/**
 	 * @brief Receives messages from the network interface
@@ -234,6 +290,14 @@ protected:
 	 */
 	void *openPort( EtherPort *port );
 
+	/**
+	 * @brief  Receives and processes one message from the network
+	 * interface. Raises FAULT_DETECTED on a fatal receive error.
+	 * @return net_succeed if a message was processed, net_trfail if none
+	 * was available, net_fatal on error
+	 */
+	net_result receiveMessage();
+
 	/**
 	 * @brief  Sends and event to a IEEE1588 port. It includes timestamp
 	 * @param  buf [in] Pointer to the data buffer
@@ -241,11 +305,14 @@ protected:
 	 * @param  mcast_type Enumeration MulticastType (pdlay, none or other). Depracated.
 	 * @param  destIdentity Destination port identity
 	 * @param  [out] link_speed indicates link speed
+	 * @param  launch_time Launch time in device time nanoseconds, 0 to
+	 * send now
 	 * @return void
 	 */
 	void sendEventPort
 	(uint16_t etherType, uint8_t * buf, int len, MulticastType mcast_type,
-	 PortIdentity * destIdentity, uint32_t *link_speed );
+	 PortIdentity * destIdentity, uint32_t *link_speed,
+	 uint64_t launch_time = 0 );
 
 	/**
 	 * @brief Sends a general message to a port. No timestamps
@@ -457,6 +524,20 @@ protected:
 	(PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
 	 bool last);
 
+	/**
+	 * @brief  Waits for the TX timestamp of a PTP message
+	 * @param  msg PTPMessageCommon message
+	 * @param  timestamp [out] TX timestamp
+	 * @param  counter_value [out] timestamp count value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if collected, any other code when the wait
+	 * is over and the TX lock released, GPTP_EC_UNSUPPORTED if the
+	 * timestamper cannot wait and getTxTimestamp() must be polled.
+	 */
+	int waitTxTimestamp
+	(PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
+	 unsigned timeout_us);
+
 	/**
 	 * @brief  Gets RX timestamp based on PTP message
 	 * @param  msg PTPMessageCommon message
@@ -52,6 +52,33 @@ public:
 	( PortIdentity * identity, PTPMessageId messageId,
 	  Timestamp &timestamp, unsigned &clock_value, bool last ) = 0;
 
+	/**
+	 * @brief  Waits for the tx timestamp of a message to complete.
+	 * Timestampers able to block on the completion (e.g. on an error
+	 * queue) override this and return as soon as the timestamp arrives.
+	 * The default makes one non-blocking attempt.
+	 * @param  identity PTP port identity
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @param  clock_value [out] Clock value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS once the timestamp is collected, any other
+	 * code after a wait is final and the lock is then released.
+	 * GPTP_EC_UNSUPPORTED if the timestamper cannot wait and the caller
+	 * must keep polling HWTimestamper_txtimestamp().
+	 */
+	virtual int HWTimestamper_txtimestampWait
+	( PortIdentity * identity, PTPMessageId messageId,
+	  Timestamp &timestamp, unsigned &clock_value,
+	  unsigned /*timeout_us*/ )
+	{
+		int ret;
+
+		ret = HWTimestamper_txtimestamp
+			( identity, messageId, timestamp, clock_value, false );
+		return ret == GPTP_EC_SUCCESS ? ret : GPTP_EC_UNSUPPORTED;
+	}
+
 	/**
 	 * @brief  Get rx timestamp
 	 * @param  identity PTP port identity
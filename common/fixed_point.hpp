@@ -0,0 +1,252 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef FIXED_POINT_HPP
+#define FIXED_POINT_HPP
+
+/**@file*/
+
+#include <ptptypes.hpp>
+#include <stdint.h>
+
+/**
+ * @brief Rate ratio minus one in units of 2^-41, the representation of
+ * cumulativeScaledRateOffset in the Follow_Up information TLV
+ * (IEEE 802.1AS-2011 Clause 11.4.4.3.6). Integer arithmetic on it gives
+ * the same result on every architecture.
+ */
+typedef int64_t ScaledRateOffset;
+
+/**
+ * @brief Frequency offset in parts per billion scaled by 2^16
+ */
+typedef int64_t ScaledPpb;
+
+#define RATE_OFFSET_SHIFT 41					/*!< Fractional bits of ScaledRateOffset */
+#define RATE_OFFSET_ONE ((int64_t)1 << RATE_OFFSET_SHIFT)	/*!< ScaledRateOffset of a rate offset of 1 */
+#define RATE_OFFSET_MAX ((int64_t)1 << 51)			/*!< Saturated rate offset, a ratio of about 1024 */
+#define SCALED_PPB_ONE 65536					/*!< ScaledPpb of 1 ppb */
+
+/**
+ * @brief ScaledRateOffset of a constant offset in ppm
+ */
+#define PPM_TO_RATE_OFFSET(ppm) \
+	((ScaledRateOffset)(ppm) * RATE_OFFSET_ONE / 1000000)
+
+/**
+ * @brief ScaledPpb of a constant offset in ppm
+ */
+#define PPM_TO_SCALED_PPB(ppm) ((ScaledPpb)(ppm) * 1000 * SCALED_PPB_ONE)
+
+/**
+ * @brief  Computes a * b / c rounded to the nearest integer (halves away
+ * from zero) without intermediate overflow, using shifts and adds only.
+ * The quotient must fit 64 bits.
+ * @param  a Multiplicand
+ * @param  b Multiplier
+ * @param  c Divisor, greater than zero
+ * @return a * b / c
+ */
+static inline int64_t mulDiv64Portable( int64_t a, int64_t b, int64_t c )
+{
+	uint64_t ua, ub, uc, hi, lo, mid, q, r;
+	uint64_t p0, p1, p2, p3, half;
+	bool negative;
+	int i;
+
+	negative = ( a < 0 ) != ( b < 0 );
+	ua = a < 0 ? ~(uint64_t) a + 1 : (uint64_t) a;
+	ub = b < 0 ? ~(uint64_t) b + 1 : (uint64_t) b;
+	uc = (uint64_t) c;
+
+	// 128 bit product from 32 bit halves
+	p0 = ( ua & 0xFFFFFFFF ) * ( ub & 0xFFFFFFFF );
+	p1 = ( ua & 0xFFFFFFFF ) * ( ub >> 32 );
+	p2 = ( ua >> 32 ) * ( ub & 0xFFFFFFFF );
+	p3 = ( ua >> 32 ) * ( ub >> 32 );
+	mid = ( p0 >> 32 ) + ( p1 & 0xFFFFFFFF ) + ( p2 & 0xFFFFFFFF );
+	lo = ( p0 & 0xFFFFFFFF ) | ( mid << 32 );
+	hi = p3 + ( p1 >> 32 ) + ( p2 >> 32 ) + ( mid >> 32 );
+
+	half = uc / 2;
+	lo += half;
+	if( lo < half )
+		++hi;
+
+	// Restoring division, the remainder stays below c < 2^63
+	q = 0;
+	r = 0;
+	for( i = 127; i >= 0; --i ) {
+		r = ( r << 1 ) |
+			((( i >= 64 ? hi >> ( i - 64 ) : lo >> i )) & 1 );
+		q <<= 1;
+		if( r >= uc ) {
+			r -= uc;
+			q |= 1;
+		}
+	}
+
+	return negative ? -(int64_t) q : (int64_t) q;
+}
+
+/**
+ * @brief  Computes a * b / c rounded to the nearest integer (halves away
+ * from zero) without intermediate overflow. Uses the compiler's 128 bit
+ * integers where available; the result is identical to
+ * mulDiv64Portable().
+ * @param  a Multiplicand
+ * @param  b Multiplier
+ * @param  c Divisor, greater than zero
+ * @return a * b / c
+ */
+static inline int64_t mulDiv64( int64_t a, int64_t b, int64_t c )
+{
+#if defined(__SIZEOF_INT128__)
+	__int128 product = (__int128) a * b;
+
+	if( product < 0 )
+		return (int64_t) -(( -product + c / 2 ) / c );
+	return (int64_t)(( product + c / 2 ) / c );
+#else
+	return mulDiv64Portable( a, b, c );
+#endif
+}
+
+/**
+ * @brief  Computes the rate offset of one clock relative to another from
+ * the time elapsed on each
+ * @param  numerator Time elapsed on the clock measured, in ns
+ * @param  denominator Time elapsed on the reference clock, in ns
+ * @return numerator / denominator - 1, RATE_OFFSET_MAX if the ratio
+ * exceeds 1024 or denominator is zero
+ */
+static inline ScaledRateOffset rateOffsetFromElapsed
+( uint64_t numerator, uint64_t denominator )
+{
+	if( ( numerator >> 10 ) >= denominator )
+		return RATE_OFFSET_MAX;
+
+	return mulDiv64
+		( (int64_t)( numerator - denominator ), RATE_OFFSET_ONE,
+		  (int64_t) denominator );
+}
+
+/**
+ * @brief  Divides two rate ratios
+ * @param  a Rate offset of the dividend
+ * @param  b Rate offset of the divisor
+ * @return (1 + a) / (1 + b) - 1
+ */
+static inline ScaledRateOffset rateOffsetDivide
+( ScaledRateOffset a, ScaledRateOffset b )
+{
+	return mulDiv64( a - b, RATE_OFFSET_ONE, RATE_OFFSET_ONE + b );
+}
+
+/**
+ * @brief  Inverts a rate ratio
+ * @param  r Rate offset
+ * @return 1 / (1 + r) - 1
+ */
+static inline ScaledRateOffset rateOffsetInvert( ScaledRateOffset r )
+{
+	return mulDiv64( -r, RATE_OFFSET_ONE, RATE_OFFSET_ONE + r );
+}
+
+/**
+ * @brief  Multiplies a time interval by a rate ratio
+ * @param  ns Interval in ns
+ * @param  r Rate offset
+ * @return ns * (1 + r)
+ */
+static inline int64_t rateOffsetApply( int64_t ns, ScaledRateOffset r )
+{
+	return ns + mulDiv64( ns, r, RATE_OFFSET_ONE );
+}
+
+/**
+ * @brief  Divides a time interval by a rate ratio
+ * @param  ns Interval in ns
+ * @param  r Rate offset
+ * @return ns / (1 + r)
+ */
+static inline int64_t rateOffsetRemove( int64_t ns, ScaledRateOffset r )
+{
+	return mulDiv64( ns, RATE_OFFSET_ONE, RATE_OFFSET_ONE + r );
+}
+
+/**
+ * @brief  Converts a rate offset to a frequency offset
+ * @param  r Rate offset
+ * @return r in ppb scaled by 2^16
+ */
+static inline ScaledPpb rateOffsetToScaledPpb( ScaledRateOffset r )
+{
+	// r * 10^9 * 2^16 / 2^41
+	return mulDiv64( r, 1000000000, (int64_t) 1 << 25 );
+}
+
+/**
+ * @brief  Converts a rate offset to a rate ratio, for interfaces and logs
+ * outside the fixed point path
+ * @param  r Rate offset
+ * @return 1 + r
+ */
+static inline FrequencyRatio rateOffsetToRatio( ScaledRateOffset r )
+{
+	return 1.0 + (FrequencyRatio) r / RATE_OFFSET_ONE;
+}
+
+/**
+ * @brief  Converts a rate ratio to a rate offset
+ * @param  ratio Rate ratio
+ * @return ratio - 1 in units of 2^-41
+ */
+static inline ScaledRateOffset rateOffsetFromRatio( FrequencyRatio ratio )
+{
+	return (ScaledRateOffset)(( ratio - 1.0 ) * RATE_OFFSET_ONE );
+}
+
+/**
+ * @brief  Converts a frequency offset to ppm, for interfaces and logs
+ * outside the fixed point path
+ * @param  freq Frequency offset
+ * @return freq in ppm
+ */
+static inline double scaledPpbToPpm( ScaledPpb freq )
+{
+	return (double) freq / ( 1000.0 * SCALED_PPB_ONE );
+}
+
+#endif/*FIXED_POINT_HPP*/
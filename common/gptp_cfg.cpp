@@ -52,6 +52,23 @@ uint32_t findSpeedByName( const char *name, const char **end );
 
 GptpIniParser::GptpIniParser(std::string filename)
 {
+    _config.servo = CLOCK_SERVO_PI;
+    _config.servoWindow = LINREG_WINDOW_DEFAULT;
+    _config.offsetFilter.type = SAMPLE_FILTER_NONE;
+    _config.offsetFilter.percentile = 50;
+    _config.offsetFilter.window = SAMPLE_FILTER_WINDOW_DEFAULT;
+    _config.offsetFilter.reject = 0;
+    _config.delayFilter.type = SAMPLE_FILTER_NONE;
+    _config.delayFilter.percentile = 50;
+    _config.delayFilter.window = SAMPLE_FILTER_WINDOW_DEFAULT;
+    _config.delayFilter.reject = 0;
+    _config.rxBatchSize = 0;
+    _config.rxRingBlocks = 0;
+    _config.rxFilter = false;
+    _config.rxBusyPoll = 0;
+    _config.rxBusyPollBudget = 0;
+    _config.rxCpu = -1;
+    _config.syncLaunchLead = 0;
     _error = ini_parse(filename.c_str(), iniCallBack, this);
 }
 
@@ -85,6 +102,37 @@ int GptpIniParser::iniCallBack(void *user, const char *section, const char *name
                 parser->_config.priority1 = p1;
             }
         }
+
+        else if( parseMatch(name, "servo") )
+        {
+            valOK = parseClockServoType( value, &parser->_config.servo );
+        }
+
+        else if( parseMatch(name, "servoWindow") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned long sw = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0 &&
+                sw >= LINREG_WINDOW_MIN && sw <= LINREG_WINDOW_MAX ) {
+                valOK = true;
+                parser->_config.servoWindow = (unsigned int) sw;
+            }
+        }
+
+        else if( parseMatch(name, "offsetFilterWindow") )
+        {
+            valOK = parseFilterWindow( value, &parser->_config.offsetFilter );
+        }
+
+        else if( parseMatch(name, "offsetFilterReject") )
+        {
+            valOK = parseFilterReject( value, &parser->_config.offsetFilter );
+            // Offsets are checked against the median of the window
+            parser->_config.offsetFilter.type =
+                parser->_config.offsetFilter.reject != 0 ?
+                SAMPLE_FILTER_MEDIAN : SAMPLE_FILTER_NONE;
+        }
     }
     else if( parseMatch(section, "port") )
     {
@@ -118,6 +166,18 @@ int GptpIniParser::iniCallBack(void *user, const char *section, const char *name
                 parser->_config.neighborPropDelayThresh = nt;
             }
         }
+        else if( parseMatch(name, "delayFilter") )
+        {
+            valOK = parseSampleFilterType( value, &parser->_config.delayFilter );
+        }
+        else if( parseMatch(name, "delayFilterWindow") )
+        {
+            valOK = parseFilterWindow( value, &parser->_config.delayFilter );
+        }
+        else if( parseMatch(name, "delayFilterReject") )
+        {
+            valOK = parseFilterReject( value, &parser->_config.delayFilter );
+        }
         else if( parseMatch(name, "syncReceiptThresh") )
         {
             errno = 0;
@@ -205,6 +265,83 @@ int GptpIniParser::iniCallBack(void *user, const char *section, const char *name
             }
         }
 
+        else if( parseMatch(name, "rxBatchSize") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int rbs = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.rxBatchSize = rbs;
+            }
+        }
+
+        else if( parseMatch(name, "rxRingBlocks") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int rrb = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.rxRingBlocks = rrb;
+            }
+        }
+
+        else if( parseMatch(name, "rxFilter") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int rf = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.rxFilter = rf != 0;
+            }
+        }
+
+        else if( parseMatch(name, "rxBusyPoll") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int rbp = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.rxBusyPoll = rbp;
+            }
+        }
+
+        else if( parseMatch(name, "rxBusyPollBudget") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int rbpb = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.rxBusyPollBudget = rbpb;
+            }
+        }
+
+        else if( parseMatch(name, "rxCpu") )
+        {
+            errno = 0;
+            char *pEnd;
+            long rc = strtol(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0 && rc >= -1 ) {
+                valOK = true;
+                parser->_config.rxCpu = (int) rc;
+            }
+        }
+
+        else if( parseMatch(name, "syncLaunchLead") )
+        {
+            errno = 0;
+            char *pEnd;
+            unsigned int sll = strtoul(value, &pEnd, 10);
+            if( *pEnd == '\0' && errno == 0) {
+                valOK = true;
+                parser->_config.syncLaunchLead = sll;
+            }
+        }
+
         else if( parseMatch(name, "phy_delay") )
         {
             errno = 0;
@@ -242,6 +379,31 @@ bool GptpIniParser::parseMatch(const char *s1, const char *s2)
     return strcasecmp(s1, s2) == 0;
 }
 
+bool GptpIniParser::parseFilterWindow(const char *value, sample_filter_config_t *filter)
+{
+    errno = 0;
+    char *pEnd;
+    unsigned long fw = strtoul(value, &pEnd, 10);
+    if( *pEnd != '\0' || errno != 0 ||
+        fw == 0 || fw > SAMPLE_FILTER_WINDOW_MAX ) {
+        return false;
+    }
+    filter->window = (unsigned) fw;
+    return true;
+}
+
+bool GptpIniParser::parseFilterReject(const char *value, sample_filter_config_t *filter)
+{
+    errno = 0;
+    char *pEnd;
+    long long fr = strtoll(value, &pEnd, 10);
+    if( *pEnd != '\0' || errno != 0 || fr < 0 ) {
+        return false;
+    }
+    filter->reject = fr;
+    return true;
+}
+
 #define PHY_DELAY_DESC_LEN 21
 
 void GptpIniParser::print_phy_delay( void )
@@ -39,6 +39,8 @@ https://github.com/benhoyt/inih/commit/74d2ca064fb293bc60a77b0bd068075b293cf175.
 #include "ini.h"
 #include <limits.h>
 #include <common_port.hpp>
+#include <clock_servo.hpp>
+#include <sample_filter.hpp>
 
 const uint32_t LINKSPEED_10G =		10000000;
 const uint32_t LINKSPEED_2_5G =		2500000;
@@ -67,12 +69,16 @@ class GptpIniParser
         {
             /*ptp data set*/
             unsigned char priority1;
+            clock_servo_type_t servo;	//!< Servo adjusting the clock when syntonizing
+            unsigned int servoWindow;	//!< Largest window of the linreg servo in samples
+            sample_filter_config_t offsetFilter;	//!< Outlier rejection for master offsets
 
             /*port data set*/
             unsigned int announceReceiptTimeout;
             unsigned int syncReceiptTimeout;
             unsigned int syncReceiptThresh;		//!< Number of wrong sync messages that will trigger a switch to master
             int64_t neighborPropDelayThresh;
+            sample_filter_config_t delayFilter;	//!< Pre-filter for link delay samples
             unsigned int seqIdAsCapableThresh;
             uint16_t lostPdelayRespThresh;
             PortState port_state;
@@ -81,6 +87,13 @@ class GptpIniParser
             /*ethernet adapter data set*/
 	    std::string ifname;
 		phy_delay_map_t phy_delay;
+		unsigned int rxBatchSize;	//!< Frames drained per receive call, 0 disables batching
+		unsigned int rxRingBlocks;	//!< Memory mapped receive ring blocks, 0 disables the ring
+		bool rxFilter;			//!< Drop foreign PTP frames with an in-kernel filter
+		unsigned int rxBusyPoll;	//!< Busy poll time in microseconds, 0 disables busy polling
+		unsigned int rxBusyPollBudget;	//!< Packets per busy poll, 0 keeps the default
+		int rxCpu;			//!< CPU the listening thread is pinned to, -1 disables pinning
+		unsigned int syncLaunchLead;	//!< Sync launch time lead in microseconds, 0 disables SO_TXTIME
         } gptp_cfg_t;
 
         /*public methods*/
@@ -144,6 +157,26 @@ class GptpIniParser
             return _config.neighborPropDelayThresh;
         }
 
+        /**
+         * @brief  Reads the link delay filter from the configuration file
+         * @return delayFilter, delayFilterWindow and delayFilterReject
+         * values from the .ini file
+         */
+        sample_filter_config_t getDelayFilter(void)
+        {
+            return _config.delayFilter;
+        }
+
+        /**
+         * @brief  Reads the master offset filter from the configuration file
+         * @return offsetFilterWindow and offsetFilterReject values from the
+         * .ini file
+         */
+        sample_filter_config_t getOffsetFilter(void)
+        {
+            return _config.offsetFilter;
+        }
+
         /**
          * @brief  Reads the sync receipt threshold from the configuration file
          * @return syncRecepitThresh value from the .ini file
@@ -162,6 +195,88 @@ class GptpIniParser
             return _config.allowNegativeCorrField;
         }
 
+        /**
+         * @brief  Reads the receive batch size from the configuration file
+         * @return rxBatchSize value from the .ini file
+         */
+        unsigned int getRxBatchSize(void)
+        {
+            return _config.rxBatchSize;
+        }
+
+        /**
+         * @brief  Reads the receive ring size from the configuration file
+         * @return rxRingBlocks value from the .ini file
+         */
+        unsigned int getRxRingBlocks(void)
+        {
+            return _config.rxRingBlocks;
+        }
+
+        /**
+         * @brief  Reads the receive filter setting from the configuration file
+         * @return rxFilter value from the .ini file
+         */
+        bool getRxFilter(void)
+        {
+            return _config.rxFilter;
+        }
+
+        /**
+         * @brief  Reads the busy poll time from the configuration file
+         * @return rxBusyPoll value from the .ini file
+         */
+        unsigned int getRxBusyPoll(void)
+        {
+            return _config.rxBusyPoll;
+        }
+
+        /**
+         * @brief  Reads the busy poll budget from the configuration file
+         * @return rxBusyPollBudget value from the .ini file
+         */
+        unsigned int getRxBusyPollBudget(void)
+        {
+            return _config.rxBusyPollBudget;
+        }
+
+        /**
+         * @brief  Reads the listening thread CPU from the configuration file
+         * @return rxCpu value from the .ini file
+         */
+        int getRxCpu(void)
+        {
+            return _config.rxCpu;
+        }
+
+        /**
+         * @brief  Reads the clock servo from the configuration file
+         * @return servo value from the .ini file
+         */
+        clock_servo_type_t getServo(void)
+        {
+            return _config.servo;
+        }
+
+        /**
+         * @brief  Reads the largest linreg servo window from the
+         * configuration file
+         * @return servoWindow value from the .ini file
+         */
+        unsigned int getServoWindow(void)
+        {
+            return _config.servoWindow;
+        }
+
+        /**
+         * @brief  Reads the Sync launch time lead from the configuration file
+         * @return syncLaunchLead value from the .ini file
+         */
+        unsigned int getSyncLaunchLead(void)
+        {
+            return _config.syncLaunchLead;
+        }
+
 	/**
 	 * @brief Dump PHY delays to screen
 	 */
@@ -173,5 +288,7 @@ class GptpIniParser
 
         static int iniCallBack(void *user, const char *section, const char *name, const char *value);
         static bool parseMatch(const char *s1, const char *s2);
+        static bool parseFilterWindow(const char *value, sample_filter_config_t *filter);
+        static bool parseFilterReject(const char *value, sample_filter_config_t *filter);
 };
 
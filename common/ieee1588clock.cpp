@@ -99,10 +99,7 @@ IEEE1588Clock::IEEE1588Clock
 	domain_number = 0;
 
 	_syntonize = syntonize;
-	_new_syntonization_set_point = false;
-	_ppm = 0;
-
-	_phase_error_violation = 0;
+	servo = createClockServo( CLOCK_SERVO_PI );
 
 	_master_local_freq_offset_init = false;
 	_local_system_freq_offset_init = false;
@@ -234,12 +231,11 @@ void timerq_handler(void *arg)
 void IEEE1588Clock::addEventTimer
 ( CommonPort *target, Event e, unsigned long long time_ns )
 {
-	event_descriptor_t *event_descriptor = new event_descriptor_t();
-	event_descriptor->event = e;
-	event_descriptor->port = target;
+	// The port owns the descriptor, arming an event already pending
+	// moves its deadline
 	timerq->addEvent
-		((unsigned)(time_ns / 1000), (int)e, timerq_handler, event_descriptor,
-		 true, NULL);
+		((unsigned)(time_ns / 1000), (int)e, timerq_handler,
+		 target->getEventSlot( e ), false, NULL);
 }
 
 void IEEE1588Clock::addEventTimerLocked
@@ -255,7 +251,7 @@ void IEEE1588Clock::addEventTimerLocked
 void IEEE1588Clock::deleteEventTimer
 ( CommonPort *target, Event event )
 {
-	timerq->cancelEvent((int)event, NULL);
+	timerq->cancelEvent((int)event, target, NULL);
 }
 
 void IEEE1588Clock::deleteEventTimerLocked
@@ -263,7 +259,7 @@ void IEEE1588Clock::deleteEventTimerLocked
 {
     if( getTimerQLock() == oslock_fail ) return;
 
-	timerq->cancelEvent((int)event, NULL);
+	timerq->cancelEvent((int)event, target, NULL);
 
     if( putTimerQLock() == oslock_fail ) return;
 }
@@ -303,10 +299,10 @@ FrequencyRatio IEEE1588Clock::calcLocalSystemClockRateDifference( Timestamp loca
 
 
 
-FrequencyRatio IEEE1588Clock::calcMasterLocalClockRateDifference( Timestamp master_time, Timestamp sync_time ) {
+ScaledRateOffset IEEE1588Clock::calcMasterLocalClockRateDifference( Timestamp master_time, Timestamp sync_time ) {
 	unsigned long long inter_sync_time;
 	unsigned long long inter_master_time;
-	FrequencyRatio ppt_offset;
+	ScaledRateOffset rate_offset;
 
 	GPTP_LOG_DEBUG( "Calculated master to local clock rate difference" );
 
@@ -316,7 +312,7 @@ FrequencyRatio IEEE1588Clock::calcMasterLocalClockRateDifference( Timestamp mast
 
 		_master_local_freq_offset_init = true;
 
-		return 1.0;
+		return 0;
 	}
 
 	inter_sync_time =
@@ -327,33 +323,37 @@ FrequencyRatio IEEE1588Clock::calcMasterLocalClockRateDifference( Timestamp mast
 
 	inter_master_time = master_time_ns - prev_master_time_ns;
 
-	if( inter_sync_time != 0 ) {
-		ppt_offset = ((FrequencyRatio)inter_master_time)/inter_sync_time;
-	} else {
-		ppt_offset = 1.0;
-	}
-
 	if( master_time_ns < prev_master_time_ns ) {
-		GPTP_LOG_ERROR("Negative time jump detected - inter_master_time: %lld, inter_sync_time: %lld, incorrect ppt_offset: %Lf",
-					   inter_master_time, inter_sync_time, ppt_offset);
+		GPTP_LOG_ERROR("Negative time jump detected - inter_master_time: %lld, inter_sync_time: %lld",
+					   (long long) inter_master_time, inter_sync_time);
 		_master_local_freq_offset_init = false;
 
 		return NEGATIVE_TIME_JUMP;
 	}
 
+	if( inter_sync_time != 0 ) {
+		rate_offset = rateOffsetFromElapsed
+			( inter_master_time, inter_sync_time );
+	} else {
+		rate_offset = 0;
+	}
+
 	_prev_sync_time = sync_time;
 	_prev_master_time = master_time;
 
-	return ppt_offset;
+	return rate_offset;
 }
 
 void IEEE1588Clock::setMasterOffset
 ( CommonPort *port, int64_t master_local_offset,
-  Timestamp local_time, FrequencyRatio master_local_freq_offset,
+  Timestamp local_time, ScaledRateOffset master_local_rate_offset,
   int64_t local_system_offset, Timestamp system_time,
   FrequencyRatio local_system_freq_offset, unsigned sync_count,
   unsigned pdelay_count, PortState port_state, bool asCapable )
 {
+	FrequencyRatio master_local_freq_offset =
+		rateOffsetToRatio( master_local_rate_offset );
+
 	_master_local_freq_offset = master_local_freq_offset;
 	_local_system_freq_offset = local_system_freq_offset;
 
@@ -392,14 +392,33 @@ void IEEE1588Clock::setMasterOffset
 			port_number);
 	}
 
-	if( master_local_offset == 0 && master_local_freq_offset == 1.0 ) {
+	if( master_local_offset == 0 && master_local_rate_offset == 0 ) {
 		return;
 	}
 
 	if( _syntonize ) {
-		if( _new_syntonization_set_point || _phase_error_violation > PHASE_ERROR_MAX_COUNT ) {
-			_new_syntonization_set_point = false;
-			_phase_error_violation = 0;
+		servo_decision_t decision;
+		int64_t filtered;
+		ScaledPpb freq;
+
+		// Outliers are only rejected while locked, a converging
+		// servo moves the offset further than any spike
+		if( !offset_filter.sample
+		    ( master_local_offset, filtered, servo->isLocked() )) {
+			if( port->getTestMode() ) {
+				GPTP_LOG_STATUS( "Clock offset rejected, median %lld",
+						 filtered );
+			}
+			return;
+		}
+
+		decision = servo->sample
+			( master_local_offset, TIMESTAMP_TO_NS(local_time),
+			  master_local_rate_offset, port->getSyncInterval(),
+			  (int64_t) port->getLinkDelay(), pdelay_count, freq );
+		updateServoEstimate( port );
+
+		if( decision == SERVO_STEP ) {
 			/* Make sure that there are no transmit operations
 			   in progress */
 			getTxLockAll();
@@ -408,30 +427,19 @@ void IEEE1588Clock::setMasterOffset
 			}
 			port->adjustClockPhase( -master_local_offset );
 			_master_local_freq_offset_init = false;
+			offset_filter.reset();
 			restartPDelayAll();
 			putTxLockAll();
-			master_local_offset = 0;
 		}
 
-		// Adjust for frequency offset
-		long double phase_error = (long double) -master_local_offset;
-		if( fabsl(phase_error) > PHASE_ERROR_THRESHOLD ) {
-			++_phase_error_violation;
-		} else {
-			_phase_error_violation = 0;
-
-			float syncPerSec = (float)(1.0 / pow((float)2, port->getSyncInterval()));
-			_ppm += (float) ((INTEGRAL * syncPerSec * phase_error) + PROPORTIONAL*((master_local_freq_offset-1.0)*1000000));
-
-			GPTP_LOG_DEBUG("phase_error = %Lf, ppm = %f", phase_error, _ppm );
+		if( decision == SERVO_HOLD ) {
+			return;
 		}
-
-		if( _ppm < LOWER_FREQ_LIMIT ) _ppm = LOWER_FREQ_LIMIT;
-		if( _ppm > UPPER_FREQ_LIMIT ) _ppm = UPPER_FREQ_LIMIT;
 		if ( port->getTestMode() ) {
-			GPTP_LOG_STATUS("Adjust clock rate ppm:%f", _ppm);
+			GPTP_LOG_STATUS("Adjust clock rate ppm:%f",
+					scaledPpbToPpm( freq ));
 		}
-		if( !port->adjustClockRate( _ppm ) ) {
+		if( !port->adjustClockRate( freq ) ) {
 			GPTP_LOG_ERROR( "Failed to adjust clock rate" );
 		}
 	}
@@ -496,5 +504,36 @@ bool IEEE1588Clock::isBetterThan(PTPMessageAnnounce * msg)
 
 IEEE1588Clock::~IEEE1588Clock(void)
 {
-	// Do nothing
+	delete servo;
+}
+
+void IEEE1588Clock::updateServoEstimate( CommonPort *port )
+{
+	clock_servo_estimate_t estimate;
+
+	if( !servo->getEstimate( estimate ))
+		return;
+
+	if( port->getTestMode() ) {
+		GPTP_LOG_STATUS
+			( "Clock estimate phase:%.1f+-%.1f freq(ppb):%.1f+-%.1f "
+			  "delay:%.1f+-%.1f", estimate.phase,
+			  estimate.phase_stddev, estimate.freq,
+			  estimate.freq_stddev, estimate.delay,
+			  estimate.delay_stddev );
+	}
+	if( ipc != NULL ) {
+		ipc->update_estimate
+			( (uint32_t) estimate.phase_stddev,
+			  (uint32_t)( estimate.freq_stddev * 1000 ),
+			  (int64_t) estimate.delay,
+			  (uint32_t) estimate.delay_stddev );
+	}
+}
+
+void IEEE1588Clock::setServo( ClockServo *servo )
+{
+	delete this->servo;
+	this->servo = servo;
+	GPTP_LOG_STATUS( "Clock servo: %s", servo->getName() );
 }
@@ -97,6 +97,12 @@ typedef struct {
 	bool asCapable;                 //!< asCapable flag: true = device is AS Capable; false otherwise
 	PortState port_state;			//!< gPTP port state. It can assume values defined at ::PortState
 	PID_TYPE process_id;			//!< Process id number
+
+	/* Clock servo estimate, all 0's if the servo does not provide one */
+	uint32_t ml_phoffset_stddev;		//!< Standard deviation of the estimated master to local phase offset in ns
+	uint32_t ml_freqoffset_stddev;		//!< Standard deviation of the estimated frequency offset in parts per trillion
+	int64_t  link_delay;			//!< Estimated link delay in ns
+	uint32_t link_delay_stddev;		//!< Standard deviation of the estimated link delay in ns
 } gPtpTimeData;
 
 /*
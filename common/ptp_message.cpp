@@ -34,6 +34,7 @@
 #include <ieee1588.hpp>
 #include <avbts_clock.hpp>
 #include <avbts_message.hpp>
+#include <ptp_message_view.hpp>
 #include <ether_port.hpp>
 #include <avbts_ostimer.hpp>
 #include <ether_tstamper.hpp>
@@ -42,6 +43,245 @@
 #include <string.h>
 #include <math.h>
 
+/* Prefix placed in front of every message object. While the slot is free it
+   links the free list; once allocated it records the owning pool (NULL for
+   heap storage) so that operator delete can return it. */
+struct PTPMessagePool::Slot {
+	union {
+		PTPMessagePool *owner;
+		Slot *next;
+		long double align_ld;
+		long long align_ll;
+	};
+};
+
+PTPMessagePool::PTPMessagePool( OSLock *lock, unsigned capacity )
+{
+	unsigned i;
+
+	this->lock = lock;
+	this->capacity = capacity;
+	stride = sizeof(Slot) + PTPMessageCommon::getMaxMessageSize();
+	stride = (stride + sizeof(Slot) - 1) / sizeof(Slot) * sizeof(Slot);
+	storage = new char[stride * capacity];
+	free_list = NULL;
+	for( i = capacity; i > 0; --i ) {
+		Slot *slot = (Slot *) (storage + (i - 1) * stride);
+		slot->next = free_list;
+		free_list = slot;
+	}
+
+	in_use = 0;
+	high_water = 0;
+	pool_allocations = 0;
+	heap_allocations = 0;
+}
+
+PTPMessagePool::~PTPMessagePool()
+{
+	delete [] storage;
+	delete lock;
+}
+
+void *PTPMessagePool::allocate( size_t size )
+{
+	Slot *slot = NULL;
+
+	if( size <= stride - sizeof(Slot) ) {
+		lock->lock();
+		slot = free_list;
+		if( slot != NULL ) {
+			free_list = slot->next;
+			++pool_allocations;
+			if( ++in_use > high_water )
+				high_water = in_use;
+		} else {
+			++heap_allocations;
+		}
+		lock->unlock();
+	} else {
+		lock->lock();
+		++heap_allocations;
+		lock->unlock();
+	}
+
+	if( slot == NULL ) {
+		GPTP_LOG_VERBOSE( "Message pool exhausted, allocating from heap" );
+		return allocateHeap( size );
+	}
+
+	slot->owner = this;
+	return slot + 1;
+}
+
+void *PTPMessagePool::allocateHeap( size_t size )
+{
+	Slot *slot = (Slot *) ::operator new( sizeof(Slot) + size );
+
+	slot->owner = NULL;
+	return slot + 1;
+}
+
+void PTPMessagePool::put( Slot *slot )
+{
+	lock->lock();
+	slot->next = free_list;
+	free_list = slot;
+	--in_use;
+	lock->unlock();
+}
+
+void PTPMessagePool::release( void *ptr )
+{
+	Slot *slot;
+
+	if( ptr == NULL )
+		return;
+
+	slot = ((Slot *) ptr) - 1;
+	if( slot->owner == NULL ) {
+		::operator delete( slot );
+		return;
+	}
+	slot->owner->put( slot );
+}
+
+void PTPMessagePool::logStatistics()
+{
+	lock->lock();
+	GPTP_LOG_STATUS
+		( "Message pool: %u/%u slots in use, high water %u, "
+		  "pool allocations %llu, heap allocations %llu",
+		  in_use, capacity, high_water,
+		  (unsigned long long) pool_allocations,
+		  (unsigned long long) heap_allocations );
+	lock->unlock();
+}
+
+PTPFrameTemplates::PTPFrameTemplates()
+{
+	unsigned i;
+	uintptr_t aligned;
+
+	generation = 0;
+	for( i = 0; i < PTP_FRAME_TEMPLATE_TYPES; ++i ) {
+		built[i] = generation - 1;
+		pending[i] = built[i];
+	}
+	memset( counters, 0, sizeof( counters ));
+
+	// operator new only guarantees fundamental alignment
+	storage = new uint8_t
+		[PTP_FRAME_TEMPLATE_TYPES * PTP_FRAME_TEMPLATE_SIZE +
+		 PTP_CACHE_LINE_SIZE - 1];
+	aligned = ((uintptr_t) storage + PTP_CACHE_LINE_SIZE - 1) &
+		~((uintptr_t) PTP_CACHE_LINE_SIZE - 1);
+	frames = (uint8_t *) aligned;
+}
+
+PTPFrameTemplates::~PTPFrameTemplates()
+{
+	delete [] storage;
+}
+
+bool PTPFrameTemplates::copy
+( MessageType type, uint16_t length, uint8_t *buf )
+{
+	unsigned current = __atomic_load_n( &generation, __ATOMIC_RELAXED );
+	Counters *counter = counters + ( type & 0xF );
+
+	if( built[type & 0xF] != current ) {
+		pending[type & 0xF] = current;
+		return false;
+	}
+
+	memcpy( buf, frames + ( type & 0xF ) * PTP_FRAME_TEMPLATE_SIZE,
+		length );
+	__atomic_store_n
+		( &counter->hits, counter->hits + 1, __ATOMIC_RELAXED );
+
+	return true;
+}
+
+void PTPFrameTemplates::store
+( MessageType type, uint16_t length, const uint8_t *buf )
+{
+	Counters *counter = counters + ( type & 0xF );
+
+	__atomic_store_n
+		( &counter->builds, counter->builds + 1, __ATOMIC_RELAXED );
+	if( length > PTP_FRAME_TEMPLATE_SIZE ) {
+		__atomic_store_n
+			( &counter->oversize, counter->oversize + 1,
+			  __ATOMIC_RELAXED );
+		return;
+	}
+
+	memcpy( frames + ( type & 0xF ) * PTP_FRAME_TEMPLATE_SIZE, buf,
+		length );
+	// Tagged with the generation copy() saw, an invalidate() since then
+	// makes the next send rebuild it
+	built[type & 0xF] = pending[type & 0xF];
+}
+
+void PTPFrameTemplates::logStatistics()
+{
+	uint64_t hits = 0, builds = 0, oversize = 0;
+	unsigned i;
+
+	for( i = 0; i < PTP_FRAME_TEMPLATE_TYPES; ++i ) {
+		hits += __atomic_load_n( &counters[i].hits, __ATOMIC_RELAXED );
+		builds += __atomic_load_n
+			( &counters[i].builds, __ATOMIC_RELAXED );
+		oversize += __atomic_load_n
+			( &counters[i].oversize, __ATOMIC_RELAXED );
+	}
+
+	GPTP_LOG_STATUS
+		( "Frame templates: %llu messages built from a template, "
+		  "%llu headers built in full (%llu too large for a template)",
+		  (unsigned long long) hits, (unsigned long long) builds,
+		  (unsigned long long) oversize );
+}
+
+void *PTPMessageCommon::operator new( size_t size )
+{
+	return PTPMessagePool::allocateHeap( size );
+}
+
+void *PTPMessageCommon::operator new( size_t size, PTPMessagePool *pool )
+{
+	if( pool == NULL )
+		return PTPMessagePool::allocateHeap( size );
+
+	return pool->allocate( size );
+}
+
+void PTPMessageCommon::operator delete( void *ptr )
+{
+	PTPMessagePool::release( ptr );
+}
+
+void PTPMessageCommon::operator delete
+( void *ptr, PTPMessagePool * /*pool*/ )
+{
+	PTPMessagePool::release( ptr );
+}
+
+size_t PTPMessageCommon::getMaxMessageSize()
+{
+	size_t max = sizeof(PTPMessageAnnounce);
+
+	max = std::max( max, sizeof(PTPMessageSync) );
+	max = std::max( max, sizeof(PTPMessageFollowUp) );
+	max = std::max( max, sizeof(PTPMessagePathDelayReq) );
+	max = std::max( max, sizeof(PTPMessagePathDelayResp) );
+	max = std::max( max, sizeof(PTPMessagePathDelayRespFollowUp) );
+	max = std::max( max, sizeof(PTPMessageSignalling) );
+
+	return max;
+}
+
 PTPMessageCommon::PTPMessageCommon( CommonPort *port )
 {
 	// Fill in fields using port/clock dataset as a template
@@ -53,7 +293,6 @@ PTPMessageCommon::PTPMessageCommon( CommonPort *port )
 	flags[PTP_PTPTIMESCALE_BYTE] |= (0x1 << PTP_PTPTIMESCALE_BIT);
 	correctionField = 0;
 	_gc = false;
-	sourcePortIdentity = new PortIdentity();
 
 	return;
 }
@@ -62,25 +301,26 @@ PTPMessageCommon::PTPMessageCommon( CommonPort *port )
    uuid, and port id fields */
 bool PTPMessageCommon::isSenderEqual(PortIdentity portIdentity)
 {
-	return portIdentity == *sourcePortIdentity;
+	return portIdentity == sourcePortIdentity;
 }
 
 PTPMessageCommon *buildPTPMessage
 ( char *buf, int size, LinkLayerAddress *remote,
-  CommonPort *port )
+  CommonPort *port, Timestamp *rx_timestamp )
 {
-	OSTimer *timer = port->getTimerFactory()->createTimer();
+	OSTimer *timer = NULL;
 	PTPMessageCommon *msg = NULL;
+	PTPMessagePool *pool = port->getMessagePool();
+	PTPMessageView view( (uint8_t *) buf, size < 0 ? 0 : size );
 	PTPMessageId messageId;
 	MessageType messageType;
-	unsigned char tspec_msg_t = 0;
 	unsigned char transportSpecific = 0;
 
 	uint16_t sequenceId;
-	PortIdentity *sourcePortIdentity;
+	PortIdentity sourcePortIdentity;
 	Timestamp timestamp(0, 0, 0);
 	unsigned counter_value = 0;
-	EtherPort *eport = NULL;
+	EtherPort *eport = dynamic_cast <EtherPort *> ( port );
 
 #if PTP_DEBUG
 	{
@@ -96,36 +336,29 @@ PTPMessageCommon *buildPTPMessage
 	}
 #endif
 
-	memcpy(&tspec_msg_t,
-	       buf + PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET),
-	       sizeof(tspec_msg_t));
-	messageType = (MessageType) (tspec_msg_t & 0xF);
-	transportSpecific = (tspec_msg_t >> 4) & 0x0F;
-
-	sourcePortIdentity = new PortIdentity
-		((uint8_t *)
-		 (buf + PTP_COMMON_HDR_SOURCE_CLOCK_ID
-		  (PTP_COMMON_HDR_OFFSET)),
-		 (uint16_t *)
-		 (buf + PTP_COMMON_HDR_SOURCE_PORT_ID
-		  (PTP_COMMON_HDR_OFFSET)));
+	if (!view.has(PTP_COMMON_HDR_OFFSET, PTP_COMMON_HDR_LENGTH)) {
+		GPTP_LOG_ERROR("*** Received truncated PTP header, length=%d",
+			       size);
+		goto abort;
+	}
 
-	memcpy
-		(&(sequenceId),
-		 buf + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
-		 sizeof(sequenceId));
-	sequenceId = PLAT_ntohs(sequenceId);
+	messageType = view.getMessageType();
+	transportSpecific = view.getTransportSpecific();
+	view.getSourcePortIdentity(sourcePortIdentity);
+	sequenceId = view.getSequenceId();
 
 	GPTP_LOG_VERBOSE("Captured Sequence Id: %u", sequenceId);
 	messageId.setMessageType(messageType);
 	messageId.setSequenceId(sequenceId);
 
 
-	if (!(messageType >> 3)) {
+	if (view.isEvent() && rx_timestamp != NULL) {
+		// Timestamp delivered with the frame, nothing to wait for
+		timestamp = *rx_timestamp;
+	} else if (view.isEvent()) {
 		int iter = 5;
 		long req = 4000;	// = 1 ms
 
-		eport = dynamic_cast <EtherPort *> ( port );
 		if (eport == NULL)
 		{
 			GPTP_LOG_ERROR
@@ -136,16 +369,18 @@ PTPMessageCommon *buildPTPMessage
 
 		int ts_good =
 		    eport->getRxTimestamp
-			(sourcePortIdentity, messageId, timestamp, counter_value, false);
+			(&sourcePortIdentity, messageId, timestamp, counter_value, false);
 		while (ts_good != GPTP_EC_SUCCESS && iter-- != 0) {
 			// Waits at least 1 time slice regardless of size of 'req'
+			if (timer == NULL)
+				timer = port->getTimerFactory()->createTimer();
 			timer->sleep(req);
 			if (ts_good != GPTP_EC_EAGAIN)
 				GPTP_LOG_ERROR(
 					"Error (RX) timestamping RX event packet (Retrying), error=%d",
 					  ts_good );
 			ts_good =
-			    eport->getRxTimestamp(sourcePortIdentity, messageId,
+			    eport->getRxTimestamp(&sourcePortIdentity, messageId,
 						 timestamp, counter_value,
 						 iter == 0);
 			req *= 2;
@@ -170,30 +405,34 @@ PTPMessageCommon *buildPTPMessage
 		GPTP_LOG_EXCEPTION("*** Received message with unsupported transportSpecific type=%d", transportSpecific);
 		goto abort;
 	}
- 
+
+	if (PTPMessageView::getBodyLength(messageType) == 0) {
+		GPTP_LOG_EXCEPTION("Received unsupported message type, %d",
+		            (int)messageType);
+		port->incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+
+		goto abort;
+	}
+
+	// Be sure buffer is the correct size
+	if (!view.isValid()) {
+		GPTP_LOG_ERROR("*** Received truncated message, type=%d, "
+			       "length=%d", (int)messageType, size);
+		goto abort;
+	}
+
 	switch (messageType) {
 	case SYNC_MESSAGE:
 
 		GPTP_LOG_DEBUG("*** Received Sync message" );
 		GPTP_LOG_VERBOSE("Sync RX timestamp = %hu,%u,%u", timestamp.seconds_ms, timestamp.seconds_ls, timestamp.nanoseconds );
 
-		// Be sure buffer is the correction size
-		if (size < PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH) {
-			goto abort;
-		}
 		{
-			PTPMessageSync *sync_msg = new PTPMessageSync();
+			PTPMessageSync *sync_msg = new (pool) PTPMessageSync();
 			sync_msg->messageType = messageType;
 			// Copy in v2 sync specific fields
-			memcpy(&(sync_msg->originTimestamp.seconds_ms),
-			       buf + PTP_SYNC_SEC_MS(PTP_SYNC_OFFSET),
-			       sizeof(sync_msg->originTimestamp.seconds_ms));
-			memcpy(&(sync_msg->originTimestamp.seconds_ls),
-			       buf + PTP_SYNC_SEC_LS(PTP_SYNC_OFFSET),
-			       sizeof(sync_msg->originTimestamp.seconds_ls));
-			memcpy(&(sync_msg->originTimestamp.nanoseconds),
-			       buf + PTP_SYNC_NSEC(PTP_SYNC_OFFSET),
-			       sizeof(sync_msg->originTimestamp.nanoseconds));
+			sync_msg->originTimestamp =
+				view.getTimestamp(PTP_SYNC_OFFSET);
 			msg = sync_msg;
 		}
 		break;
@@ -201,95 +440,41 @@ PTPMessageCommon *buildPTPMessage
 
 		GPTP_LOG_DEBUG("*** Received Follow Up message");
 
-		// Be sure buffer is the correction size
-		if (size < (int)(PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + sizeof(FollowUpTLV))) {
-			goto abort;
-		}
 		{
-			PTPMessageFollowUp *followup_msg =
-			    new PTPMessageFollowUp();
+			PTPMessageFollowUp *followup_msg;
+
+			if (!view.has(PTP_FOLLOWUP_OFFSET + PTP_FOLLOWUP_LENGTH,
+				      sizeof(FollowUpTLV))) {
+				port->incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+				goto abort;
+			}
+
+			followup_msg = new (pool) PTPMessageFollowUp();
 			followup_msg->messageType = messageType;
 			// Copy in v2 sync specific fields
-			memcpy(&
-			       (followup_msg->
-				preciseOriginTimestamp.seconds_ms),
-			       buf + PTP_FOLLOWUP_SEC_MS(PTP_FOLLOWUP_OFFSET),
-			       sizeof(followup_msg->
-				      preciseOriginTimestamp.seconds_ms));
-			memcpy(&
-			       (followup_msg->
-				preciseOriginTimestamp.seconds_ls),
-			       buf + PTP_FOLLOWUP_SEC_LS(PTP_FOLLOWUP_OFFSET),
-			       sizeof(followup_msg->
-				      preciseOriginTimestamp.seconds_ls));
-			memcpy(&
-			       (followup_msg->
-				preciseOriginTimestamp.nanoseconds),
-			       buf + PTP_FOLLOWUP_NSEC(PTP_FOLLOWUP_OFFSET),
-			       sizeof(followup_msg->
-				      preciseOriginTimestamp.nanoseconds));
-
-			followup_msg->preciseOriginTimestamp.seconds_ms =
-			    PLAT_ntohs(followup_msg->
-				       preciseOriginTimestamp.seconds_ms);
-			followup_msg->preciseOriginTimestamp.seconds_ls =
-			    PLAT_ntohl(followup_msg->
-				       preciseOriginTimestamp.seconds_ls);
-			followup_msg->preciseOriginTimestamp.nanoseconds =
-			    PLAT_ntohl(followup_msg->
-				       preciseOriginTimestamp.nanoseconds);
-
-			memcpy( &(followup_msg->tlv),
-				buf+PTP_FOLLOWUP_OFFSET+PTP_FOLLOWUP_LENGTH,
-				sizeof(followup_msg->tlv) );
+			followup_msg->preciseOriginTimestamp =
+				view.getTimestamp(PTP_FOLLOWUP_OFFSET);
+
+			// The TLV is kept in wire format
+			view.getBytes
+				( PTP_FOLLOWUP_OFFSET + PTP_FOLLOWUP_LENGTH,
+				  &followup_msg->tlv, sizeof(followup_msg->tlv) );
 
 			msg = followup_msg;
-        }
+		}
 
 		break;
 	case PATH_DELAY_REQ_MESSAGE:
 
 		GPTP_LOG_DEBUG("*** Received PDelay Request message");
 
-		// Be sure buffer is the correction size
-		if (size < PTP_COMMON_HDR_LENGTH + PTP_PDELAY_REQ_LENGTH
-		    && /* For Broadcom compatibility */ size != 46) {
-			goto abort;
-		}
 		{
 			PTPMessagePathDelayReq *pdelay_req_msg =
-			    new PTPMessagePathDelayReq();
+			    new (pool) PTPMessagePathDelayReq();
 			pdelay_req_msg->messageType = messageType;
 
-#if 0
-            /*TODO: Do we need the code below? Can we remove it?*/
-			// The origin timestamp for PDelay Request packets has been eliminated since it is unused
-			// Copy in v2 PDelay Request specific fields
-			memcpy(&(pdelay_req_msg->originTimestamp.seconds_ms),
-			       buf +
-			       PTP_PDELAY_REQ_SEC_MS(PTP_PDELAY_REQ_OFFSET),
-			       sizeof(pdelay_req_msg->
-				      originTimestamp.seconds_ms));
-			memcpy(&(pdelay_req_msg->originTimestamp.seconds_ls),
-			       buf +
-			       PTP_PDELAY_REQ_SEC_LS(PTP_PDELAY_REQ_OFFSET),
-			       sizeof(pdelay_req_msg->
-				      originTimestamp.seconds_ls));
-			memcpy(&(pdelay_req_msg->originTimestamp.nanoseconds),
-			       buf + PTP_PDELAY_REQ_NSEC(PTP_PDELAY_REQ_OFFSET),
-			       sizeof(pdelay_req_msg->
-				      originTimestamp.nanoseconds));
-
-			pdelay_req_msg->originTimestamp.seconds_ms =
-			    PLAT_ntohs(pdelay_req_msg->
-				       originTimestamp.seconds_ms);
-			pdelay_req_msg->originTimestamp.seconds_ls =
-			    PLAT_ntohl(pdelay_req_msg->
-				       originTimestamp.seconds_ls);
-			pdelay_req_msg->originTimestamp.nanoseconds =
-			    PLAT_ntohl(pdelay_req_msg->
-				       originTimestamp.nanoseconds);
-#endif
+			// The origin timestamp for PDelay Request packets is
+			// unused (and missing from some implementations)
 
 			msg = pdelay_req_msg;
 		}
@@ -300,57 +485,17 @@ PTPMessageCommon *buildPTPMessage
 			   timestamp.seconds_ls, timestamp.nanoseconds,
 			   sequenceId);
 
-		// Be sure buffer is the correction size
-		if (size < PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH) {
-			goto abort;
-		}
 		{
 			PTPMessagePathDelayResp *pdelay_resp_msg =
-			    new PTPMessagePathDelayResp();
+			    new (pool) PTPMessagePathDelayResp();
 			pdelay_resp_msg->messageType = messageType;
 			// Copy in v2 PDelay Response specific fields
-			pdelay_resp_msg->requestingPortIdentity =
-			    new PortIdentity((uint8_t *) buf +
-					     PTP_PDELAY_RESP_REQ_CLOCK_ID
-					     (PTP_PDELAY_RESP_OFFSET),
-					     (uint16_t *) (buf +
-							   PTP_PDELAY_RESP_REQ_PORT_ID
-							   (PTP_PDELAY_RESP_OFFSET)));
-
-#ifdef DEBUG
-			for (int n = 0; n < PTP_CLOCK_IDENTITY_LENGTH; ++n) {	// MMM
-				GPTP_LOG_VERBOSE("%c",
-					pdelay_resp_msg->
-					requestingPortIdentity.clockIdentity
-					[n]);
-			}
-#endif
-
-			memcpy(& (pdelay_resp_msg->requestReceiptTimestamp.seconds_ms),
-			       buf + PTP_PDELAY_RESP_SEC_MS(PTP_PDELAY_RESP_OFFSET),
-			       sizeof
-				   (pdelay_resp_msg->requestReceiptTimestamp.seconds_ms));
-			memcpy(&
-			       (pdelay_resp_msg->
-				requestReceiptTimestamp.seconds_ls),
-			       buf +
-			       PTP_PDELAY_RESP_SEC_LS(PTP_PDELAY_RESP_OFFSET),
-			       sizeof(pdelay_resp_msg->
-				      requestReceiptTimestamp.seconds_ls));
-			memcpy(&
-			       (pdelay_resp_msg->
-				requestReceiptTimestamp.nanoseconds),
-			       buf +
-			       PTP_PDELAY_RESP_NSEC(PTP_PDELAY_RESP_OFFSET),
-			       sizeof(pdelay_resp_msg->
-				      requestReceiptTimestamp.nanoseconds));
-
-			pdelay_resp_msg->requestReceiptTimestamp.seconds_ms =
-			    PLAT_ntohs(pdelay_resp_msg->requestReceiptTimestamp.seconds_ms);
-			pdelay_resp_msg->requestReceiptTimestamp.seconds_ls =
-			    PLAT_ntohl(pdelay_resp_msg->requestReceiptTimestamp.seconds_ls);
-			pdelay_resp_msg->requestReceiptTimestamp.nanoseconds =
-			    PLAT_ntohl(pdelay_resp_msg->requestReceiptTimestamp.nanoseconds);
+			view.getPortIdentity
+				( PTP_PDELAY_RESP_REQ_CLOCK_ID
+				  (PTP_PDELAY_RESP_OFFSET),
+				  pdelay_resp_msg->requestingPortIdentity );
+			pdelay_resp_msg->requestReceiptTimestamp =
+				view.getTimestamp(PTP_PDELAY_RESP_OFFSET);
 
 			msg = pdelay_resp_msg;
 		}
@@ -359,66 +504,17 @@ PTPMessageCommon *buildPTPMessage
 
 		GPTP_LOG_DEBUG("*** Received PDelay Response FollowUp message");
 
-		// Be sure buffer is the correction size
-//     if( size < PTP_COMMON_HDR_LENGTH + PTP_PDELAY_FOLLOWUP_LENGTH ) {
-//       goto abort;
-//     }
 		{
 			PTPMessagePathDelayRespFollowUp *pdelay_resp_fwup_msg =
-			    new PTPMessagePathDelayRespFollowUp();
+			    new (pool) PTPMessagePathDelayRespFollowUp();
 			pdelay_resp_fwup_msg->messageType = messageType;
 			// Copy in v2 PDelay Response specific fields
-			pdelay_resp_fwup_msg->requestingPortIdentity =
-			    new PortIdentity((uint8_t *) buf +
-					     PTP_PDELAY_FOLLOWUP_REQ_CLOCK_ID
-					     (PTP_PDELAY_RESP_OFFSET),
-					     (uint16_t *) (buf +
-							   PTP_PDELAY_FOLLOWUP_REQ_PORT_ID
-							   (PTP_PDELAY_FOLLOWUP_OFFSET)));
-
-			memcpy(&
-			       (pdelay_resp_fwup_msg->
-				responseOriginTimestamp.seconds_ms),
-			       buf +
-			       PTP_PDELAY_FOLLOWUP_SEC_MS
-			       (PTP_PDELAY_FOLLOWUP_OFFSET),
-			       sizeof
-			       (pdelay_resp_fwup_msg->responseOriginTimestamp.
-				seconds_ms));
-			memcpy(&
-			       (pdelay_resp_fwup_msg->
-				responseOriginTimestamp.seconds_ls),
-			       buf +
-			       PTP_PDELAY_FOLLOWUP_SEC_LS
-			       (PTP_PDELAY_FOLLOWUP_OFFSET),
-			       sizeof
-			       (pdelay_resp_fwup_msg->responseOriginTimestamp.
-				seconds_ls));
-			memcpy(&
-			       (pdelay_resp_fwup_msg->
-				responseOriginTimestamp.nanoseconds),
-			       buf +
-			       PTP_PDELAY_FOLLOWUP_NSEC
-			       (PTP_PDELAY_FOLLOWUP_OFFSET),
-			       sizeof
-			       (pdelay_resp_fwup_msg->responseOriginTimestamp.
-				nanoseconds));
-
-			pdelay_resp_fwup_msg->
-			    responseOriginTimestamp.seconds_ms =
-			    PLAT_ntohs
-			    (pdelay_resp_fwup_msg->responseOriginTimestamp.
-			     seconds_ms);
-			pdelay_resp_fwup_msg->
-			    responseOriginTimestamp.seconds_ls =
-			    PLAT_ntohl
-			    (pdelay_resp_fwup_msg->responseOriginTimestamp.
-			     seconds_ls);
-			pdelay_resp_fwup_msg->
-			    responseOriginTimestamp.nanoseconds =
-			    PLAT_ntohl
-			    (pdelay_resp_fwup_msg->responseOriginTimestamp.
-			     nanoseconds);
+			view.getPortIdentity
+				( PTP_PDELAY_FOLLOWUP_REQ_CLOCK_ID
+				  (PTP_PDELAY_FOLLOWUP_OFFSET),
+				  pdelay_resp_fwup_msg->requestingPortIdentity );
+			pdelay_resp_fwup_msg->responseOriginTimestamp =
+				view.getTimestamp(PTP_PDELAY_FOLLOWUP_OFFSET);
 
 			msg = pdelay_resp_fwup_msg;
 		}
@@ -428,58 +524,57 @@ PTPMessageCommon *buildPTPMessage
 		GPTP_LOG_VERBOSE("*** Received Announce message");
 
 		{
-			PTPMessageAnnounce *annc = new PTPMessageAnnounce();
+			PTPMessageAnnounce *annc = new (pool) PTPMessageAnnounce();
+			size_t tlv_offset = view.getTLVOffset();
+			PTPTLVView tlv;
+
 			annc->messageType = messageType;
-			int tlv_length = size - PTP_COMMON_HDR_LENGTH + PTP_ANNOUNCE_LENGTH;
-
-			memcpy(&(annc->currentUtcOffset),
-			       buf +
-			       PTP_ANNOUNCE_CURRENT_UTC_OFFSET
-			       (PTP_ANNOUNCE_OFFSET),
-			       sizeof(annc->currentUtcOffset));
-			annc->currentUtcOffset =
-			    PLAT_ntohs(annc->currentUtcOffset);
-			memcpy(&(annc->grandmasterPriority1),
-			       buf +
-			       PTP_ANNOUNCE_GRANDMASTER_PRIORITY1
-			       (PTP_ANNOUNCE_OFFSET),
-			       sizeof(annc->grandmasterPriority1));
-			memcpy( annc->grandmasterClockQuality,
-				buf+
-				PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
-				(PTP_ANNOUNCE_OFFSET),
-				sizeof( *annc->grandmasterClockQuality ));
-			annc->
-			  grandmasterClockQuality->offsetScaledLogVariance =
-			  PLAT_ntohs
-			  ( annc->grandmasterClockQuality->
-			    offsetScaledLogVariance );
-			memcpy(&(annc->grandmasterPriority2),
-			       buf +
-			       PTP_ANNOUNCE_GRANDMASTER_PRIORITY2
-			       (PTP_ANNOUNCE_OFFSET),
-			       sizeof(annc->grandmasterPriority2));
-			memcpy(&(annc->grandmasterIdentity),
-			       buf +
-			       PTP_ANNOUNCE_GRANDMASTER_IDENTITY
-			       (PTP_ANNOUNCE_OFFSET),
-			       PTP_CLOCK_IDENTITY_LENGTH);
-			memcpy(&(annc->stepsRemoved),
-			       buf +
-			       PTP_ANNOUNCE_STEPS_REMOVED(PTP_ANNOUNCE_OFFSET),
-			       sizeof(annc->stepsRemoved));
-			annc->stepsRemoved = PLAT_ntohs(annc->stepsRemoved);
-			memcpy(&(annc->timeSource),
-			       buf +
-			       PTP_ANNOUNCE_TIME_SOURCE(PTP_ANNOUNCE_OFFSET),
-			       sizeof(annc->timeSource));
-
-			// Parse TLV if it exists
-			buf += PTP_COMMON_HDR_LENGTH + PTP_ANNOUNCE_LENGTH;
-			if( tlv_length > (int) (2*sizeof(uint16_t)) && PLAT_ntohs(*((uint16_t *)buf)) == PATH_TRACE_TLV_TYPE)  {
-				buf += sizeof(uint16_t);
-				tlv_length -= sizeof(uint16_t);
-				annc->tlv.parseClockIdentity((uint8_t *)buf, tlv_length);
+
+			annc->currentUtcOffset = view.getUint16
+				(PTP_ANNOUNCE_CURRENT_UTC_OFFSET
+				 (PTP_ANNOUNCE_OFFSET));
+			annc->grandmasterPriority1 = view.getUint8
+				(PTP_ANNOUNCE_GRANDMASTER_PRIORITY1
+				 (PTP_ANNOUNCE_OFFSET));
+			annc->grandmasterClockQuality.cq_class = view.getUint8
+				(PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
+				 (PTP_ANNOUNCE_OFFSET));
+			annc->grandmasterClockQuality.clockAccuracy =
+				view.getUint8
+				(PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
+				 (PTP_ANNOUNCE_OFFSET) + 1);
+			annc->grandmasterClockQuality.offsetScaledLogVariance =
+				view.getUint16
+				(PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
+				 (PTP_ANNOUNCE_OFFSET) + 2);
+			annc->grandmasterPriority2 = view.getUint8
+				(PTP_ANNOUNCE_GRANDMASTER_PRIORITY2
+				 (PTP_ANNOUNCE_OFFSET));
+			view.getBytes
+				(PTP_ANNOUNCE_GRANDMASTER_IDENTITY
+				 (PTP_ANNOUNCE_OFFSET),
+				 annc->grandmasterIdentity,
+				 PTP_CLOCK_IDENTITY_LENGTH);
+			annc->stepsRemoved = view.getUint16
+				(PTP_ANNOUNCE_STEPS_REMOVED(PTP_ANNOUNCE_OFFSET));
+			annc->timeSource = view.getUint8
+				(PTP_ANNOUNCE_TIME_SOURCE(PTP_ANNOUNCE_OFFSET));
+
+			// Parse the path trace TLV if it exists
+			while (view.nextTLV(tlv_offset, tlv)) {
+				size_t id_offset;
+
+				if (tlv.type != PATH_TRACE_TLV_TYPE)
+					continue;
+				for (id_offset = tlv.value_offset;
+				     id_offset + PTP_CLOCK_IDENTITY_LENGTH <=
+					     tlv.value_offset + tlv.length;
+				     id_offset += PTP_CLOCK_IDENTITY_LENGTH) {
+					ClockIdentity id((uint8_t *)
+						view.data() + id_offset);
+					annc->tlv.appendClockIdentity(&id);
+				}
+				break;
 			}
 
 			msg = annc;
@@ -488,14 +583,25 @@ PTPMessageCommon *buildPTPMessage
 
 	case SIGNALLING_MESSAGE:
 		{
-			PTPMessageSignalling *signallingMsg = new PTPMessageSignalling();
+			PTPMessageSignalling *signallingMsg = new (pool) PTPMessageSignalling();
 			signallingMsg->messageType = messageType;
 
-			memcpy(&(signallingMsg->targetPortIdentify),
-			       buf + PTP_SIGNALLING_TARGET_PORT_IDENTITY(PTP_SIGNALLING_OFFSET),
-			       sizeof(signallingMsg->targetPortIdentify));
-
-			memcpy( &(signallingMsg->tlv), buf + PTP_SIGNALLING_OFFSET + PTP_SIGNALLING_LENGTH, sizeof(signallingMsg->tlv) );
+			// The target port identity and the TLV are kept in
+			// wire format
+			if (!view.getBytes
+			    (PTP_SIGNALLING_TARGET_PORT_IDENTITY
+			     (PTP_SIGNALLING_OFFSET),
+			     &signallingMsg->targetPortIdentify,
+			     sizeof(signallingMsg->targetPortIdentify)) ||
+			    !view.getBytes
+			    (PTP_SIGNALLING_OFFSET + PTP_SIGNALLING_LENGTH,
+			     &signallingMsg->tlv, sizeof(signallingMsg->tlv))) {
+				GPTP_LOG_ERROR("*** Received truncated Signalling "
+					       "message, length=%d", size);
+				delete signallingMsg;
+				port->incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+				goto abort;
+			}
 
 			msg = signallingMsg;
 		}
@@ -513,33 +619,18 @@ PTPMessageCommon *buildPTPMessage
 	msg->_gc = false;
 
 	// Copy in common header fields
-	memcpy(&(msg->versionPTP),
-	       buf + PTP_COMMON_HDR_PTP_VERSION(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->versionPTP));
-	memcpy(&(msg->messageLength),
-	       buf + PTP_COMMON_HDR_MSG_LENGTH(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->messageLength));
-	msg->messageLength = PLAT_ntohs(msg->messageLength);
-	memcpy(&(msg->domainNumber),
-	       buf + PTP_COMMON_HDR_DOMAIN_NUMBER(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->domainNumber));
-	memcpy(&(msg->flags), buf + PTP_COMMON_HDR_FLAGS(PTP_COMMON_HDR_OFFSET),
-	       PTP_FLAGS_LENGTH);
-	memcpy(&(msg->correctionField),
-	       buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->correctionField));
-	msg->correctionField = PLAT_ntohll(msg->correctionField);
+	msg->versionPTP = view.getVersionPTP();
+	msg->messageLength = view.getMessageLength();
+	msg->domainNumber = view.getDomainNumber();
+	view.getFlags(msg->flags);
+	msg->correctionField = view.getCorrectionField();
 	msg->sourcePortIdentity = sourcePortIdentity;
 	msg->sequenceId = sequenceId;
-	memcpy(&(msg->control),
-	       buf + PTP_COMMON_HDR_CONTROL(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->control));
-	memcpy(&(msg->logMeanMessageInterval),
-	       buf + PTP_COMMON_HDR_LOG_MSG_INTRVL(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->logMeanMessageInterval));
+	msg->control = (LegacyMessageType) view.getControl();
+	msg->logMeanMessageInterval = view.getLogMeanMessageInterval();
 
 	if( eport != NULL )
-		eport->addSockAddrMap( msg->sourcePortIdentity, remote );
+		eport->addSockAddrMap( &msg->sourcePortIdentity, remote );
 
 	msg->_timestamp = timestamp;
 	msg->_timestamp_counter_value = counter_value;
@@ -549,7 +640,6 @@ PTPMessageCommon *buildPTPMessage
 	return msg;
 
 abort:
-	delete sourcePortIdentity;
 	delete timer;
 
 	return NULL;
@@ -564,9 +654,16 @@ bool PTPMessageCommon::getTxTimestamp( EtherPort *port, uint32_t link_speed )
 	unsigned req = TX_TIMEOUT_BASE;
 	int iter = TX_TIMEOUT_ITER;
 
-	ts_good = port->getTxTimestamp
-		( this, tx_timestamp, unused, false );
-	while( ts_good != GPTP_EC_SUCCESS && iter-- != 0 )
+	// Blocks until the timestamp completes where the timestamper
+	// supports it, the result is then final. Otherwise falls back to
+	// polling with backoff.
+	ts_good = port->waitTxTimestamp
+		( this, tx_timestamp, unused, TX_TIMEOUT_TOTAL );
+	if( ts_good != GPTP_EC_UNSUPPORTED )
+		iter = 0;
+	else
+		ts_good = GPTP_EC_EAGAIN;
+	while( ts_good != GPTP_EC_SUCCESS && iter-- > 0 )
 	{
 		timer->sleep(req);
 		if (ts_good != GPTP_EC_EAGAIN && iter < 1)
@@ -628,10 +725,10 @@ void PTPMessageCommon::buildCommonHeader(uint8_t * buf)
 	memcpy(buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
 	       &correctionField_BE, sizeof(correctionField));
 
-	sourcePortIdentity->getClockIdentityString
+	sourcePortIdentity.getClockIdentityString
 	  ((uint8_t *) buf+
 	   PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET));
-	sourcePortIdentity->getPortNumberNO
+	sourcePortIdentity.getPortNumberNO
 	  ((uint16_t *) (buf + PTP_COMMON_HDR_SOURCE_PORT_ID
 			 (PTP_COMMON_HDR_OFFSET)));
 
@@ -648,30 +745,57 @@ void PTPMessageCommon::buildCommonHeader(uint8_t * buf)
 	return;
 }
 
+void PTPMessageCommon::buildHeader( CommonPort *port, uint8_t *buf )
+{
+	buildHeader( port->getFrameTemplates(), buf );
+}
+
+void PTPMessageCommon::buildHeader
+( PTPFrameTemplates *templates, uint8_t *buf )
+{
+	uint16_t sequenceId_NO;
+	long long correctionField_NO;
+
+	if( !templates->copy( messageType, messageLength, buf )) {
+		memset( buf, 0, messageLength );
+		buildCommonHeader( buf );
+		templates->store( messageType, messageLength, buf );
+		return;
+	}
+
+	// Only these header fields change from one message to the next
+	GPTP_LOG_VERBOSE("Sending Sequence Id: %u", sequenceId);
+	sequenceId_NO = PLAT_htons(sequenceId);
+	memcpy(buf + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
+	       &sequenceId_NO, sizeof(sequenceId_NO));
+	correctionField_NO = PLAT_htonll(correctionField);
+	memcpy(buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
+	       &correctionField_NO, sizeof(correctionField));
+	memcpy(buf + PTP_COMMON_HDR_LOG_MSG_INTRVL(PTP_COMMON_HDR_OFFSET),
+	       &logMeanMessageInterval, sizeof(logMeanMessageInterval));
+}
+
 void PTPMessageCommon::getPortIdentity(PortIdentity * identity)
 {
-	*identity = *sourcePortIdentity;
+	*identity = sourcePortIdentity;
 }
 
 void PTPMessageCommon::setPortIdentity(PortIdentity * identity)
 {
-	*sourcePortIdentity = *identity;
+	sourcePortIdentity = *identity;
 }
 
 PTPMessageCommon::~PTPMessageCommon(void)
 {
-	delete sourcePortIdentity;
 	return;
 }
 
 PTPMessageAnnounce::PTPMessageAnnounce(void)
 {
-	grandmasterClockQuality = new ClockQuality();
 }
 
 PTPMessageAnnounce::~PTPMessageAnnounce(void)
 {
-	delete grandmasterClockQuality;
 }
 
 bool PTPMessageAnnounce::isBetterThan(PTPMessageAnnounce * msg)
@@ -683,13 +807,13 @@ bool PTPMessageAnnounce::isBetterThan(PTPMessageAnnounce * msg)
 	this1[0] = grandmasterPriority1;
 	that1[0] = msg->getGrandmasterPriority1();
 
-	this1[1] = grandmasterClockQuality->cq_class;
+	this1[1] = grandmasterClockQuality.cq_class;
 	that1[1] = msg->getGrandmasterClockQuality()->cq_class;
 
-	this1[2] = grandmasterClockQuality->clockAccuracy;
+	this1[2] = grandmasterClockQuality.clockAccuracy;
 	that1[2] = msg->getGrandmasterClockQuality()->clockAccuracy;
 
-	tmp = grandmasterClockQuality->offsetScaledLogVariance;
+	tmp = grandmasterClockQuality.offsetScaledLogVariance;
 	tmp = PLAT_htons(tmp);
 	memcpy(this1 + 3, &tmp, sizeof(tmp));
 	tmp = msg->getGrandmasterClockQuality()->offsetScaledLogVariance;
@@ -718,6 +842,7 @@ bool PTPMessageAnnounce::isBetterThan(PTPMessageAnnounce * msg)
 
 
 PTPMessageSync::PTPMessageSync() {
+	launchTime = 0;
 }
 
 PTPMessageSync::~PTPMessageSync() {
@@ -733,6 +858,7 @@ PTPMessageSync::PTPMessageSync( EtherPort *port ) :
 	flags[PTP_ASSIST_BYTE] |= (0x1 << PTP_ASSIST_BIT);
 
 	originTimestamp = port->getClock()->getTime();
+	launchTime = 0;
 
 	logMeanMessageInterval = port->getSyncInterval();
 	return;
@@ -747,12 +873,12 @@ bool PTPMessageSync::sendPort
 	Timestamp originTimestamp_BE;
 	uint32_t link_speed;
 
-	memset(buf_t, 0, 256);
+	memset(buf_t, 0, port->getPayloadOffset());
 	// Create packet in buf
 	// Copy in common header
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH;
 	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildHeader(port, buf_ptr);
 	// Get timestamp
 	originTimestamp = port->getClock()->getTime();
 	originTimestamp_BE.seconds_ms = PLAT_htons(originTimestamp.seconds_ms);
@@ -772,7 +898,7 @@ bool PTPMessageSync::sendPort
 
 	port->sendEventPort
 		( PTP_ETHERTYPE, buf_t, messageLength, MCAST_OTHER,
-		  destIdentity, &link_speed );
+		  destIdentity, &link_speed, launchTime );
 	port->incCounter_ieee8021AsPortStatTxSyncCount();
 
 	return getTxTimestamp( port, link_speed );
@@ -793,8 +919,7 @@ PTPMessageAnnounce::PTPMessageAnnounce( CommonPort *port ) :
 	currentUtcOffset = port->getClock()->getCurrentUtcOffset();
 	grandmasterPriority1 = port->getClock()->getPriority1();
 	grandmasterPriority2 = port->getClock()->getPriority2();
-	grandmasterClockQuality = new ClockQuality();
-	*grandmasterClockQuality = port->getClock()->getClockQuality();
+	grandmasterClockQuality = port->getClock()->getClockQuality();
 	stepsRemoved = 0;
 	timeSource = port->getClock()->getTimeSource();
 	clock_identity = port->getClock()->getGrandmasterClockIdentity();
@@ -813,7 +938,7 @@ bool PTPMessageAnnounce::sendPort
 
 	uint16_t currentUtcOffset_l = PLAT_htons(currentUtcOffset);
 	uint16_t stepsRemoved_l = PLAT_htons(stepsRemoved);
-	ClockQuality clockQuality_l = *grandmasterClockQuality;
+	ClockQuality clockQuality_l = grandmasterClockQuality;
 	clockQuality_l.offsetScaledLogVariance =
 	    PLAT_htons(clockQuality_l.offsetScaledLogVariance);
 
@@ -856,15 +981,11 @@ void PTPMessageAnnounce::processMessage( CommonPort *port )
 
 	port->incCounter_ieee8021AsPortStatRxAnnounce();
 
-	// Delete announce receipt timeout
-	port->getClock()->deleteEventTimerLocked
-		(port, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES);
-
 	if( stepsRemoved >= 255 ) goto bail;
 
 	// Reject Announce message from myself
 	my_clock_identity = port->getClock()->getClockIdentity();
-	if( sourcePortIdentity->getClockIdentity() == my_clock_identity ) {
+	if( sourcePortIdentity.getClockIdentity() == my_clock_identity ) {
 		goto bail;
 	}
 
@@ -877,9 +998,9 @@ void PTPMessageAnnounce::processMessage( CommonPort *port )
 
 	port->getClock()->addEventTimerLocked(port, STATE_CHANGE_EVENT, 16000000);
  bail:
-	port->getClock()->addEventTimerLocked
-		(port, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
-		 (unsigned long long)
+	// Restart announce receipt timeout
+	port->startAnnounceReceiptTimer
+		((unsigned long long)
 		 (ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLIER *
 		  (pow
 		   ((double)2,
@@ -955,7 +1076,7 @@ size_t PTPMessageFollowUp::buildMessage( CommonPort *port, uint8_t *buf_ptr )
 	Timestamp preciseOriginTimestamp_BE;
 
 	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildHeader(port, buf_ptr);
 	preciseOriginTimestamp_BE.seconds_ms =
 		PLAT_htons(preciseOriginTimestamp.seconds_ms);
 	preciseOriginTimestamp_BE.seconds_ls =
@@ -989,7 +1110,7 @@ bool PTPMessageFollowUp::sendPort
 {
 	uint8_t buf_t[256];
 	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	memset(buf_t, 0, 256);
+	memset(buf_t, 0, port->getPayloadOffset());
 	/* Create packet in buf
 	   Copy in common header */
 	buildMessage(port, buf_ptr);
@@ -1027,9 +1148,9 @@ void PTPMessageFollowUp::processMessage
 	signed long long local_system_offset;
 	signed long long scalar_offset;
 
-	FrequencyRatio local_clock_adjustment;
+	ScaledRateOffset local_clock_adjustment;
 	FrequencyRatio local_system_freq_offset;
-	FrequencyRatio master_local_freq_offset;
+	ScaledRateOffset master_local_rate_offset;
 	int64_t correction;
 	int32_t scaledLastGmFreqChange = 0;
 	scaledNs scaledLastGmPhaseChange;
@@ -1043,10 +1164,8 @@ void PTPMessageFollowUp::processMessage
 		goto done;
 	}
 
-	master_local_freq_offset = tlv.getRateOffset();
-	master_local_freq_offset /= 1ULL << 41;
-	master_local_freq_offset += 1.0;
-	master_local_freq_offset /= port->getPeerRateOffset();
+	master_local_rate_offset = rateOffsetDivide
+		( tlv.getRateOffset(), port->getPeerRateOffset() );
 
 	correctionField /= 1 << 16;
 	if( correctionField < 0 )
@@ -1063,8 +1182,8 @@ void PTPMessageFollowUp::processMessage
 			goto done;
 		}
 	}
-	correction = (int64_t)
-		((delay * master_local_freq_offset) + correctionField);
+	correction = rateOffsetApply
+		( (int64_t) delay, master_local_rate_offset ) + correctionField;
 
 	if (correction > 0)
 		TIMESTAMP_ADD_NS(preciseOriginTimestamp, correction);
@@ -1115,7 +1234,7 @@ void PTPMessageFollowUp::processMessage
 
 	/*Update information on local status structure.*/
 	scaledLastGmFreqChange = (int32_t)
-		((1.0 / local_clock_adjustment - 1.0) * (1ULL << 41));
+		rateOffsetInvert( local_clock_adjustment );
 	scaledLastGmPhaseChange.setLSB(tlv.getRateOffset( ));
 	port->getClock()->getFUPStatus()->setScaledLastGmFreqChange
 		( scaledLastGmFreqChange );
@@ -1215,7 +1334,7 @@ void PTPMessageFollowUp::processMessage( CommonPort *port )
 		sync->getPortIdentity(&sync_id);
 
 		if( sync->getSequenceId() != sequenceId ||
-		    sync_id != *sourcePortIdentity )
+		    sync_id != sourcePortIdentity )
 		{
 			unsigned int cnt = 0;
 
@@ -1259,13 +1378,6 @@ PTPMessagePathDelayReq::PTPMessagePathDelayReq
 
 void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 {
-	OSTimer *timer = port->getTimerFactory()->createTimer();
-	PortIdentity resp_fwup_id;
-	PortIdentity requestingPortIdentity_p;
-	PTPMessagePathDelayResp *resp;
-	PortIdentity resp_id;
-	PTPMessagePathDelayRespFollowUp *resp_fwup;
-
 	EtherPort *eport = dynamic_cast <EtherPort *> (port);
 	if (eport == NULL)
 	{
@@ -1273,21 +1385,37 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 		goto done;
 	}
 
+	processRequest( eport, &sourcePortIdentity, sequenceId, _timestamp );
+
+done:
+	_gc = true;
+	return;
+}
+
+void PTPMessagePathDelayReq::processRequest
+( EtherPort *port, PortIdentity *requester, uint16_t sequenceId,
+  Timestamp receipt )
+{
+	PortIdentity resp_fwup_id;
+	PTPMessagePathDelayResp *resp;
+	PortIdentity resp_id;
+	PTPMessagePathDelayRespFollowUp *resp_fwup;
+
 	if (port->getPortState() == PTP_DISABLED) {
 		// Do nothing all messages should be ignored when in this state
-		goto done;
+		return;
 	}
 
 	if (port->getPortState() == PTP_FAULTY) {
 		// According to spec recovery is implementation specific
-		eport->recoverPort();
-		goto done;
+		port->recoverPort();
+		return;
 	}
 
 	port->incCounter_ieee8021AsPortStatRxPdelayRequest();
 
 	/* Generate and send message */
-	resp = new PTPMessagePathDelayResp(eport);
+	resp = new (port->getMessagePool()) PTPMessagePathDelayResp(port);
 	port->getPortIdentity(resp_id);
 	resp->setPortIdentity(&resp_id);
 	resp->setSequenceId(sequenceId);
@@ -1300,59 +1428,54 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 	}
 #endif
 
-	this->getPortIdentity(&requestingPortIdentity_p);
-	resp->setRequestingPortIdentity(&requestingPortIdentity_p);
-	resp->setRequestReceiptTimestamp(_timestamp);
+	resp->setRequestingPortIdentity(requester);
+	resp->setRequestReceiptTimestamp(receipt);
 
 	port->getTxLock();
-	resp->sendPort(eport, sourcePortIdentity);
+	resp->sendPort(port, requester);
 	GPTP_LOG_DEBUG("*** Sent PDelay Response message");
 	port->putTxLock();
 
-	if( resp->getTimestamp()._version != _timestamp._version ) {
+	if( resp->getTimestamp()._version != receipt._version ) {
 		GPTP_LOG_ERROR("TX timestamp version mismatch: %u/%u",
-			       resp->getTimestamp()._version, _timestamp._version);
+			       resp->getTimestamp()._version, receipt._version);
 #if 0 // discarding the request could lead to the peer setting the link to non-asCapable
 		delete resp;
-		goto done;
+		return;
 #endif
 	}
 
-	resp_fwup = new PTPMessagePathDelayRespFollowUp(eport);
+	resp_fwup = new (port->getMessagePool())
+		PTPMessagePathDelayRespFollowUp(port);
 	port->getPortIdentity(resp_fwup_id);
 	resp_fwup->setPortIdentity(&resp_fwup_id);
 	resp_fwup->setSequenceId(sequenceId);
-	resp_fwup->setRequestingPortIdentity(sourcePortIdentity);
+	resp_fwup->setRequestingPortIdentity(requester);
 	resp_fwup->setResponseOriginTimestamp(resp->getTimestamp());
 	long long turnaround;
-	turnaround = (resp->getTimestamp().seconds_ls - _timestamp.seconds_ls)
+	turnaround = (resp->getTimestamp().seconds_ls - receipt.seconds_ls)
 		* 1000000000LL;
 
 	GPTP_LOG_VERBOSE("Response Depart(sec): %u",
 			 resp->getTimestamp().seconds_ls);
-	GPTP_LOG_VERBOSE("Request Arrival(sec): %u", _timestamp.seconds_ls);
+	GPTP_LOG_VERBOSE("Request Arrival(sec): %u", receipt.seconds_ls);
 	GPTP_LOG_VERBOSE("#1 Correction Field: %Ld", turnaround);
 
 	turnaround += resp->getTimestamp().nanoseconds;
 
 	GPTP_LOG_VERBOSE("#2 Correction Field: %Ld", turnaround);
 
-	turnaround -= _timestamp.nanoseconds;
+	turnaround -= receipt.nanoseconds;
 
 	GPTP_LOG_VERBOSE("#3 Correction Field: %Ld", turnaround);
 
 	resp_fwup->setCorrectionField(0);
-	resp_fwup->sendPort(eport, sourcePortIdentity);
+	resp_fwup->sendPort(port, requester);
 
 	GPTP_LOG_DEBUG("*** Sent PDelay Response FollowUp message");
 
 	delete resp;
 	delete resp_fwup;
-
-done:
-	delete timer;
-	_gc = true;
-	return;
 }
 
 bool PTPMessagePathDelayReq::sendPort
@@ -1366,12 +1489,12 @@ bool PTPMessagePathDelayReq::sendPort
 	uint8_t buf_t[256];
 	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
 	unsigned char tspec_msg_t = 0;
-	memset(buf_t, 0, 256);
+	memset(buf_t, 0, port->getPayloadOffset());
 	/* Create packet in buf */
 	/* Copy in common header */
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_REQ_LENGTH;
 	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildHeader(port, buf_ptr);
 	port->sendEventPort
 		( PTP_ETHERTYPE, buf_t, messageLength, MCAST_PDELAY,
 		  destIdentity, &link_speed );
@@ -1388,7 +1511,6 @@ PTPMessagePathDelayResp::PTPMessagePathDelayResp
 	control = MESSAGE_OTHER;
 	messageType = PATH_DELAY_RESP_MESSAGE;
 	versionPTP = GPTP_VERSION;
-	requestingPortIdentity = new PortIdentity();
 
 	flags[PTP_ASSIST_BYTE] |= (0x1 << PTP_ASSIST_BIT);
 
@@ -1397,7 +1519,6 @@ PTPMessagePathDelayResp::PTPMessagePathDelayResp
 
 PTPMessagePathDelayResp::~PTPMessagePathDelayResp()
 {
-	delete requestingPortIdentity;
 }
 
 void PTPMessagePathDelayResp::processMessage( CommonPort *port )
@@ -1495,12 +1616,12 @@ bool PTPMessagePathDelayResp::sendPort
 	Timestamp requestReceiptTimestamp_BE;
 	uint32_t link_speed;
 
-	memset(buf_t, 0, 256);
+	memset(buf_t, 0, port->getPayloadOffset());
 	// Create packet in buf
 	// Copy in common header
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH;
 	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildHeader(port, buf_ptr);
 	requestReceiptTimestamp_BE.seconds_ms =
 	    PLAT_htons(requestReceiptTimestamp.seconds_ms);
 	requestReceiptTimestamp_BE.seconds_ls =
@@ -1509,10 +1630,10 @@ bool PTPMessagePathDelayResp::sendPort
 	    PLAT_htonl(requestReceiptTimestamp.nanoseconds);
 
 	// Copy in v2 PDelay_Req specific fields
-	requestingPortIdentity->getClockIdentityString
+	requestingPortIdentity.getClockIdentityString
 	  (buf_ptr + PTP_PDELAY_RESP_REQ_CLOCK_ID
 	   (PTP_PDELAY_RESP_OFFSET));
-	requestingPortIdentity->getPortNumberNO
+	requestingPortIdentity.getPortNumberNO
 		((uint16_t *)
 		 (buf_ptr + PTP_PDELAY_RESP_REQ_PORT_ID
 		  (PTP_PDELAY_RESP_OFFSET)));
@@ -1541,13 +1662,13 @@ bool PTPMessagePathDelayResp::sendPort
 void PTPMessagePathDelayResp::setRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*requestingPortIdentity = *identity;
+	requestingPortIdentity = *identity;
 }
 
 void PTPMessagePathDelayResp::getRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*identity = *requestingPortIdentity;
+	*identity = requestingPortIdentity;
 }
 
 PTPMessagePathDelayRespFollowUp::PTPMessagePathDelayRespFollowUp
@@ -1557,14 +1678,12 @@ PTPMessagePathDelayRespFollowUp::PTPMessagePathDelayRespFollowUp
 	control = MESSAGE_OTHER;
 	messageType = PATH_DELAY_FOLLOWUP_MESSAGE;
 	versionPTP = GPTP_VERSION;
-	requestingPortIdentity = new PortIdentity();
 
 	return;
 }
 
 PTPMessagePathDelayRespFollowUp::~PTPMessagePathDelayRespFollowUp()
 {
-	delete requestingPortIdentity;
 }
 
 #define US_PER_SEC 1000000
@@ -1643,7 +1762,7 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 		resp->getRequestingPortIdentity(&resp_id);
 
 		resp_id.getPortNumber(&resp_port_number);
-		requestingPortIdentity->getPortNumber(&req_port_number);
+		requestingPortIdentity.getPortNumber(&req_port_number);
 
 		resp->getPortIdentity(&resp_sourcePortIdentity);
 		getPortIdentity(&fup_sourcePortIdentity);
@@ -1705,6 +1824,7 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 	GPTP_LOG_VERBOSE("Follow-Up Sequence Id: %u", sequenceId);
 
 	int64_t link_delay;
+	int64_t filtered_delay;
 	unsigned long long turn_around;
 
 	/* Assume that we are a two step clock, otherwise originTimestamp
@@ -1764,22 +1884,17 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 		 remote_req_rx_timestamp.nanoseconds);
 
 	// Adjust turn-around time for peer to local clock rate difference
-	// TODO: Are these .998 and 1.002 specifically defined in the standard?
-	// Should we create a define for them ?
+	// TODO: Is the 2000 ppm bound specifically defined in the standard?
 	if
-		( port->getPeerRateOffset() > .998 &&
-		  port->getPeerRateOffset() < 1.002 ) {
-		turn_around = (int64_t)
-			(turn_around * port->getPeerRateOffset());
+		( port->getPeerRateOffset() > PPM_TO_RATE_OFFSET(-2000) &&
+		  port->getPeerRateOffset() < PPM_TO_RATE_OFFSET(2000) ) {
+		turn_around = rateOffsetApply
+			( (int64_t) turn_around, port->getPeerRateOffset() );
 	}
 
 	GPTP_LOG_VERBOSE
 		("Turn Around Adjustment %Lf",
-		 ((long long)turn_around * port->getPeerRateOffset()) /
-		 1000000000000LL);
-	GPTP_LOG_VERBOSE
-		("Step #1: Turn Around Adjustment %Lf",
-		 ((long long)turn_around * port->getPeerRateOffset()));
+		 rateOffsetToRatio( port->getPeerRateOffset() ));
 	GPTP_LOG_VERBOSE("Adjusted Peer turn around is %Lu", turn_around);
 
 	/* Subtract turn-around time from link delay after rate adjustment */
@@ -1787,41 +1902,52 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 	link_delay /= 2;
 	GPTP_LOG_DEBUG( "Link delay: %ld ns", link_delay );
 
+	// An outlier (a queued response) changes neither the link delay nor
+	// the neighbor rate ratio; keeping the previous peer timestamps also
+	// measures the next rate ratio over a longer baseline. The rate ratio
+	// is measured with the raw samples, each of which belongs to its
+	// exchange's timestamps.
+	if( !port->filterLinkDelay( link_delay, filtered_delay ))
+	{
+		GPTP_LOG_VERBOSE( "Link delay sample rejected, filtered "
+				  "link delay %ld ns", filtered_delay );
+		goto abort;
+	}
+
 	{
 		uint64_t mine_elapsed;
 		uint64_t theirs_elapsed;
 		Timestamp prev_peer_ts_mine;
 		Timestamp prev_peer_ts_theirs;
-		FrequencyRatio rate_offset;
-		if( port->getPeerOffset( prev_peer_ts_mine, prev_peer_ts_theirs )) {
-			FrequencyRatio upper_ratio_limit, lower_ratio_limit;
-			upper_ratio_limit =
-				PPM_OFFSET_TO_RATIO(UPPER_LIMIT_PPM);
-			lower_ratio_limit =
-				PPM_OFFSET_TO_RATIO(LOWER_LIMIT_PPM);
+		int64_t prev_link_delay;
+		ScaledRateOffset rate_offset;
+		if( port->getPeerOffset
+		    ( prev_peer_ts_mine, prev_peer_ts_theirs,
+		      prev_link_delay )) {
 
 			mine_elapsed =  TIMESTAMP_TO_NS(request_tx_timestamp) -
 				TIMESTAMP_TO_NS(prev_peer_ts_mine);
 			theirs_elapsed =
 				TIMESTAMP_TO_NS(remote_req_rx_timestamp) -
 				TIMESTAMP_TO_NS(prev_peer_ts_theirs);
-			theirs_elapsed -= port->getLinkDelay();
+			theirs_elapsed -=
+				prev_link_delay < 0 ? 0 : prev_link_delay;
 			theirs_elapsed += link_delay < 0 ? 0 : link_delay;
-			rate_offset =  ((FrequencyRatio) mine_elapsed)
-						       / theirs_elapsed;
+			rate_offset = rateOffsetFromElapsed
+				( mine_elapsed, theirs_elapsed );
 
-			if( rate_offset < upper_ratio_limit &&
-			    rate_offset > lower_ratio_limit )
+			if( rate_offset < PPM_TO_RATE_OFFSET(UPPER_LIMIT_PPM) &&
+			    rate_offset > PPM_TO_RATE_OFFSET(LOWER_LIMIT_PPM) )
 				port->setPeerRateOffset(rate_offset);
 		}
 	}
-	if( !port->setLinkDelay( link_delay ))
+	if( !port->setLinkDelay( filtered_delay ))
 	{
 		if( !eport->getAutomotiveProfile( ))
 		{
 			GPTP_LOG_ERROR( "Link delay %ld beyond "
 					"neighborPropDelayThresh; "
-					"not AsCapable", link_delay );
+					"not AsCapable", filtered_delay );
 			port->setAsCapable( false );
 		}
 	} else
@@ -1829,7 +1955,8 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 		if( !eport->getAutomotiveProfile( ))
 			port->setAsCapable( true );
 	}
-	port->setPeerOffset( request_tx_timestamp, remote_req_rx_timestamp );
+	port->setPeerOffset
+		( request_tx_timestamp, remote_req_rx_timestamp, link_delay );
 
  abort:
 	delete resp;
@@ -1850,12 +1977,12 @@ bool PTPMessagePathDelayRespFollowUp::sendPort
 	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
 	unsigned char tspec_msg_t = 0;
 	Timestamp responseOriginTimestamp_BE;
-	memset(buf_t, 0, 256);
+	memset(buf_t, 0, port->getPayloadOffset());
 	/* Create packet in buf
 	   Copy in common header */
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH;
 	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildHeader(port, buf_ptr);
 	responseOriginTimestamp_BE.seconds_ms =
 		PLAT_htons(responseOriginTimestamp.seconds_ms);
 	responseOriginTimestamp_BE.seconds_ls =
@@ -1864,10 +1991,10 @@ bool PTPMessagePathDelayRespFollowUp::sendPort
 		PLAT_htonl(responseOriginTimestamp.nanoseconds);
 
 	// Copy in v2 PDelay_Req specific fields
-	requestingPortIdentity->getClockIdentityString
+	requestingPortIdentity.getClockIdentityString
 		(buf_ptr + PTP_PDELAY_FOLLOWUP_REQ_CLOCK_ID
 		 (PTP_PDELAY_FOLLOWUP_OFFSET));
-	requestingPortIdentity->getPortNumberNO
+	requestingPortIdentity.getPortNumberNO
 		((uint16_t *)
 		 (buf_ptr + PTP_PDELAY_FOLLOWUP_REQ_PORT_ID
 		  (PTP_PDELAY_FOLLOWUP_OFFSET)));
@@ -1897,7 +2024,7 @@ bool PTPMessagePathDelayRespFollowUp::sendPort
 void PTPMessagePathDelayRespFollowUp::setRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*requestingPortIdentity = *identity;
+	requestingPortIdentity = *identity;
 }
 
 
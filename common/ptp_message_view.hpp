@@ -0,0 +1,420 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef PTP_MESSAGE_VIEW_HPP
+#define PTP_MESSAGE_VIEW_HPP
+
+/**@file*/
+
+#include <stdint.h>
+#include <string.h>
+#include <avbts_message.hpp>
+
+#define PTP_TLV_HEADER_LENGTH 4	/*!< tlvType and lengthField */
+
+/**
+ * @brief Location of a TLV inside a PTPMessageView
+ */
+typedef struct {
+	uint16_t type;		//!< tlvType
+	uint16_t length;	//!< lengthField, size of the value in bytes
+	size_t value_offset;	//!< Offset of the value from the start of the message
+} PTPTLVView;
+
+/**
+ * @brief Non-owning, bounds checked view over a received PTP message.
+ * Accessors decode fields in place from network byte order; reads outside
+ * the frame return zero, so a frame passing isValid() can be decoded
+ * without further length checks. The view must not outlive the buffer.
+ */
+class PTPMessageView {
+private:
+	const uint8_t *buf;
+	size_t length;
+
+public:
+	/**
+	 * @brief  Creates a view over a received frame
+	 * @param  buf [in] Start of the PTP common header
+	 * @param  length Number of valid bytes at buf
+	 */
+	PTPMessageView( const uint8_t *buf, size_t length )
+	{
+		this->buf = buf;
+		this->length = length;
+	}
+
+	/**
+	 * @brief  Gets the start of the viewed frame
+	 * @return Pointer to the first byte of the PTP common header
+	 */
+	const uint8_t *data() const
+	{
+		return buf;
+	}
+
+	/**
+	 * @brief  Gets the size of the viewed frame
+	 * @return Number of bytes
+	 */
+	size_t size() const
+	{
+		return length;
+	}
+
+	/**
+	 * @brief  Checks that a field lies inside the frame
+	 * @param  offset Field offset
+	 * @param  count Field size in bytes
+	 * @return TRUE if the whole field can be read
+	 */
+	bool has( size_t offset, size_t count ) const
+	{
+		return offset <= length && count <= length - offset;
+	}
+
+	/**
+	 * @brief  Reads an 8 bit field
+	 * @param  offset Field offset
+	 * @return Field value, 0 if out of bounds
+	 */
+	uint8_t getUint8( size_t offset ) const
+	{
+		return has( offset, 1 ) ? buf[offset] : 0;
+	}
+
+	/**
+	 * @brief  Reads a 16 bit network byte order field
+	 * @param  offset Field offset
+	 * @return Field value in host byte order, 0 if out of bounds
+	 */
+	uint16_t getUint16( size_t offset ) const
+	{
+		if( !has( offset, 2 ))
+			return 0;
+		return (uint16_t)(( buf[offset] << 8 ) | buf[offset+1] );
+	}
+
+	/**
+	 * @brief  Reads a 32 bit network byte order field
+	 * @param  offset Field offset
+	 * @return Field value in host byte order, 0 if out of bounds
+	 */
+	uint32_t getUint32( size_t offset ) const
+	{
+		if( !has( offset, 4 ))
+			return 0;
+		return
+			((uint32_t) buf[offset] << 24 ) |
+			((uint32_t) buf[offset+1] << 16 ) |
+			((uint32_t) buf[offset+2] << 8 ) |
+			(uint32_t) buf[offset+3];
+	}
+
+	/**
+	 * @brief  Reads a 64 bit network byte order field
+	 * @param  offset Field offset
+	 * @return Field value in host byte order, 0 if out of bounds
+	 */
+	uint64_t getUint64( size_t offset ) const
+	{
+		if( !has( offset, 8 ))
+			return 0;
+		return
+			((uint64_t) getUint32( offset ) << 32 ) |
+			getUint32( offset + 4 );
+	}
+
+	/**
+	 * @brief  Copies raw bytes, e.g. into a wire format structure
+	 * @param  offset Offset of the first byte
+	 * @param  dest [out] Destination buffer
+	 * @param  count Number of bytes
+	 * @return FALSE (and nothing copied) if out of bounds
+	 */
+	bool getBytes( size_t offset, void *dest, size_t count ) const
+	{
+		if( !has( offset, count ))
+			return false;
+		memcpy( dest, buf + offset, count );
+		return true;
+	}
+
+	/**
+	 * @brief  Reads a 10 byte PTP timestamp
+	 * @param  offset Field offset
+	 * @return Timestamp, zero if out of bounds
+	 */
+	Timestamp getTimestamp( size_t offset ) const
+	{
+		return Timestamp
+			( getUint32( offset + 6 ), getUint32( offset + 2 ),
+			  getUint16( offset ));
+	}
+
+	/**
+	 * @brief  Reads a 10 byte port identity
+	 * @param  offset Field offset
+	 * @param  identity [out] Port identity
+	 * @return FALSE if out of bounds
+	 */
+	bool getPortIdentity( size_t offset, PortIdentity &identity ) const
+	{
+		uint8_t clock_id[PTP_CLOCK_IDENTITY_LENGTH];
+		uint16_t port_number;
+
+		if( !has( offset, PTP_CLOCK_IDENTITY_LENGTH + 2 ))
+			return false;
+		memcpy( clock_id, buf + offset, PTP_CLOCK_IDENTITY_LENGTH );
+		memcpy( &port_number, buf + offset + PTP_CLOCK_IDENTITY_LENGTH,
+			sizeof( port_number ));
+		identity = PortIdentity( clock_id, &port_number );
+
+		return true;
+	}
+
+	/**
+	 * @brief  Gets the transportSpecific header field
+	 * @return transportSpecific
+	 */
+	uint8_t getTransportSpecific() const
+	{
+		return getUint8
+			( PTP_COMMON_HDR_TRANSSPEC_MSGTYPE
+			  (PTP_COMMON_HDR_OFFSET) ) >> 4;
+	}
+
+	/**
+	 * @brief  Gets the messageType header field
+	 * @return messageType
+	 */
+	MessageType getMessageType() const
+	{
+		return (MessageType) ( getUint8
+			( PTP_COMMON_HDR_TRANSSPEC_MSGTYPE
+			  (PTP_COMMON_HDR_OFFSET) ) & 0xF );
+	}
+
+	/**
+	 * @brief  Checks for an event message (one carrying a timestamp)
+	 * @return TRUE for Sync, Delay_Req, Pdelay_Req and Pdelay_Resp
+	 */
+	bool isEvent() const
+	{
+		return ( getMessageType() >> 3 ) == 0;
+	}
+
+	/**
+	 * @brief  Gets the versionPTP header field
+	 * @return versionPTP
+	 */
+	uint8_t getVersionPTP() const
+	{
+		return getUint8
+			( PTP_COMMON_HDR_PTP_VERSION(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the messageLength header field
+	 * @return messageLength
+	 */
+	uint16_t getMessageLength() const
+	{
+		return getUint16
+			( PTP_COMMON_HDR_MSG_LENGTH(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the domainNumber header field
+	 * @return domainNumber
+	 */
+	uint8_t getDomainNumber() const
+	{
+		return getUint8
+			( PTP_COMMON_HDR_DOMAIN_NUMBER(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Copies the two flag octets
+	 * @param  flags [out] Flags, PTP_FLAGS_LENGTH bytes
+	 * @return void
+	 */
+	void getFlags( unsigned char *flags ) const
+	{
+		if( !getBytes
+		    ( PTP_COMMON_HDR_FLAGS(PTP_COMMON_HDR_OFFSET), flags,
+		      PTP_FLAGS_LENGTH ))
+			memset( flags, 0, PTP_FLAGS_LENGTH );
+	}
+
+	/**
+	 * @brief  Gets the correctionField header field
+	 * @return correctionField (scaled nanoseconds)
+	 */
+	int64_t getCorrectionField() const
+	{
+		return (int64_t) getUint64
+			( PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the sourcePortIdentity header field
+	 * @param  identity [out] Source port identity
+	 * @return void
+	 */
+	void getSourcePortIdentity( PortIdentity &identity ) const
+	{
+		getPortIdentity
+			( PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET),
+			  identity );
+	}
+
+	/**
+	 * @brief  Gets the sequenceId header field
+	 * @return sequenceId
+	 */
+	uint16_t getSequenceId() const
+	{
+		return getUint16
+			( PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the message identity (type and sequence id)
+	 * @return PTPMessageId
+	 */
+	PTPMessageId getMessageId() const
+	{
+		return PTPMessageId( getMessageType(), getSequenceId() );
+	}
+
+	/**
+	 * @brief  Gets the control header field
+	 * @return control
+	 */
+	uint8_t getControl() const
+	{
+		return getUint8
+			( PTP_COMMON_HDR_CONTROL(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the logMessageInterval header field
+	 * @return logMessageInterval
+	 */
+	int8_t getLogMeanMessageInterval() const
+	{
+		return (int8_t) getUint8
+			( PTP_COMMON_HDR_LOG_MSG_INTRVL(PTP_COMMON_HDR_OFFSET) );
+	}
+
+	/**
+	 * @brief  Gets the fixed body length of a message type
+	 * @param  type Message type
+	 * @return Body length in bytes, 0 for unsupported types
+	 */
+	static size_t getBodyLength( MessageType type )
+	{
+		switch( type ) {
+		case SYNC_MESSAGE:
+			return PTP_SYNC_LENGTH;
+		case FOLLOWUP_MESSAGE:
+			return PTP_FOLLOWUP_LENGTH;
+		case PATH_DELAY_REQ_MESSAGE:
+			return PTP_PDELAY_REQ_LENGTH;
+		case PATH_DELAY_RESP_MESSAGE:
+			return PTP_PDELAY_RESP_LENGTH;
+		case PATH_DELAY_FOLLOWUP_MESSAGE:
+			return PTP_PDELAY_FOLLOWUP_LENGTH;
+		case ANNOUNCE_MESSAGE:
+			return PTP_ANNOUNCE_LENGTH;
+		case SIGNALLING_MESSAGE:
+			return PTP_SIGNALLING_LENGTH;
+		default:
+			return 0;
+		}
+	}
+
+	/**
+	 * @brief  Checks that the frame holds the common header and the fixed
+	 * body of its message type
+	 * @return TRUE if the header and body can be decoded
+	 */
+	bool isValid() const
+	{
+		MessageType type;
+
+		if( !has( PTP_COMMON_HDR_OFFSET, PTP_COMMON_HDR_LENGTH ))
+			return false;
+		type = getMessageType();
+		if( getBodyLength( type ) == 0 )
+			return false;
+		/* For Broadcom compatibility */
+		if( type == PATH_DELAY_REQ_MESSAGE &&
+		    length == PTP_COMMON_HDR_LENGTH + 12 )
+			return true;
+
+		return has( PTP_COMMON_HDR_LENGTH, getBodyLength( type ));
+	}
+
+	/**
+	 * @brief  Gets the offset of the first TLV
+	 * @return Offset just past the fixed body
+	 */
+	size_t getTLVOffset() const
+	{
+		return PTP_COMMON_HDR_LENGTH + getBodyLength( getMessageType() );
+	}
+
+	/**
+	 * @brief  Walks the TLV chain. Start with offset = getTLVOffset().
+	 * @param  offset [inout] Offset of the TLV, advanced past it on return
+	 * @param  tlv [out] TLV type, length and value location
+	 * @return FALSE at the end of the chain or if the TLV is truncated
+	 */
+	bool nextTLV( size_t &offset, PTPTLVView &tlv ) const
+	{
+		if( !has( offset, PTP_TLV_HEADER_LENGTH ))
+			return false;
+		tlv.type = getUint16( offset );
+		tlv.length = getUint16( offset + 2 );
+		tlv.value_offset = offset + PTP_TLV_HEADER_LENGTH;
+		if( !has( tlv.value_offset, tlv.length ))
+			return false;
+		offset = tlv.value_offset + tlv.length;
+
+		return true;
+	}
+};
+
+#endif/*PTP_MESSAGE_VIEW_HPP*/
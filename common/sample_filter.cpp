@@ -0,0 +1,172 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#include <sample_filter.hpp>
+#include <gptp_log.hpp>
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+
+SampleFilter::SampleFilter()
+{
+	memset( &config, 0, sizeof( config ));
+	memset( &stats, 0, sizeof( stats ));
+	config.type = SAMPLE_FILTER_NONE;
+	config.window = SAMPLE_FILTER_WINDOW_DEFAULT;
+	head = 0;
+	count = 0;
+	rejected_run = 0;
+}
+
+void SampleFilter::configure( const sample_filter_config_t &config )
+{
+	this->config = config;
+	if( this->config.window == 0 )
+		this->config.window = 1;
+	if( this->config.window > SAMPLE_FILTER_WINDOW_MAX )
+		this->config.window = SAMPLE_FILTER_WINDOW_MAX;
+	if( this->config.percentile > 100 )
+		this->config.percentile = 100;
+	reset();
+}
+
+int64_t SampleFilter::statistic() const
+{
+	int64_t sorted[SAMPLE_FILTER_WINDOW_MAX];
+	unsigned rank;
+
+	switch( config.type ) {
+	case SAMPLE_FILTER_MIN:
+		return *std::min_element( window, window + count );
+	case SAMPLE_FILTER_MEDIAN:
+		rank = count / 2;
+		break;
+	case SAMPLE_FILTER_PERCENTILE:
+	default:
+		rank = ( config.percentile * ( count - 1 ) + 50 ) / 100;
+		break;
+	}
+
+	memcpy( sorted, window, count * sizeof( *sorted ));
+	std::nth_element( sorted, sorted + rank, sorted + count );
+
+	return sorted[rank];
+}
+
+bool SampleFilter::sample( int64_t value, int64_t &filtered, bool reject )
+{
+	int64_t deviation;
+
+	++stats.samples;
+	if( config.type == SAMPLE_FILTER_NONE ) {
+		filtered = value;
+		return true;
+	}
+
+	window[head] = value;
+	head = ( head + 1 ) % config.window;
+	if( count < config.window )
+		++count;
+
+	filtered = statistic();
+	deviation = value > filtered ? value - filtered : filtered - value;
+	if( deviation > stats.max_deviation )
+		stats.max_deviation = deviation;
+
+	if( !reject || config.reject == 0 || deviation <= config.reject ||
+	    count < SAMPLE_FILTER_HISTORY_MIN ) {
+		rejected_run = 0;
+		return true;
+	}
+
+	if( rejected_run >= config.window / 2 ) {
+		rejected_run = 0;
+		++stats.forced;
+		return true;
+	}
+	++rejected_run;
+	++stats.rejected;
+
+	return false;
+}
+
+void SampleFilter::logStatistics( const char *name ) const
+{
+	if( config.type == SAMPLE_FILTER_NONE )
+		return;
+
+	GPTP_LOG_STATUS
+		( "%s filter: samples %llu, rejected %llu, accepted after "
+		  "rejections %llu, max deviation %lld ns", name,
+		  (unsigned long long) stats.samples,
+		  (unsigned long long) stats.rejected,
+		  (unsigned long long) stats.forced,
+		  (long long) stats.max_deviation );
+}
+
+bool parseSampleFilterType( const char *name, sample_filter_config_t *config )
+{
+	char *end;
+	unsigned long percentile;
+
+	if( strcasecmp( name, "none" ) == 0 ) {
+		config->type = SAMPLE_FILTER_NONE;
+		return true;
+	}
+	if( strcasecmp( name, "min" ) == 0 ) {
+		config->type = SAMPLE_FILTER_MIN;
+		return true;
+	}
+	if( strcasecmp( name, "median" ) == 0 ) {
+		config->type = SAMPLE_FILTER_MEDIAN;
+		return true;
+	}
+	if( name[0] == 'p' || name[0] == 'P' ) {
+		percentile = strtoul( name + 1, &end, 10 );
+		if( end != name + 1 && *end == '\0' && percentile <= 100 ) {
+			config->type = SAMPLE_FILTER_PERCENTILE;
+			config->percentile = (unsigned) percentile;
+			return true;
+		}
+	}
+
+	return false;
+}
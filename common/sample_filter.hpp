@@ -0,0 +1,167 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef SAMPLE_FILTER_HPP
+#define SAMPLE_FILTER_HPP
+
+/**@file*/
+
+#include <stdint.h>
+
+#define SAMPLE_FILTER_WINDOW_MAX 64	/*!< Largest sample filter window */
+#define SAMPLE_FILTER_WINDOW_DEFAULT 8	/*!< Default sample filter window */
+#define SAMPLE_FILTER_HISTORY_MIN 3	/*!< Samples needed before any is rejected */
+
+/**
+ * @brief Statistic a sample filter computes over its window
+ */
+typedef enum {
+	SAMPLE_FILTER_NONE = 0,		//!< Samples pass unchanged
+	SAMPLE_FILTER_MIN,		//!< Smallest sample ("lucky packet")
+	SAMPLE_FILTER_MEDIAN,		//!< Median
+	SAMPLE_FILTER_PERCENTILE,	//!< Configured percentile
+} sample_filter_type_t;
+
+/**
+ * @brief Sample filter configuration
+ */
+typedef struct {
+	sample_filter_type_t type;	//!< Statistic over the window
+	unsigned percentile;		//!< Percentile for SAMPLE_FILTER_PERCENTILE (0-100)
+	unsigned window;		//!< Samples in the window
+	int64_t reject;			//!< Samples further than this from the statistic are rejected, 0 disables
+} sample_filter_config_t;
+
+/**
+ * @brief Statistics collected by SampleFilter
+ */
+typedef struct {
+	uint64_t samples;	//!< Samples filtered
+	uint64_t rejected;	//!< Samples rejected
+	uint64_t forced;	//!< Outliers accepted after consecutive rejections
+	int64_t max_deviation;	//!< Largest distance of a sample from the statistic
+} sample_filter_stats_t;
+
+/**
+ * @brief SampleFilter: sliding window pre-filter for timing samples. Each
+ * sample enters the window, then the window statistic (minimum, median or
+ * a percentile) is computed. A sample further than the rejection
+ * threshold from the statistic is rejected. Rejected samples still enter
+ * the window, and after half a window of consecutive rejections the next
+ * sample is accepted, so a lasting change of the measured value is
+ * followed rather than rejected indefinitely.
+ */
+class SampleFilter {
+public:
+	/**
+	 * @brief  Default constructor, the filter passes samples unchanged
+	 */
+	SampleFilter();
+
+	/**
+	 * @brief  Sets the configuration and empties the window
+	 * @param  config Filter configuration, the window is limited to
+	 * SAMPLE_FILTER_WINDOW_MAX
+	 * @return void
+	 */
+	void configure( const sample_filter_config_t &config );
+
+	/**
+	 * @brief  Empties the window, for example after a phase step
+	 * @return void
+	 */
+	void reset()
+	{
+		head = 0;
+		count = 0;
+		rejected_run = 0;
+	}
+
+	/**
+	 * @brief  Checks if the filter does anything
+	 * @return FALSE if samples pass unchanged
+	 */
+	bool enabled() const
+	{
+		return config.type != SAMPLE_FILTER_NONE;
+	}
+
+	/**
+	 * @brief  Filters a sample
+	 * @param  value Sample
+	 * @param  filtered [out] Window statistic, value if the filter is
+	 * disabled
+	 * @param  reject FALSE only adds the sample to the window
+	 * @return FALSE if the sample is rejected
+	 */
+	bool sample( int64_t value, int64_t &filtered, bool reject = true );
+
+	/**
+	 * @brief  Gets the filter statistics
+	 * @return Reference to the statistics
+	 */
+	const sample_filter_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the filter statistics
+	 * @param  name Name of the filtered quantity
+	 * @return void
+	 */
+	void logStatistics( const char *name ) const;
+
+private:
+	sample_filter_config_t config;
+	sample_filter_stats_t stats;
+
+	int64_t window[SAMPLE_FILTER_WINDOW_MAX];
+	unsigned head;
+	unsigned count;
+	unsigned rejected_run;
+
+	int64_t statistic() const;
+};
+
+/**
+ * @brief  Parses a sample filter type: none, min, median or pNN for the
+ * NNth percentile
+ * @param  name Name from the configuration file
+ * @param  config [out] type and percentile are set
+ * @return FALSE if the name is unknown
+ */
+bool parseSampleFilterType( const char *name, sample_filter_config_t *config );
+
+#endif/*SAMPLE_FILTER_HPP*/
@@ -106,7 +106,7 @@ bool WirelessPort::_processEvent( Event e )
 
 		if( prev_dialog.dialog_token != 0 )
 		{
-			follow_up = new PTPMessageFollowUp( this );
+			follow_up = new (message_pool) PTPMessageFollowUp( this );
 
 			getPortIdentity(dest_id);
 			follow_up->setPortIdentity(&dest_id);
@@ -147,7 +147,7 @@ bool WirelessPort::openPort()
 
 	while (true)
 	{
-		uint8_t buf[128];
+		uint8_t buf[PTP_MAX_MESSAGE_LENGTH];
 		LinkLayerAddress remote;
 		net_result rrecv;
 		size_t length = sizeof(buf);
@@ -227,7 +227,7 @@ void WirelessPort::becomeMaster(bool annc)
 {
 	setPortState( PTP_MASTER );
 	// Stop announce receipt timeout timer
-	clock->deleteEventTimerLocked( this, ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES);
+	stopAnnounceReceiptTimer();
 
 	// Stop sync receipt timeout timer
 	stopSyncReceiptTimer();
@@ -0,0 +1,554 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+/*
+ * Unit tests for the fixed point helpers, the sample filter, the message
+ * view and the clock servos. Prints every failed check and exits non-zero
+ * if there was one.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avbts_clock.hpp>
+#include <avbts_message.hpp>
+#include <clock_servo.hpp>
+#include <fixed_point.hpp>
+#include <ptp_message_view.hpp>
+#include <sample_filter.hpp>
+
+#define SERVO_SAMPLES 400		/*!< Samples fed to each servo */
+#define SERVO_LOG_INTERVAL -3		/*!< logSyncInterval fed to the servos */
+#define SERVO_INTERVAL_NS 125000000	/*!< Sync interval fed to the servos */
+
+static unsigned checks;
+static unsigned failures;
+
+static void check( bool ok, const char *expr, const char *file, int line )
+{
+	++checks;
+	if( !ok ) {
+		++failures;
+		fprintf( stderr, "%s:%d: check failed: %s\n", file, line, expr );
+	}
+}
+
+#define CHECK(expr) check( (expr), #expr, __FILE__, __LINE__ )
+
+static uint64_t random_state = 0x2545F4914F6CDD1DULL;
+
+/* Deterministic, every run sees the same input */
+static uint64_t nextRandom( void )
+{
+	random_state = random_state * 6364136223846793005ULL +
+		1442695040888963407ULL;
+	return random_state >> 11;
+}
+
+/* Uniform in [-range, range] */
+static int64_t randomRange( int64_t range )
+{
+	return (int64_t)( nextRandom() % ( 2 * (uint64_t) range + 1 )) - range;
+}
+
+static void testMulDiv( void )
+{
+	int i;
+
+	// Rounding, halves away from zero
+	CHECK( mulDiv64( 5, 1, 2 ) == 3 );
+	CHECK( mulDiv64( -5, 1, 2 ) == -3 );
+	CHECK( mulDiv64( 4, 1, 3 ) == 1 );
+	CHECK( mulDiv64( -4, 1, 3 ) == -1 );
+	CHECK( mulDiv64( 7, -3, 2 ) == -11 );
+	CHECK( mulDiv64Portable( 5, 1, 2 ) == 3 );
+	CHECK( mulDiv64Portable( -5, 1, 2 ) == -3 );
+	CHECK( mulDiv64Portable( 7, -3, 2 ) == -11 );
+
+	// Products beyond 64 bits
+	CHECK( mulDiv64( INT64_MAX, RATE_OFFSET_ONE, RATE_OFFSET_ONE ) ==
+	       INT64_MAX );
+	CHECK( mulDiv64Portable
+	       ( INT64_MAX, RATE_OFFSET_ONE, RATE_OFFSET_ONE ) == INT64_MAX );
+	CHECK( mulDiv64( -INT64_MAX, 3, 3 ) == -INT64_MAX );
+	CHECK( mulDiv64Portable( -INT64_MAX, 3, 3 ) == -INT64_MAX );
+
+	// The portable form gives the 128 bit result
+	for( i = 0; i < 100000; ++i ) {
+		int64_t a, b, c;
+
+		a = randomRange( INT64_MAX >> ( nextRandom() % 63 ));
+		b = randomRange( INT64_MAX >> ( nextRandom() % 63 ));
+		c = 1 + (int64_t)( nextRandom() >> ( nextRandom() % 53 ));
+		// Keep the quotient within 64 bits
+		while( b != 0 && fabs( (double) a * b / c ) > 9.0e18 )
+			b /= 2;
+		if( mulDiv64( a, b, c ) != mulDiv64Portable( a, b, c )) {
+			CHECK( mulDiv64( a, b, c ) ==
+			       mulDiv64Portable( a, b, c ));
+			break;
+		}
+	}
+	CHECK( i == 100000 );
+}
+
+static void testRateOffset( void )
+{
+	ScaledRateOffset r, inverse;
+	int i;
+
+	CHECK( rateOffsetFromElapsed( 1000000000, 1000000000 ) == 0 );
+	CHECK( rateOffsetFromElapsed( 1000001000, 1000000000 ) ==
+	       PPM_TO_RATE_OFFSET(1) );
+	CHECK( rateOffsetFromElapsed( 999999000, 1000000000 ) ==
+	       -PPM_TO_RATE_OFFSET(1) );
+	// Saturated rather than overflowed
+	CHECK( rateOffsetFromElapsed( 1000000000, 0 ) == RATE_OFFSET_MAX );
+	CHECK( rateOffsetFromElapsed( UINT64_MAX / 2, 1 ) == RATE_OFFSET_MAX );
+
+	CHECK( rateOffsetApply( 1000000, PPM_TO_RATE_OFFSET(100) ) == 1000100 );
+	CHECK( rateOffsetApply( 1000000, -PPM_TO_RATE_OFFSET(100) ) == 999900 );
+	CHECK( rateOffsetRemove( 1000100, PPM_TO_RATE_OFFSET(100) ) == 1000000 );
+	// Within one unit of rate offset, about 30 ScaledPpb
+	CHECK( llabs( rateOffsetToScaledPpb( PPM_TO_RATE_OFFSET(1) ) -
+		      PPM_TO_SCALED_PPB(1) ) <= 30 );
+	CHECK( rateOffsetDivide( PPM_TO_RATE_OFFSET(50), 0 ) ==
+	       PPM_TO_RATE_OFFSET(50) );
+	CHECK( rateOffsetDivide( PPM_TO_RATE_OFFSET(50),
+				 PPM_TO_RATE_OFFSET(50) ) == 0 );
+	CHECK( scaledPpbToPpm( PPM_TO_SCALED_PPB(-250) ) == -250.0 );
+
+	// Inverting twice comes back within rounding, and agrees with the
+	// floating point ratio
+	for( i = 0; i < 1000; ++i ) {
+		r = randomRange( PPM_TO_RATE_OFFSET(1000) );
+		inverse = rateOffsetInvert( r );
+		CHECK( llabs( rateOffsetInvert( inverse ) - r ) <= 1 );
+		CHECK( fabs( rateOffsetToRatio( inverse ) *
+			     rateOffsetToRatio( r ) - 1.0 ) < 1e-12 );
+		CHECK( llabs( rateOffsetFromRatio( rateOffsetToRatio( r )) - r )
+		       <= 1 );
+	}
+}
+
+static void testSampleFilter( void )
+{
+	sample_filter_config_t config;
+	SampleFilter filter;
+	int64_t filtered;
+	int i;
+
+	// Disabled, samples pass unchanged
+	CHECK( !filter.enabled() );
+	CHECK( filter.sample( 12345, filtered ) && filtered == 12345 );
+
+	config.type = SAMPLE_FILTER_MEDIAN;
+	config.percentile = 50;
+	config.window = 8;
+	config.reject = 100;
+	filter.configure( config );
+	CHECK( filter.enabled() );
+
+	// No rejection before SAMPLE_FILTER_HISTORY_MIN samples
+	CHECK( filter.sample( 1000, filtered ));
+	CHECK( filter.sample( 5000, filtered ));
+	filter.reset();
+
+	for( i = 0; i < 8; ++i )
+		CHECK( filter.sample( 1000 + i % 3, filtered ));
+	CHECK( filtered >= 1000 && filtered <= 1002 );
+
+	// A spike is rejected and leaves the median where it was
+	CHECK( !filter.sample( 9000, filtered ));
+	CHECK( filtered >= 1000 && filtered <= 1002 );
+	CHECK( filter.getStatistics().rejected == 1 );
+	CHECK( filter.sample( 1001, filtered ));
+
+	// Samples not checked for rejection still enter the window
+	CHECK( filter.sample( 9000, filtered, false ));
+	CHECK( filter.getStatistics().rejected == 1 );
+
+	// The minimum holds through a lasting step, which is accepted after
+	// half a window of rejections
+	config.type = SAMPLE_FILTER_MIN;
+	filter.configure( config );
+	for( i = 0; i < 8; ++i )
+		CHECK( filter.sample( 1000 + i % 3, filtered ));
+	CHECK( filtered == 1000 );
+	for( i = 0; i < 4; ++i )
+		CHECK( !filter.sample( 3000, filtered ));
+	CHECK( filter.sample( 3000, filtered ));
+	CHECK( filtered == 1000 );
+	CHECK( filter.getStatistics().forced == 1 );
+	// Statistics survive reconfiguration, one earlier rejection
+	CHECK( filter.getStatistics().rejected == 5 );
+	CHECK( !filter.sample( 3000, filtered ));
+
+	CHECK( parseSampleFilterType( "median", &config ) &&
+	       config.type == SAMPLE_FILTER_MEDIAN );
+	CHECK( parseSampleFilterType( "p90", &config ) &&
+	       config.type == SAMPLE_FILTER_PERCENTILE &&
+	       config.percentile == 90 );
+	CHECK( !parseSampleFilterType( "mean", &config ));
+}
+
+static void testMessageView( void )
+{
+	uint8_t frame[PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + 32];
+	PortIdentity identity;
+	size_t offset;
+	PTPTLVView tlv;
+	uint8_t bytes[4];
+
+	memset( frame, 0, sizeof( frame ));
+	frame[0] = 0x10 | SYNC_MESSAGE;
+	frame[1] = GPTP_VERSION;
+	frame[2] = 0;
+	frame[3] = PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH;
+	frame[30] = 0x12;
+	frame[31] = 0x34;
+
+	PTPMessageView sync( frame, PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH );
+	CHECK( sync.isValid() );
+	CHECK( sync.getTransportSpecific() == 1 );
+	CHECK( sync.getMessageType() == SYNC_MESSAGE );
+	CHECK( sync.isEvent() );
+	CHECK( sync.getSequenceId() == 0x1234 );
+	CHECK( sync.getMessageLength() ==
+	       PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH );
+
+	// Truncated frames are rejected and reads past the end return 0
+	PTPMessageView short_sync
+		( frame, PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH - 1 );
+	CHECK( !short_sync.isValid() );
+	CHECK( short_sync.getUint32( PTP_COMMON_HDR_LENGTH + 6 ) == 0 );
+	CHECK( !short_sync.getBytes
+	       ( PTP_COMMON_HDR_LENGTH + 6, bytes, sizeof( bytes )));
+
+	PTPMessageView header( frame, PTP_COMMON_HDR_LENGTH - 1 );
+	CHECK( !header.isValid() );
+	CHECK( header.getSequenceId() == 0x1234 );
+	CHECK( header.getPortIdentity
+	       ( PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET),
+		 identity ));
+
+	PTPMessageView identity_cut
+		( frame, PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET)
+		  + PTP_CLOCK_IDENTITY_LENGTH + 1 );
+	CHECK( !identity_cut.getPortIdentity
+	       ( PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET),
+		 identity ));
+
+	PTPMessageView empty( frame, 0 );
+	CHECK( !empty.isValid() );
+	CHECK( empty.getUint8( 0 ) == 0 );
+
+	// Offsets that would wrap around
+	CHECK( !sync.has( SIZE_MAX, 2 ));
+	CHECK( !sync.has( 2, SIZE_MAX ));
+	CHECK( sync.has( sync.size(), 0 ));
+	CHECK( !sync.has( sync.size(), 1 ));
+
+	// Unsupported message types are not decoded
+	frame[0] = 0x10 | MANAGEMENT_MESSAGE;
+	CHECK( !PTPMessageView( frame, sizeof( frame )).isValid() );
+
+	// TLV chain, a TLV running past the frame ends it
+	frame[0] = 0x10 | FOLLOWUP_MESSAGE;
+	offset = PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH;
+	frame[offset] = 0x00;
+	frame[offset + 1] = 0x03;
+	frame[offset + 2] = 0x00;
+	frame[offset + 3] = 28;
+	PTPMessageView followup( frame, sizeof( frame ));
+	CHECK( followup.isValid() );
+	offset = followup.getTLVOffset();
+	CHECK( followup.nextTLV( offset, tlv ));
+	CHECK( tlv.type == 3 && tlv.length == 28 );
+	CHECK( offset == sizeof( frame ));
+	CHECK( !followup.nextTLV( offset, tlv ));
+
+	PTPMessageView cut( frame, sizeof( frame ) - 1 );
+	offset = cut.getTLVOffset();
+	CHECK( !cut.nextTLV( offset, tlv ));
+}
+
+static void testFrameTemplates( void )
+{
+	PTPFrameTemplates templates;
+	uint8_t frame[PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH];
+	uint8_t copied[sizeof( frame )];
+
+	memset( frame, 0, sizeof( frame ));
+	frame[0] = 0x10 | SYNC_MESSAGE;
+
+	CHECK( !templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	templates.store( SYNC_MESSAGE, sizeof( frame ), frame );
+	CHECK( templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	CHECK( memcmp( frame, copied, sizeof( frame )) == 0 );
+	CHECK( !templates.copy( FOLLOWUP_MESSAGE, sizeof( frame ), copied ));
+
+	templates.invalidate();
+	CHECK( !templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	frame[PTP_COMMON_HDR_SOURCE_PORT_ID(PTP_COMMON_HDR_OFFSET)] = 2;
+	templates.store( SYNC_MESSAGE, sizeof( frame ), frame );
+	CHECK( templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	CHECK( memcmp( frame, copied, sizeof( frame )) == 0 );
+
+	// Invalidated while the template was being built
+	templates.invalidate();
+	CHECK( !templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	templates.invalidate();
+	templates.store( SYNC_MESSAGE, sizeof( frame ), frame );
+	CHECK( !templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+	templates.store( SYNC_MESSAGE, sizeof( frame ), frame );
+	CHECK( templates.copy( SYNC_MESSAGE, sizeof( frame ), copied ));
+}
+
+/*
+ * The PI loop as it was before the fixed point conversion, the fixed
+ * point servo must follow it within rounding
+ */
+static float floatPi( float &ppm, int64_t offset, FrequencyRatio rate_ratio )
+{
+	long double phase_error = (long double) -offset;
+	float syncPerSec;
+
+	if( fabsl( phase_error ) <= PHASE_ERROR_THRESHOLD ) {
+		syncPerSec = (float)( 1.0 / pow( (float) 2, SERVO_LOG_INTERVAL ));
+		ppm += (float)(( INTEGRAL * syncPerSec * phase_error ) +
+			       PROPORTIONAL * (( rate_ratio - 1.0 ) * 1000000 ));
+	}
+	if( ppm < LOWER_FREQ_LIMIT ) ppm = LOWER_FREQ_LIMIT;
+	if( ppm > UPPER_FREQ_LIMIT ) ppm = UPPER_FREQ_LIMIT;
+
+	return ppm;
+}
+
+static void testPiServo( void )
+{
+	PiClockServo servo;
+	uint64_t local_time = 1000000000ULL;
+	double max_difference = 0;
+	float ppm = 0;
+	int i;
+
+	for( i = 0; i < SERVO_SAMPLES; ++i ) {
+		int64_t offset = randomRange( 5000 );
+		ScaledRateOffset rate_offset =
+			randomRange( PPM_TO_RATE_OFFSET(50) );
+		servo_decision_t decision;
+		ScaledPpb freq;
+		double difference;
+
+		decision = servo.sample
+			( offset, local_time, rate_offset, SERVO_LOG_INTERVAL,
+			  500, 0, freq );
+		CHECK( decision == SERVO_SLEW );
+		floatPi( ppm, offset, rateOffsetToRatio( rate_offset ));
+
+		difference = fabs( scaledPpbToPpm( freq ) - ppm );
+		if( difference > max_difference )
+			max_difference = difference;
+		local_time += SERVO_INTERVAL_NS;
+	}
+	// Float rounding accumulates well below 1 ppb
+	CHECK( max_difference < 0.001 );
+
+	// Clamped to the frequency limits
+	{
+		ScaledPpb freq;
+
+		for( i = 0; i < 100; ++i )
+			servo.sample
+				( -1000000, local_time, 0, SERVO_LOG_INTERVAL,
+				  500, 0, freq );
+		CHECK( freq == UPPER_FREQ_LIMIT_SCALED );
+	}
+
+	// A step is taken on request, with no phase adjustment
+	{
+		ScaledPpb freq;
+
+		servo.requestStep();
+		CHECK( servo.sample
+		       ( 1000, local_time, 0, SERVO_LOG_INTERVAL, 500, 0,
+			 freq ) == SERVO_STEP );
+	}
+}
+
+/*
+ * Closed loop: a clock 30 ppm fast with 20 ns of timestamp noise, starting
+ * 15 us off, optionally stepping later. Every servo must lock and then
+ * hold the offset.
+ */
+static void testServoConvergence
+( clock_servo_type_t type, unsigned window, double step )
+{
+	ClockServo *servo = createClockServo( type, window );
+	uint64_t local_time = 1000000000ULL;
+	double offset = 15000, applied = 0, drift = 30;
+	double elapsed_freq = drift;
+	double max_locked = 0;
+	double last_noise = 0;
+	int lock_sample = -1;
+	int i;
+
+	for( i = 0; i < SERVO_SAMPLES; ++i ) {
+		double noise = ( nextRandom() % 41 ) - 20.0;
+		double measured = offset + noise;
+		servo_decision_t decision;
+		ScaledPpb freq;
+
+		decision = servo->sample
+			( (int64_t) measured, local_time,
+			  rateOffsetFromRatio
+			  ( 1.0 - elapsed_freq * 1e-6 +
+			    ( noise - last_noise ) / SERVO_INTERVAL_NS ),
+			  SERVO_LOG_INTERVAL, 500, i / 8, freq );
+		last_noise = noise;
+		if( decision == SERVO_STEP )
+			offset -= measured;
+		if( decision != SERVO_HOLD )
+			applied = scaledPpbToPpm( freq );
+
+		if( servo->isLocked() && lock_sample < 0 )
+			lock_sample = i;
+		if( i >= SERVO_SAMPLES / 2 && fabs( offset ) > max_locked )
+			max_locked = fabs( offset );
+
+		// The rate ratio is measured over the interval that follows
+		elapsed_freq = drift + applied;
+		offset += elapsed_freq * 1e-6 * SERVO_INTERVAL_NS;
+		local_time += SERVO_INTERVAL_NS;
+		if( i == SERVO_SAMPLES * 3 / 4 )
+			drift += step;
+	}
+
+	if( lock_sample < 0 || lock_sample > SERVO_SAMPLES / 4 ||
+	    max_locked > SERVO_LOCK_THRESHOLD )
+		fprintf( stderr, "Servo %s window %u: locked at sample %d, "
+			 "largest offset after %d samples %.0f ns\n",
+			 servo->getName(), window, lock_sample,
+			 SERVO_SAMPLES / 2, max_locked );
+	CHECK( lock_sample >= 0 && lock_sample <= SERVO_SAMPLES / 4 );
+	CHECK( max_locked <= SERVO_LOCK_THRESHOLD );
+	CHECK( servo->getStatistics().lock_losses == 0 );
+
+	delete servo;
+}
+
+static void testServos( void )
+{
+	clock_servo_type_t type;
+	clock_servo_estimate_t estimate;
+	ClockServo *servo;
+
+	// The oscillator steps by 5 ppm, 625 ns a Sync interval, after three
+	// quarters of the samples
+	testServoConvergence( CLOCK_SERVO_PI, 0, 5 );
+	testServoConvergence( CLOCK_SERVO_LINREG, 4, 5 );
+	testServoConvergence( CLOCK_SERVO_LINREG, LINREG_WINDOW_DEFAULT, 5 );
+	testServoConvergence( CLOCK_SERVO_LINREG, LINREG_WINDOW_MAX, 5 );
+	testServoConvergence( CLOCK_SERVO_KALMAN, 0, 5 );
+
+	CHECK( parseClockServoType( "linreg", &type ) &&
+	       type == CLOCK_SERVO_LINREG );
+	CHECK( !parseClockServoType( "fuzzy", &type ));
+
+	// Only the Kalman servo estimates the clock state
+	servo = createClockServo( CLOCK_SERVO_PI );
+	CHECK( !servo->getEstimate( estimate ));
+	delete servo;
+
+	// The Kalman state keeps advancing through held samples
+	{
+		clock_servo_estimate_t held;
+		uint64_t local_time = 1000000000ULL;
+		ScaledPpb freq;
+		int i;
+
+		servo = createClockServo( CLOCK_SERVO_KALMAN );
+		for( i = 0; i < 40; ++i ) {
+			servo->sample( 0, local_time, 0, SERVO_LOG_INTERVAL,
+				       500, 1, freq );
+			local_time += SERVO_INTERVAL_NS;
+		}
+		CHECK( servo->getEstimate( estimate ));
+		CHECK( servo->sample
+		       ( 2 * (int64_t) PHASE_ERROR_THRESHOLD, local_time, 0,
+			 SERVO_LOG_INTERVAL, 500, 1, freq ) == SERVO_HOLD );
+		CHECK( servo->getEstimate( held ));
+		CHECK( held.freq_stddev > estimate.freq_stddev );
+		CHECK( held.phase_stddev > estimate.phase_stddev );
+		delete servo;
+	}
+
+	// A renegotiated Sync interval keeps the lock
+	{
+		uint64_t local_time = 1000000000ULL;
+		ScaledPpb freq;
+		int i;
+
+		servo = createClockServo( CLOCK_SERVO_PI );
+		for( i = 0; i < 8; ++i ) {
+			servo->sample( 0, local_time, 0, SERVO_LOG_INTERVAL,
+				       500, 1, freq );
+			local_time += SERVO_INTERVAL_NS;
+		}
+		CHECK( servo->isLocked() );
+		servo->sample( 0, local_time, 0, 0, 500, 1, freq );
+		CHECK( servo->isLocked() );
+		CHECK( servo->getStatistics().interval_changes == 1 );
+		delete servo;
+	}
+}
+
+int main( int /*argc*/, char * /*argv*/[] )
+{
+	testMulDiv();
+	testRateOffset();
+	testSampleFilter();
+	testMessageView();
+	testFrameTemplates();
+	testPiServo();
+	testServos();
+
+	printf( "%u checks, %u failed\n", checks, failures );
+
+	return failures == 0 ? 0 : 1;
+}
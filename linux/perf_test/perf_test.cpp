@@ -0,0 +1,763 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+/*
+ * Microbenchmarks for the daemon's per-message hot paths. Each benchmark
+ * times the current implementation against the one it replaced on the
+ * same generated input, and checks that both agree. Run without
+ * arguments to run all of them.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <avbts_clock.hpp>
+#include <avbts_message.hpp>
+#include <clock_servo.hpp>
+#include <fixed_point.hpp>
+
+#define DEFAULT_SAMPLES 1000000		/*!< Iterations per benchmark */
+#define SYNC_INPUTS 4096		/*!< Distinct generated sync samples */
+#define SYNC_LOG_INTERVAL -3		/*!< logSyncInterval of the sync input */
+#define SYNC_INTERVAL_NS 125000000	/*!< Sync interval of the sync input */
+#define FRAME_BUFFER_SIZE 256		/*!< Transmit buffer, as in sendPort() */
+#define FRAME_PAYLOAD_OFFSET 14		/*!< Ethernet header length */
+#define SERVO_TRACE_SAMPLES 2400	/*!< Sync samples in the servo trace */
+#define SERVO_TRACE_PHASES 4		/*!< Trace quarters, each with its own Sync interval */
+#define SERVO_INITIAL_OFFSET 15000	/*!< Offset at the first sample, ns */
+#define SERVO_INITIAL_FREQ 30.0		/*!< Free running frequency error, ppm */
+#define SERVO_FREQ_STEP 10.0		/*!< Oscillator step, ppm */
+#define SERVO_FREQ_WANDER 0.002		/*!< Frequency random walk per 125 ms, ppm */
+#define SERVO_TIMESTAMP_NOISE 30.0	/*!< Timestamp noise, ns standard deviation */
+#define SERVO_DELAY_NOISE 50.0		/*!< Link delay noise, ns standard deviation */
+#define SERVO_LINK_DELAY 500.0		/*!< True link delay, ns */
+#define SERVO_PDELAY_INTERVAL_NS 1000000000	/*!< Pdelay exchange interval */
+#define SERVO_EVENT_NS 10000000000ULL	/*!< Time after a step or interval change counted as settling */
+
+static uint64_t random_state = 0x853C49E6748FEA9BULL;
+
+/* Keeps timed results from being optimized away */
+static volatile int64_t sink;
+
+/* Deterministic, so every run and architecture sees the same input */
+static uint64_t nextRandom( void )
+{
+	random_state = random_state * 6364136223846793005ULL +
+		1442695040888963407ULL;
+	return random_state >> 11;
+}
+
+/* Uniform in [-range, range] */
+static int64_t randomRange( int64_t range )
+{
+	return (int64_t)( nextRandom() % ( 2 * (uint64_t) range + 1 )) - range;
+}
+
+static uint64_t monotonicNs( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report
+( const char *name, const char *variant, uint64_t elapsed,
+  unsigned long samples )
+{
+	printf( "%-10s %-20s %10.2f ns/op\n", name, variant,
+		(double) elapsed / samples );
+}
+
+/*
+ * Sync path: the arithmetic a Follow_Up goes through on its way to the
+ * frequency adjustment. Master/peer rate ratio, correction, master/local
+ * rate difference, scaledLastGmFreqChange, PI servo update and the
+ * ADJ_FREQUENCY value.
+ */
+
+struct SyncInput {
+	int64_t tlv_rate_offset;	/* cumulativeScaledRateOffset */
+	int64_t peer_rate_offset;	/* Neighbor rate ratio - 1, 2^-41 */
+	int64_t delay;			/* Mean link delay, ns */
+	int64_t correction_field;	/* Follow_Up correction, ns */
+	uint64_t inter_master;		/* Master time between Syncs, ns */
+	uint64_t inter_sync;		/* Local time between Syncs, ns */
+	int64_t offset;			/* Master/local offset, ns */
+};
+
+struct SyncOutput {
+	int64_t correction;
+	int32_t gm_freq_change;
+	long timex_freq;
+};
+
+static SyncInput sync_inputs[SYNC_INPUTS];
+
+static void generateSyncInputs( void )
+{
+	int i;
+
+	for( i = 0; i < SYNC_INPUTS; ++i ) {
+		int64_t drift = randomRange( 100000 );	// +/-100 ppm in ppb
+
+		sync_inputs[i].tlv_rate_offset =
+			randomRange( PPM_TO_RATE_OFFSET(100) );
+		sync_inputs[i].peer_rate_offset =
+			randomRange( PPM_TO_RATE_OFFSET(100) );
+		sync_inputs[i].delay = nextRandom() % 10000;
+		sync_inputs[i].correction_field = nextRandom() % 100000;
+		sync_inputs[i].inter_sync =
+			SYNC_INTERVAL_NS + randomRange( 10000 );
+		sync_inputs[i].inter_master = sync_inputs[i].inter_sync +
+			(int64_t) sync_inputs[i].inter_sync * drift / 1000000000;
+		sync_inputs[i].offset = randomRange( 2000 );
+	}
+}
+
+/* The FrequencyRatio and float loop the fixed point path replaced */
+static void syncFloat
+( const SyncInput &in, float &ppm, SyncOutput &out )
+{
+	FrequencyRatio master_local_freq_offset;
+	FrequencyRatio peer_rate_ratio;
+	FrequencyRatio local_clock_adjustment;
+	long double phase_error;
+	float syncPerSec;
+
+	peer_rate_ratio = 1.0 +
+		(FrequencyRatio) in.peer_rate_offset / ( 1ULL << 41 );
+	master_local_freq_offset = in.tlv_rate_offset;
+	master_local_freq_offset /= 1ULL << 41;
+	master_local_freq_offset += 1.0;
+	master_local_freq_offset /= peer_rate_ratio;
+
+	out.correction = (int64_t)
+		(( in.delay * master_local_freq_offset ) + in.correction_field );
+
+	local_clock_adjustment =
+		((FrequencyRatio) in.inter_master ) / in.inter_sync;
+	out.gm_freq_change = (int32_t)
+		(( 1.0 / local_clock_adjustment - 1.0 ) * ( 1ULL << 41 ));
+
+	phase_error = (long double) -in.offset;
+	if( fabsl( phase_error ) <= PHASE_ERROR_THRESHOLD ) {
+		syncPerSec = (float)( 1.0 / pow( (float) 2, SYNC_LOG_INTERVAL ));
+		ppm += (float)(( INTEGRAL * syncPerSec * phase_error ) +
+			       PROPORTIONAL *
+			       (( master_local_freq_offset - 1.0 ) * 1000000 ));
+	}
+	if( ppm < LOWER_FREQ_LIMIT ) ppm = LOWER_FREQ_LIMIT;
+	if( ppm > UPPER_FREQ_LIMIT ) ppm = UPPER_FREQ_LIMIT;
+
+	out.timex_freq  = long( ppm ) << 16;
+	out.timex_freq += long( fmodf( ppm, 1.0 ) * 65536.0 );
+}
+
+/* The fixed point path, as PTPMessageFollowUp and PiClockServo run it */
+static void syncFixed
+( const SyncInput &in, ScaledPpb &freq, SyncOutput &out )
+{
+	ScaledRateOffset master_local_rate_offset;
+	ScaledRateOffset local_clock_adjustment;
+	int64_t integral_num, integral_den;
+	int shift = SYNC_LOG_INTERVAL;
+
+	master_local_rate_offset = rateOffsetDivide
+		( in.tlv_rate_offset, in.peer_rate_offset );
+
+	out.correction = rateOffsetApply
+		( in.delay, master_local_rate_offset ) + in.correction_field;
+
+	local_clock_adjustment = rateOffsetFromElapsed
+		( in.inter_master, in.inter_sync );
+	out.gm_freq_change = (int32_t) rateOffsetInvert
+		( local_clock_adjustment );
+
+	if( in.offset <= PHASE_ERROR_THRESHOLD &&
+	    in.offset >= -PHASE_ERROR_THRESHOLD ) {
+		integral_num = (int64_t) INTEGRAL_NUM * PPM_TO_SCALED_PPB(1);
+		integral_den = INTEGRAL_DEN;
+		if( shift < 0 ) {
+			integral_num <<= -shift;
+		} else {
+			integral_den <<= shift;
+		}
+		freq += mulDiv64( -in.offset, integral_num, integral_den ) +
+			mulDiv64( rateOffsetToScaledPpb
+				  ( master_local_rate_offset ),
+				  PROPORTIONAL_NUM, PROPORTIONAL_DEN );
+	}
+	if( freq < LOWER_FREQ_LIMIT_SCALED ) freq = LOWER_FREQ_LIMIT_SCALED;
+	if( freq > UPPER_FREQ_LIMIT_SCALED ) freq = UPPER_FREQ_LIMIT_SCALED;
+
+	out.timex_freq = (long) mulDiv64( freq, 1, 1000 );
+}
+
+static bool benchSyncPath( unsigned long samples )
+{
+	SyncOutput float_out, fixed_out;
+	int64_t max_correction_diff = 0;
+	int64_t max_gm_freq_change_diff = 0;
+	long max_timex_diff = 0;
+	uint64_t checksum = 0;
+	uint64_t start, elapsed;
+	ScaledPpb freq = 0;
+	float ppm = 0;
+	unsigned long i;
+
+	generateSyncInputs();
+
+	// Parity, both loops fed the same sequence
+	for( i = 0; i < SYNC_INPUTS; ++i ) {
+		int64_t diff;
+
+		syncFloat( sync_inputs[i], ppm, float_out );
+		syncFixed( sync_inputs[i], freq, fixed_out );
+
+		diff = llabs( float_out.correction - fixed_out.correction );
+		if( diff > max_correction_diff )
+			max_correction_diff = diff;
+		diff = llabs( (int64_t) float_out.gm_freq_change -
+			      fixed_out.gm_freq_change );
+		if( diff > max_gm_freq_change_diff )
+			max_gm_freq_change_diff = diff;
+		if( labs( float_out.timex_freq - fixed_out.timex_freq ) >
+		    max_timex_diff )
+			max_timex_diff = labs
+				( float_out.timex_freq - fixed_out.timex_freq );
+
+		checksum = checksum * 31 + (uint64_t) fixed_out.correction;
+		checksum = checksum * 31 + (uint64_t) fixed_out.gm_freq_change;
+		checksum = checksum * 31 + (uint64_t) fixed_out.timex_freq;
+	}
+
+	printf( "syncpath   max difference: correction %lld ns, "
+		"scaledLastGmFreqChange %lld, timex freq %ld (2^-16 ppm)\n",
+		(long long) max_correction_diff,
+		(long long) max_gm_freq_change_diff, max_timex_diff );
+	// Identical on every architecture and with or without __int128
+	printf( "syncpath   fixed point checksum %016llx\n",
+		(unsigned long long) checksum );
+
+	ppm = 0;
+	start = monotonicNs();
+	for( i = 0; i < samples; ++i )
+		syncFloat( sync_inputs[i % SYNC_INPUTS], ppm, float_out );
+	elapsed = monotonicNs() - start;
+	report( "syncpath", "float", elapsed, samples );
+
+	freq = 0;
+	start = monotonicNs();
+	for( i = 0; i < samples; ++i )
+		syncFixed( sync_inputs[i % SYNC_INPUTS], freq, fixed_out );
+	elapsed = monotonicNs() - start;
+	report( "syncpath", "fixed", elapsed, samples );
+
+	sink = float_out.timex_freq + fixed_out.timex_freq;
+
+	// The float loop drifts from the fixed one by rounding only, the
+	// accumulated frequency stays within 1 ppb
+	return max_correction_diff <= 1 && max_gm_freq_change_diff <= 1 &&
+		max_timex_diff <= 65;
+}
+
+/*
+ * mulDiv64: the 128 bit integer form against the portable shift-and-add
+ * form used where the compiler has no 128 bit integers.
+ */
+
+static bool benchMulDiv( unsigned long samples )
+{
+	int64_t a[SYNC_INPUTS], b[SYNC_INPUTS], c[SYNC_INPUTS];
+	uint64_t start, elapsed;
+	int64_t sum = 0;
+	unsigned long i;
+	int mismatches = 0;
+
+	for( i = 0; i < SYNC_INPUTS; ++i ) {
+		a[i] = randomRange( INT64_MAX >> ( nextRandom() % 63 ));
+		b[i] = randomRange( RATE_OFFSET_ONE );
+		c[i] = 1 + ( nextRandom() % RATE_OFFSET_MAX );
+		// Keep the quotient within 64 bits
+		if( a[i] / c[i] > INT64_MAX / ( RATE_OFFSET_ONE + 1 ))
+			a[i] >>= 24;
+		if( mulDiv64( a[i], b[i], c[i] ) !=
+		    mulDiv64Portable( a[i], b[i], c[i] ))
+			++mismatches;
+	}
+	printf( "muldiv     mismatches %d of %d\n", mismatches, SYNC_INPUTS );
+
+	start = monotonicNs();
+	for( i = 0; i < samples; ++i ) {
+		int j = i % SYNC_INPUTS;
+		sum += mulDiv64( a[j], b[j], c[j] );
+	}
+	elapsed = monotonicNs() - start;
+	report( "muldiv", "int128", elapsed, samples );
+
+	start = monotonicNs();
+	for( i = 0; i < samples; ++i ) {
+		int j = i % SYNC_INPUTS;
+		sum += mulDiv64Portable( a[j], b[j], c[j] );
+	}
+	elapsed = monotonicNs() - start;
+	report( "muldiv", "portable", elapsed, samples );
+
+	sink = sum;
+
+	return mismatches == 0;
+}
+
+/*
+ * Frame templates: building a transmit header from the port's template
+ * against the full header build over a cleared buffer it replaced.
+ */
+
+class TemplateMessage : public PTPMessageCommon {
+public:
+	TemplateMessage
+	( MessageType type, LegacyMessageType legacy_type, uint16_t length )
+	{
+		uint8_t clock_id[PTP_CLOCK_IDENTITY_LENGTH] =
+			{ 0x00, 0x1B, 0x21, 0xFF, 0xFE, 0x12, 0x34, 0x56 };
+		uint16_t port_number = 1;
+
+		versionPTP = GPTP_VERSION;
+		versionNetwork = PTP_NETWORK_VERSION;
+		domainNumber = 0;
+		memset( flags, 0, PTP_FLAGS_LENGTH );
+		flags[PTP_PTPTIMESCALE_BYTE] |= (0x1 << PTP_PTPTIMESCALE_BIT);
+		correctionField = 0;
+		_gc = false;
+		messageType = type;
+		control = legacy_type;
+		messageLength = length;
+		logMeanMessageInterval = SYNC_LOG_INTERVAL;
+		sourcePortIdentity = PortIdentity( clock_id, &port_number );
+	}
+
+	void setPortNumber( uint16_t port_number )
+	{
+		sourcePortIdentity.setPortNumber( &port_number );
+	}
+
+	void buildFull( uint8_t *buf_t )
+	{
+		memset( buf_t, 0, FRAME_BUFFER_SIZE );
+		buildCommonHeader( buf_t + FRAME_PAYLOAD_OFFSET );
+	}
+
+	void buildFromTemplate( PTPFrameTemplates *templates, uint8_t *buf_t )
+	{
+		memset( buf_t, 0, FRAME_PAYLOAD_OFFSET );
+		buildHeader( templates, buf_t + FRAME_PAYLOAD_OFFSET );
+	}
+};
+
+static bool benchTemplates( unsigned long samples )
+{
+	static const struct {
+		const char *name;
+		MessageType type;
+		LegacyMessageType legacy_type;
+		uint16_t length;
+	} messages[] = {
+		{ "sync", SYNC_MESSAGE, SYNC,
+		  PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH },
+		{ "followup", FOLLOWUP_MESSAGE, FOLLOWUP,
+		  PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH +
+		  sizeof( FollowUpTLV ) },
+		{ "pdelayresp", PATH_DELAY_RESP_MESSAGE, MESSAGE_OTHER,
+		  PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH },
+	};
+	uint8_t full[FRAME_BUFFER_SIZE], templated[FRAME_BUFFER_SIZE];
+	uint64_t start, elapsed;
+	unsigned long i;
+	size_t m;
+	bool ok = true;
+
+	for( m = 0; m < sizeof( messages ) / sizeof( *messages ); ++m ) {
+		PTPFrameTemplates templates;
+		TemplateMessage message
+			( messages[m].type, messages[m].legacy_type,
+			  messages[m].length );
+		char variant[32];
+
+		// The first build stores the template, later ones copy it
+		// until the port invalidates it with a new identity
+		for( i = 0; i < 4; ++i ) {
+			if( i == 2 ) {
+				message.setPortNumber( 2 );
+				templates.invalidate();
+			}
+			message.setSequenceId( 100 + i );
+			message.buildFull( full );
+			message.buildFromTemplate( &templates, templated );
+			if( memcmp( full, templated, FRAME_PAYLOAD_OFFSET +
+				    messages[m].length ) != 0 ) {
+				printf( "templates  %s differs from the full "
+					"build\n", messages[m].name );
+				ok = false;
+			}
+		}
+
+		start = monotonicNs();
+		for( i = 0; i < samples; ++i ) {
+			message.setSequenceId( i );
+			message.buildFull( full );
+		}
+		elapsed = monotonicNs() - start;
+		snprintf( variant, sizeof( variant ), "%s-full",
+			  messages[m].name );
+		report( "templates", variant, elapsed, samples );
+
+		start = monotonicNs();
+		for( i = 0; i < samples; ++i ) {
+			message.setSequenceId( i );
+			message.buildFromTemplate( &templates, templated );
+		}
+		elapsed = monotonicNs() - start;
+		snprintf( variant, sizeof( variant ), "%s-template",
+			  messages[m].name );
+		report( "templates", variant, elapsed, samples );
+
+		sink = full[FRAME_PAYLOAD_OFFSET + 30] +
+			templated[FRAME_PAYLOAD_OFFSET + 30];
+	}
+
+	return ok;
+}
+
+/*
+ * Servos: a closed loop simulation of a clock following its master,
+ * driven by a generated disturbance trace. The trace is the oscillator
+ * frequency wander and the timestamp and link delay noise of every
+ * sample. Each scenario adds events to it: an oscillator step halfway
+ * through, or Sync interval changes at the quarters, as Signalling
+ * renegotiates them. Every servo, and the linear regression servo at
+ * every window setting, is fed the same trace, so their time to lock,
+ * residual offset and cost can be compared from run to run.
+ */
+
+struct ServoTrace {
+	double wander;		/* Oscillator random walk, standard normal */
+	double noise;		/* Offset timestamp noise, ns */
+	double delay_noise;	/* Link delay measurement noise, ns */
+};
+
+struct ServoScenario {
+	const char *name;
+	double step;		/* Oscillator step halfway through, ppm */
+	signed char log_interval[SERVO_TRACE_PHASES];
+};
+
+static const ServoScenario servo_scenarios[] = {
+	{ "step", SERVO_FREQ_STEP, { -3, -3, -3, -3 } },
+	{ "interval", 0, { -3, 0, 1, -3 } },
+};
+
+static ServoTrace servo_trace[SERVO_TRACE_SAMPLES];
+
+/* Standard normal, Box-Muller over nextRandom() */
+static double randomGauss( void )
+{
+	double u, v;
+
+	u = ( nextRandom() + 1.0 ) / 9007199254740994.0;
+	v = ( nextRandom() + 1.0 ) / 9007199254740994.0;
+	return sqrt( -2 * log( u )) * cos( 2 * M_PI * v );
+}
+
+static void generateServoTrace( void )
+{
+	int i;
+
+	for( i = 0; i < SERVO_TRACE_SAMPLES; ++i ) {
+		servo_trace[i].wander = randomGauss();
+		servo_trace[i].noise = randomGauss() * SERVO_TIMESTAMP_NOISE;
+		servo_trace[i].delay_noise = randomGauss() * SERVO_DELAY_NOISE;
+	}
+}
+
+struct ServoResult {
+	double lock_ms;		/* Time to the first lock, -1 if never */
+	double settle_ms;	/* Longest time for the true offset to get back
+				   within SERVO_LOCK_THRESHOLD after an event,
+				   -1 if it stayed out */
+	double rms;		/* True offset while locked, outside events, ns */
+	double max;		/* Largest of the above, ns */
+	double event_max;	/* Largest true offset after an event, ns */
+	uint64_t lock_losses;
+	double sample_ns;	/* Mean cost of a sample */
+};
+
+static void runServo
+( ClockServo *servo, const ServoScenario &scenario, ServoResult &result )
+{
+	uint64_t local_time = 1000000000ULL;
+	uint64_t start_time = local_time;
+	uint64_t event_time = 0, next_pdelay = local_time;
+	double offset = SERVO_INITIAL_OFFSET;
+	double freq_error = SERVO_INITIAL_FREQ;
+	double delay = SERVO_LINK_DELAY;
+	double applied = 0;
+	double elapsed_freq = freq_error;
+	double last_noise = 0;
+	double square = 0;
+	unsigned delay_count = 0;
+	int steady_samples = 0;
+	bool event = false, settled = true;
+	signed char log_interval = scenario.log_interval[0];
+	int i;
+
+	result.lock_ms = -1;
+	result.settle_ms = 0;
+	result.max = 0;
+	result.event_max = 0;
+
+	for( i = 0; i < SERVO_TRACE_SAMPLES; ++i ) {
+		const ServoTrace &trace = servo_trace[i];
+		signed char next_interval = scenario.log_interval
+			[i * SERVO_TRACE_PHASES / SERVO_TRACE_SAMPLES];
+		int64_t interval = (int64_t)( ldexp( 1.0, log_interval ) *
+					       1000000000.0 );
+		servo_decision_t decision;
+		double measured, rate_ratio;
+		ScaledPpb freq;
+
+		// Interval changes take effect from this sample, the step
+		// from the interval that follows it
+		if( next_interval != log_interval ||
+		    ( scenario.step != 0 && i == SERVO_TRACE_SAMPLES / 2 )) {
+			event = true;
+			event_time = local_time;
+		}
+		if( i == SERVO_TRACE_SAMPLES / 2 )
+			freq_error += scenario.step;
+		log_interval = next_interval;
+
+		if( local_time >= next_pdelay ) {
+			delay = SERVO_LINK_DELAY + trace.delay_noise;
+			++delay_count;
+			next_pdelay += SERVO_PDELAY_INTERVAL_NS;
+		}
+		// The offset is measured against the measured link delay, the
+		// rate ratio over the interval that just elapsed between two
+		// noisy Sync timestamps
+		measured = offset + trace.noise + ( SERVO_LINK_DELAY - delay );
+		rate_ratio = 1.0 - elapsed_freq * 1e-6 +
+			( trace.noise - last_noise ) / interval;
+		last_noise = trace.noise;
+
+		decision = servo->sample
+			( (int64_t) measured, local_time,
+			  rateOffsetFromRatio( rate_ratio ), log_interval,
+			  (int64_t) delay, delay_count, freq );
+		if( decision == SERVO_STEP )
+			offset -= measured;
+		if( decision != SERVO_HOLD )
+			applied = scaledPpbToPpm( freq );
+
+		if( event && local_time - event_time > SERVO_EVENT_NS ) {
+			event = false;
+			if( !settled )
+				result.settle_ms = -1;
+		}
+		if( servo->isLocked() && result.lock_ms < 0 )
+			result.lock_ms = ( local_time - start_time ) / 1000000.0;
+		if( event ) {
+			if( fabs( offset ) > SERVO_LOCK_THRESHOLD ) {
+				settled = false;
+			} else if( !settled ) {
+				settled = true;
+				if( result.settle_ms >= 0 &&
+				    ( local_time - event_time ) / 1000000.0 >
+				    result.settle_ms )
+					result.settle_ms = ( local_time -
+							     event_time ) /
+						1000000.0;
+			}
+			if( fabs( offset ) > result.event_max )
+				result.event_max = fabs( offset );
+		} else if( servo->isLocked() ) {
+			square += offset * offset;
+			++steady_samples;
+			if( fabs( offset ) > result.max )
+				result.max = fabs( offset );
+		}
+
+		// The oscillator wanders with the square root of time
+		interval = (int64_t)( ldexp( 1.0, log_interval ) *
+				      1000000000.0 );
+		freq_error += trace.wander * SERVO_FREQ_WANDER *
+			sqrt( interval / 125000000.0 );
+		elapsed_freq = freq_error + applied;
+		offset += elapsed_freq * 1e-6 * interval;
+		local_time += interval;
+	}
+
+	if( !settled )
+		result.settle_ms = -1;
+	result.rms = steady_samples != 0 ? sqrt( square / steady_samples ) : 0;
+	result.lock_losses = servo->getStatistics().lock_losses;
+	result.sample_ns = (double) servo->getStatistics().time_total /
+		servo->getStatistics().samples;
+}
+
+static void reportServo
+( const char *scenario, const char *variant, const ServoResult &result )
+{
+	char name[32];
+
+	snprintf( name, sizeof( name ), "%s/%s", scenario, variant );
+	printf( "servo      %-20s lock %6.0f ms, settle %6.0f ms, "
+		"rms %6.1f ns, max %6.0f ns, event max %6.0f ns, "
+		"losses %llu, %6.0f ns/op\n",
+		name, result.lock_ms, result.settle_ms, result.rms, result.max,
+		result.event_max, (unsigned long long) result.lock_losses,
+		result.sample_ns );
+}
+
+static bool benchServo( unsigned long /*samples*/ )
+{
+	static const struct {
+		const char *name;
+		clock_servo_type_t type;
+		unsigned window;
+	} servos[] = {
+		{ "pi", CLOCK_SERVO_PI, 0 },
+		{ "linreg-4", CLOCK_SERVO_LINREG, 4 },
+		{ "linreg-8", CLOCK_SERVO_LINREG, 8 },
+		{ "linreg-16", CLOCK_SERVO_LINREG, 16 },
+		{ "linreg-32", CLOCK_SERVO_LINREG, 32 },
+		{ "linreg-64", CLOCK_SERVO_LINREG, 64 },
+		{ "kalman", CLOCK_SERVO_KALMAN, 0 },
+	};
+	ServoResult result;
+	bool ok = true;
+	size_t i, j;
+
+	generateServoTrace();
+
+	// Lock is timed from the first sample. Settling is timed from a
+	// step or interval change until the true offset is back within
+	// SERVO_LOCK_THRESHOLD. rms and max leave out SERVO_EVENT_NS after
+	// events, event max covers them.
+	for( j = 0; j < sizeof( servo_scenarios ) / sizeof( *servo_scenarios );
+	     ++j ) {
+		for( i = 0; i < sizeof( servos ) / sizeof( *servos ); ++i ) {
+			ClockServo *servo = createClockServo
+				( servos[i].type, servos[i].window );
+
+			runServo( servo, servo_scenarios[j], result );
+			reportServo
+				( servo_scenarios[j].name, servos[i].name,
+				  result );
+			if( result.lock_ms < 0 || result.settle_ms < 0 )
+				ok = false;
+			delete servo;
+		}
+	}
+
+	return ok;
+}
+
+struct Benchmark {
+	const char *name;
+	bool (*run)( unsigned long samples );
+};
+
+static const Benchmark benchmarks[] = {
+	{ "syncpath", benchSyncPath },
+	{ "muldiv", benchMulDiv },
+	{ "templates", benchTemplates },
+	{ "servo", benchServo },
+};
+
+static void usage( const char *arg0 )
+{
+	size_t i;
+
+	fprintf( stderr, "%s [-n samples] [benchmark ...]\n"
+		 "Benchmarks:", arg0 );
+	for( i = 0; i < sizeof( benchmarks ) / sizeof( *benchmarks ); ++i )
+		fprintf( stderr, " %s", benchmarks[i].name );
+	fprintf( stderr, "\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	unsigned long samples = DEFAULT_SAMPLES;
+	bool selected[sizeof( benchmarks ) / sizeof( *benchmarks )];
+	bool any = false;
+	bool ok = true;
+	size_t i;
+	int arg;
+
+	memset( selected, 0, sizeof( selected ));
+	for( arg = 1; arg < argc; ++arg ) {
+		if( strcmp( argv[arg], "-n" ) == 0 && arg + 1 < argc ) {
+			samples = strtoul( argv[++arg], NULL, 0 );
+			continue;
+		}
+		for( i = 0; i < sizeof( benchmarks ) / sizeof( *benchmarks );
+		     ++i ) {
+			if( strcmp( argv[arg], benchmarks[i].name ) == 0 )
+				break;
+		}
+		if( i == sizeof( benchmarks ) / sizeof( *benchmarks ) ||
+		    samples == 0 ) {
+			usage( argv[0] );
+			return -1;
+		}
+		selected[i] = true;
+		any = true;
+	}
+
+	for( i = 0; i < sizeof( benchmarks ) / sizeof( *benchmarks ); ++i ) {
+		if( any && !selected[i] )
+			continue;
+		if( !benchmarks[i].run( samples )) {
+			printf( "%-10s FAILED\n", benchmarks[i].name );
+			ok = false;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
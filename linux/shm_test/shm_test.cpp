@@ -128,6 +128,11 @@ int main(int argc, char *argv[])
     fprintf(stdout, "Port State %d\n", (int)ptpData->port_state);
     fprintf(stdout, "process_id %d\n\n", (int)ptpData->process_id);
 
+    fprintf(stdout, "ml phoffset stddev %u ns\n", ptpData->ml_phoffset_stddev);
+    fprintf(stdout, "ml freq offset stddev %u ppt\n", ptpData->ml_freqoffset_stddev);
+    fprintf(stdout, "link delay %ld +- %u ns\n\n", (long) ptpData->link_delay,
+            ptpData->link_delay_stddev);
+
     return 0;
 }
 
@@ -46,11 +46,14 @@
 #endif
 
 #include "linux_hal_persist_file.hpp"
+#include "linux_hal_reactor.hpp"
 #include <ctype.h>
 #include <inttypes.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/stat.h>
@@ -75,7 +78,9 @@ void print_usage( char *arg0 ) {
 			"[-D <gb_tx_delay,gb_rx_delay,mb_tx_delay,mb_rx_delay>] "
 			"[-T] [-L] [-E] [-GM] [-N] [-INITSYNC <value>] [-OPERSYNC <value>] "
 			"[-INITPDELAY <value>] [-OPERPDELAY <value>] "
-			"[-F <path to gptp_cfg.ini file>] "
+			"[-F <path to gptp_cfg.ini file>] [-RXBATCH <frames>] "
+			"[-RXRING <blocks>] [-RXFILTER] [-RXBUSYPOLL <usec>] "
+			"[-RXCPU <cpu>] [-TXTIME <usec>] [-REACTOR] [-SERVO <pi|linreg|kalman>] "
 			"\n",
 			arg0 );
 	fprintf
@@ -97,6 +102,14 @@ void print_usage( char *arg0 ) {
 		  "\t-INITPDELAY <value> initial pdelay interval (Log base 2. 0 = 1 second)\n"
 		  "\t-OPERPDELAY <value> operational pdelay interval (Log base 2. 0 = 1 sec)\n"
 		  "\t-F <path-to-ini-file>\n"
+		  "\t-RXBATCH <frames> receive up to <frames> per recvmmsg() call (0 = disabled)\n"
+		  "\t-RXRING <blocks> receive through a TPACKET_V3 ring of <blocks> blocks (0 = disabled)\n"
+		  "\t-RXFILTER drop foreign PTP frames in the kernel with a socket filter\n"
+		  "\t-RXBUSYPOLL <usec> busy poll the event socket instead of sleeping (0 = disabled)\n"
+		  "\t-RXCPU <cpu> pin the listening thread to <cpu> (-1 = not pinned)\n"
+		  "\t-TXTIME <usec> as master, schedule Sync <usec> ahead with SO_TXTIME (0 = disabled)\n"
+		  "\t-REACTOR run timers, receive, link and signal handling on one epoll thread\n"
+		  "\t-SERVO <pi|linreg|kalman> clock servo used with -S\n"
 		);
 }
 
@@ -130,6 +143,64 @@ int watchdog_setup(OSThreadFactory *thread_factory)
 
 static IEEE1588Clock *pClock = NULL;
 static EtherPort *pPort = NULL;
+static LinuxReactor *reactor = NULL;
+static int signal_fd = -1;
+static int exit_signal = 0;
+
+/**
+ * @brief  Handles a signal taken from the blocked set
+ * @param  sig Signal number
+ * @param  persist [in] Persistent storage, may be NULL
+ * @return TRUE to keep running, FALSE to exit
+ */
+static bool handleSignal( int sig, GPTPPersist *persist )
+{
+	if (sig == SIGHUP) {
+		if (persist) {
+		  // If port is either master or slave, save clock and then port state
+		  if (pPort->getPortState() == PTP_MASTER || pPort->getPortState() == PTP_SLAVE) {
+			persist->triggerWriteStorage();
+		  }
+		}
+		return true;
+	}
+
+	if (sig == SIGUSR2) {
+		pPort->logIEEEPortCounters();
+		pPort->logNetworkStatistics();
+		pPort->logSyncStatistics();
+		pPort->logReceiptTimerStatistics();
+		pClock->logTimerStatistics();
+		pClock->logServoStatistics();
+		pPort->logDelayFilterStatistics();
+		pPort->getMessagePool()->logStatistics();
+		pPort->getFrameTemplates()->logStatistics();
+		if( reactor != NULL )
+			reactor->logStatistics();
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief  Reactor handler of the signalfd, replaces the sigwait() loop
+ * @param  arg [in] Persistent storage, may be NULL
+ * @param  events Ready epoll events
+ * @return void
+ */
+static void reactorSignal( void *arg, uint32_t /*events*/ )
+{
+	struct signalfd_siginfo info;
+
+	while( read( signal_fd, &info, sizeof( info )) == sizeof( info )) {
+		if( !handleSignal( info.ssi_signo, (GPTPPersist *) arg )) {
+			exit_signal = info.ssi_signo;
+			reactor->stop();
+			break;
+		}
+	}
+}
 
 int main(int argc, char **argv)
 {
@@ -158,17 +229,6 @@ int main(int argc, char **argv)
 	GPTPPersist *pGPTPPersist = NULL;
 	LinuxThreadFactory *thread_factory = new LinuxThreadFactory();
 
-	// Block SIGUSR1
-	{
-		sigset_t block;
-		sigemptyset( &block );
-		sigaddset( &block, SIGUSR1 );
-		if( pthread_sigmask( SIG_BLOCK, &block, NULL ) != 0 ) {
-			GPTP_LOG_ERROR("Failed to block SIGUSR1");
-			return -1;
-		}
-	}
-
 	GPTP_LOG_REGISTER();
 	GPTP_LOG_INFO("gPTP starting");
 	if (watchdog_setup(thread_factory) != 0) {
@@ -177,6 +237,17 @@ int main(int argc, char **argv)
 	}
 	phy_delay_map_t ether_phy_delay;
 	bool input_delay=false;
+	bool input_rx_batch=false;
+	bool input_rx_ring=false;
+	bool input_rx_filter=false;
+	bool input_rx_busy_poll=false;
+	bool input_rx_cpu=false;
+	bool input_sync_launch_lead=false;
+	unsigned sync_launch_lead=0;
+	bool use_reactor=false;
+	bool input_servo=false;
+	clock_servo_type_t servo_type=CLOCK_SERVO_PI;
+	unsigned int servo_window=LINREG_WINDOW_DEFAULT;
 
 	portInit.clock = NULL;
 	portInit.index = 0;
@@ -187,6 +258,8 @@ int main(int argc, char **argv)
 	portInit.testMode = false;
 	portInit.linkUp = false;
 	portInit.allowNegativeCorrField = false;
+	portInit.syncLaunchLead = 0;
+	portInit.delayFilter.type = SAMPLE_FILTER_NONE;
 	portInit.initialLogSyncInterval = LOG2_INTERVAL_INVALID;
 	portInit.initialLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
 	portInit.operLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
@@ -329,6 +402,67 @@ int main(int argc, char **argv)
 			else if (strcmp(argv[i] + 1, "OPERPDELAY") == 0) {
 				portInit.operLogPdelayReqInterval = atoi(argv[++i]);
 			}
+			else if (strcmp(argv[i] + 1, "RXBATCH") == 0) {
+				if( i+1 < argc ) {
+					input_rx_batch = true;
+					default_factory->getOptions().rx_batch_size =
+						strtoul( argv[++i], NULL, 0 );
+				} else {
+					fprintf(stderr, "receive batch size must be specified.\n");
+				}
+			}
+			else if (strcmp(argv[i] + 1, "REACTOR") == 0) {
+				use_reactor = true;
+			}
+			else if (strcmp(argv[i] + 1, "SERVO") == 0) {
+				if( i+1 < argc &&
+				    parseClockServoType( argv[i+1], &servo_type )) {
+					input_servo = true;
+					++i;
+				} else {
+					fprintf(stderr, "Servo must be pi, linreg or kalman.\n");
+				}
+			}
+			else if (strcmp(argv[i] + 1, "RXFILTER") == 0) {
+				input_rx_filter = true;
+				default_factory->getOptions().rx_filter = true;
+			}
+			else if (strcmp(argv[i] + 1, "RXBUSYPOLL") == 0) {
+				if( i+1 < argc ) {
+					input_rx_busy_poll = true;
+					default_factory->getOptions().rx_busy_poll =
+						strtoul( argv[++i], NULL, 0 );
+				} else {
+					fprintf(stderr, "busy poll time must be specified.\n");
+				}
+			}
+			else if (strcmp(argv[i] + 1, "RXCPU") == 0) {
+				if( i+1 < argc ) {
+					input_rx_cpu = true;
+					default_factory->getOptions().rx_cpu =
+						atoi( argv[++i] );
+				} else {
+					fprintf(stderr, "listening thread CPU must be specified.\n");
+				}
+			}
+			else if (strcmp(argv[i] + 1, "TXTIME") == 0) {
+				if( i+1 < argc ) {
+					input_sync_launch_lead = true;
+					sync_launch_lead =
+						strtoul( argv[++i], NULL, 0 );
+				} else {
+					fprintf(stderr, "Sync launch lead time must be specified.\n");
+				}
+			}
+			else if (strcmp(argv[i] + 1, "RXRING") == 0) {
+				if( i+1 < argc ) {
+					input_rx_ring = true;
+					default_factory->getOptions().rx_ring_blocks =
+						strtoul( argv[++i], NULL, 0 );
+				} else {
+					fprintf(stderr, "receive ring block count must be specified.\n");
+				}
+			}
 			else if (strcmp(argv[i] + 1, "F") == 0)
 			{
 				if( i+1 < argc ) {
@@ -382,6 +516,19 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	// The clock creates its timer queue, the reactor must be known first
+	if( use_reactor ) {
+		reactor = new LinuxReactor();
+		if( !reactor->init() ) {
+			GPTP_LOG_ERROR("Failed to create the reactor");
+			GPTP_LOG_UNREGISTER();
+			return -1;
+		}
+		timerq_factory->setReactor( reactor );
+		default_factory->getOptions().reactor = reactor;
+		GPTP_LOG_STATUS("Single threaded reactor mode enabled");
+	}
+
 	pClock = new IEEE1588Clock
 		( false, syntonize, priority1, timerq_factory, ipc,
 		  lock_factory );
@@ -424,6 +571,8 @@ int main(int argc, char **argv)
 			 * Otherwise it will use its default value (800ns) */
 			portInit.neighborPropDelayThreshold =
 				iniParser.getNeighborPropDelayThresh();
+			portInit.delayFilter = iniParser.getDelayFilter();
+			pClock->setOffsetFilter( iniParser.getOffsetFilter() );
 
 			/* If using config file, set the syncReceiptThreshold, otherwise
 			 * it will use the default value (SYNC_RECEIPT_THRESH)
@@ -437,6 +586,44 @@ int main(int argc, char **argv)
 				ether_phy_delay = iniParser.getPhyDelay();
 			}
 
+			/* Command line receive batch size takes precedence */
+			if( !input_rx_batch )
+			{
+				default_factory->getOptions().rx_batch_size =
+					iniParser.getRxBatchSize();
+			}
+			if( !input_rx_ring )
+			{
+				default_factory->getOptions().rx_ring_blocks =
+					iniParser.getRxRingBlocks();
+			}
+			if( !input_rx_filter )
+			{
+				default_factory->getOptions().rx_filter =
+					iniParser.getRxFilter();
+			}
+			if( !input_rx_busy_poll )
+			{
+				default_factory->getOptions().rx_busy_poll =
+					iniParser.getRxBusyPoll();
+			}
+			default_factory->getOptions().rx_busy_poll_budget =
+				iniParser.getRxBusyPollBudget();
+			if( !input_rx_cpu )
+			{
+				default_factory->getOptions().rx_cpu =
+					iniParser.getRxCpu();
+			}
+			if( !input_sync_launch_lead )
+			{
+				sync_launch_lead = iniParser.getSyncLaunchLead();
+			}
+			if( !input_servo )
+			{
+				servo_type = iniParser.getServo();
+			}
+			servo_window = iniParser.getServoWindow();
+
 			portInit.allowNegativeCorrField = iniParser.getAllowNegativeCorrField();
 			GPTP_LOG_INFO("SyncFollowUp with negative correction field: %s",
 						  portInit.allowNegativeCorrField ? "permitted" : "forbidden");
@@ -444,6 +631,12 @@ int main(int argc, char **argv)
 
 	}
 
+	if( syntonize )
+		pClock->setServo( createClockServo( servo_type, servo_window ));
+
+	default_factory->getOptions().rx_filter_domain = pClock->getDomain();
+	default_factory->getOptions().tx_launch_time = sync_launch_lead != 0;
+	portInit.syncLaunchLead = (uint64_t) sync_launch_lead * 1000;
 	pPort = new EtherPort(&portInit);
 
 	if (!pPort->init_port()) {
@@ -494,9 +687,27 @@ int main(int argc, char **argv)
 		pGPTPPersist->registerWriteCB(gPTPPersistWriteCB);
 	}
 
+	if( reactor != NULL ) {
+		signal_fd = signalfd( -1, &set, SFD_NONBLOCK | SFD_CLOEXEC );
+		if( signal_fd == -1 ||
+		    !reactor->add
+		    ( signal_fd, EPOLLIN, reactorSignal, pGPTPPersist,
+		      "signals" )) {
+			GPTP_LOG_ERROR("Failed to register the signals with the reactor");
+			GPTP_LOG_UNREGISTER();
+			return -1;
+		}
+	}
+
 	pPort->processEvent(POWERUP);
 
-	do {
+	if( reactor != NULL ) {
+		if( !reactor->run() ) {
+			GPTP_LOG_UNREGISTER();
+			return -1;
+		}
+		sig = exit_signal;
+	} else do {
 		sig = 0;
 
 		if (sigwait(&set, &sig) != 0) {
@@ -504,20 +715,7 @@ int main(int argc, char **argv)
 			GPTP_LOG_UNREGISTER();
 			return -1;
 		}
-
-		if (sig == SIGHUP) {
-			if (pGPTPPersist) {
-			  // If port is either master or slave, save clock and then port state
-			  if (pPort->getPortState() == PTP_MASTER || pPort->getPortState() == PTP_SLAVE) {
-				pGPTPPersist->triggerWriteStorage();
-			  }
-			}
-		}
-
-		if (sig == SIGUSR2) {
-			pPort->logIEEEPortCounters();
-		}
-	} while (sig == SIGHUP || sig == SIGUSR2);
+	} while (handleSignal(sig, pGPTPPersist));
 
 	GPTP_LOG_ERROR("Exiting on %d", sig);
 
@@ -532,12 +730,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	OSThreadExitCode listenExitCode, linkExitCode;
-	pPort->stopListeningThread();
-	pPort->stopLinkWatchThread();
-	pPort->joinListeningThread(listenExitCode);
-	pPort->joinLinkWatchThread(linkExitCode);
-	GPTP_LOG_INFO("All threads terminated");
+	// The reactor started neither thread
+	if( reactor == NULL ) {
+		OSThreadExitCode listenExitCode, linkExitCode;
+		pPort->stopListeningThread();
+		pPort->stopLinkWatchThread();
+		pPort->joinListeningThread(listenExitCode);
+		pPort->joinLinkWatchThread(linkExitCode);
+		GPTP_LOG_INFO("All threads terminated");
+	}
 
 	if( ipc ) delete ipc;
 
@@ -32,6 +32,14 @@
 ******************************************************************************/
 
 #include <linux_hal_common.hpp>
+#include <linux_hal_rxbatch.hpp>
+#include <linux_hal_rxring.hpp>
+#include <linux_hal_rxfilter.hpp>
+#include <linux_hal_latency.hpp>
+#include <linux_hal_txbatch.hpp>
+#include <linux_hal_txqueue.hpp>
+#include <linux_hal_timerq.hpp>
+#include <linux_hal_reactor.hpp>
 #include <sys/types.h>
 #include <avbts_clock.hpp>
 #include <ether_port.hpp>
@@ -40,6 +48,8 @@
 #include <linux_ipc.hpp>
 
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
 #include <fcntl.h>
 #include <grp.h>
 #include <net/if.h>
@@ -60,8 +70,21 @@
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/sockios.h>
+#include <linux/net_tstamp.h>
 #include <gptp_cfg.hpp>
 
+// Added in Linux 5.11, not yet in every libc
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+// Added in Linux 4.19
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+
 Timestamp tsToTimestamp(struct timespec *ts)
 {
 	Timestamp ret;
@@ -79,35 +102,149 @@ Timestamp tsToTimestamp(struct timespec *ts)
 }
 
 LinuxNetworkInterface::~LinuxNetworkInterface() {
+	// Stop the queue owner before the socket it sends on is closed
+	if ( tx_queue != NULL ) delete tx_queue;
+	if ( rx_batch != NULL ) delete rx_batch;
+	if ( rx_ring != NULL ) delete rx_ring;
+	if ( rx_filter != NULL ) delete rx_filter;
+	if ( rx_latency != NULL ) delete rx_latency;
+	if ( tx_batch != NULL ) delete tx_batch;
+	delete [] tx_dest;
+	if ( reactor != NULL && reactor_port != NULL ) {
+		reactor->remove( netlink_sd );
+		reactor->remove( sd_event );
+	}
+	closeNetLink();
 	if ( sd_event != -1 ) close( sd_event );
 	if ( sd_general != -1 ) close( sd_general );
 }
 
-net_result LinuxNetworkInterface::send
-( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload, size_t length, bool timestamp ) {
-	sockaddr_ll *remote = NULL;
+void LinuxNetworkInterface::logStatistics() {
+	if( rx_batch != NULL )
+		rx_batch->logStatistics();
+	if( rx_ring != NULL )
+		rx_ring->logStatistics();
+	if( rx_filter != NULL )
+		rx_filter->logStatistics();
+	if( rx_busy_poll != 0 ) {
+		GPTP_LOG_STATUS
+			( "RX busy poll: %llu polls, %llu empty",
+			  (unsigned long long) rx_busy_polls,
+			  (unsigned long long) rx_busy_empty );
+	}
+	if( rx_latency != NULL )
+		rx_latency->logStatistics( "RX receive-to-process latency" );
+	if( tx_queue != NULL )
+		tx_queue->logStatistics();
+	if( tx_batch != NULL )
+		tx_batch->logStatistics();
+	if( tx_dest_misses != 0 ) {
+		GPTP_LOG_STATUS
+			( "TX destination cache misses: %llu",
+			  (unsigned long long) tx_dest_misses );
+	}
+	if( timestamper != NULL )
+		timestamper->logStatistics();
+}
+
+void LinuxNetworkInterface::pinReceiveThread() {
+	cpu_set_t cpus;
 	int err;
-	remote = new struct sockaddr_ll;
+
+	// Only try once, a failure is not fatal
+	rx_cpu_pinned = true;
+
+	CPU_ZERO( &cpus );
+	CPU_SET( rx_cpu, &cpus );
+	err = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+	if( err != 0 ) {
+		GPTP_LOG_ERROR
+			( "Failed to pin listening thread to CPU %d: %s", rx_cpu,
+			  strerror( err ));
+		return;
+	}
+	GPTP_LOG_STATUS( "Listening thread pinned to CPU %d", rx_cpu );
+}
+
+void LinuxNetworkInterface::recordReceiveLatency( struct timespec *software ) {
+	struct timespec now;
+	int64_t latency;
+
+	if( software->tv_sec == 0 && software->tv_nsec == 0 )
+		return;
+
+	clock_gettime( CLOCK_REALTIME, &now );
+	latency = ((int64_t) now.tv_sec - software->tv_sec ) * 1000000000LL +
+		( now.tv_nsec - software->tv_nsec );
+	if( latency >= 0 )
+		rx_latency->add( latency );
+}
+
+void LinuxNetworkInterface::addDestination
+( uint64_t addr, uint16_t etherType ) {
+	struct sockaddr_ll *remote = tx_dest + tx_dest_count++;
+	LinkLayerAddress dest( addr );
+
 	memset( remote, 0, sizeof( *remote ));
 	remote->sll_family = AF_PACKET;
 	remote->sll_protocol = PLAT_htons( etherType );
 	remote->sll_ifindex = ifindex;
 	remote->sll_halen = ETH_ALEN;
-	addr->toOctetArray( remote->sll_addr );
+	dest.toOctetArray( remote->sll_addr );
+}
+
+const struct sockaddr_ll *LinuxNetworkInterface::getDestination
+( LinkLayerAddress *addr, uint16_t etherType, struct sockaddr_ll *scratch ) {
+	uint8_t octets[ETH_ALEN];
+	unsigned i;
+
+	addr->toOctetArray( octets );
+	for( i = 0; i < tx_dest_count; ++i ) {
+		if( tx_dest[i].sll_protocol == PLAT_htons( etherType ) &&
+		    memcmp( tx_dest[i].sll_addr, octets, ETH_ALEN ) == 0 )
+			return tx_dest + i;
+	}
+
+	// Unicast destination (not used by 802.1AS), build it on the stack
+	++tx_dest_misses;
+	memset( scratch, 0, sizeof( *scratch ));
+	scratch->sll_family = AF_PACKET;
+	scratch->sll_protocol = PLAT_htons( etherType );
+	scratch->sll_ifindex = ifindex;
+	scratch->sll_halen = ETH_ALEN;
+	memcpy( scratch->sll_addr, octets, ETH_ALEN );
+	return scratch;
+}
+
+net_result LinuxNetworkInterface::send
+( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload, size_t length, bool timestamp ) {
+	const struct sockaddr_ll *remote;
+	struct sockaddr_ll scratch;
+	int err;
+
+	remote = getDestination( addr, etherType, &scratch );
 
 	if( timestamp ) {
-#ifndef ARCH_INTELCE
-		net_lock.lock();
-#endif
+		// The queue owner sends the frame and collects its timestamp,
+		// the caller waits for the result in getTxTimestamp()
+		if( tx_queue != NULL )
+			return tx_queue->submit( remote, payload, length );
+		// Only the reactor sends without a queue on this timestamper,
+		// from the thread that also collects the timestamp
+		timestamper->expectTxTimestamp( payload, length );
 		err = sendto
 			( sd_event, payload, length, 0, (sockaddr *) remote,
 			  sizeof( *remote ));
+		if( err == -1 )
+			timestamper->cancelTxTimestamp();
 	} else {
+		if( tx_batch != NULL && tx_batch->owned() &&
+		    tx_batch->queue( remote, payload, length ))
+			return net_succeed;
 		err = sendto
 			( sd_general, payload, length, 0, (sockaddr *) remote,
 			  sizeof( *remote ));
 	}
-	delete remote;
 	if( err == -1 ) {
 		GPTP_LOG_ERROR( "Failed to send: %s(%d)", strerror(errno), errno );
 		return net_fatal;
@@ -115,6 +252,38 @@ net_result LinuxNetworkInterface::send
 	return net_succeed;
 }
 
+net_result LinuxNetworkInterface::sendAtLaunchTime
+( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload, size_t length,
+  uint64_t launch_time ) {
+	const struct sockaddr_ll *remote;
+	struct sockaddr_ll scratch;
+	uint64_t tai, device;
+
+	// ETF schedules against CLOCK_TAI, which is not locked to the
+	// device clock: translate through a fresh cross timestamp taken
+	// just before queueing. Over the launch lead (at most a few ms) the
+	// rate difference of the two clocks is negligible.
+	if( tx_queue == NULL || !tx_launch_time ||
+	    !timestamper->getTaiCrossTimestamp( tai, device ))
+		return send( addr, etherType, payload, length, true );
+
+	remote = getDestination( addr, etherType, &scratch );
+	return tx_queue->submit
+		( remote, payload, length,
+		  tai + (int64_t)( launch_time - device ));
+}
+
+void LinuxNetworkInterface::beginSendBatch() {
+	if( tx_batch != NULL )
+		tx_batch->begin();
+}
+
+net_result LinuxNetworkInterface::flushSendBatch() {
+	if( tx_batch == NULL )
+		return net_succeed;
+	return tx_batch->end();
+}
+
 
 void LinuxNetworkInterface::disable_rx_queue() {
 	struct packet_mreq mr_8021as;
@@ -308,26 +477,15 @@ bool LinuxNetworkInterface::getLinkSpeed( int sd, uint32_t *speed )
 	return true;
 }
 
-void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
+bool LinuxNetworkInterface::openNetLink( EtherPort *pPort )
 {
-	fd_set netLinkFD;
-	int netLinkSocket;
-	int inetSocket;
 	struct sockaddr_nl addr;
 	uint32_t link_speed = INVALID_LINKSPEED;
 
-	EtherPort *pPort =
-		dynamic_cast<EtherPort *>(iPort);
-	if( pPort == NULL )
-	{
+	netlink_sd = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (netlink_sd < 0) {
 		GPTP_LOG_ERROR("NETLINK socket open error");
-		return;
-	}
-
-	netLinkSocket = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-	if (netLinkSocket < 0) {
-		GPTP_LOG_ERROR("NETLINK socket open error");
-		return;
+		return false;
 	}
 
 	memset((void *) &addr, 0, sizeof (addr));
@@ -336,39 +494,84 @@ void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
 	addr.nl_pid = getpid ();
 	addr.nl_groups = RTMGRP_LINK;
 
-	if (bind (netLinkSocket, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+	if (bind (netlink_sd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
 		GPTP_LOG_ERROR("Socket (netLinkSocket) bind failed %s", strerror(errno));
-		close (netLinkSocket);
-		return;
+		closeNetLink();
+		return false;
 	}
 
 	/*
 	 * Open an INET family socket to be passed to getLinkSpeed() which calls
-	 * ioctl() because NETLINK sockets do not support ioctl(). Since we will
-	 * enter an infinite loop, there are no apparent close() calls for the
-	 * open sockets, but they will be closed on process termination.
+	 * ioctl() because NETLINK sockets do not support ioctl().
 	 */
-	inetSocket = socket (AF_INET, SOCK_STREAM, 0);
-	if (inetSocket < 0) {
+	inet_sd = socket (AF_INET, SOCK_STREAM, 0);
+	if (inet_sd < 0) {
 		GPTP_LOG_ERROR("watchNetLink error opening socket: %s", strerror(errno));
-		close (netLinkSocket);
-		return;
+		closeNetLink();
+		return false;
 	}
 
 	x_initLinkUpStatus(pPort, ifindex);
 
 	if( pPort->getLinkUpState() )
 	{
-		getLinkSpeed( inetSocket, &link_speed );
+		getLinkSpeed( inet_sd, &link_speed );
 	}
 	pPort->setLinkSpeed( link_speed );
 
+	return true;
+}
+
+void LinuxNetworkInterface::readNetLink( EtherPort *pPort )
+{
+	uint32_t link_speed = INVALID_LINKSPEED;
+	bool prev_link_up = pPort->getLinkUpState();
+
+	x_readEvent(netlink_sd, pPort, ifindex);
+
+	// Don't do anything else if link state is the same
+	if( prev_link_up == pPort->getLinkUpState() )
+		return;
+
+	if( pPort->getLinkUpState() )
+	{
+		if ( !getLinkSpeed( inet_sd, &link_speed ) )
+		{
+			link_speed = INVALID_LINKSPEED;
+		}
+	}
+	pPort->setLinkSpeed( link_speed );
+}
+
+void LinuxNetworkInterface::closeNetLink()
+{
+	if( inet_sd != -1 ) close( inet_sd );
+	if( netlink_sd != -1 ) close( netlink_sd );
+	inet_sd = -1;
+	netlink_sd = -1;
+}
+
+void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
+{
+	fd_set netLinkFD;
+
+	EtherPort *pPort =
+		dynamic_cast<EtherPort *>(iPort);
+	if( pPort == NULL )
+	{
+		GPTP_LOG_ERROR("NETLINK socket open error");
+		return;
+	}
+
+	if( !openNetLink( pPort ))
+		return;
+
 	pPort->setLinkThreadRunning(true);
 
 	while ( pPort->getLinkThreadRunning() ) {
 		FD_ZERO(&netLinkFD);
-		FD_CLR(netLinkSocket, &netLinkFD);
-		FD_SET(netLinkSocket, &netLinkFD);
+		FD_CLR(netlink_sd, &netLinkFD);
+		FD_SET(netlink_sd, &netLinkFD);
 
 		// Wait for a net link event
 		struct timeval timeout = { 0, 250000 }; // 250 ms
@@ -376,44 +579,96 @@ void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
 		if (retval == -1)
 			; // Error on select. We will ignore and keep going
 		else if (retval) {
-			bool prev_link_up = pPort->getLinkUpState();
-			x_readEvent(netLinkSocket, pPort, ifindex);
-
-			// Don't do anything else if link state is the same
-			if( prev_link_up == pPort->getLinkUpState() )
-				continue;
-
-			if( pPort->getLinkUpState() )
-			{
-				if ( !getLinkSpeed( inetSocket, &link_speed ) )
-				{
-					link_speed = INVALID_LINKSPEED;
-				}
-			}
-			pPort->setLinkSpeed( link_speed );
+			readNetLink( pPort );
 		}
 		else {
 			GPTP_LOG_VERBOSE("Net link event timeout");
 		}
 	}
-	close(inetSocket);
-	close(netLinkSocket);
+	closeNetLink();
 	GPTP_LOG_DEBUG("Link watch thread terminated ...");
 }
 
+void LinuxNetworkInterface::reactorReceive( void *arg, uint32_t events )
+{
+	LinuxNetworkInterface *iface = (LinuxNetworkInterface *) arg;
+	EtherPort *pPort = (EtherPort *) iface->reactor_port;
+	net_result ret;
+	unsigned i;
+
+	// Timestamps a sender gave up on, nobody else reads the error queue
+	if( events & EPOLLERR )
+		iface->timestamper->drainTxTimestamps();
+
+	if( !( events & EPOLLIN ))
+		return;
+
+	// Level triggered, frames left in the socket are reported again on
+	// the next wakeup, after the timer queue had a chance to run. Frames
+	// already copied out by a batch or ring fill are not, finish them.
+	for( i = 0; i < REACTOR_RX_BUDGET ||
+		     ( iface->rx_ring != NULL && iface->rx_ring->pending() ) ||
+		     ( iface->rx_batch != NULL && iface->rx_batch->pending() );
+	     ++i ) {
+		ret = pPort->receiveMessage();
+		if( ret == net_trfail )
+			break;
+		// Stop receiving, as the listening thread does
+		if( ret == net_fatal ) {
+			iface->reactor->remove( iface->sd_event );
+			break;
+		}
+	}
+}
+
+void LinuxNetworkInterface::reactorNetLink
+( void *arg, uint32_t /*events*/ )
+{
+	LinuxNetworkInterface *iface = (LinuxNetworkInterface *) arg;
+
+	iface->readNetLink( (EtherPort *) iface->reactor_port );
+}
+
+bool LinuxNetworkInterface::attachPort( CommonPort *iPort )
+{
+	EtherPort *pPort;
+
+	if( reactor == NULL )
+		return false;
+
+	pPort = dynamic_cast<EtherPort *>(iPort);
+	if( pPort == NULL ) {
+		GPTP_LOG_ERROR( "Only Ethernet ports can be driven by the reactor" );
+		return false;
+	}
+	if( !openNetLink( pPort ))
+		return false;
+
+	reactor_port = pPort;
+	if( !reactor->add
+	    ( sd_event, EPOLLIN, reactorReceive, this, "event socket" ) ||
+	    !reactor->add
+	    ( netlink_sd, EPOLLIN, reactorNetLink, this, "netlink" )) {
+		reactor->remove( sd_event );
+		closeNetLink();
+		reactor_port = NULL;
+		return false;
+	}
+
+	return true;
+}
+
 
 struct LinuxTimerQueuePrivate {
-	pthread_t signal_thread;
+	pthread_t timer_thread;
 	bool thread_id_valid;
 };
 
-struct LinuxTimerQueueActionArg {
-	timer_t timer_handle;
-	struct sigevent sevp;
+struct LinuxTimerQueueActionArg : public LinuxTimerEntry {
 	event_descriptor_t *inner_arg;
 	ostimerq_handler func;
-	int type;
 	bool rm;
+	bool cancelled;
 };
 
 LinuxTimerQueue::~LinuxTimerQueue() {
@@ -421,10 +676,37 @@ LinuxTimerQueue::~LinuxTimerQueue() {
 	if( _private != NULL ) {
 
 		if ( _private->thread_id_valid ) {
-			pthread_join(_private->signal_thread, NULL);
+			struct itimerspec its;
+
+			// Expire the timer right away to wake the thread up
+			stop = true;
+			memset( &its, 0, sizeof( its ));
+			its.it_value.tv_nsec = 1;
+			timerfd_settime( timer_fd, 0, &its, NULL );
+			pthread_join(_private->timer_thread, NULL);
 		}
 		delete _private;
 	}
+	if( heap != NULL ) {
+		while( heap->size() != 0 ) {
+			LinuxTimerQueueActionArg *arg =
+				(LinuxTimerQueueActionArg *) heap->pop();
+			if( arg->rm ) {
+				delete arg->inner_arg;
+			}
+			delete arg;
+		}
+		delete heap;
+	}
+	while( !spare.empty() ) {
+		delete spare.back();
+		spare.pop_back();
+	}
+	delete index;
+	if( timer_fd != -1 ) close( timer_fd );
+	delete lateness;
+	delete lock_hold;
+	delete handler_time;
 }
 
 bool LinuxTimerQueue::init() {
@@ -433,53 +715,163 @@ bool LinuxTimerQueue::init() {
 	if( _private == NULL ) return false;
 
 	_private->thread_id_valid = false;
+
+	timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+	if( timer_fd == -1 ) {
+		GPTP_LOG_ERROR("timerfd_create failed - %s", strerror(errno));
+		return false;
+	}
+
+	heap = new LinuxTimerHeap( 32 );
+	index = new LinuxTimerIndex();
+	lateness = new LinuxLatencyHistogram();
+	lock_hold = new LinuxLatencyHistogram();
+	handler_time = new LinuxLatencyHistogram();
+	expired.reserve( 32 );
+	spare.reserve( 32 );
+	memset( &stats, 0, sizeof( stats ));
+	return true;
+}
+
+void LinuxTimerQueue::rearm() {
+	LinuxTimerEntry *next = heap->top();
+	uint64_t deadline = next != NULL ? next->deadline : 0;
+	struct itimerspec its;
+
+	// Already armed for the earliest deadline
+	if( deadline == armed ) {
+		return;
+	}
+
+	// A zero it_value disarms the timer
+	memset( &its, 0, sizeof( its ));
+	its.it_value.tv_sec = deadline / 1000000000ULL;
+	its.it_value.tv_nsec = deadline % 1000000000ULL;
+	if( timerfd_settime( timer_fd, TFD_TIMER_ABSTIME, &its, NULL ) == -1 ) {
+		GPTP_LOG_ERROR("Failed to arm timer: %s", strerror(errno));
+		return;
+	}
+	armed = deadline;
+	++stats.rearms;
+}
+
+bool LinuxTimerQueue::dispatch() {
+	LinuxTimerEntry *next;
+	uint64_t now;
+	unsigned i;
+
+	if( lock->lock() != oslock_ok ) {
+		return false;
+	}
+	now = getMonotonicTime();
+	++stats.wakeups;
+
+	// Expired events stay indexed until their handler is about to run so
+	// they can still be cancelled
+	expired.clear();
+	while(( next = heap->top() ) != NULL && next->deadline <= now ) {
+		LinuxTimerQueueActionArg *arg = (LinuxTimerQueueActionArg *) next;
+
+		heap->pop();
+		expired.push_back( arg );
+		++stats.expired;
+		lateness->add( now - arg->deadline );
+	}
+	if( expired.empty() ) {
+		++stats.empty_wakeups;
+	}
+	if( expired.size() > stats.max_expired ) {
+		stats.max_expired = expired.size();
+	}
+
+	// The timerfd expired, it is disarmed until set again
+	armed = 0;
+	rearm();
+
+	lock_hold->add( getMonotonicTime() - now );
+	if( lock->unlock() != oslock_ok ) {
+		return false;
+	}
+
+	for( i = 0; i < expired.size(); ++i ) {
+		LinuxTimerQueueActionArg *arg;
+		bool cancelled;
+
+		if( lock->lock() != oslock_ok ) {
+			return false;
+		}
+		now = getMonotonicTime();
+		arg = expired[i];
+		expired[i] = NULL;
+		cancelled = arg->cancelled;
+		if( !cancelled ) {
+			index->unlink( arg );
+		}
+		lock_hold->add( getMonotonicTime() - now );
+		if( lock->unlock() != oslock_ok ) {
+			return false;
+		}
+
+		if( !cancelled ) {
+			now = getMonotonicTime();
+			LinuxTimerQueueAction( arg );
+			handler_time->add( getMonotonicTime() - now );
+		}
+
+		// Spare entries are shared with addEvent() under the lock
+		if( lock->lock() != oslock_ok ) {
+			return false;
+		}
+		release( arg );
+		if( lock->unlock() != oslock_ok ) {
+			return false;
+		}
+	}
+
 	return true;
 }
 
 void *LinuxTimerQueueHandler( void *arg ) {
 	LinuxTimerQueue *timerq = (LinuxTimerQueue *) arg;
-	sigset_t waitfor;
-	struct timespec timeout;
-	timeout.tv_sec = 0; timeout.tv_nsec = 100000000; /* 100 ms */
+	uint64_t expirations;
 
-	sigemptyset( &waitfor );
-	GPTP_LOG_DEBUG("Signal thread started");
+	GPTP_LOG_DEBUG("Timer thread started");
 	while( !timerq->stop ) {
-		siginfo_t info;
-		LinuxTimerQueueMap_t::iterator iter;
-		sigaddset( &waitfor, SIGUSR1 );
-		if( sigtimedwait( &waitfor, &info, &timeout ) == -1 ) {
-			if( errno == EAGAIN ) {
+		if( read( timerq->timer_fd, &expirations, sizeof( expirations ))
+		    == -1 ) {
+			if( errno == EINTR || errno == EAGAIN ) {
 				continue;
 			}
-			else {
-				GPTP_LOG_ERROR("Signal thread sigtimedwait error: %d", errno);
-				break;
-			}
-		}
-		if( timerq->lock->lock() != oslock_ok ) {
+			GPTP_LOG_ERROR("Timer thread read error: %d", errno);
 			break;
 		}
-
-		iter = timerq->timerQueueMap.find(info.si_value.sival_int);
-		if( iter != timerq->timerQueueMap.end() ) {
-		    struct LinuxTimerQueueActionArg *arg = iter->second;
-			timerq->timerQueueMap.erase(iter);
-			timerq->LinuxTimerQueueAction( arg );
-			if( arg->rm ) {
-				delete arg->inner_arg;
-			}
-			timer_delete(arg->timer_handle);
-			delete arg;
+		if( timerq->stop ) {
+			break;
 		}
-		if( timerq->lock->unlock() != oslock_ok ) {
+		if( !timerq->dispatch() ) {
 			break;
 		}
 	}
-	GPTP_LOG_DEBUG("Signal thread exit");
+	GPTP_LOG_DEBUG("Timer thread exit");
 	return NULL;
 }
 
+void LinuxTimerQueueReactorHandler( void *arg, uint32_t /*events*/ ) {
+	LinuxTimerQueue *timerq = (LinuxTimerQueue *) arg;
+	uint64_t expirations;
+
+	// Another handler may have re-armed the timer since it was reported
+	// readable, the descriptor is non-blocking
+	if( read( timerq->timer_fd, &expirations, sizeof( expirations ))
+	    == -1 ) {
+		if( errno != EAGAIN ) {
+			GPTP_LOG_ERROR("Timer read error: %d", errno);
+		}
+		return;
+	}
+	timerq->dispatch();
+}
+
 void LinuxTimerQueue::LinuxTimerQueueAction( LinuxTimerQueueActionArg *arg ) {
 	arg->func( arg->inner_arg );
 
@@ -495,11 +887,20 @@ OSTimerQueue *LinuxTimerQueueFactory::createOSTimerQueue
 		return NULL;
 	}
 
-	ret->key = 0;
 	ret->stop = false;
 	ret->lock = clock->timerQLock();
+	if( reactor != NULL ) {
+		if( fcntl( ret->timer_fd, F_SETFL, O_NONBLOCK ) == -1 ||
+		    !reactor->add
+		    ( ret->timer_fd, EPOLLIN, LinuxTimerQueueReactorHandler, ret,
+		      "timer queue" )) {
+			delete ret;
+			return NULL;
+		}
+		return ret;
+	}
 	if( pthread_create
-		( &(ret->_private->signal_thread),
+		( &(ret->_private->timer_thread),
 		  NULL, LinuxTimerQueueHandler, ret ) != 0 ) {
 		delete ret;
 		return NULL;
@@ -510,72 +911,150 @@ OSTimerQueue *LinuxTimerQueueFactory::createOSTimerQueue
 
 
 
+LinuxTimerQueueActionArg *LinuxTimerQueue::allocate() {
+	LinuxTimerQueueActionArg *arg;
+
+	if( spare.empty() ) {
+		++stats.allocated;
+		return new LinuxTimerQueueActionArg;
+	}
+	arg = spare.back();
+	spare.pop_back();
+
+	return arg;
+}
+
+void LinuxTimerQueue::release( LinuxTimerQueueActionArg *arg ) {
+	if( arg->rm ) {
+		delete arg->inner_arg;
+	}
+	spare.push_back( arg );
+}
+
 bool LinuxTimerQueue::addEvent
 ( unsigned long micros, int type, ostimerq_handler func,
   event_descriptor_t * arg, bool rm, unsigned *event) {
 	LinuxTimerQueueActionArg *outer_arg;
-	int err;
-	LinuxTimerQueueMap_t::iterator iter;
-
+	LinuxTimerEntry *entry;
+	uint64_t deadline = getMonotonicTime() + micros * 1000ULL;
+
+	// Arming a descriptor that is still pending moves its deadline.
+	// Once expired it is no longer in the heap and is armed again.
+	if( arg != NULL ) {
+		for( entry = index->find( arg->port, type ); entry != NULL;
+		     entry = entry->next ) {
+			outer_arg = (LinuxTimerQueueActionArg *) entry;
+			if( outer_arg->inner_arg != arg ||
+			    !heap->update( entry, deadline )) {
+				continue;
+			}
+			outer_arg->func = func;
+			++stats.moved;
+			rearm();
+			return true;
+		}
+	}
 
-	outer_arg = new LinuxTimerQueueActionArg;
+	outer_arg = allocate();
 	outer_arg->inner_arg = arg;
 	outer_arg->rm = rm;
+	outer_arg->cancelled = false;
 	outer_arg->func = func;
 	outer_arg->type = type;
+	outer_arg->owner = arg != NULL ? arg->port : NULL;
+	outer_arg->deadline = deadline;
 
-	// Find key that we can use
-	while( timerQueueMap.find( key ) != timerQueueMap.end() ) {
-		++key;
+	heap->push( outer_arg );
+	index->insert( outer_arg );
+	++stats.added;
+	if( heap->size() > stats.max_pending ) {
+		stats.max_pending = heap->size();
 	}
 
-	{
-		struct itimerspec its;
-		memset(&(outer_arg->sevp), 0, sizeof(outer_arg->sevp));
-		outer_arg->sevp.sigev_notify = SIGEV_SIGNAL;
-		outer_arg->sevp.sigev_signo  = SIGUSR1;
-		outer_arg->sevp.sigev_value.sival_int = key;
-		if ( timer_create
-			 (CLOCK_MONOTONIC, &outer_arg->sevp, &outer_arg->timer_handle)
-			 == -1) {
-			GPTP_LOG_ERROR("timer_create failed - %s", strerror(errno));
-			return false;
-		}
-		timerQueueMap[key] = outer_arg;
-
-		memset(&its, 0, sizeof(its));
-		its.it_value.tv_sec = micros / 1000000;
-		its.it_value.tv_nsec = (micros % 1000000) * 1000;
-		err = timer_settime( outer_arg->timer_handle, 0, &its, NULL );
-		if( err < 0 ) {
-			GPTP_LOG_ERROR("Failed to arm timer: %s", strerror(errno));
-			return false;
-		}
-	}
+	// Only touches the timerfd when this is the new earliest event
+	rearm();
 
 	return true;
 }
 
 
-bool LinuxTimerQueue::cancelEvent( int type, unsigned *event ) {
-	LinuxTimerQueueMap_t::iterator iter;
-	for( iter = timerQueueMap.begin(); iter != timerQueueMap.end();) {
-		if( (iter->second)->type == type ) {
-			// Delete element
-			if( (iter->second)->rm ) {
-				delete (iter->second)->inner_arg;
+void LinuxTimerQueue::cancel( LinuxTimerQueueActionArg *arg ) {
+	index->unlink( arg );
+
+	// Not in the heap: expired, the timer thread releases it
+	if( !heap->remove( arg )) {
+		arg->cancelled = true;
+		++stats.dispatch_cancelled;
+		return;
+	}
+	release( arg );
+	++stats.cancelled;
+}
+
+bool LinuxTimerQueue::cancelEvent
+( int type, CommonPort *port, unsigned *event ) {
+	LinuxTimerQueueActionArg *arg;
+	unsigned i = 0;
+
+	if( port != NULL ) {
+		while(( arg = (LinuxTimerQueueActionArg *)
+			index->find( port, type )) != NULL ) {
+			cancel( arg );
+		}
+	} else {
+		while( i < heap->size() ) {
+			arg = (LinuxTimerQueueActionArg *) heap->at( i );
+			if( arg->type != type ) {
+				++i;
+				continue;
+			}
+			// Removal moves another entry into position i, look again
+			cancel( arg );
+		}
+		for( i = 0; i < expired.size(); ++i ) {
+			arg = expired[i];
+			if( arg != NULL && arg->type == type && !arg->cancelled ) {
+				cancel( arg );
 			}
-			timer_delete(iter->second->timer_handle);
-			delete iter->second;
-			timerQueueMap.erase(iter++);
-		} else {
-			++iter;
 		}
 	}
 
+	// Leaving the timer armed for a cancelled event only costs a wakeup,
+	// defer reprogramming until the next dispatch or earlier event
+
 	return true;
 }
 
+void LinuxTimerQueue::logStatistics() {
+	if( lock->lock() != oslock_ok ) {
+		return;
+	}
+	GPTP_LOG_STATUS
+		( "Timer queue: added %llu, cancelled %llu, expired %llu, "
+		  "pending %u, max pending %u",
+		  (unsigned long long) stats.added,
+		  (unsigned long long) stats.cancelled,
+		  (unsigned long long) stats.expired, heap->size(),
+		  stats.max_pending );
+	GPTP_LOG_STATUS
+		( "Timer queue: wakeups %llu, empty %llu, timerfd rearms %llu",
+		  (unsigned long long) stats.wakeups,
+		  (unsigned long long) stats.empty_wakeups,
+		  (unsigned long long) stats.rearms );
+	GPTP_LOG_STATUS
+		( "Timer queue: cancelled after expiry %llu, max expired per "
+		  "wakeup %u", (unsigned long long) stats.dispatch_cancelled,
+		  stats.max_expired );
+	GPTP_LOG_STATUS
+		( "Timer queue: moved in place %llu, entries allocated %u, "
+		  "spare %u", (unsigned long long) stats.moved, stats.allocated,
+		  (unsigned) spare.size() );
+	lateness->logStatistics( "Timer expiry lateness" );
+	lock_hold->logStatistics( "Timer thread lock hold" );
+	handler_time->logStatistics( "Timer handler run time" );
+	lock->unlock();
+}
+
 
 void* OSThreadCallback( void* input ) {
 	OSThreadArg *arg = (OSThreadArg*) input;
@@ -1028,6 +1507,30 @@ bool LinuxSharedMemoryIPC::update_network_interface(
 	return true;
 }
 
+bool LinuxSharedMemoryIPC::update_estimate(
+	uint32_t phase_stddev,
+	uint32_t freq_stddev,
+	int64_t  link_delay,
+	uint32_t link_delay_stddev )
+{
+	int buf_offset = 0;
+	char *shm_buffer = master_offset_buffer;
+	gPtpTimeData *ptimedata;
+	if( shm_buffer != NULL ) {
+		/* lock */
+		pthread_mutex_lock((pthread_mutex_t *) shm_buffer);
+		buf_offset += sizeof(pthread_mutex_t);
+		ptimedata   = (gPtpTimeData *) (shm_buffer + buf_offset);
+		ptimedata->ml_phoffset_stddev = phase_stddev;
+		ptimedata->ml_freqoffset_stddev = freq_stddev;
+		ptimedata->link_delay = link_delay;
+		ptimedata->link_delay_stddev = link_delay_stddev;
+		/* unlock */
+		pthread_mutex_unlock((pthread_mutex_t *) shm_buffer);
+	}
+	return true;
+}
+
 void LinuxSharedMemoryIPC::stop() {
 	if( master_offset_buffer != NULL ) {
 		munmap( master_offset_buffer, SHM_SIZE );
@@ -1089,6 +1592,21 @@ bool LinuxNetworkInterfaceFactory::createInterface
 	}
 	ifindex = device.ifr_ifindex;
 	net_iface_l->ifindex = ifindex;
+
+	// Every multicast destination is fixed, build their socket
+	// addresses once rather than on each transmit. Pdelay and other
+	// messages share GPTP_MULTICAST.
+	net_iface_l->tx_dest = new struct sockaddr_ll[TX_DEST_CACHE_SIZE];
+	net_iface_l->addDestination( GPTP_MULTICAST, PTP_ETHERTYPE );
+	net_iface_l->addDestination( TEST_STATUS_MULTICAST, AVTP_ETHERTYPE );
+
+	net_iface_l->tx_batch = new LinuxTxBatch();
+	if( !net_iface_l->tx_batch->init
+	    ( net_iface_l->sd_general, TX_BATCH_MAX )) {
+		GPTP_LOG_ERROR( "Failed to set up batched transmit" );
+		goto exit_error;
+	}
+
 	memset( &mr_8021as, 0, sizeof( mr_8021as ));
 	mr_8021as.mr_ifindex = ifindex;
 	mr_8021as.mr_type = PACKET_MR_MULTICAST;
@@ -1116,6 +1634,109 @@ bool LinuxNetworkInterfaceFactory::createInterface
 		goto exit_error;
 	}
 
+	if( options.rx_filter ) {
+		net_iface_l->rx_filter = new LinuxRxFilter();
+		if( !net_iface_l->rx_filter->init
+		    ( ifindex, PTP_ETHERTYPE, &net_iface_l->local_addr,
+		      options.rx_filter_domain ) ||
+		    !net_iface_l->rx_filter->attach( net_iface_l->sd_event ) ||
+		    !net_iface_l->rx_filter->attach( net_iface_l->sd_general )) {
+			GPTP_LOG_ERROR( "Failed to set up receive filter" );
+			goto exit_error;
+		}
+		GPTP_LOG_STATUS
+			( "In-kernel PTP receive filter enabled (domain %u)",
+			  options.rx_filter_domain );
+	}
+
+	if( options.rx_busy_poll != 0 ) {
+		int value = options.rx_busy_poll;
+		err = setsockopt
+			( net_iface_l->sd_event, SOL_SOCKET, SO_BUSY_POLL, &value,
+			  sizeof( value ));
+		if( err == -1 ) {
+			GPTP_LOG_ERROR
+				( "Failed to enable busy polling: %s", strerror(errno));
+			goto exit_error;
+		}
+		// The remaining options only tune busy polling, older kernels
+		// lack them
+		value = 1;
+		err = setsockopt
+			( net_iface_l->sd_event, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+			  &value, sizeof( value ));
+		if( err == -1 ) {
+			GPTP_LOG_WARNING
+				( "SO_PREFER_BUSY_POLL not supported: %s",
+				  strerror(errno));
+		}
+		if( options.rx_busy_poll_budget != 0 ) {
+			value = options.rx_busy_poll_budget;
+			err = setsockopt
+				( net_iface_l->sd_event, SOL_SOCKET,
+				  SO_BUSY_POLL_BUDGET, &value, sizeof( value ));
+			if( err == -1 ) {
+				GPTP_LOG_WARNING
+					( "SO_BUSY_POLL_BUDGET not supported: %s",
+					  strerror(errno));
+			}
+		}
+		net_iface_l->rx_busy_poll = options.rx_busy_poll;
+		GPTP_LOG_STATUS
+			( "Busy poll receive enabled, %u us, budget %u",
+			  options.rx_busy_poll, options.rx_busy_poll_budget );
+	}
+	if( options.tx_launch_time && options.reactor != NULL ) {
+		GPTP_LOG_WARNING
+			( "Sync launch times need the TX queue, disabled in "
+			  "reactor mode" );
+	} else if( options.tx_launch_time ) {
+		struct sock_txtime txtime;
+
+		memset( &txtime, 0, sizeof( txtime ));
+		txtime.clockid = CLOCK_TAI;
+		txtime.flags = SOF_TXTIME_REPORT_ERRORS;
+		err = setsockopt
+			( net_iface_l->sd_event, SOL_SOCKET, SO_TXTIME, &txtime,
+			  sizeof( txtime ));
+		if( err == -1 ) {
+			GPTP_LOG_ERROR
+				( "Failed to enable SO_TXTIME: %s", strerror(errno));
+			goto exit_error;
+		}
+		net_iface_l->tx_launch_time = true;
+		GPTP_LOG_STATUS( "Sync launch time scheduling (SO_TXTIME) enabled" );
+	}
+	net_iface_l->rx_cpu = options.rx_cpu;
+	net_iface_l->rx_latency = new LinuxLatencyHistogram();
+
+	if( options.rx_ring_blocks != 0 ) {
+		if( options.rx_batch_size != 0 ) {
+			GPTP_LOG_WARNING
+				( "Receive ring enabled, ignoring receive batch "
+				  "size" );
+		}
+		net_iface_l->rx_ring = new LinuxRxRing();
+		if( !net_iface_l->rx_ring->init
+		    ( net_iface_l->sd_event, options.rx_ring_blocks )) {
+			GPTP_LOG_ERROR( "Failed to set up receive ring" );
+			goto exit_error;
+		}
+		GPTP_LOG_STATUS
+			( "TPACKET_V3 receive ring enabled, %u blocks of %u bytes",
+			  options.rx_ring_blocks, RX_RING_BLOCK_SIZE );
+	} else if( options.rx_batch_size != 0 ) {
+		net_iface_l->rx_batch = new LinuxRxBatch();
+		if( !net_iface_l->rx_batch->init
+		    ( net_iface_l->sd_event, options.rx_batch_size )) {
+			GPTP_LOG_ERROR( "Failed to set up batched receive" );
+			goto exit_error;
+		}
+		GPTP_LOG_STATUS
+			( "Batched receive enabled, up to %u frames per call",
+			  options.rx_batch_size );
+	}
+
 	net_iface_l->timestamper =
 		dynamic_cast <LinuxTimestamper *>(timestamper);
 	if(net_iface_l->timestamper == NULL) {
@@ -1127,6 +1748,23 @@ bool LinuxNetworkInterfaceFactory::createInterface
 		GPTP_LOG_ERROR( "post_init failed\n" );
 		goto exit_error;
 	}
+	net_iface_l->reactor = options.reactor;
+#ifndef ARCH_INTELCE
+	// The reactor thread sends event messages and collects their
+	// timestamps itself
+	if( options.reactor != NULL ) {
+		*net_iface = net_iface_l;
+		return true;
+	}
+	net_iface_l->tx_queue = new LinuxTxQueue();
+	if( !net_iface_l->tx_queue->init
+	    ( net_iface_l->sd_event, net_iface_l->timestamper ) ||
+	    !net_iface_l->tx_queue->start() ) {
+		GPTP_LOG_ERROR( "Failed to set up the TX queue" );
+		goto exit_error;
+	}
+	net_iface_l->timestamper->setTxQueue( net_iface_l->tx_queue );
+#endif
 	*net_iface = net_iface_l;
 	return true;
 
@@ -48,12 +48,15 @@
 #include <linux/ethtool.h>
 
 #include <list>
+#include <vector>
 
 #define ONE_WAY_PHY_DELAY 400	/*!< One way phy delay. TX or RX phy delay default value*/
 #define P8021AS_MULTICAST "\x01\x80\xC2\x00\x00\x0E"	/*!< Default multicast address*/
 #define PTP_DEVICE "/dev/ptpXX"			/*!< Default PTP device */
 #define PTP_DEVICE_IDX_OFFS 8			/*!< PTP device index offset*/
 #define CLOCKFD 3						/*!< Clock file descriptor */
+#define TX_DEST_CACHE_SIZE 2			/*!< Cached transmit destinations (PTP and test status multicast) */
+#define REACTOR_RX_BUDGET 64			/*!< Frames received per reactor wakeup before other sources run */
 #define FD_TO_CLOCKID(fd)       ((~(clockid_t) (fd) << 3) | CLOCKFD)	/*!< Converts an FD to CLOCKID */
 struct timespec;
 
@@ -65,6 +68,15 @@ struct timespec;
 extern Timestamp tsToTimestamp(struct timespec *ts);
 
 struct TicketingLockPrivate;
+class LinuxRxBatch;
+class LinuxRxRing;
+class LinuxRxFilter;
+class LinuxLatencyHistogram;
+class LinuxTxBatch;
+class LinuxTxQueue;
+class LinuxReactor;
+class EtherPort;
+struct sockaddr_ll;
 
 /**
  * @brief Provides the type for the TicketingLock private structure
@@ -140,6 +152,74 @@ public:
 	 * @return TRUE if success, FALSE in case of error
 	 */
 	virtual bool post_init( int ifindex, int sd, TicketingLock *lock ) = 0;
+
+	/**
+	 * @brief  Logs timestamper statistics, if any
+	 * @return void
+	 */
+	virtual void logStatistics() { }
+
+	/**
+	 * @brief  Collects the TX timestamp of the event frame just sent.
+	 * Called by the TX queue owner, the only reader of the error queue.
+	 * @param  messageId Message type and sequence id of the frame
+	 * @param  timestamp [out] TX timestamp
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if collected, GPTP_EC_FAILURE otherwise
+	 */
+	virtual int collectTxTimestamp
+	( PTPMessageId /*messageId*/, Timestamp & /*timestamp*/,
+	  unsigned /*timeout_us*/ ) {
+		return GPTP_EC_FAILURE;
+	}
+
+	/**
+	 * @brief  Reads the device clock and CLOCK_TAI at the same instant.
+	 * CLOCK_TAI is the clock launch times are scheduled against.
+	 * @param  tai [out] CLOCK_TAI time in nanoseconds
+	 * @param  device [out] Device time in nanoseconds
+	 * @return FALSE if the device clock cannot be read
+	 */
+	virtual bool getTaiCrossTimestamp
+	( uint64_t & /*tai*/, uint64_t & /*device*/ ) const {
+		return false;
+	}
+
+	/**
+	 * @brief  Sets the queue event frames are sent through, timestamps
+	 * are then taken from the queue
+	 * @param  queue [in] TX queue of the network interface
+	 * @return void
+	 */
+	virtual void setTxQueue( LinuxTxQueue * /*queue*/ ) { }
+
+	/**
+	 * @brief  Called by the sending thread just before an event message
+	 * is sent, so its TX timestamp can be correlated later
+	 * @param  payload [in] PTP message being sent
+	 * @param  length Length of the message
+	 * @return void
+	 */
+	virtual void expectTxTimestamp
+	( const uint8_t * /*payload*/, size_t /*length*/ ) { }
+
+	/**
+	 * @brief  Called when sending the message passed to the last
+	 * expectTxTimestamp() call failed
+	 * @return void
+	 */
+	virtual void cancelTxTimestamp() { }
+
+	/**
+	 * @brief  Reads the TX timestamps pending on the socket error queue
+	 * without waiting. Called when the error queue is readable and no
+	 * sender is collecting its timestamp.
+	 * @return GPTP_EC_SUCCESS if the queue was drained, GPTP_EC_FAILURE on
+	 * error
+	 */
+	virtual int drainTxTimestamps() {
+		return GPTP_EC_SUCCESS;
+	}
 };
 
 /**
@@ -155,6 +235,101 @@ private:
 	int ifindex;
 
 	TicketingLock net_lock;
+	LinuxRxBatch *rx_batch;
+	LinuxRxRing *rx_ring;
+	LinuxRxFilter *rx_filter;
+
+	unsigned rx_busy_poll;
+	int rx_cpu;
+	bool rx_cpu_pinned;
+	uint64_t rx_busy_polls;
+	uint64_t rx_busy_empty;
+	LinuxLatencyHistogram *rx_latency;
+
+	LinuxTxQueue *tx_queue;
+	bool tx_launch_time;
+	LinuxTxBatch *tx_batch;
+	struct sockaddr_ll *tx_dest;
+	unsigned tx_dest_count;
+	uint64_t tx_dest_misses;
+
+	LinuxReactor *reactor;
+	CommonPort *reactor_port;
+	int netlink_sd;
+	int inet_sd;
+
+	/**
+	 * @brief  Opens the netlink socket and reads the initial link state
+	 * @param  pPort [in] Port notified of link changes
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool openNetLink( EtherPort *pPort );
+
+	/**
+	 * @brief  Reads pending netlink messages and updates the port link
+	 * state and speed
+	 * @param  pPort [in] Port notified of link changes
+	 * @return void
+	 */
+	void readNetLink( EtherPort *pPort );
+
+	/**
+	 * @brief  Closes the netlink sockets
+	 * @return void
+	 */
+	void closeNetLink();
+
+	/**
+	 * @brief  Reactor handler of the event socket. Receives and processes
+	 * frames until none is left or REACTOR_RX_BUDGET is reached, and
+	 * drains late TX timestamps on EPOLLERR.
+	 * @param  arg [in] LinuxNetworkInterface
+	 * @param  events Ready epoll events
+	 * @return void
+	 */
+	static void reactorReceive( void *arg, uint32_t events );
+
+	/**
+	 * @brief  Reactor handler of the netlink socket
+	 * @param  arg [in] LinuxNetworkInterface
+	 * @param  events Ready epoll events
+	 * @return void
+	 */
+	static void reactorNetLink( void *arg, uint32_t events );
+
+	/**
+	 * @brief  Adds a fixed destination to the transmit address cache
+	 * @param  addr Destination MAC address
+	 * @param  etherType EtherType in host order
+	 * @return void
+	 */
+	void addDestination( uint64_t addr, uint16_t etherType );
+
+	/**
+	 * @brief  Looks up the socket address for a destination, building it
+	 * in scratch if it is not cached
+	 * @param  addr [in] Destination address
+	 * @param  etherType EtherType in host order
+	 * @param  scratch [out] Storage used on a cache miss
+	 * @return Pointer to the socket address
+	 */
+	const struct sockaddr_ll *getDestination
+	( LinkLayerAddress *addr, uint16_t etherType,
+	  struct sockaddr_ll *scratch );
+
+	/**
+	 * @brief  Pins the calling (listening) thread to rx_cpu
+	 * @return void
+	 */
+	void pinReceiveThread();
+
+	/**
+	 * @brief  Records the time between the kernel receiving a frame and
+	 * the frame being handed to the protocol code
+	 * @param  software [in] Kernel receive time, ignored if zero
+	 * @return void
+	 */
+	void recordReceiveLatency( struct timespec *software );
 public:
 	/**
 	 * @brief Sends a packet to a remote address
@@ -181,6 +356,47 @@ public:
 	virtual net_result nrecv
 	( LinkLayerAddress *addr, uint8_t *payload, size_t &length );
 
+	/**
+	 * @brief  Receives a packet and hands back its hardware receive
+	 * timestamp directly, without going through the timestamper
+	 * @param  addr [in] Remote link layer address
+	 * @param  payload [out] Data buffer
+	 * @param  length [out] Size of received data buffer
+	 * @param  rx_timestamp [out] Device receive timestamp
+	 * @param  rx_timestamp_valid [out] TRUE if rx_timestamp was set
+	 * @return net_succeed in case of successful reception, net_trfail in case there is
+	 * an error on the transmit side, net_fatal if error on reception
+	 */
+	virtual net_result nrecvTimestamped
+	( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+	  Timestamp &rx_timestamp, bool &rx_timestamp_valid );
+
+	/**
+	 * @brief  Receives a packet in place. With a receive ring the frame
+	 * is handed out where the kernel wrote it and its block stays with
+	 * the process until releaseReceived(), otherwise it is received into
+	 * buf.
+	 * @param  addr [in] Remote link layer address
+	 * @param  buf [in] Buffer to receive into without a receive ring
+	 * @param  payload [out] Received data
+	 * @param  length [inout] Size of buf on input, size of received data
+	 * on output
+	 * @param  rx_timestamp [out] Device receive timestamp
+	 * @param  rx_timestamp_valid [out] TRUE if rx_timestamp was set
+	 * @return net_succeed in case of successful reception, net_trfail in case there is
+	 * an error on the transmit side, net_fatal if error on reception
+	 */
+	virtual net_result nrecvInPlace
+	( LinkLayerAddress *addr, uint8_t *buf, uint8_t *&payload,
+	  size_t &length, Timestamp &rx_timestamp, bool &rx_timestamp_valid );
+
+	/**
+	 * @brief  Releases the frame returned by nrecvInPlace(), handing its
+	 * receive ring block back to the kernel after the block's last frame
+	 * @return void
+	 */
+	virtual void releaseReceived();
+
 	/**
 	 * @brief  Disables rx socket descriptor rx queue
 	 * @return void
@@ -216,6 +432,15 @@ public:
 	 */
 	virtual void watchNetLink( CommonPort *pPort );
 
+	/**
+	 * @brief  Registers the event socket and a netlink socket of the port
+	 * with the reactor given in the factory options, if any
+	 * @param  pPort [in] Port to drive
+	 * @return TRUE if the reactor drives the port, FALSE if the port must
+	 * start its own threads
+	 */
+	virtual bool attachPort( CommonPort *pPort );
+
 	/**
 	 * @brief Gets the payload offset
 	 * @return payload offset
@@ -223,6 +448,50 @@ public:
 	virtual unsigned getPayloadOffset() {
 		return 0;
 	}
+
+	/**
+	 * @brief  Checks whether SO_TXTIME is enabled on the event socket
+	 * @return TRUE if launch times are honoured
+	 */
+	virtual bool launchTimeEnabled() {
+		return tx_launch_time;
+	}
+
+	/**
+	 * @brief  Queues an event message for transmission at a launch time.
+	 * The time is converted to CLOCK_TAI, the clock of the ETF qdisc,
+	 * through a device to CLOCK_TAI cross timestamp and handed to the
+	 * qdisc with SCM_TXTIME.
+	 * @param  addr [in] Remote link layer address
+	 * @param  etherType The EtherType of the message in host order
+	 * @param  payload [in] Data buffer
+	 * @param  length Size of data buffer
+	 * @param  launch_time Launch time in device time nanoseconds
+	 * @return net_succeed if queued, net_fatal otherwise
+	 */
+	virtual net_result sendAtLaunchTime
+	( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload,
+	  size_t length, uint64_t launch_time );
+
+	/**
+	 * @brief  Queues general messages sent by the calling thread until
+	 * flushSendBatch()
+	 * @return void
+	 */
+	virtual void beginSendBatch();
+
+	/**
+	 * @brief  Sends the queued general messages with one sendmmsg() call
+	 * @return net_succeed if all messages were sent, net_fatal otherwise
+	 */
+	virtual net_result flushSendBatch();
+
+	/**
+	 * @brief Logs receive and transmit statistics
+	 * @return void
+	 */
+	virtual void logStatistics();
+
 	/**
 	 * @brief Destroys the network interface
 	 */
@@ -234,6 +503,26 @@ protected:
 	LinuxNetworkInterface() {
 		sd_event = -1;
 		sd_general = -1;
+		timestamper = NULL;
+		rx_batch = NULL;
+		rx_ring = NULL;
+		rx_filter = NULL;
+		rx_busy_poll = 0;
+		rx_cpu = -1;
+		rx_cpu_pinned = false;
+		rx_busy_polls = 0;
+		rx_busy_empty = 0;
+		rx_latency = NULL;
+		tx_queue = NULL;
+		tx_launch_time = false;
+		tx_batch = NULL;
+		tx_dest = NULL;
+		tx_dest_count = 0;
+		tx_dest_misses = 0;
+		reactor = NULL;
+		reactor_port = NULL;
+		netlink_sd = -1;
+		inet_sd = -1;
 	}
 };
 
@@ -392,11 +681,8 @@ public:
 };
 
 struct LinuxTimerQueueActionArg;
-
-/**
- * @brief Provides a map type for the LinuxTimerQueue class
- */
-typedef std::map < int, struct LinuxTimerQueueActionArg *> LinuxTimerQueueMap_t;
+class LinuxTimerHeap;
+class LinuxTimerIndex;
 
 /**
  * @brief  Linux timer queue handler. Deals with linux queues
@@ -405,6 +691,15 @@ typedef std::map < int, struct LinuxTimerQueueActionArg *> LinuxTimerQueueMap_t;
  */
 void *LinuxTimerQueueHandler( void *arg );
 
+/**
+ * @brief  Dispatches the expired timers when the timerfd of a timer queue
+ * driven by a LinuxReactor becomes readable
+ * @param  arg [in] LinuxTimerQueue
+ * @param  events Ready epoll events
+ * @return void
+ */
+void LinuxTimerQueueReactorHandler( void *arg, uint32_t events );
+
 struct LinuxTimerQueuePrivate;
 /**
  * @brief Provides a private type for the LinuxTimerQueue class
@@ -412,24 +707,71 @@ struct LinuxTimerQueuePrivate;
 typedef struct LinuxTimerQueuePrivate * LinuxTimerQueuePrivate_t;
 
 /**
- * @brief Extends OSTimerQueue to Linux
+ * @brief Statistics collected by LinuxTimerQueue
+ */
+typedef struct {
+	uint64_t added;			//!< Events armed
+	uint64_t cancelled;		//!< Events removed before expiring
+	uint64_t expired;		//!< Events dispatched
+	uint64_t wakeups;		//!< Timer thread wakeups
+	uint64_t empty_wakeups;		//!< Wakeups without an expired event
+	uint64_t rearms;		//!< timerfd_settime() calls
+	uint64_t dispatch_cancelled;	//!< Cancelled after expiring, before running
+	uint64_t moved;			//!< Pending events re-armed in place
+	unsigned allocated;		//!< Queue entries allocated, reused afterwards
+	unsigned max_pending;		//!< Most events pending at once
+	unsigned max_expired;		//!< Most events expired in one wakeup
+} timer_queue_stats_t;
+
+/**
+ * @brief Extends OSTimerQueue to Linux. Pending events are kept in a
+ * min-heap ordered by deadline and a single CLOCK_MONOTONIC timerfd is
+ * armed for the earliest one. A dedicated thread blocks on the timerfd
+ * and dispatches every expired event, no signals are involved. Events
+ * are also indexed by (port, type) so cancelling only visits the events
+ * of that port and type. Expired events are collected under the timer
+ * queue lock and their handlers run after it is released, so handlers
+ * that send frames or sleep do not block other threads adding or
+ * cancelling timers. An expired event cancelled before its handler runs
+ * is dropped.
  */
 class LinuxTimerQueue : public OSTimerQueue {
 	friend class LinuxTimerQueueFactory;
 	friend void *LinuxTimerQueueHandler( void * arg );
+	friend void LinuxTimerQueueReactorHandler( void *arg, uint32_t events );
 private:
-	LinuxTimerQueueMap_t timerQueueMap;
-	int key;
+	LinuxTimerHeap *heap;
+	LinuxTimerIndex *index;
+	int timer_fd;
+	uint64_t armed;
 	bool stop;
 	LinuxTimerQueuePrivate_t _private;
 	OSLock *lock;
+	std::vector<LinuxTimerQueueActionArg *> expired;
+	std::vector<LinuxTimerQueueActionArg *> spare;
+	timer_queue_stats_t stats;
+	LinuxLatencyHistogram *lateness;
+	LinuxLatencyHistogram *lock_hold;
+	LinuxLatencyHistogram *handler_time;
 	void LinuxTimerQueueAction( LinuxTimerQueueActionArg *arg );
+	void rearm();
+	bool dispatch();
+	void cancel( LinuxTimerQueueActionArg *arg );
+	LinuxTimerQueueActionArg *allocate();
+	void release( LinuxTimerQueueActionArg *arg );
 protected:
 	/**
 	 * @brief Default constructor
 	 */
 	LinuxTimerQueue() {
 		_private = NULL;
+		heap = NULL;
+		index = NULL;
+		lateness = NULL;
+		lock_hold = NULL;
+		handler_time = NULL;
+		timer_fd = -1;
+		armed = 0;
 	}
 
 	/**
@@ -460,17 +802,43 @@ public:
 	/**
 	 * @brief Removes an event from the timer queue
 	 * @param type Event type
+	 * @param port Port the event was added for, NULL for all ports
 	 * @param event [inout] Pointer to the event
 	 * @return TRUE success, FALSE fail
 	 */
-	bool cancelEvent( int type, unsigned *event );
+	bool cancelEvent( int type, CommonPort *port, unsigned *event );
+
+	/**
+	 * @brief  Logs the timer statistics
+	 * @return void
+	 */
+	void logStatistics();
 };
 
 /**
  * @brief Implements factory design pattern for linux
  */
 class LinuxTimerQueueFactory : public OSTimerQueueFactory {
+private:
+	LinuxReactor *reactor;
 public:
+	/**
+	 * @brief Default constructor, timer queues get their own thread
+	 */
+	LinuxTimerQueueFactory() {
+		reactor = NULL;
+	}
+
+	/**
+	 * @brief Makes timer queues created afterwards dispatch from a
+	 * reactor instead of their own thread
+	 * @param reactor [in] Reactor, NULL for a dedicated thread
+	 * @return void
+	 */
+	void setReactor( LinuxReactor *reactor ) {
+		this->reactor = reactor;
+	}
+
 	/**
 	 * @brief Creates Linux timer queue
 	 * @param clock [in] Pointer to IEEE15588Clock type
@@ -577,11 +945,46 @@ class LinuxThreadFactory:public OSThreadFactory {
 	 }
 };
 
+/**
+ * @brief Options applied to each interface created by
+ * LinuxNetworkInterfaceFactory
+ */
+typedef struct {
+	unsigned rx_batch_size;		//!< Frames per recvmmsg() call, 0 disables batched receive
+	unsigned rx_ring_blocks;	//!< TPACKET_V3 receive ring blocks, 0 disables the ring
+	bool rx_filter;			//!< Attach the in-kernel PTP frame filter
+	uint8_t rx_filter_domain;	//!< Domain number accepted by the filter
+	unsigned rx_busy_poll;		//!< SO_BUSY_POLL time in microseconds, 0 keeps blocking receives
+	unsigned rx_busy_poll_budget;	//!< SO_BUSY_POLL_BUDGET in packets, 0 keeps the kernel default
+	int rx_cpu;			//!< CPU the listening thread is pinned to, -1 disables pinning
+	bool tx_launch_time;		//!< Honour Sync launch times with SO_TXTIME (ETF qdisc)
+	LinuxReactor *reactor;		//!< Event loop driving the port, NULL for listening and link threads
+} LinuxNetworkInterfaceOptions_t;
+
 /**
  * @brief Extends OSNetworkInterfaceFactory for LinuxNetworkInterface
  */
 class LinuxNetworkInterfaceFactory : public OSNetworkInterfaceFactory {
+private:
+	LinuxNetworkInterfaceOptions_t options;
 public:
+	/**
+	 * @brief Default constructor, all optional receive modes disabled
+	 */
+	LinuxNetworkInterfaceFactory() {
+		memset( &options, 0, sizeof( options ));
+		options.rx_cpu = -1;
+	}
+
+	/**
+	 * @brief  Gets the options used for new interfaces
+	 * @return Reference to the options, may be modified before the port
+	 * is initialized
+	 */
+	LinuxNetworkInterfaceOptions_t &getOptions() {
+		return options;
+	}
+
 	/**
 	 * @brief  Creates a new interface
 	 * @param net_iface [out] Network interface. Created internally.
@@ -719,6 +1122,22 @@ public:
 		int8_t   log_pdelay_interval,
 		uint16_t port_number );
 
+	/**
+	 * @brief Updates the clock servo estimate IPC values
+	 *
+	 * @param  phase_stddev Standard deviation of the phase estimate in ns
+	 * @param  freq_stddev Standard deviation of the frequency estimate in parts per trillion
+	 * @param  link_delay Estimated link delay in ns
+	 * @param  link_delay_stddev Standard deviation of the link delay estimate in ns
+	 *
+	 * @return TRUE
+	 */
+	virtual bool update_estimate(
+		uint32_t phase_stddev,
+		uint32_t freq_stddev,
+		int64_t  link_delay,
+		uint32_t link_delay_stddev );
+
 	/**
 	 * @brief unmaps and unlink shared memory
 	 * @return void
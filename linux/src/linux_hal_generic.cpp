@@ -32,9 +32,12 @@
 ******************************************************************************/
 #include <linux_hal_generic.hpp>
 #include <linux_hal_generic_tsprivate.hpp>
+#include <linux_hal_rxbatch.hpp>
+#include <linux_hal_rxring.hpp>
 #include <platform.hpp>
 #include <avbts_message.hpp>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netpacket/packet.h>
 #include <errno.h>
@@ -45,6 +48,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 #include <linux/ptp_clock.h>
 #include <syscall.h>
 #include <limits.h>
@@ -54,11 +58,32 @@
 
 net_result LinuxNetworkInterface::nrecv
 ( LinkLayerAddress *addr, uint8_t *payload, size_t &length )
+{
+	LinuxTimestamperGeneric *gtimestamper;
+	Timestamp device;
+	bool device_valid;
+	rx_ts_key_t key;
+	net_result ret;
+
+	ret = nrecvTimestamped( addr, payload, length, device, device_valid );
+
+	/* Callers not taking the timestamp inline look it up later */
+	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
+	if( ret == net_succeed && device_valid && gtimestamper != NULL &&
+	    LinuxRxTimestampRing::keyFromHeader( &key, payload, length )) {
+		gtimestamper->pushRXTimestamp( &key, &device );
+	}
+
+	return ret;
+}
+
+net_result LinuxNetworkInterface::nrecvTimestamped
+( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+  Timestamp &rx_timestamp, bool &rx_timestamp_valid )
 {
 	fd_set readfds;
 	int err;
 	struct msghdr msg;
-	struct cmsghdr *cmsg;
 	union {
 		char control_data[CMSG_SPACE(256)];
 		struct cmsghdr cm;
@@ -67,10 +92,41 @@ net_result LinuxNetworkInterface::nrecv
 	struct iovec sgentry;
 	net_result ret = net_succeed;
 	bool got_net_lock;
+	Timestamp device;
+	struct timespec software;
 
 	LinuxTimestamperGeneric *gtimestamper;
 
 	struct timeval timeout = { 0, 16000 }; // 16 ms
+	// Busy polling never sleeps, the listening thread spins on the socket.
+	// The reactor only calls in once the socket is readable.
+	bool nonblocking = rx_busy_poll != 0 || reactor != NULL;
+	int timeout_ms = nonblocking ? 0 : 16;
+
+	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
+	rx_timestamp_valid = false;
+
+	if( rx_cpu >= 0 && !rx_cpu_pinned ) {
+		pinReceiveThread();
+	}
+
+	if( rx_ring != NULL ) {
+		uint8_t *frame;
+		size_t frame_length = length;
+
+		ret = nrecvInPlace
+			( addr, payload, frame, frame_length, rx_timestamp,
+			  rx_timestamp_valid );
+		if( ret == net_succeed ) {
+			memcpy( payload, frame, frame_length );
+			length = frame_length;
+			releaseReceived();
+		}
+		return ret;
+	}
+	if( rx_batch != NULL && rx_batch->pending() ) {
+		goto batch_next;
+	}
 
 	if( !net_lock.lock( &got_net_lock )) {
 		GPTP_LOG_ERROR("A Failed to lock mutex");
@@ -80,6 +136,25 @@ net_result LinuxNetworkInterface::nrecv
 		return net_trfail;
 	}
 
+	if( rx_batch != NULL ) {
+		ret = rx_batch->fill( timeout_ms );
+		if( !net_lock.unlock()) {
+			GPTP_LOG_ERROR("A Failed to unlock");
+			return net_fatal;
+		}
+		if( ret != net_succeed ) {
+			return ret;
+		}
+		goto batch_next;
+	}
+
+	if( nonblocking ) {
+		/* Non-blocking receive, see the EAGAIN handling below */
+		if( rx_busy_poll != 0 )
+			++rx_busy_polls;
+		goto busy_poll;
+	}
+
 	FD_ZERO( &readfds );
 	FD_SET( sd_event, &readfds );
 
@@ -103,6 +178,8 @@ net_result LinuxNetworkInterface::nrecv
 		goto done;
 	}
 
+ busy_poll:
+
 	memset( &msg, 0, sizeof( msg ));
 
 	msg.msg_iov = &sgentry;
@@ -117,8 +194,17 @@ net_result LinuxNetworkInterface::nrecv
 	msg.msg_control = &control;
 	msg.msg_controllen = sizeof(control);
 
-	err = recvmsg( sd_event, &msg, 0 );
+	// Never block: select() also wakes on a TX timestamp pending on the
+	// error queue, which leaves nothing to read here, and a blocking call
+	// would then wait for the next frame while holding net_lock
+	err = recvmsg( sd_event, &msg, MSG_DONTWAIT );
 	if( err < 0 ) {
+		if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+			if( nonblocking && rx_busy_poll != 0 )
+				++rx_busy_empty;
+			ret = net_trfail;
+			goto done;
+		}
 		if( errno == ENOMSG ) {
 			GPTP_LOG_ERROR("Got ENOMSG: %s:%d", __FILE__, __LINE__);
 			ret = net_trfail;
@@ -130,25 +216,14 @@ net_result LinuxNetworkInterface::nrecv
 	}
 	*addr = LinkLayerAddress( remote.sll_addr );
 
-	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
-	if( err > 0 && !(payload[0] & 0x8) && gtimestamper != NULL ) {
-		/* Retrieve the timestamp */
-		cmsg = CMSG_FIRSTHDR(&msg);
-		while( cmsg != NULL ) {
-			if
-				( cmsg->cmsg_level == SOL_SOCKET &&
-				  cmsg->cmsg_type == SO_TIMESTAMPING ) {
-				struct timespec *ts_device, *ts_system;
-				Timestamp device, system;
-				ts_system = ((struct timespec *) CMSG_DATA(cmsg)) + 1;
-				system = tsToTimestamp( ts_system );
-				ts_device = ts_system + 1; device = tsToTimestamp( ts_device );
-				gtimestamper->pushRXTimestamp( &device );
-				break;
-			}
-			cmsg = CMSG_NXTHDR(&msg,cmsg);
-		}
+	/* Retrieve the timestamps */
+	if( getRxHardwareTimestamp( &msg, &device, &software ) &&
+	    err > 0 && !(payload[0] & 0x8) && gtimestamper != NULL ) {
+		device._version = gtimestamper->getVersion();
+		rx_timestamp = device;
+		rx_timestamp_valid = true;
 	}
+	recordReceiveLatency( &software );
 
 	length = err;
 
@@ -159,6 +234,77 @@ net_result LinuxNetworkInterface::nrecv
 	}
 
 	return ret;
+
+ batch_next:
+	/* Serve the next frame drained by the last recvmmsg() call */
+	if( rx_batch->next( addr, payload, length, &device, &software ) &&
+	    gtimestamper != NULL ) {
+		device._version = gtimestamper->getVersion();
+		rx_timestamp = device;
+		rx_timestamp_valid = true;
+	}
+	recordReceiveLatency( &software );
+
+	return net_succeed;
+}
+
+net_result LinuxNetworkInterface::nrecvInPlace
+( LinkLayerAddress *addr, uint8_t *buf, uint8_t *&payload, size_t &length,
+  Timestamp &rx_timestamp, bool &rx_timestamp_valid )
+{
+	LinuxTimestamperGeneric *gtimestamper;
+	Timestamp device;
+	bool got_net_lock;
+	net_result ret;
+	int timeout_ms = rx_busy_poll != 0 || reactor != NULL ? 0 : 16;
+
+	if( rx_ring == NULL ) {
+		payload = buf;
+		return nrecvTimestamped
+			( addr, buf, length, rx_timestamp, rx_timestamp_valid );
+	}
+
+	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
+	rx_timestamp_valid = false;
+
+	if( rx_cpu >= 0 && !rx_cpu_pinned ) {
+		pinReceiveThread();
+	}
+
+	if( !rx_ring->pending() ) {
+		if( !net_lock.lock( &got_net_lock )) {
+			GPTP_LOG_ERROR("A Failed to lock mutex");
+			return net_fatal;
+		}
+		if( !got_net_lock ) {
+			return net_trfail;
+		}
+		ret = rx_ring->fill( timeout_ms );
+		if( !net_lock.unlock()) {
+			GPTP_LOG_ERROR("A Failed to unlock");
+			return net_fatal;
+		}
+		if( ret != net_succeed ) {
+			return ret;
+		}
+	}
+
+	/* Hand out the next frame of the current receive ring block */
+	if( rx_ring->peek( addr, payload, length, &device ) &&
+	    gtimestamper != NULL ) {
+		device._version = gtimestamper->getVersion();
+		rx_timestamp = device;
+		rx_timestamp_valid = true;
+	}
+
+	return net_succeed;
+}
+
+void LinuxNetworkInterface::releaseReceived()
+{
+	if( rx_ring != NULL && rx_ring->pending() ) {
+		rx_ring->consume();
+	}
 }
 
 int findPhcIndex( InterfaceLabel *iface_label ) {
@@ -211,6 +357,29 @@ LinuxTimestamperGeneric::LinuxTimestamperGeneric() {
 	igb_private = NULL;
 #endif
 	sd = -1;
+	tx_completions = 0;
+	tx_timeouts = 0;
+	tx_ts_keyed = false;
+	tx_queue = NULL;
+	tx_launch_missed = 0;
+	tx_launch_invalid = 0;
+}
+
+void LinuxTimestamperGeneric::logStatistics() {
+	rxTimestampRing.logStatistics();
+	if( tx_ts_keyed )
+		txTimestampTable.logStatistics();
+	GPTP_LOG_STATUS
+		( "TX timestamps: %llu completed, %llu timed out",
+		  (unsigned long long) tx_completions,
+		  (unsigned long long) tx_timeouts );
+	if( tx_launch_missed != 0 || tx_launch_invalid != 0 ) {
+		GPTP_LOG_STATUS
+			( "TX launch time: %llu missed, %llu rejected",
+			  (unsigned long long) tx_launch_missed,
+			  (unsigned long long) tx_launch_invalid );
+	}
+	tx_latency.logStatistics( "TX timestamp latency" );
 }
 
 bool LinuxTimestamperGeneric::Adjust( void *tmx ) const {
@@ -283,6 +452,16 @@ void LinuxTimestamperGeneric::HWTimestamper_reset()
 int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 ( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
   unsigned &clock_value, bool last )
+{
+	// Without a TX queue the sender reads its own timestamp
+	if( tx_queue == NULL )
+		return readTxTimestamp( messageId, timestamp );
+
+	return tx_queue->wait( messageId, timestamp, 0, last );
+}
+
+int LinuxTimestamperGeneric::readTxTimestamp
+( PTPMessageId messageId, Timestamp &timestamp )
 {
 	int err;
 	int ret = GPTP_EC_EAGAIN;
@@ -300,6 +479,16 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 	} control;
 
 	if( sd == -1 ) return -1;
+
+	if( tx_ts_keyed ) {
+		ret = drainTxTimestamps();
+		if( ret == GPTP_EC_SUCCESS &&
+		    !txTimestampTable.lookup( messageId, timestamp )) {
+			ret = GPTP_EC_EAGAIN;
+		}
+		goto done;
+	}
+
 	memset( &msg, 0, sizeof( msg ));
 	memset( reflected_bytes, 0, sizeof( reflected_bytes ));
 
@@ -340,6 +529,13 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 	// Retrieve the timestamp
 	cmsg = CMSG_FIRSTHDR(&msg);
 	while( cmsg != NULL ) {
+		if( cmsg->cmsg_level == SOL_PACKET &&
+		    cmsg->cmsg_type == PACKET_TX_TIMESTAMP &&
+		    launchTimeError
+		    ( (struct sock_extended_err *) CMSG_DATA(cmsg) )) {
+			ret = GPTP_EC_FAILURE;
+			goto done;
+		}
 		if( cmsg->cmsg_level == SOL_SOCKET &&
 			cmsg->cmsg_type == SO_TIMESTAMPING ) {
 			struct timespec *ts_device, *ts_system;
@@ -361,21 +557,161 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 	}
 
  done:
-	if( ret == 0 || last ) {
-		net_lock->unlock();
+	return ret;
+}
+
+bool LinuxTimestamperGeneric::launchTimeError( struct sock_extended_err *serr )
+{
+	if( serr->ee_origin != SO_EE_ORIGIN_TXTIME )
+		return false;
+
+	if( serr->ee_code == SO_EE_CODE_TXTIME_MISSED ) {
+		++tx_launch_missed;
+		GPTP_LOG_WARNING( "Event frame missed its launch time" );
+	} else {
+		++tx_launch_invalid;
+		GPTP_LOG_ERROR
+			( "Event frame launch time rejected, code %u",
+			  serr->ee_code );
 	}
 
-	return ret;
+	return true;
+}
+
+int LinuxTimestamperGeneric::drainTxTimestamps()
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union {
+		char control_data[CMSG_SPACE(256)];
+		struct cmsghdr cm;
+	} control;
+	unsigned i;
+	int err;
+
+	// Each completion carries no payload (OPT_TSONLY), only the
+	// timestamp and the key of the frame it belongs to
+	for( i = 0; i < TX_TS_TABLE_SIZE; ++i ) {
+		struct sock_extended_err *serr = NULL;
+		struct timespec *ts = NULL;
+
+		memset( &msg, 0, sizeof( msg ));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof(control);
+
+		err = recvmsg( sd, &msg, MSG_ERRQUEUE );
+		if( err == -1 ) {
+			if( errno == EAGAIN )
+				return GPTP_EC_SUCCESS;
+			GPTP_LOG_ERROR
+				( "Failed to read TX timestamp: %s", strerror(errno));
+			return GPTP_EC_FAILURE;
+		}
+
+		for( cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(&msg,cmsg) ) {
+			if( cmsg->cmsg_level == SOL_SOCKET &&
+			    cmsg->cmsg_type == SO_TIMESTAMPING ) {
+				ts = (struct timespec *) CMSG_DATA(cmsg);
+			} else if( cmsg->cmsg_level == SOL_PACKET &&
+				   cmsg->cmsg_type == PACKET_TX_TIMESTAMP ) {
+				serr = (struct sock_extended_err *)
+					CMSG_DATA(cmsg);
+			}
+		}
+		// The frame was dropped by the qdisc, it is the one in flight
+		if( serr != NULL && launchTimeError( serr ))
+			return GPTP_EC_FAILURE;
+		if( ts == NULL || serr == NULL ||
+		    serr->ee_errno != ENOMSG ||
+		    serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING ) {
+			GPTP_LOG_ERROR
+				( "Received a error message, but didn't find a "
+				  "valid timestamp" );
+			continue;
+		}
+
+		// ts[0] software, ts[1] deprecated, ts[2] raw hardware
+		Timestamp device = tsToTimestamp( ts + 2 );
+		device._version = version;
+		if( !txTimestampTable.complete( serr->ee_data, device )) {
+			GPTP_LOG_WARNING
+				( "TX timestamp with unknown key %u discarded",
+				  serr->ee_data );
+		}
+	}
+
+	return GPTP_EC_SUCCESS;
 }
 
-bool LinuxTimestamperGeneric::post_init( int ifindex, int sd, TicketingLock *lock ) {
+int LinuxTimestamperGeneric::HWTimestamper_txtimestampWait
+( PortIdentity * /*identity*/, PTPMessageId messageId, Timestamp &timestamp,
+  unsigned & /*clock_value*/, unsigned timeout_us )
+{
+	if( tx_queue == NULL )
+		return collectTxTimestamp( messageId, timestamp, timeout_us );
+
+	// The caller does not poll after the wait, it gives up on the frame
+	return tx_queue->wait( messageId, timestamp, timeout_us, true );
+}
+
+int LinuxTimestamperGeneric::collectTxTimestamp
+( PTPMessageId messageId, Timestamp &timestamp, unsigned timeout_us )
+{
+	struct pollfd pfd;
+	struct timespec start, now;
+	int64_t elapsed;
+	int remaining_ms;
+	int ret;
+	int err;
+
+	if( sd == -1 ) return GPTP_EC_FAILURE;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	// POLLERR is always reported, normal frames (POLLIN) don't wake us
+	pfd.fd = sd;
+	pfd.events = 0;
+
+	while( true ) {
+		ret = readTxTimestamp( messageId, timestamp );
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		elapsed = ((int64_t) now.tv_sec - start.tv_sec ) * 1000000000LL +
+			( now.tv_nsec - start.tv_nsec );
+		if( ret == GPTP_EC_SUCCESS ) {
+			++tx_completions;
+			tx_latency.add( elapsed );
+			return ret;
+		}
+		if( ret != GPTP_EC_EAGAIN ) {
+			break;
+		}
+
+		remaining_ms = (int)
+			(( (int64_t) timeout_us * 1000 - elapsed + 999999 ) / 1000000 );
+		if( remaining_ms <= 0 ) {
+			++tx_timeouts;
+			break;
+		}
+
+		err = poll( &pfd, 1, remaining_ms );
+		if( err == -1 && errno != EINTR ) {
+			GPTP_LOG_ERROR( "poll() failed: %s", strerror(errno) );
+			break;
+		}
+	}
+
+	return GPTP_EC_FAILURE;
+}
+
+bool LinuxTimestamperGeneric::post_init
+( int ifindex, int sd, TicketingLock * /*lock*/ ) {
 	int timestamp_flags = 0;
 	struct ifreq device;
 	struct hwtstamp_config hwconfig;
 	int err;
 
 	this->sd = sd;
-	this->net_lock = lock;
 
 	memset( &device, 0, sizeof(device));
 	device.ifr_ifindex = ifindex;
@@ -401,9 +737,28 @@ bool LinuxTimestamperGeneric::post_init( int ifindex, int sd, TicketingLock *loc
 	timestamp_flags |= SOF_TIMESTAMPING_RX_HARDWARE;
 	timestamp_flags |= SOF_TIMESTAMPING_SYS_HARDWARE;
 	timestamp_flags |= SOF_TIMESTAMPING_RAW_HARDWARE;
+	// Kernel receive time, used for receive-to-process latency
+	timestamp_flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
+	timestamp_flags |= SOF_TIMESTAMPING_SOFTWARE;
+	// Key each TX timestamp and don't loop the frame back with it
+	timestamp_flags |= SOF_TIMESTAMPING_OPT_ID;
+	timestamp_flags |= SOF_TIMESTAMPING_OPT_TSONLY;
 	err = setsockopt
 		( sd, SOL_SOCKET, SO_TIMESTAMPING, &timestamp_flags,
 		  sizeof(timestamp_flags) );
+	tx_ts_keyed = err != -1;
+	if( !tx_ts_keyed ) {
+		GPTP_LOG_WARNING
+			("Keyed TX timestamps not supported, matching reflected "
+			 "headers: %s", strerror(errno));
+		timestamp_flags &= ~( SOF_TIMESTAMPING_OPT_ID |
+				      SOF_TIMESTAMPING_OPT_TSONLY );
+		err = setsockopt
+			( sd, SOL_SOCKET, SO_TIMESTAMPING, &timestamp_flags,
+			  sizeof(timestamp_flags) );
+	}
+	// The kernel starts numbering frames from zero
+	txTimestampTable.clear();
 	if( err == -1 ) {
 		GPTP_LOG_ERROR
 			("Failed to configure timestamping on socket: %s",
@@ -446,6 +801,35 @@ static inline Timestamp pctTimestamp( struct ptp_clock_time *t ) {
 	return result;
 }
 
+bool LinuxTimestamperGeneric::getTaiCrossTimestamp
+( uint64_t &tai, uint64_t &device ) const
+{
+	struct timespec before, phc, after;
+	int64_t interval, best = LLONG_MAX;
+	unsigned i;
+
+	if( phc_fd == -1 )
+		return false;
+
+	for( i = 0; i < TAI_CROSSTSTAMP_SAMPLES; ++i ) {
+		if( clock_gettime( CLOCK_TAI, &before ) == -1 ||
+		    clock_gettime( _private->clockid, &phc ) == -1 ||
+		    clock_gettime( CLOCK_TAI, &after ) == -1 )
+			return false;
+		interval = ((int64_t) after.tv_sec - before.tv_sec ) *
+			1000000000LL + ( after.tv_nsec - before.tv_nsec );
+		if( interval < best ) {
+			best = interval;
+			tai = (uint64_t) before.tv_sec * 1000000000ULL +
+				before.tv_nsec + interval / 2;
+			device = (uint64_t) phc.tv_sec * 1000000000ULL +
+				phc.tv_nsec;
+		}
+	}
+
+	return true;
+}
+
 // Use HW cross-timestamp if available
 bool LinuxTimestamperGeneric::HWTimestamper_gettime
 ( Timestamp *system_time, Timestamp *device_time, uint32_t *local_clock,
@@ -35,9 +35,17 @@
 #define LINUX_HAL_GENERIC_HPP
 
 #include <linux_hal_common.hpp>
+#include <linux_hal_rxtsring.hpp>
+#include <linux_hal_latency.hpp>
+#include <linux_hal_txtstable.hpp>
+#include <linux_hal_txqueue.hpp>
 
 /**@file*/
 
+#define TAI_CROSSTSTAMP_SAMPLES 5	/*!< CLOCK_TAI/device clock reads per launch time conversion */
+
+struct sock_extended_err;
+
 struct LinuxTimestamperGenericPrivate;
 /**
  * @brief Provides LinuxTimestamperGeneric a private type
@@ -60,18 +68,44 @@ private:
 	Timestamp crstamp_device;
 	LinuxTimestamperGenericPrivate_t _private;
 	bool cross_stamp_good;
-	std::list<Timestamp> rxTimestampList;
+	LinuxRxTimestampRing rxTimestampRing;
 	LinuxNetworkInterfaceList iface_list;
 #ifdef PTP_HW_CROSSTSTAMP
 	bool precise_timestamp_enabled;
 #endif
 
-	TicketingLock *net_lock;
+	LinuxTxQueue *tx_queue;
+
+	LinuxTxTimestampTable txTimestampTable;
+	bool tx_ts_keyed;
+	LinuxLatencyHistogram tx_latency;
+	uint64_t tx_completions;
+	uint64_t tx_timeouts;
+	uint64_t tx_launch_missed;
+	uint64_t tx_launch_invalid;
 
 #ifdef WITH_IGBLIB
 	LinuxTimestamperIGBPrivate_t igb_private;
 #endif
 
+	/**
+	 * @brief  Reads the TX timestamp of a message from the socket error
+	 * queue without waiting
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @return GPTP_EC_SUCCESS if found, GPTP_EC_EAGAIN if not reported
+	 * yet, GPTP_EC_FAILURE on error
+	 */
+	int readTxTimestamp( PTPMessageId messageId, Timestamp &timestamp );
+
+	/**
+	 * @brief  Checks for and counts an SO_TXTIME error reported on the
+	 * error queue instead of a timestamp
+	 * @param  serr [in] Extended error of the error queue message
+	 * @return TRUE if the frame was dropped because of its launch time
+	 */
+	bool launchTimeError( struct sock_extended_err *serr );
+
 public:
 	/**
 	 * @brief Default constructor. Initializes internal variables
@@ -109,21 +143,78 @@ public:
 	virtual void HWTimestamper_reset();
 
 	/**
-	 * @brief  Inserts a new timestamp to the beginning of the
-	 * RX timestamp list.
+	 * @brief  Stores the RX timestamp of an event message
+	 * @param key [in] Identifies the message the timestamp belongs to
 	 * @param tstamp [in] RX timestamp
 	 * @return void
 	 */
-	void pushRXTimestamp( Timestamp *tstamp ) {
+	void pushRXTimestamp( const rx_ts_key_t *key, Timestamp *tstamp ) {
 		tstamp->_version = version;
-		rxTimestampList.push_front(*tstamp);
+		rxTimestampRing.push( key, *tstamp );
+	}
+
+	/**
+	 * @brief  Drains the socket error queue into the TX timestamp table
+	 * @return GPTP_EC_SUCCESS if the queue was drained, GPTP_EC_FAILURE on
+	 * error
+	 */
+	virtual int drainTxTimestamps();
+
+	/**
+	 * @brief  Logs the RX timestamp lookup and TX timestamp completion
+	 * statistics
+	 * @return void
+	 */
+	virtual void logStatistics();
+
+	/**
+	 * @brief  Records the event message about to be sent in the TX
+	 * timestamp table
+	 * @param  payload [in] PTP message being sent
+	 * @param  length Length of the message
+	 * @return void
+	 */
+	virtual void expectTxTimestamp( const uint8_t *payload, size_t length ) {
+		if( tx_ts_keyed )
+			txTimestampTable.expect( payload, length );
+	}
+
+	/**
+	 * @brief  Drops the last message recorded in the TX timestamp table
+	 * @return void
+	 */
+	virtual void cancelTxTimestamp() {
+		if( tx_ts_keyed )
+			txTimestampTable.cancel();
+	}
+
+	/**
+	 * @brief  Waits on the error queue for the TX timestamp of the frame
+	 * just sent. Called by the TX queue owner, no lock is held.
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if collected, GPTP_EC_FAILURE on error or
+	 * timeout
+	 */
+	virtual int collectTxTimestamp
+	( PTPMessageId messageId, Timestamp &timestamp, unsigned timeout_us );
+
+	/**
+	 * @brief  Sets the queue event frames are sent through
+	 * @param  queue [in] TX queue of the network interface
+	 * @return void
+	 */
+	virtual void setTxQueue( LinuxTxQueue *queue ) {
+		tx_queue = queue;
 	}
 
 	/**
 	 * @brief  Post initialization procedure.
 	 * @param  ifindex struct ifreq.ifr_ifindex value
 	 * @param  sd Socket file descriptor
-	 * @param  lock [in] Instance of TicketingLock object
+	 * @param  lock [in] Network lock, held by the TX queue owner rather
+	 * than the timestamper
 	 * @return TRUE if ok. FALSE if error.
 	 */
 	bool post_init( int ifindex, int sd, TicketingLock *lock );
@@ -140,22 +231,48 @@ public:
 	( Timestamp *system_time, Timestamp *device_time,
 	  uint32_t *local_clock, uint32_t *nominal_clock_rate ) const;
 
+	/**
+	 * @brief  Reads the PTP hardware clock between two CLOCK_TAI reads,
+	 * keeping the tightest of TAI_CROSSTSTAMP_SAMPLES attempts
+	 * @param  tai [out] CLOCK_TAI time in nanoseconds
+	 * @param  device [out] Device time in nanoseconds
+	 * @return FALSE if the device clock cannot be read
+	 */
+	virtual bool getTaiCrossTimestamp( uint64_t &tai, uint64_t &device ) const;
+
 	/**
 	 * @brief  Gets the TX timestamp from hardware interface
 	 * @param  identity PTP port identity
 	 * @param  PTPMessageId Message ID
 	 * @param  timestamp [out] Timestamp value
 	 * @param  clock_value [out] Clock value
-	 * @param  last Signalizes that it is the last timestamp to get. When TRUE, releases the lock when its done.
+	 * @param  last Signalizes that it is the last timestamp to get
 	 * @return GPTP_EC_SUCCESS if no error, GPTP_EC_FAILURE if error and GPTP_EC_EAGAIN to try again.
 	 */
 	virtual int HWTimestamper_txtimestamp
 	( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
 	  unsigned &clock_value, bool last );
 
+	/**
+	 * @brief  Waits for the TX queue owner to collect the TX timestamp
+	 * of a message
+	 * @param  identity PTP port identity
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @param  clock_value [out] Clock value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if no error, GPTP_EC_EAGAIN if the frame
+	 * is still queued or in flight when the wait times out,
+	 * GPTP_EC_FAILURE on error. Both are final.
+	 */
+	virtual int HWTimestamper_txtimestampWait
+	( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
+	  unsigned &clock_value, unsigned timeout_us );
+
 	/**
 	 * @brief  Gets the RX timestamp from the hardware interface. This
 	 * Currently the RX timestamp is retrieved at LinuxNetworkInterface::nrecv method.
+	 * EtherPort receives it inline through nrecvTimestamped() instead.
 	 * @param  identity PTP port identity
 	 * @param  PTPMessageId Message ID
 	 * @param  timestamp [out] Timestamp value
@@ -166,10 +283,11 @@ public:
 	virtual int HWTimestamper_rxtimestamp
 	( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
 	  unsigned &clock_value, bool last ) {
-		/* This shouldn't happen. Ever. */
-		if( rxTimestampList.empty() ) return GPTP_EC_EAGAIN;
-		timestamp = rxTimestampList.back();
-		rxTimestampList.pop_back();
+		rx_ts_key_t key;
+
+		LinuxRxTimestampRing::keyFromMessage( &key, identity, messageId );
+		if( !rxTimestampRing.lookup( &key, timestamp ))
+			return GPTP_EC_EAGAIN;
 
 		return GPTP_EC_SUCCESS;
 	}
@@ -188,6 +306,14 @@ public:
 	 */
 	virtual bool HWTimestamper_adjclockrate( float freq_offset ) const;
 
+	/**
+	 * @brief  Adjusts the frequency without floating point conversion
+	 * @param  freq_offset Frequency adjustment in ppb scaled by 2^16
+	 * @return TRUE in case of sucess, FALSE if error.
+	 */
+	virtual bool HWTimestamper_adjclockrate_scaled
+	( ScaledPpb freq_offset ) const;
+
 #ifdef WITH_IGBLIB
 	bool HWTimestamper_PPS_start( );
 	bool HWTimestamper_PPS_stop();
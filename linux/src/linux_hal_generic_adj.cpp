@@ -60,7 +60,7 @@ bool LinuxTimestamperGeneric::HWTimestamper_adjclockphase( int64_t phase_adjust
 		(*iface_iter)->disable_rx_queue();
 	}
 		
-	rxTimestampList.clear();
+	rxTimestampRing.clear();
 		
 	/* Wait 180 ms - This is plenty of time for any time sync frames
 	   to clear the queue */
@@ -100,3 +100,13 @@ bool LinuxTimestamperGeneric::HWTimestamper_adjclockrate( float freq_offset ) co
 
 	return Adjust(&tx);
 }
+
+bool LinuxTimestamperGeneric::HWTimestamper_adjclockrate_scaled
+( ScaledPpb freq_offset ) const {
+	struct timex tx;
+	tx.modes = ADJ_FREQUENCY;
+	// timex frequency is in ppm scaled by 2^16
+	tx.freq = (long) mulDiv64( freq_offset, 1, 1000 );
+
+	return Adjust(&tx);
+}
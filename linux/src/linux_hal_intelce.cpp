@@ -185,6 +185,25 @@ bool LinuxTimestamperIntelCE::HWTimestamper_gettime
 
 
 
+net_result LinuxNetworkInterface::nrecvTimestamped
+( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+  Timestamp &rx_timestamp, bool &rx_timestamp_valid ) {
+	// Timestamps are read from the device by the timestamper
+	rx_timestamp_valid = false;
+	return nrecv( addr, payload, length );
+}
+
+net_result LinuxNetworkInterface::nrecvInPlace
+( LinkLayerAddress *addr, uint8_t *buf, uint8_t *&payload, size_t &length,
+  Timestamp &rx_timestamp, bool &rx_timestamp_valid ) {
+	payload = buf;
+	return nrecvTimestamped
+		( addr, buf, length, rx_timestamp, rx_timestamp_valid );
+}
+
+void LinuxNetworkInterface::releaseReceived() {
+}
+
 net_result LinuxNetworkInterface::nrecv
 ( LinkLayerAddress *addr, uint8_t *payload, size_t &length ) {
 	fd_set readfds;
@@ -0,0 +1,123 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_latency.hpp>
+#include <gptp_log.hpp>
+
+#include <string.h>
+
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+
+LinuxLatencyHistogram::LinuxLatencyHistogram()
+{
+	clear();
+}
+
+void LinuxLatencyHistogram::clear()
+{
+	count = 0;
+	sum_ns = 0;
+	min_ns = UINT64_MAX;
+	max_ns = 0;
+	overflow = 0;
+	memset( fine, 0, sizeof( fine ));
+	memset( coarse, 0, sizeof( coarse ));
+}
+
+void LinuxLatencyHistogram::add( uint64_t latency_ns )
+{
+	++count;
+	sum_ns += latency_ns;
+	if( latency_ns < min_ns )
+		min_ns = latency_ns;
+	if( latency_ns > max_ns )
+		max_ns = latency_ns;
+
+	if( latency_ns < LATENCY_FINE_BUCKETS * NS_PER_US )
+		++fine[latency_ns / NS_PER_US];
+	else if( latency_ns < LATENCY_COARSE_BUCKETS * NS_PER_MS )
+		++coarse[latency_ns / NS_PER_MS];
+	else
+		++overflow;
+}
+
+uint64_t LinuxLatencyHistogram::getPercentile( double percent ) const
+{
+	uint64_t target;
+	uint64_t seen = 0;
+	unsigned i;
+
+	if( count == 0 )
+		return 0;
+
+	target = (uint64_t)( count * percent / 100.0 );
+	if( target == 0 )
+		target = 1;
+
+	for( i = 0; i < LATENCY_FINE_BUCKETS; ++i ) {
+		seen += fine[i];
+		if( seen >= target )
+			return clampToMax(( i + 1 ) * NS_PER_US );
+	}
+	// The first coarse bucket overlaps the fine range and is never used
+	for( i = 1; i < LATENCY_COARSE_BUCKETS; ++i ) {
+		seen += coarse[i];
+		if( seen >= target )
+			return clampToMax(( i + 1 ) * NS_PER_MS );
+	}
+
+	return max_ns;
+}
+
+void LinuxLatencyHistogram::logStatistics( const char *name ) const
+{
+	if( count == 0 ) {
+		GPTP_LOG_STATUS( "%s: no samples", name );
+		return;
+	}
+
+	GPTP_LOG_STATUS
+		( "%s: %llu samples, min %llu ns, mean %llu ns, max %llu ns, "
+		  "over 1 s %llu", name, (unsigned long long) count,
+		  (unsigned long long) min_ns,
+		  (unsigned long long)( sum_ns / count ),
+		  (unsigned long long) max_ns, (unsigned long long) overflow );
+	GPTP_LOG_STATUS
+		( "%s: p50 <= %llu ns, p90 <= %llu ns, p99 <= %llu ns, "
+		  "p99.9 <= %llu ns", name,
+		  (unsigned long long) getPercentile( 50.0 ),
+		  (unsigned long long) getPercentile( 90.0 ),
+		  (unsigned long long) getPercentile( 99.0 ),
+		  (unsigned long long) getPercentile( 99.9 ));
+}
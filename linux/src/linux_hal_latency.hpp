@@ -0,0 +1,111 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_LATENCY_HPP
+#define LINUX_HAL_LATENCY_HPP
+
+/**@file*/
+
+#include <stdint.h>
+
+#define LATENCY_FINE_BUCKETS 1000	/*!< 1 microsecond buckets, up to 1 ms */
+#define LATENCY_COARSE_BUCKETS 1000	/*!< 1 millisecond buckets, up to 1 s */
+
+/**
+ * @brief LinuxLatencyHistogram: fixed size latency histogram with
+ * microsecond resolution below one millisecond and millisecond resolution
+ * up to one second. Samples above one second are counted as overflow.
+ * Adding a sample is a couple of arithmetic operations and never
+ * allocates, so it may be used on the receive and transmit paths.
+ * Not thread safe, each histogram must be updated from a single thread.
+ */
+class LinuxLatencyHistogram {
+public:
+	/**
+	 * @brief  Creates an empty histogram
+	 */
+	LinuxLatencyHistogram();
+
+	/**
+	 * @brief  Adds a sample
+	 * @param  latency_ns Latency in nanoseconds
+	 * @return void
+	 */
+	void add( uint64_t latency_ns );
+
+	/**
+	 * @brief  Gets the number of samples
+	 * @return Sample count
+	 */
+	uint64_t getCount() const
+	{
+		return count;
+	}
+
+	/**
+	 * @brief  Computes a percentile of the recorded samples
+	 * @param  percent Percentile, between 0 and 100
+	 * @return Upper bound of the bucket containing the percentile, in
+	 * nanoseconds. The maximum sample is returned for the overflow bucket.
+	 */
+	uint64_t getPercentile( double percent ) const;
+
+	/**
+	 * @brief  Discards all samples
+	 * @return void
+	 */
+	void clear();
+
+	/**
+	 * @brief  Logs count, min, mean, p50, p90, p99, p99.9 and max
+	 * @param  name Histogram name used as the log prefix
+	 * @return void
+	 */
+	void logStatistics( const char *name ) const;
+
+private:
+	uint64_t clampToMax( uint64_t bound ) const
+	{
+		return bound < max_ns ? bound : max_ns;
+	}
+
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t overflow;
+	uint32_t fine[LATENCY_FINE_BUCKETS];
+	uint32_t coarse[LATENCY_COARSE_BUCKETS];
+};
+
+#endif/*LINUX_HAL_LATENCY_HPP*/
@@ -0,0 +1,192 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#include <linux_hal_reactor.hpp>
+#include <linux_hal_latency.hpp>
+#include <linux_hal_timerq.hpp>
+#include <gptp_log.hpp>
+
+#include <sys/epoll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+LinuxReactor::LinuxReactor()
+{
+	epfd = -1;
+	running = false;
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxReactor::~LinuxReactor()
+{
+	unsigned i;
+
+	if( epfd != -1 ) close( epfd );
+	for( i = 0; i < sources.size(); ++i ) {
+		delete sources[i]->run_time;
+		delete sources[i];
+	}
+}
+
+bool LinuxReactor::init()
+{
+	epfd = epoll_create1( EPOLL_CLOEXEC );
+	if( epfd == -1 ) {
+		GPTP_LOG_ERROR( "epoll_create1() failed: %s", strerror(errno) );
+		return false;
+	}
+
+	return true;
+}
+
+bool LinuxReactor::add
+( int fd, uint32_t events, LinuxReactorHandler handler, void *arg,
+  const char *name )
+{
+	struct epoll_event ev;
+	Source *source = new Source;
+
+	source->fd = fd;
+	source->handler = handler;
+	source->arg = arg;
+	source->name = name;
+	source->calls = 0;
+	source->run_time = new LinuxLatencyHistogram();
+
+	memset( &ev, 0, sizeof( ev ));
+	ev.events = events;
+	ev.data.ptr = source;
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to add %s to the reactor: %s", name,
+			  strerror(errno) );
+		delete source->run_time;
+		delete source;
+		return false;
+	}
+	sources.push_back( source );
+
+	return true;
+}
+
+bool LinuxReactor::remove( int fd )
+{
+	unsigned i;
+
+	for( i = 0; i < sources.size(); ++i ) {
+		if( sources[i]->fd != fd )
+			continue;
+		if( epoll_ctl( epfd, EPOLL_CTL_DEL, fd, NULL ) == -1 ) {
+			GPTP_LOG_ERROR
+				( "Failed to remove %s from the reactor: %s",
+				  sources[i]->name, strerror(errno) );
+			return false;
+		}
+		// Keep the source, a pending event in the current batch
+		// may still refer to it
+		sources[i]->handler = NULL;
+		return true;
+	}
+
+	return false;
+}
+
+bool LinuxReactor::run()
+{
+	struct epoll_event ready[REACTOR_EVENTS_MAX];
+	int count;
+	int i;
+
+	running = true;
+	GPTP_LOG_STATUS( "Reactor started with %u sources",
+			 (unsigned) sources.size() );
+
+	while( running ) {
+		count = epoll_wait( epfd, ready, REACTOR_EVENTS_MAX, -1 );
+		if( count == -1 ) {
+			if( errno == EINTR ) {
+				++stats.interrupted;
+				continue;
+			}
+			GPTP_LOG_ERROR( "epoll_wait() failed: %s", strerror(errno) );
+			return false;
+		}
+		if( count == 0 ) {
+			++stats.interrupted;
+			continue;
+		}
+
+		++stats.wakeups;
+		if( (unsigned) count > stats.max_ready )
+			stats.max_ready = count;
+
+		for( i = 0; i < count && running; ++i ) {
+			Source *source = (Source *) ready[i].data.ptr;
+			uint64_t start;
+
+			if( source->handler == NULL )
+				continue;
+			start = getMonotonicTime();
+			source->handler( source->arg, ready[i].events );
+			source->run_time->add( getMonotonicTime() - start );
+			++source->calls;
+			++stats.dispatched;
+		}
+	}
+
+	return true;
+}
+
+void LinuxReactor::logStatistics()
+{
+	unsigned i;
+
+	GPTP_LOG_STATUS
+		( "Reactor: wakeups %llu, without events %llu, handler calls "
+		  "%llu, max ready %u", (unsigned long long) stats.wakeups,
+		  (unsigned long long) stats.interrupted,
+		  (unsigned long long) stats.dispatched, stats.max_ready );
+	for( i = 0; i < sources.size(); ++i ) {
+		char name[64];
+
+		GPTP_LOG_STATUS
+			( "Reactor %s: %llu calls", sources[i]->name,
+			  (unsigned long long) sources[i]->calls );
+		snprintf( name, sizeof( name ), "Reactor %s run time",
+			  sources[i]->name );
+		sources[i]->run_time->logStatistics( name );
+	}
+}
@@ -0,0 +1,152 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef LINUX_HAL_REACTOR_HPP
+#define LINUX_HAL_REACTOR_HPP
+
+/**@file*/
+
+#include <stdint.h>
+#include <vector>
+
+#define REACTOR_EVENTS_MAX 16	/*!< Ready descriptors handled per epoll_wait() */
+
+class LinuxLatencyHistogram;
+
+/**
+ * @brief Reactor callback, run when a registered descriptor is ready
+ * @param arg Argument given when the descriptor was added
+ * @param events Ready epoll events
+ */
+typedef void (*LinuxReactorHandler)( void *arg, uint32_t events );
+
+/**
+ * @brief Statistics collected by LinuxReactor
+ */
+typedef struct {
+	uint64_t wakeups;		//!< epoll_wait() returns with ready descriptors
+	uint64_t interrupted;		//!< epoll_wait() returns without any
+	uint64_t dispatched;		//!< Handler calls
+	unsigned max_ready;		//!< Most descriptors ready at once
+} reactor_stats_t;
+
+/**
+ * @brief LinuxReactor: single threaded, run-to-completion event loop.
+ * Descriptors are registered with a handler; run() blocks in
+ * epoll_wait() without a timeout and calls the handler of each ready
+ * descriptor until stop() is called. Handlers run one at a time on the
+ * reactor thread, so state they share needs no locking against each
+ * other.
+ */
+class LinuxReactor {
+public:
+	/**
+	 * @brief  Default constructor. Call init() before use.
+	 */
+	LinuxReactor();
+
+	/**
+	 * @brief  Closes the epoll descriptor
+	 */
+	~LinuxReactor();
+
+	/**
+	 * @brief  Creates the epoll instance
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init();
+
+	/**
+	 * @brief  Registers a descriptor
+	 * @param  fd Descriptor to watch
+	 * @param  events epoll events to wait for (EPOLLERR and EPOLLHUP are
+	 * always reported)
+	 * @param  handler Callback run when the descriptor is ready
+	 * @param  arg Callback argument
+	 * @param  name Name used in the statistics
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool add
+	( int fd, uint32_t events, LinuxReactorHandler handler, void *arg,
+	  const char *name );
+
+	/**
+	 * @brief  Unregisters a descriptor
+	 * @param  fd Descriptor previously added
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool remove( int fd );
+
+	/**
+	 * @brief  Runs the event loop on the calling thread until stop()
+	 * @return FALSE if epoll_wait() failed, TRUE otherwise
+	 */
+	bool run();
+
+	/**
+	 * @brief  Makes run() return once the current handler completes.
+	 * Must be called from a handler.
+	 * @return void
+	 */
+	void stop()
+	{
+		running = false;
+	}
+
+	/**
+	 * @brief  Logs the reactor statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	/**
+	 * @brief Registered descriptor
+	 */
+	struct Source {
+		int fd;
+		LinuxReactorHandler handler;
+		void *arg;
+		const char *name;
+		uint64_t calls;
+		LinuxLatencyHistogram *run_time;
+	};
+
+	int epfd;
+	bool running;
+	std::vector<Source *> sources;
+	reactor_stats_t stats;
+};
+
+#endif/*LINUX_HAL_REACTOR_HPP*/
@@ -0,0 +1,266 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_rxbatch.hpp>
+#include <linux_hal_common.hpp>
+#include <gptp_log.hpp>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+#include <linux/net_tstamp.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RX_CONTROL_SPACE CMSG_SPACE(RX_CONTROL_MAX)
+
+bool getRxHardwareTimestamp
+( struct msghdr *msg, Timestamp *device, struct timespec *software )
+{
+	struct cmsghdr *cmsg;
+
+	if( software != NULL )
+		memset( software, 0, sizeof( *software ));
+
+	cmsg = CMSG_FIRSTHDR(msg);
+	while( cmsg != NULL ) {
+		if
+			( cmsg->cmsg_level == SOL_SOCKET &&
+			  cmsg->cmsg_type == SO_TIMESTAMPING ) {
+			struct timespec *ts;
+			// ts[0] software, ts[1] deprecated, ts[2] raw hardware
+			ts = (struct timespec *) CMSG_DATA(cmsg);
+			if( software != NULL )
+				*software = ts[0];
+			// Software reporting is enabled, the message may carry
+			// only ts[0]
+			if( ts[2].tv_sec == 0 && ts[2].tv_nsec == 0 )
+				return false;
+			*device = tsToTimestamp( ts + 2 );
+			return true;
+		}
+		cmsg = CMSG_NXTHDR(msg,cmsg);
+	}
+
+	return false;
+}
+
+LinuxRxBatch::LinuxRxBatch()
+{
+	epfd = -1;
+	sd = -1;
+	size = 0;
+	count = 0;
+	next_frame = 0;
+	msgs = NULL;
+	iov = NULL;
+	names = NULL;
+	frames = NULL;
+	control = NULL;
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxRxBatch::~LinuxRxBatch()
+{
+	if( epfd != -1 ) close( epfd );
+	delete [] msgs;
+	delete [] iov;
+	delete [] names;
+	delete [] frames;
+	delete [] control;
+}
+
+bool LinuxRxBatch::init( int sd, unsigned size )
+{
+	struct epoll_event ev;
+	unsigned i;
+
+	if( size == 0 || size > RX_BATCH_MAX ) {
+		GPTP_LOG_ERROR( "Invalid receive batch size: %u", size );
+		return false;
+	}
+
+	this->sd = sd;
+	this->size = size;
+
+	epfd = epoll_create1( EPOLL_CLOEXEC );
+	if( epfd == -1 ) {
+		GPTP_LOG_ERROR( "epoll_create1() failed: %s", strerror(errno) );
+		return false;
+	}
+
+	memset( &ev, 0, sizeof( ev ));
+	ev.events = EPOLLIN;
+	ev.data.fd = sd;
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, sd, &ev ) == -1 ) {
+		GPTP_LOG_ERROR( "epoll_ctl() failed: %s", strerror(errno) );
+		return false;
+	}
+
+	msgs = new struct mmsghdr[size];
+	iov = new struct iovec[size];
+	names = new struct sockaddr_ll[size];
+	frames = new uint8_t[size * RX_FRAME_MAX];
+	control = new uint8_t[size * RX_CONTROL_SPACE];
+
+	memset( msgs, 0, size * sizeof( *msgs ));
+	for( i = 0; i < size; ++i ) {
+		iov[i].iov_base = frames + i * RX_FRAME_MAX;
+		iov[i].iov_len = RX_FRAME_MAX;
+		msgs[i].msg_hdr.msg_iov = iov + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = names + i;
+		msgs[i].msg_hdr.msg_control = control + i * RX_CONTROL_SPACE;
+	}
+
+	return true;
+}
+
+net_result LinuxRxBatch::fill( int timeout_ms )
+{
+	struct epoll_event ev;
+	unsigned i;
+	int err;
+
+	count = 0;
+	next_frame = 0;
+
+	err = epoll_wait( epfd, &ev, 1, timeout_ms );
+	if( err == 0 ) {
+		return net_trfail;
+	} else if( err == -1 ) {
+		if( errno == EINTR ) {
+			return net_trfail;
+		}
+		GPTP_LOG_ERROR( "epoll_wait() failed: %s", strerror(errno) );
+		return net_fatal;
+	}
+	++stats.wakeups;
+
+	// The kernel overwrites these on return, reset them every batch
+	for( i = 0; i < size; ++i ) {
+		msgs[i].msg_hdr.msg_namelen = sizeof( *names );
+		msgs[i].msg_hdr.msg_controllen = RX_CONTROL_SPACE;
+		msgs[i].msg_hdr.msg_flags = 0;
+		msgs[i].msg_len = 0;
+	}
+
+	err = recvmmsg( sd, msgs, size, MSG_DONTWAIT, NULL );
+	if( err == -1 ) {
+		if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) {
+			++stats.empty_wakeups;
+			return net_trfail;
+		}
+		if( errno == ENOMSG ) {
+			GPTP_LOG_ERROR("Got ENOMSG: %s:%d", __FILE__, __LINE__);
+			return net_trfail;
+		}
+		GPTP_LOG_ERROR( "recvmmsg() failed: %s", strerror(errno) );
+		return net_fatal;
+	}
+	if( err == 0 ) {
+		++stats.empty_wakeups;
+		return net_trfail;
+	}
+
+	count = err;
+	++stats.batches;
+	stats.frames += count;
+	++stats.histogram[count];
+	if( count > stats.max_batch )
+		stats.max_batch = count;
+
+	return net_succeed;
+}
+
+bool LinuxRxBatch::next
+( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+  Timestamp *device, struct timespec *software )
+{
+	struct mmsghdr *mmsg;
+	size_t frame_length;
+	uint8_t *frame;
+
+	mmsg = msgs + next_frame;
+	frame = frames + next_frame * RX_FRAME_MAX;
+	++next_frame;
+
+	if( mmsg->msg_hdr.msg_flags & MSG_TRUNC )
+		++stats.truncated;
+
+	frame_length = mmsg->msg_len;
+	if( frame_length > length )
+		frame_length = length;
+	memcpy( payload, frame, frame_length );
+	length = frame_length;
+
+	*addr = LinkLayerAddress
+		( ((struct sockaddr_ll *)mmsg->msg_hdr.msg_name)->sll_addr );
+
+	if( frame_length == 0 ) {
+		if( software != NULL )
+			memset( software, 0, sizeof( *software ));
+		return false;
+	}
+
+	// Only event messages carry a hardware timestamp
+	return getRxHardwareTimestamp( &mmsg->msg_hdr, device, software ) &&
+		!( frame[0] & 0x8 );
+}
+
+void LinuxRxBatch::logStatistics()
+{
+	unsigned i;
+
+	GPTP_LOG_STATUS
+		( "RX batch: wakeups %llu, empty %llu, batches %llu, "
+		  "frames %llu, truncated %llu, max batch %u",
+		  (unsigned long long) stats.wakeups,
+		  (unsigned long long) stats.empty_wakeups,
+		  (unsigned long long) stats.batches,
+		  (unsigned long long) stats.frames,
+		  (unsigned long long) stats.truncated, stats.max_batch );
+	if( stats.batches != 0 ) {
+		GPTP_LOG_STATUS
+			( "RX batch: %.2f frames per recvmmsg() call",
+			  (double) stats.frames / stats.batches );
+	}
+	for( i = 1; i <= size; ++i ) {
+		if( stats.histogram[i] == 0 )
+			continue;
+		GPTP_LOG_STATUS
+			( "RX batch size %2u : %llu", i,
+			  (unsigned long long) stats.histogram[i] );
+	}
+}
@@ -0,0 +1,170 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_RXBATCH_HPP
+#define LINUX_HAL_RXBATCH_HPP
+
+/**@file*/
+
+#include "avbts_osnet.hpp"
+#include "ieee1588.hpp"
+
+#include <stdint.h>
+
+#define RX_BATCH_MAX 32		/*!< Maximum number of frames drained per recvmmsg() */
+#define RX_FRAME_MAX 1536	/*!< Size of each receive buffer */
+#define RX_CONTROL_MAX 256	/*!< Size of each ancillary data buffer */
+
+struct msghdr;
+struct mmsghdr;
+struct iovec;
+struct sockaddr_ll;
+struct timespec;
+
+/**
+ * @brief  Extracts the device (hardware) receive timestamp from the
+ * SO_TIMESTAMPING control message attached to a received frame
+ * @param  msg [in] Message header returned by recvmsg()/recvmmsg()
+ * @param  device [out] Device timestamp
+ * @param  software [out] Kernel (CLOCK_REALTIME) receive time, zeroed if
+ * absent. May be NULL.
+ * @return TRUE if a device timestamp was found, FALSE otherwise
+ */
+bool getRxHardwareTimestamp
+( struct msghdr *msg, Timestamp *device, struct timespec *software = NULL );
+
+/**
+ * @brief Receive statistics collected by LinuxRxBatch
+ */
+typedef struct {
+	uint64_t wakeups;		//!< Number of epoll_wait() returns with data
+	uint64_t empty_wakeups;		//!< Readable, but recvmmsg() found nothing
+	uint64_t batches;		//!< Number of recvmmsg() calls returning frames
+	uint64_t frames;		//!< Total number of frames received
+	uint64_t truncated;		//!< Frames larger than RX_FRAME_MAX
+	unsigned max_batch;		//!< Largest batch seen
+	uint64_t histogram[RX_BATCH_MAX+1];	//!< Batch size distribution
+} rx_batch_stats_t;
+
+/**
+ * @brief LinuxRxBatch: epoll driven receive engine draining a packet
+ * socket with recvmmsg() into a preallocated array of frame and
+ * control buffers. Frames are then served one at a time without further
+ * system calls.
+ */
+class LinuxRxBatch {
+public:
+	/**
+	 * @brief  Default constructor. Call init() before use.
+	 */
+	LinuxRxBatch();
+
+	/**
+	 * @brief  Closes the epoll descriptor and frees the buffers
+	 */
+	~LinuxRxBatch();
+
+	/**
+	 * @brief  Allocates the receive buffers and registers the socket
+	 * with a new epoll instance
+	 * @param  sd Socket descriptor to drain
+	 * @param  size Number of frames per recvmmsg() call (at most
+	 * RX_BATCH_MAX)
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init( int sd, unsigned size );
+
+	/**
+	 * @brief  Waits for the socket to become readable and drains up to
+	 * size frames with a single recvmmsg() call
+	 * @param  timeout_ms Maximum time to wait in milliseconds
+	 * @return net_succeed if at least one frame was received, net_trfail on
+	 * timeout or interruption, net_fatal on error
+	 */
+	net_result fill( int timeout_ms );
+
+	/**
+	 * @brief  Checks for frames received but not yet consumed
+	 * @return TRUE if next() will return a frame
+	 */
+	bool pending() const
+	{
+		return next_frame < count;
+	}
+
+	/**
+	 * @brief  Consumes the next received frame
+	 * @param  addr [out] Source address
+	 * @param  payload [out] Buffer the frame is copied into
+	 * @param  length [inout] Size of payload on input, frame length on output
+	 * @param  device [out] Device receive timestamp, if present
+	 * @param  software [out] Kernel receive time, zeroed if absent. May be
+	 * NULL.
+	 * @return TRUE if device holds a valid timestamp
+	 */
+	bool next
+	( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+	  Timestamp *device, struct timespec *software = NULL );
+
+	/**
+	 * @brief  Gets the receive statistics
+	 * @return Reference to the statistics
+	 */
+	const rx_batch_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the receive statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	int epfd;
+	int sd;
+	unsigned size;
+	unsigned count;
+	unsigned next_frame;
+
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	struct sockaddr_ll *names;
+	uint8_t *frames;
+	uint8_t *control;
+
+	rx_batch_stats_t stats;
+};
+
+#endif/*LINUX_HAL_RXBATCH_HPP*/
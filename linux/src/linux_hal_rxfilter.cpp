@@ -0,0 +1,195 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_rxfilter.hpp>
+#include <avbts_message.hpp>
+#include <gptp_log.hpp>
+#include <platform.hpp>
+
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RX_FILTER_LENGTH 16
+#define RX_FILTER_DROP 15	/*!< Index of the drop return */
+#define RX_FILTER_ACCEPT_ALL 0xFFFFFFFF
+#define RX_FILTER_COUNT_ONLY 1	/*!< Snap length for counted frames */
+
+/* Relative jump offset from instruction i to instruction target */
+#define RX_FILTER_JUMP(i,target) ((target) - ((i) + 1))
+
+LinuxRxFilter::LinuxRxFilter()
+{
+	counter_sd = -1;
+	mac_high = 0;
+	mac_low = 0;
+	domain = 0;
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxRxFilter::~LinuxRxFilter()
+{
+	if( counter_sd != -1 ) close( counter_sd );
+}
+
+bool LinuxRxFilter::setFilter( int sd, bool inverse )
+{
+	uint32_t accept = inverse ? 0 : RX_FILTER_ACCEPT_ALL;
+	uint32_t drop = inverse ? RX_FILTER_COUNT_ONLY : 0;
+	struct sock_filter code[RX_FILTER_LENGTH] = {
+		/* 0: Frames we sent ourselves */
+		BPF_STMT( BPF_LD | BPF_B | BPF_ABS,
+			  (uint32_t) ( SKF_AD_OFF + SKF_AD_PKTTYPE )),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING,
+			  RX_FILTER_JUMP( 1, RX_FILTER_DROP ), 0 ),
+		/* 2: Frames looped back with our source address */
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS,
+			  (uint32_t) ( SKF_LL_OFF + 6 )),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, mac_high,
+			  0, RX_FILTER_JUMP( 3, 6 )),
+		BPF_STMT( BPF_LD | BPF_H | BPF_ABS,
+			  (uint32_t) ( SKF_LL_OFF + 10 )),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, mac_low,
+			  RX_FILTER_JUMP( 5, RX_FILTER_DROP ), 0 ),
+		/* 6: transportSpecific (also drops frames too short to load) */
+		BPF_STMT( BPF_LD | BPF_B | BPF_ABS,
+			  PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET) ),
+		BPF_STMT( BPF_ALU | BPF_AND | BPF_K, 0xF0 ),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K,
+			  RX_FILTER_TRANSPORT_SPECIFIC << 4,
+			  0, RX_FILTER_JUMP( 8, RX_FILTER_DROP )),
+		/* 9: versionPTP */
+		BPF_STMT( BPF_LD | BPF_B | BPF_ABS,
+			  PTP_COMMON_HDR_PTP_VERSION(PTP_COMMON_HDR_OFFSET) ),
+		BPF_STMT( BPF_ALU | BPF_AND | BPF_K, 0x0F ),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, RX_FILTER_PTP_VERSION,
+			  0, RX_FILTER_JUMP( 11, RX_FILTER_DROP )),
+		/* 12: domainNumber */
+		BPF_STMT( BPF_LD | BPF_B | BPF_ABS,
+			  PTP_COMMON_HDR_DOMAIN_NUMBER(PTP_COMMON_HDR_OFFSET) ),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, domain,
+			  0, RX_FILTER_JUMP( 13, RX_FILTER_DROP )),
+		/* 14 */
+		BPF_STMT( BPF_RET | BPF_K, accept ),
+		/* 15 (RX_FILTER_DROP) */
+		BPF_STMT( BPF_RET | BPF_K, drop ),
+	};
+	struct sock_fprog prog;
+
+	prog.len = RX_FILTER_LENGTH;
+	prog.filter = code;
+
+	if( setsockopt
+	    ( sd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof( prog )) == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to attach socket filter: %s", strerror(errno) );
+		return false;
+	}
+
+	return true;
+}
+
+bool LinuxRxFilter::init
+( int ifindex, uint16_t protocol, LinkLayerAddress *local, uint8_t domain )
+{
+	struct sockaddr_ll addr;
+	uint8_t mac[ETHER_ADDR_OCTETS];
+	int rcvbuf = 0;
+
+	local->toOctetArray( mac );
+	mac_high = ((uint32_t) mac[0] << 24 ) | ((uint32_t) mac[1] << 16 ) |
+		((uint32_t) mac[2] << 8 ) | mac[3];
+	mac_low = ((uint16_t) mac[4] << 8 ) | mac[5];
+	this->domain = domain;
+
+	counter_sd = socket( PF_PACKET, SOCK_DGRAM, 0 );
+	if( counter_sd == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to open filter counter socket: %s",
+			  strerror(errno) );
+		return false;
+	}
+
+	// Attach before binding so no frame slips past the filter
+	if( !setFilter( counter_sd, true ))
+		return false;
+
+	// The kernel rounds this up to its minimum
+	setsockopt( counter_sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof( rcvbuf ));
+
+	memset( &addr, 0, sizeof( addr ));
+	addr.sll_family = AF_PACKET;
+	addr.sll_ifindex = ifindex;
+	addr.sll_protocol = PLAT_htons( protocol );
+	if( bind( counter_sd, (sockaddr *) &addr, sizeof( addr )) == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to bind filter counter socket: %s",
+			  strerror(errno) );
+		return false;
+	}
+
+	return true;
+}
+
+bool LinuxRxFilter::attach( int sd )
+{
+	return setFilter( sd, false );
+}
+
+const rx_filter_stats_t &LinuxRxFilter::getStatistics()
+{
+	struct tpacket_stats kstats;
+	socklen_t len = sizeof( kstats );
+
+	// Reading the kernel counters resets them. tp_packets includes
+	// frames dropped because the (never read) queue is full.
+	if( counter_sd != -1 &&
+	    getsockopt
+	    ( counter_sd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len ) == 0 ) {
+		stats.rejected += kstats.tp_packets;
+	}
+
+	return stats;
+}
+
+void LinuxRxFilter::logStatistics()
+{
+	getStatistics();
+
+	GPTP_LOG_STATUS
+		( "RX filter: %llu frames dropped in kernel (domain %u)",
+		  (unsigned long long) stats.rejected, domain );
+}
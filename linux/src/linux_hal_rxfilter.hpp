@@ -0,0 +1,116 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_RXFILTER_HPP
+#define LINUX_HAL_RXFILTER_HPP
+
+/**@file*/
+
+#include "avbts_osnet.hpp"
+
+#include <stdint.h>
+
+#define RX_FILTER_TRANSPORT_SPECIFIC 1	/*!< 802.1AS transportSpecific value */
+#define RX_FILTER_PTP_VERSION 2		/*!< Accepted versionPTP */
+
+/**
+ * @brief Counters collected by LinuxRxFilter
+ */
+typedef struct {
+	uint64_t rejected;	//!< Frames dropped in the kernel by the filter
+} rx_filter_stats_t;
+
+/**
+ * @brief LinuxRxFilter: classic BPF socket filter dropping, in the kernel,
+ * frames the daemon would discard anyway: frames the interface transmitted
+ * itself and frames with an unexpected transportSpecific, versionPTP or
+ * domainNumber. Rejected frames are counted by a companion packet socket
+ * running the inverse filter whose receive queue is never read; the kernel
+ * accounts every frame it matches in its packet statistics. Frames too
+ * short to hold the checked header fields are dropped without being counted.
+ */
+class LinuxRxFilter {
+public:
+	/**
+	 * @brief  Default constructor. Call init() before use.
+	 */
+	LinuxRxFilter();
+
+	/**
+	 * @brief  Closes the counting socket
+	 */
+	~LinuxRxFilter();
+
+	/**
+	 * @brief  Generates the filter program and opens the counting socket
+	 * @param  ifindex Interface index
+	 * @param  protocol Ethertype (host byte order) the sockets are bound to
+	 * @param  local [in] Local MAC address, frames from it are dropped
+	 * @param  domain Accepted PTP domain number
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init
+	( int ifindex, uint16_t protocol, LinkLayerAddress *local,
+	  uint8_t domain );
+
+	/**
+	 * @brief  Attaches the filter to a packet socket
+	 * @param  sd Socket descriptor
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool attach( int sd );
+
+	/**
+	 * @brief  Gets the filter counters
+	 * @return Reference to the counters
+	 */
+	const rx_filter_stats_t &getStatistics();
+
+	/**
+	 * @brief  Logs the filter counters
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	int counter_sd;
+	uint32_t mac_high;
+	uint16_t mac_low;
+	uint8_t domain;
+
+	rx_filter_stats_t stats;
+
+	bool setFilter( int sd, bool inverse );
+};
+
+#endif/*LINUX_HAL_RXFILTER_HPP*/
@@ -0,0 +1,270 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_rxring.hpp>
+#include <linux_hal_common.hpp>
+#include <gptp_log.hpp>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+LinuxRxRing::LinuxRxRing()
+{
+	sd = -1;
+	blocks = 0;
+	block_index = 0;
+	map = NULL;
+	map_size = 0;
+	current = NULL;
+	frame = NULL;
+	frames_left = 0;
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxRxRing::~LinuxRxRing()
+{
+	if( map != NULL )
+		munmap( map, map_size );
+}
+
+bool LinuxRxRing::init( int sd, unsigned blocks )
+{
+	struct tpacket_req3 req;
+	int version = TPACKET_V3;
+	int ts_source = SOF_TIMESTAMPING_RAW_HARDWARE;
+	void *addr;
+
+	if( blocks == 0 || blocks > RX_RING_BLOCKS_MAX ) {
+		GPTP_LOG_ERROR( "Invalid receive ring block count: %u", blocks );
+		return false;
+	}
+
+	this->sd = sd;
+	this->blocks = blocks;
+
+	if( setsockopt
+	    ( sd, SOL_PACKET, PACKET_VERSION, &version,
+	      sizeof( version )) == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to select TPACKET_V3: %s", strerror(errno) );
+		return false;
+	}
+
+	/* Report the raw hardware timestamp in the frame header. Devices
+	   without one (e.g. veth) fall back to a software timestamp, which is
+	   flagged in tp_status and ignored. */
+	if( setsockopt
+	    ( sd, SOL_PACKET, PACKET_TIMESTAMP, &ts_source,
+	      sizeof( ts_source )) == -1 ) {
+		GPTP_LOG_WARNING
+			( "Failed to request ring hardware timestamps: %s",
+			  strerror(errno) );
+	}
+
+	memset( &req, 0, sizeof( req ));
+	req.tp_block_size = RX_RING_BLOCK_SIZE;
+	req.tp_block_nr = blocks;
+	req.tp_frame_size = RX_RING_FRAME_SIZE;
+	req.tp_frame_nr = ( RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE ) * blocks;
+	req.tp_retire_blk_tov = RX_RING_BLOCK_TIMEOUT_MS;
+	if( setsockopt
+	    ( sd, SOL_PACKET, PACKET_RX_RING, &req, sizeof( req )) == -1 ) {
+		GPTP_LOG_ERROR
+			( "Failed to set up receive ring: %s", strerror(errno) );
+		return false;
+	}
+
+	map_size = (size_t) RX_RING_BLOCK_SIZE * blocks;
+	addr = mmap
+		( NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, sd, 0 );
+	if( addr == MAP_FAILED ) {
+		GPTP_LOG_ERROR
+			( "Failed to map receive ring: %s", strerror(errno) );
+		map_size = 0;
+		return false;
+	}
+	map = (uint8_t *) addr;
+
+	return true;
+}
+
+net_result LinuxRxRing::fill( int timeout_ms )
+{
+	struct tpacket_block_desc *block;
+	struct pollfd pfd;
+	int err;
+
+	block = (struct tpacket_block_desc *)
+		( map + (size_t) block_index * RX_RING_BLOCK_SIZE );
+
+	if(( __atomic_load_n( &block->hdr.bh1.block_status, __ATOMIC_ACQUIRE )
+	     & TP_STATUS_USER ) == 0 ) {
+		memset( &pfd, 0, sizeof( pfd ));
+		pfd.fd = sd;
+		pfd.events = POLLIN;
+
+		err = poll( &pfd, 1, timeout_ms );
+		if( err == 0 ) {
+			return net_trfail;
+		} else if( err == -1 ) {
+			if( errno == EINTR ) {
+				return net_trfail;
+			}
+			GPTP_LOG_ERROR( "poll() failed: %s", strerror(errno) );
+			return net_fatal;
+		}
+		++stats.wakeups;
+
+		if(( __atomic_load_n
+		     ( &block->hdr.bh1.block_status, __ATOMIC_ACQUIRE )
+		     & TP_STATUS_USER ) == 0 ) {
+			// Woken by the error queue (TX timestamps) only
+			return net_trfail;
+		}
+	}
+
+	current = block;
+	frames_left = block->hdr.bh1.num_pkts;
+	frame = (struct tpacket3_hdr *)
+		((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt );
+
+	if( frames_left == 0 ) {
+		releaseBlock();
+		return net_trfail;
+	}
+
+	return net_succeed;
+}
+
+void LinuxRxRing::releaseBlock()
+{
+	__atomic_store_n
+		( &current->hdr.bh1.block_status, TP_STATUS_KERNEL,
+		  __ATOMIC_RELEASE );
+	++stats.blocks;
+
+	current = NULL;
+	frame = NULL;
+	frames_left = 0;
+	block_index = ( block_index + 1 ) % blocks;
+}
+
+bool LinuxRxRing::peek
+( LinkLayerAddress *addr, uint8_t *&payload, size_t &length,
+  Timestamp *device )
+{
+	struct sockaddr_ll *name;
+	struct timespec ts;
+	size_t frame_length;
+	bool hw_timestamp;
+
+	name = (struct sockaddr_ll *)
+		((uint8_t *) frame + TPACKET_ALIGN( sizeof( *frame )));
+	payload = (uint8_t *) frame + frame->tp_net;
+
+	frame_length = frame->tp_snaplen;
+	if( frame_length > length ) {
+		frame_length = length;
+		++stats.truncated;
+	}
+	length = frame_length;
+
+	*addr = LinkLayerAddress( name->sll_addr );
+
+	// Only event messages carry a hardware timestamp
+	hw_timestamp = frame_length != 0 && !( payload[0] & 0x8 ) &&
+		( frame->tp_status & TP_STATUS_TS_RAW_HARDWARE );
+	if( hw_timestamp ) {
+		ts.tv_sec = frame->tp_sec;
+		ts.tv_nsec = frame->tp_nsec;
+		*device = tsToTimestamp( &ts );
+		++stats.hw_timestamps;
+	}
+
+	return hw_timestamp;
+}
+
+void LinuxRxRing::consume()
+{
+	++stats.frames;
+
+	if( --frames_left == 0 ) {
+		releaseBlock();
+	} else {
+		frame = (struct tpacket3_hdr *)
+			((uint8_t *) frame + frame->tp_next_offset );
+	}
+}
+
+void LinuxRxRing::updateKernelStatistics()
+{
+	struct tpacket_stats_v3 kstats;
+	socklen_t len = sizeof( kstats );
+
+	// Reading the kernel counters resets them
+	if( getsockopt
+	    ( sd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len ) == -1 ) {
+		return;
+	}
+	stats.kernel_drops += kstats.tp_drops;
+	stats.kernel_freezes += kstats.tp_freeze_q_cnt;
+}
+
+void LinuxRxRing::logStatistics()
+{
+	updateKernelStatistics();
+
+	GPTP_LOG_STATUS
+		( "RX ring: wakeups %llu, blocks %llu, frames %llu, "
+		  "truncated %llu, hardware timestamps %llu",
+		  (unsigned long long) stats.wakeups,
+		  (unsigned long long) stats.blocks,
+		  (unsigned long long) stats.frames,
+		  (unsigned long long) stats.truncated,
+		  (unsigned long long) stats.hw_timestamps );
+	GPTP_LOG_STATUS
+		( "RX ring: kernel drops %llu, ring full %llu",
+		  (unsigned long long) stats.kernel_drops,
+		  (unsigned long long) stats.kernel_freezes );
+	if( stats.blocks != 0 ) {
+		GPTP_LOG_STATUS
+			( "RX ring: %.2f frames per block",
+			  (double) stats.frames / stats.blocks );
+	}
+}
@@ -0,0 +1,166 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_RXRING_HPP
+#define LINUX_HAL_RXRING_HPP
+
+/**@file*/
+
+#include "avbts_osnet.hpp"
+#include "ieee1588.hpp"
+
+#include <stdint.h>
+
+#define RX_RING_BLOCK_SIZE (1 << 14)	/*!< Size of each ring block in bytes */
+#define RX_RING_FRAME_SIZE 2048		/*!< Nominal frame slot size */
+#define RX_RING_BLOCK_TIMEOUT_MS 1	/*!< Partially filled block retire timeout */
+#define RX_RING_BLOCKS_MAX 256		/*!< Upper bound for the number of blocks */
+
+struct tpacket_block_desc;
+struct tpacket3_hdr;
+
+/**
+ * @brief Receive statistics collected by LinuxRxRing
+ */
+typedef struct {
+	uint64_t wakeups;		//!< Number of poll() returns with data
+	uint64_t blocks;		//!< Blocks handed back to the kernel
+	uint64_t frames;		//!< Frames read from the ring
+	uint64_t truncated;		//!< Frames longer than the caller handles
+	uint64_t hw_timestamps;		//!< Event frames with a hardware timestamp
+	uint64_t kernel_drops;		//!< Frames dropped by the kernel (ring full)
+	uint64_t kernel_freezes;	//!< Times the kernel found the ring full
+} rx_ring_stats_t;
+
+/**
+ * @brief LinuxRxRing: PACKET_RX_RING (TPACKET_V3) receive engine. The
+ * kernel writes frames and their timestamps into blocks of a ring
+ * mapped into the process, so frames are read without a system call per
+ * frame and parsed where the kernel wrote them. A block is returned to
+ * the kernel once every frame in it has been consumed.
+ */
+class LinuxRxRing {
+public:
+	/**
+	 * @brief  Default constructor. Call init() before use.
+	 */
+	LinuxRxRing();
+
+	/**
+	 * @brief  Unmaps the ring
+	 */
+	~LinuxRxRing();
+
+	/**
+	 * @brief  Switches the socket to TPACKET_V3, sets up the ring and maps
+	 * it. Must be called on a bound packet socket before any frame is read.
+	 * @param  sd Packet socket descriptor
+	 * @param  blocks Number of RX_RING_BLOCK_SIZE blocks in the ring (at
+	 * most RX_RING_BLOCKS_MAX)
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init( int sd, unsigned blocks );
+
+	/**
+	 * @brief  Waits for the kernel to hand over the next block
+	 * @param  timeout_ms Maximum time to wait in milliseconds
+	 * @return net_succeed if a block with frames is available, net_trfail
+	 * on timeout or interruption, net_fatal on error
+	 */
+	net_result fill( int timeout_ms );
+
+	/**
+	 * @brief  Checks for frames in the current block not yet consumed
+	 * @return TRUE if next() will return a frame
+	 */
+	bool pending() const
+	{
+		return current != NULL && frames_left != 0;
+	}
+
+	/**
+	 * @brief  Gets the next frame of the current block in place. The
+	 * frame stays in the ring, and the block is not handed back to the
+	 * kernel, until consume() is called.
+	 * @param  addr [out] Source address
+	 * @param  payload [out] Frame data within the ring
+	 * @param  length [inout] Largest length the caller handles on input,
+	 * frame length on output
+	 * @param  device [out] Device receive timestamp, if present
+	 * @return TRUE if device holds a valid hardware timestamp
+	 */
+	bool peek
+	( LinkLayerAddress *addr, uint8_t *&payload, size_t &length,
+	  Timestamp *device );
+
+	/**
+	 * @brief  Consumes the frame returned by peek(), releasing the block
+	 * to the kernel after its last frame
+	 * @return void
+	 */
+	void consume();
+
+	/**
+	 * @brief  Gets the receive statistics
+	 * @return Reference to the statistics
+	 */
+	const rx_ring_stats_t &getStatistics()
+	{
+		updateKernelStatistics();
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the receive statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	void releaseBlock();
+	void updateKernelStatistics();
+
+	int sd;
+	unsigned blocks;
+	unsigned block_index;
+	uint8_t *map;
+	size_t map_size;
+
+	struct tpacket_block_desc *current;
+	struct tpacket3_hdr *frame;
+	unsigned frames_left;
+
+	rx_ring_stats_t stats;
+};
+
+#endif/*LINUX_HAL_RXRING_HPP*/
@@ -0,0 +1,192 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_rxtsring.hpp>
+#include <avbts_message.hpp>
+#include <gptp_log.hpp>
+
+#include <string.h>
+
+#define RX_TS_RING_MASK (RX_TS_RING_SIZE-1)
+
+LinuxRxTimestampRing::LinuxRxTimestampRing()
+{
+	unsigned i;
+
+	for( i = 0; i < RX_TS_RING_SIZE; ++i ) {
+		entries[i].seq.store( 0, std::memory_order_relaxed );
+		entries[i].taken.store( 0, std::memory_order_relaxed );
+	}
+	head.store( 0, std::memory_order_relaxed );
+	pushes.store( 0, std::memory_order_relaxed );
+	evictions.store( 0, std::memory_order_relaxed );
+	hits.store( 0, std::memory_order_relaxed );
+	misses.store( 0, std::memory_order_relaxed );
+}
+
+bool LinuxRxTimestampRing::keyFromHeader
+( rx_ts_key_t *key, const uint8_t *header, size_t length )
+{
+	if( length < PTP_COMMON_HDR_LENGTH )
+		return false;
+
+	key->message_type = header
+		[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET)] & 0xF;
+	// Clock identity, port number and sequence id are contiguous
+	memcpy
+		( key->id,
+		  header + PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET),
+		  sizeof( key->id ));
+
+	return true;
+}
+
+void LinuxRxTimestampRing::keyFromMessage
+( rx_ts_key_t *key, PortIdentity *identity, PTPMessageId messageId )
+{
+	uint16_t port_number;
+	uint16_t sequence_id;
+
+	key->message_type = messageId.getMessageType();
+	identity->getClockIdentityString( key->id );
+	identity->getPortNumberNO( &port_number );
+	memcpy( key->id + PTP_CLOCK_IDENTITY_LENGTH, &port_number,
+		sizeof( port_number ));
+	sequence_id = PLAT_htons( messageId.getSequenceId() );
+	memcpy( key->id + PTP_CLOCK_IDENTITY_LENGTH + sizeof( port_number ),
+		&sequence_id, sizeof( sequence_id ));
+}
+
+void LinuxRxTimestampRing::push
+( const rx_ts_key_t *key, const Timestamp &timestamp )
+{
+	uint32_t h = head.load( std::memory_order_relaxed );
+	Entry *entry = entries + ( h & RX_TS_RING_MASK );
+	uint32_t seq = entry->seq.load( std::memory_order_relaxed );
+
+	if( seq != 0 &&
+	    entry->taken.load( std::memory_order_acquire ) != seq ) {
+		evictions.store
+			( evictions.load( std::memory_order_relaxed ) + 1,
+			  std::memory_order_relaxed );
+	}
+
+	entry->seq.store( seq + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	entry->key = *key;
+	entry->timestamp = timestamp;
+	entry->seq.store( seq + 2, std::memory_order_release );
+
+	head.store( h + 1, std::memory_order_release );
+	pushes.store
+		( pushes.load( std::memory_order_relaxed ) + 1,
+		  std::memory_order_relaxed );
+}
+
+bool LinuxRxTimestampRing::lookup
+( const rx_ts_key_t *key, Timestamp &timestamp )
+{
+	uint32_t h = head.load( std::memory_order_acquire );
+	uint32_t n = h < RX_TS_RING_SIZE ? h : RX_TS_RING_SIZE;
+	uint32_t i;
+
+	// Newest first, the wanted entry is almost always the last pushed
+	for( i = 1; i <= n; ++i ) {
+		Entry *entry = entries + (( h - i ) & RX_TS_RING_MASK );
+		uint32_t seq = entry->seq.load( std::memory_order_acquire );
+		rx_ts_key_t entry_key;
+		Timestamp entry_timestamp;
+
+		if(( seq & 1 ) ||
+		   entry->taken.load( std::memory_order_relaxed ) == seq )
+			continue;
+
+		entry_key = entry->key;
+		entry_timestamp = entry->timestamp;
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( entry->seq.load( std::memory_order_relaxed ) != seq )
+			continue;	// Overwritten while reading
+
+		if( entry_key.message_type != key->message_type ||
+		    memcmp( entry_key.id, key->id, sizeof( key->id )) != 0 )
+			continue;
+
+		entry->taken.store( seq, std::memory_order_release );
+		timestamp = entry_timestamp;
+		hits.store
+			( hits.load( std::memory_order_relaxed ) + 1,
+			  std::memory_order_relaxed );
+		return true;
+	}
+
+	misses.store
+		( misses.load( std::memory_order_relaxed ) + 1,
+		  std::memory_order_relaxed );
+	return false;
+}
+
+void LinuxRxTimestampRing::clear()
+{
+	unsigned i;
+
+	for( i = 0; i < RX_TS_RING_SIZE; ++i ) {
+		entries[i].taken.store
+			( entries[i].seq.load( std::memory_order_acquire ),
+			  std::memory_order_release );
+	}
+}
+
+rx_ts_ring_stats_t LinuxRxTimestampRing::getStatistics() const
+{
+	rx_ts_ring_stats_t stats;
+
+	stats.pushes = pushes.load( std::memory_order_relaxed );
+	stats.hits = hits.load( std::memory_order_relaxed );
+	stats.misses = misses.load( std::memory_order_relaxed );
+	stats.evictions = evictions.load( std::memory_order_relaxed );
+
+	return stats;
+}
+
+void LinuxRxTimestampRing::logStatistics() const
+{
+	rx_ts_ring_stats_t stats = getStatistics();
+
+	GPTP_LOG_STATUS
+		( "RX timestamp ring: pushed %llu, hits %llu, misses %llu, "
+		  "evicted %llu",
+		  (unsigned long long) stats.pushes,
+		  (unsigned long long) stats.hits,
+		  (unsigned long long) stats.misses,
+		  (unsigned long long) stats.evictions );
+}
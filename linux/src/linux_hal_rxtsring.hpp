@@ -0,0 +1,160 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_RXTSRING_HPP
+#define LINUX_HAL_RXTSRING_HPP
+
+/**@file*/
+
+#include "ieee1588.hpp"
+
+#include <atomic>
+#include <stdint.h>
+
+#define RX_TS_RING_SIZE 16	/*!< Number of RX timestamps kept (power of two) */
+#define RX_TS_KEY_ID_LENGTH 12	/*!< Clock identity, port number and sequence id */
+
+class PortIdentity;
+class PTPMessageId;
+
+/**
+ * @brief Identifies the event message an RX timestamp belongs to. The
+ * clock identity, port number and sequence id are kept in network byte
+ * order, exactly as they appear (contiguously) in the PTP common header.
+ */
+typedef struct {
+	uint8_t id[RX_TS_KEY_ID_LENGTH];	//!< sourcePortIdentity and sequenceId
+	uint8_t message_type;			//!< PTP message type
+} rx_ts_key_t;
+
+/**
+ * @brief Lookup statistics collected by LinuxRxTimestampRing
+ */
+typedef struct {
+	uint64_t pushes;	//!< Timestamps stored
+	uint64_t hits;		//!< Lookups matched to a stored timestamp
+	uint64_t misses;	//!< Lookups with no matching timestamp
+	uint64_t evictions;	//!< Timestamps overwritten before being consumed
+} rx_ts_ring_stats_t;
+
+/**
+ * @brief LinuxRxTimestampRing: fixed capacity single producer/single
+ * consumer ring of RX timestamps keyed by (messageType, sequenceId,
+ * sourcePortIdentity). The producer (receive path) never blocks and
+ * overwrites the oldest entry when full. The consumer looks timestamps up
+ * by key, scanning at most RX_TS_RING_SIZE entries; neither side allocates.
+ */
+class LinuxRxTimestampRing {
+public:
+	/**
+	 * @brief  Default constructor, the ring starts empty
+	 */
+	LinuxRxTimestampRing();
+
+	/**
+	 * @brief  Builds a key from the PTP common header of a received frame
+	 * @param  key [out] Message key
+	 * @param  header [in] Start of the PTP common header
+	 * @param  length Number of valid bytes at header
+	 * @return FALSE if the frame is too short to hold a PTP header
+	 */
+	static bool keyFromHeader
+	( rx_ts_key_t *key, const uint8_t *header, size_t length );
+
+	/**
+	 * @brief  Builds a key from a decoded message identity
+	 * @param  key [out] Message key
+	 * @param  identity [in] Source port identity
+	 * @param  messageId Message type and sequence id
+	 * @return void
+	 */
+	static void keyFromMessage
+	( rx_ts_key_t *key, PortIdentity *identity, PTPMessageId messageId );
+
+	/**
+	 * @brief  Stores a timestamp (producer side)
+	 * @param  key [in] Message key
+	 * @param  timestamp [in] RX timestamp
+	 * @return void
+	 */
+	void push( const rx_ts_key_t *key, const Timestamp &timestamp );
+
+	/**
+	 * @brief  Finds and consumes the timestamp matching key (consumer side)
+	 * @param  key [in] Message key
+	 * @param  timestamp [out] RX timestamp
+	 * @return TRUE if found, FALSE otherwise
+	 */
+	bool lookup( const rx_ts_key_t *key, Timestamp &timestamp );
+
+	/**
+	 * @brief  Discards all stored timestamps (consumer side)
+	 * @return void
+	 */
+	void clear();
+
+	/**
+	 * @brief  Gets the lookup statistics
+	 * @return Copy of the statistics
+	 */
+	rx_ts_ring_stats_t getStatistics() const;
+
+	/**
+	 * @brief  Logs the lookup statistics
+	 * @return void
+	 */
+	void logStatistics() const;
+
+private:
+	struct Entry {
+		/* Odd while the producer is writing, incremented again once
+		   the entry is complete */
+		std::atomic<uint32_t> seq;
+		/* Value of seq when the consumer took this entry */
+		std::atomic<uint32_t> taken;
+		rx_ts_key_t key;
+		Timestamp timestamp;
+	};
+
+	Entry entries[RX_TS_RING_SIZE];
+	std::atomic<uint32_t> head;
+
+	// Written by the producer only
+	std::atomic<uint64_t> pushes;
+	std::atomic<uint64_t> evictions;
+	// Written by the consumer only
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+};
+
+#endif/*LINUX_HAL_RXTSRING_HPP*/
@@ -0,0 +1,179 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#include <linux_hal_timerq.hpp>
+
+#include <time.h>
+
+uint64_t getMonotonicTime()
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+LinuxTimerHeap::LinuxTimerHeap( unsigned reserve )
+{
+	heap.reserve( reserve );
+	sequence = 0;
+}
+
+void LinuxTimerHeap::siftUp( unsigned i )
+{
+	LinuxTimerEntry *entry = heap[i];
+
+	while( i > 0 ) {
+		unsigned parent = ( i - 1 ) / 2;
+		if( !before( entry, heap[parent] ))
+			break;
+		place( heap[parent], i );
+		i = parent;
+	}
+	place( entry, i );
+}
+
+void LinuxTimerHeap::siftDown( unsigned i )
+{
+	LinuxTimerEntry *entry = heap[i];
+	unsigned count = (unsigned) heap.size();
+
+	for( ;; ) {
+		unsigned child = 2 * i + 1;
+		if( child >= count )
+			break;
+		if( child + 1 < count && before( heap[child+1], heap[child] ))
+			++child;
+		if( !before( heap[child], entry ))
+			break;
+		place( heap[child], i );
+		i = child;
+	}
+	place( entry, i );
+}
+
+void LinuxTimerHeap::push( LinuxTimerEntry *entry )
+{
+	entry->sequence = sequence++;
+	heap.push_back( entry );
+	siftUp( (unsigned) heap.size() - 1 );
+}
+
+bool LinuxTimerHeap::remove( LinuxTimerEntry *entry )
+{
+	unsigned i = entry->index;
+	LinuxTimerEntry *last;
+
+	if( i >= heap.size() || heap[i] != entry )
+		return false;
+
+	entry->index = TIMER_HEAP_INVALID;
+	last = heap.back();
+	heap.pop_back();
+	if( last == entry )
+		return true;
+
+	// Move the last entry into the hole and restore the order in
+	// whichever direction it is violated
+	place( last, i );
+	if( i > 0 && before( last, heap[( i - 1 ) / 2] ))
+		siftUp( i );
+	else
+		siftDown( i );
+
+	return true;
+}
+
+bool LinuxTimerHeap::update( LinuxTimerEntry *entry, uint64_t deadline )
+{
+	unsigned i = entry->index;
+
+	if( i >= heap.size() || heap[i] != entry )
+		return false;
+
+	entry->deadline = deadline;
+	entry->sequence = sequence++;
+	if( i > 0 && before( entry, heap[( i - 1 ) / 2] ))
+		siftUp( i );
+	else
+		siftDown( i );
+
+	return true;
+}
+
+LinuxTimerEntry *LinuxTimerHeap::pop()
+{
+	LinuxTimerEntry *entry = top();
+
+	if( entry != NULL )
+		remove( entry );
+
+	return entry;
+}
+
+void LinuxTimerIndex::insert( LinuxTimerEntry *entry )
+{
+	LinuxTimerKey key = { entry->owner, entry->type };
+	LinuxTimerEntry *&head = heads[key];
+
+	entry->prev = NULL;
+	entry->next = head;
+	if( head != NULL )
+		head->prev = entry;
+	head = entry;
+}
+
+void LinuxTimerIndex::unlink( LinuxTimerEntry *entry )
+{
+	if( entry->prev != NULL ) {
+		entry->prev->next = entry->next;
+	} else {
+		LinuxTimerKey key = { entry->owner, entry->type };
+		LinuxTimerIndexMap_t::iterator head = heads.find( key );
+		if( head != heads.end() && head->second == entry )
+			head->second = entry->next;
+	}
+	if( entry->next != NULL )
+		entry->next->prev = entry->prev;
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+LinuxTimerEntry *LinuxTimerIndex::find( const void *owner, int type ) const
+{
+	LinuxTimerKey key = { owner, type };
+	LinuxTimerIndexMap_t::const_iterator head = heads.find( key );
+
+	return head != heads.end() ? head->second : NULL;
+}
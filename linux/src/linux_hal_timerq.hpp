@@ -0,0 +1,230 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef LINUX_HAL_TIMERQ_HPP
+#define LINUX_HAL_TIMERQ_HPP
+
+/**@file*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#define TIMER_HEAP_INVALID ((unsigned)-1)	/*!< Heap index of an entry not in a heap */
+
+/**
+ * @brief  Reads CLOCK_MONOTONIC
+ * @return Current time in nanoseconds
+ */
+uint64_t getMonotonicTime();
+
+/**
+ * @brief Entry of a LinuxTimerHeap and LinuxTimerIndex. Deadlines are
+ * CLOCK_MONOTONIC nanoseconds. The heap keeps index up to date so an
+ * entry can be removed without searching for it. Entries with the same
+ * owner and type are linked together by the index.
+ */
+struct LinuxTimerEntry {
+	uint64_t deadline;	//!< Expiration time
+	uint64_t sequence;	//!< Insertion order, breaks deadline ties
+	unsigned index;		//!< Position in the heap, TIMER_HEAP_INVALID if none
+	const void *owner;	//!< Index key, object the timer was armed for
+	int type;		//!< Index key, timer type
+	LinuxTimerEntry *prev;	//!< Previous entry with the same key
+	LinuxTimerEntry *next;	//!< Next entry with the same key
+
+	LinuxTimerEntry()
+	{
+		deadline = 0;
+		sequence = 0;
+		index = TIMER_HEAP_INVALID;
+		owner = NULL;
+		type = 0;
+		prev = NULL;
+		next = NULL;
+	}
+};
+
+/**
+ * @brief LinuxTimerHeap: binary min-heap of timer entries ordered by
+ * deadline. Entries expiring at the same time are kept in insertion
+ * order. The heap does not own the entries.
+ */
+class LinuxTimerHeap {
+public:
+	/**
+	 * @brief  Creates an empty heap
+	 * @param  reserve Number of entries to allocate room for
+	 */
+	LinuxTimerHeap( unsigned reserve = 0 );
+
+	/**
+	 * @brief  Inserts an entry
+	 * @param  entry Entry with its deadline set
+	 * @return void
+	 */
+	void push( LinuxTimerEntry *entry );
+
+	/**
+	 * @brief  Removes an entry from anywhere in the heap
+	 * @param  entry Entry previously inserted with push()
+	 * @return FALSE if the entry was not in the heap
+	 */
+	bool remove( LinuxTimerEntry *entry );
+
+	/**
+	 * @brief  Moves the deadline of an entry in place. The entry is
+	 * ordered as if it had just been inserted.
+	 * @param  entry Entry previously inserted with push()
+	 * @param  deadline New expiration time
+	 * @return FALSE if the entry was not in the heap
+	 */
+	bool update( LinuxTimerEntry *entry, uint64_t deadline );
+
+	/**
+	 * @brief  Gets the entry with the earliest deadline
+	 * @return Earliest entry, NULL if the heap is empty
+	 */
+	LinuxTimerEntry *top() const
+	{
+		return heap.empty() ? NULL : heap[0];
+	}
+
+	/**
+	 * @brief  Removes and returns the entry with the earliest deadline
+	 * @return Earliest entry, NULL if the heap is empty
+	 */
+	LinuxTimerEntry *pop();
+
+	/**
+	 * @brief  Gets the number of entries
+	 * @return Entry count
+	 */
+	unsigned size() const
+	{
+		return (unsigned) heap.size();
+	}
+
+	/**
+	 * @brief  Gets an entry by heap position, for iteration
+	 * @param  i Position, less than size()
+	 * @return Entry
+	 */
+	LinuxTimerEntry *at( unsigned i ) const
+	{
+		return heap[i];
+	}
+
+private:
+	std::vector<LinuxTimerEntry *> heap;
+	uint64_t sequence;
+
+	bool before( const LinuxTimerEntry *a, const LinuxTimerEntry *b ) const
+	{
+		return a->deadline < b->deadline ||
+			( a->deadline == b->deadline && a->sequence < b->sequence );
+	}
+	void place( LinuxTimerEntry *entry, unsigned i )
+	{
+		heap[i] = entry;
+		entry->index = i;
+	}
+	void siftUp( unsigned i );
+	void siftDown( unsigned i );
+};
+
+/**
+ * @brief Key of a LinuxTimerIndex
+ */
+struct LinuxTimerKey {
+	const void *owner;	//!< Object the timer was armed for
+	int type;		//!< Timer type
+
+	bool operator==( const LinuxTimerKey &other ) const
+	{
+		return owner == other.owner && type == other.type;
+	}
+};
+
+/**
+ * @brief Hash function of a LinuxTimerKey
+ */
+struct LinuxTimerKeyHash {
+	size_t operator()( const LinuxTimerKey &key ) const
+	{
+		return std::hash<const void *>()( key.owner ) * 31 +
+			(size_t) key.type;
+	}
+};
+
+/**
+ * @brief LinuxTimerIndex: hash table from (owner, type) to the list of
+ * pending timer entries armed with that key. Entries are linked through
+ * their own prev and next fields, so adding and unlinking an entry never
+ * allocates once a key has been seen. Keys are kept when their list
+ * empties; their number is bounded by owners times timer types.
+ */
+class LinuxTimerIndex {
+public:
+	/**
+	 * @brief  Links an entry under its owner and type
+	 * @param  entry Entry with owner and type set
+	 * @return void
+	 */
+	void insert( LinuxTimerEntry *entry );
+
+	/**
+	 * @brief  Unlinks an entry
+	 * @param  entry Entry previously inserted
+	 * @return void
+	 */
+	void unlink( LinuxTimerEntry *entry );
+
+	/**
+	 * @brief  Gets the entries armed with a key
+	 * @param  owner Object the timers were armed for
+	 * @param  type Timer type
+	 * @return First entry, follow next for the others. NULL if none.
+	 */
+	LinuxTimerEntry *find( const void *owner, int type ) const;
+
+private:
+	typedef std::unordered_map
+		< LinuxTimerKey, LinuxTimerEntry *, LinuxTimerKeyHash >
+		LinuxTimerIndexMap_t;
+	LinuxTimerIndexMap_t heads;
+};
+
+#endif/*LINUX_HAL_TIMERQ_HPP*/
@@ -0,0 +1,205 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#include <linux_hal_txbatch.hpp>
+#include <gptp_log.hpp>
+
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+#include <errno.h>
+#include <string.h>
+
+LinuxTxBatch::LinuxTxBatch() : owner( pthread_t() )
+{
+	sd = -1;
+	size = 0;
+	count = 0;
+	depth = 0;
+	failed = false;
+	msgs = NULL;
+	iov = NULL;
+	names = NULL;
+	frames = NULL;
+	pthread_mutex_init( &lock, NULL );
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxTxBatch::~LinuxTxBatch()
+{
+	pthread_mutex_destroy( &lock );
+	delete [] msgs;
+	delete [] iov;
+	delete [] names;
+	delete [] frames;
+}
+
+bool LinuxTxBatch::init( int sd, unsigned size )
+{
+	unsigned i;
+
+	if( size == 0 || size > TX_BATCH_MAX ) {
+		GPTP_LOG_ERROR( "Invalid transmit batch size: %u", size );
+		return false;
+	}
+
+	this->sd = sd;
+	this->size = size;
+
+	msgs = new struct mmsghdr[size];
+	iov = new struct iovec[size];
+	names = new struct sockaddr_ll[size];
+	frames = new uint8_t[size * TX_FRAME_MAX];
+
+	memset( msgs, 0, size * sizeof( *msgs ));
+	for( i = 0; i < size; ++i ) {
+		iov[i].iov_base = frames + i * TX_FRAME_MAX;
+		msgs[i].msg_hdr.msg_iov = iov + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = names + i;
+		msgs[i].msg_hdr.msg_namelen = sizeof( *names );
+	}
+
+	return true;
+}
+
+void LinuxTxBatch::begin()
+{
+	if( owned() ) {
+		++depth;
+		return;
+	}
+
+	// Only a thread opening a batch of its own waits here for the open
+	// one to be flushed. Other threads' general messages are not queued
+	// and go out directly with sendto(), frames from one thread still
+	// leave in order
+	pthread_mutex_lock( &lock );
+	owner.store( pthread_self() );
+	depth = 1;
+	failed = false;
+}
+
+net_result LinuxTxBatch::end()
+{
+	bool sent;
+
+	if( !owned() ) {
+		GPTP_LOG_ERROR( "Transmit batch closed by a thread not owning it" );
+		return net_fatal;
+	}
+	if( --depth != 0 )
+		return net_succeed;
+
+	sent = flush() && !failed;
+	owner.store( pthread_t() );
+	pthread_mutex_unlock( &lock );
+
+	return sent ? net_succeed : net_fatal;
+}
+
+bool LinuxTxBatch::queue
+( const struct sockaddr_ll *dest, const uint8_t *payload, size_t length )
+{
+	if( length > TX_FRAME_MAX ) {
+		++stats.oversize;
+		return false;
+	}
+
+	if( count == size ) {
+		++stats.full_flushes;
+		if( !flush() )
+			failed = true;
+	}
+
+	names[count] = *dest;
+	memcpy( frames + count * TX_FRAME_MAX, payload, length );
+	iov[count].iov_len = length;
+	++count;
+
+	return true;
+}
+
+bool LinuxTxBatch::flush()
+{
+	unsigned sent = 0;
+	bool ok = true;
+	int err;
+
+	if( count == 0 )
+		return true;
+
+	while( sent < count ) {
+		++stats.syscalls;
+		err = sendmmsg( sd, msgs + sent, count - sent, 0 );
+		if( err == -1 ) {
+			if( errno == EINTR )
+				continue;
+			// sendmmsg() only fails if the first frame could
+			// not be sent, skip it and carry on with the rest
+			GPTP_LOG_ERROR
+				( "Failed to send: %s(%d)", strerror(errno), errno );
+			++stats.errors;
+			++sent;
+			ok = false;
+			continue;
+		}
+		sent += err;
+	}
+
+	++stats.batches;
+	stats.frames += count;
+	if( count > stats.max_batch )
+		stats.max_batch = count;
+	count = 0;
+
+	return ok;
+}
+
+void LinuxTxBatch::logStatistics()
+{
+	GPTP_LOG_STATUS
+		( "TX batch: batches %llu, frames %llu, sendmmsg() calls %llu, "
+		  "full %llu, oversize %llu, errors %llu, max batch %u",
+		  (unsigned long long) stats.batches,
+		  (unsigned long long) stats.frames,
+		  (unsigned long long) stats.syscalls,
+		  (unsigned long long) stats.full_flushes,
+		  (unsigned long long) stats.oversize,
+		  (unsigned long long) stats.errors, stats.max_batch );
+	if( stats.frames > stats.syscalls ) {
+		GPTP_LOG_STATUS
+			( "TX batch: %llu send system calls saved",
+			  (unsigned long long) ( stats.frames - stats.syscalls ));
+	}
+}
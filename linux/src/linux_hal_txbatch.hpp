@@ -0,0 +1,168 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef LINUX_HAL_TXBATCH_HPP
+#define LINUX_HAL_TXBATCH_HPP
+
+/**@file*/
+
+#include "avbts_osnet.hpp"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+#define TX_BATCH_MAX 8		/*!< Maximum number of frames flushed per sendmmsg() */
+#define TX_FRAME_MAX 1536	/*!< Size of each transmit buffer */
+
+struct mmsghdr;
+struct iovec;
+struct sockaddr_ll;
+
+/**
+ * @brief Transmit statistics collected by LinuxTxBatch
+ */
+typedef struct {
+	uint64_t batches;		//!< Number of sendmmsg() flushes sending frames
+	uint64_t frames;		//!< Total number of frames queued and sent
+	uint64_t syscalls;		//!< Number of sendmmsg() calls made
+	uint64_t full_flushes;		//!< Flushes forced by a full queue
+	uint64_t oversize;		//!< Frames too large to queue, sent directly
+	uint64_t errors;		//!< Frames the kernel refused
+	unsigned max_batch;		//!< Largest batch flushed
+} tx_batch_stats_t;
+
+/**
+ * @brief LinuxTxBatch: queues general (untimestamped) frames sent by one
+ * thread between begin() and end() and hands them to the kernel with a
+ * single sendmmsg() call. Frames sent by other threads while a batch is
+ * open are not queued, and a second batch waits for the first to be
+ * flushed.
+ */
+class LinuxTxBatch {
+public:
+	/**
+	 * @brief  Default constructor. Call init() before use.
+	 */
+	LinuxTxBatch();
+
+	/**
+	 * @brief  Frees the buffers
+	 */
+	~LinuxTxBatch();
+
+	/**
+	 * @brief  Allocates the transmit buffers
+	 * @param  sd Socket descriptor frames are sent on
+	 * @param  size Number of frames per sendmmsg() call (at most
+	 * TX_BATCH_MAX)
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init( int sd, unsigned size );
+
+	/**
+	 * @brief  Opens a batch for the calling thread. Calls may nest, the
+	 * batch is flushed by the outermost end().
+	 * @return void
+	 */
+	void begin();
+
+	/**
+	 * @brief  Closes the batch opened by begin() and flushes the queued
+	 * frames
+	 * @return net_succeed if every frame was sent, net_fatal otherwise
+	 */
+	net_result end();
+
+	/**
+	 * @brief  Checks whether the calling thread has a batch open
+	 * @return TRUE if frames sent by the caller should be queued
+	 */
+	bool owned() const
+	{
+		return pthread_equal( owner.load(), pthread_self() );
+	}
+
+	/**
+	 * @brief  Queues a frame, flushing first if the queue is full. Must
+	 * only be called when owned() is TRUE.
+	 * @param  dest [in] Destination address, copied
+	 * @param  payload [in] Frame data, copied
+	 * @param  length Size of the frame
+	 * @return FALSE if the frame cannot be queued and must be sent
+	 * directly, TRUE otherwise
+	 */
+	bool queue
+	( const struct sockaddr_ll *dest, const uint8_t *payload,
+	  size_t length );
+
+	/**
+	 * @brief  Gets the transmit statistics
+	 * @return Reference to the statistics
+	 */
+	const tx_batch_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the transmit statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	int sd;
+	unsigned size;
+	unsigned count;
+	unsigned depth;
+	bool failed;
+	std::atomic<pthread_t> owner;
+	pthread_mutex_t lock;
+
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	struct sockaddr_ll *names;
+	uint8_t *frames;
+
+	tx_batch_stats_t stats;
+
+	/**
+	 * @brief  Sends every queued frame
+	 * @return TRUE if every frame was sent
+	 */
+	bool flush();
+};
+
+#endif/*LINUX_HAL_TXBATCH_HPP*/
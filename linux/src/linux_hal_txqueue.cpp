@@ -0,0 +1,400 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#include <linux_hal_txqueue.hpp>
+#include <linux_hal_common.hpp>
+#include <linux_hal_latency.hpp>
+#include <avbts_message.hpp>
+#include <gptp_log.hpp>
+
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// Added in Linux 4.19
+#ifndef SCM_TXTIME
+#define SCM_TXTIME 61
+#endif
+
+enum tx_slot_state_t {
+	TX_SLOT_FREE,		// Unused, or result taken by the sender
+	TX_SLOT_QUEUED,		// Waiting for the owner
+	TX_SLOT_IN_FLIGHT,	// Sent, timestamp being collected
+	TX_SLOT_DONE,		// Timestamp collected
+	TX_SLOT_FAILED		// Not sent or not timestamped
+};
+
+struct LinuxTxQueue::Slot {
+	tx_slot_state_t state;
+	uint8_t message_type;
+	uint16_t sequence_id;
+	struct sockaddr_ll dest;
+	uint8_t frame[TX_QUEUE_FRAME_MAX];
+	size_t length;
+	uint64_t launch_time;
+	struct timespec queued;
+	Timestamp timestamp;
+};
+
+static int64_t elapsedNs( const struct timespec *start, const struct timespec *end )
+{
+	return ((int64_t) end->tv_sec - start->tv_sec ) * 1000000000LL +
+		( end->tv_nsec - start->tv_nsec );
+}
+
+LinuxTxQueue::LinuxTxQueue()
+{
+	pthread_condattr_t attr;
+
+	sd = -1;
+	timestamper = NULL;
+	slots = NULL;
+	head = 0;
+	tail = 0;
+	depth = 0;
+	running = false;
+	stopping = false;
+	queue_delay = new LinuxLatencyHistogram();
+	memset( &stats, 0, sizeof( stats ));
+
+	pthread_mutex_init( &lock, NULL );
+	pthread_cond_init( &work, NULL );
+	// Waits for completions are timed against CLOCK_MONOTONIC
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &done, &attr );
+	pthread_condattr_destroy( &attr );
+}
+
+LinuxTxQueue::~LinuxTxQueue()
+{
+	if( running ) {
+		pthread_mutex_lock( &lock );
+		stopping = true;
+		pthread_cond_broadcast( &work );
+		pthread_mutex_unlock( &lock );
+		pthread_join( thread, NULL );
+	}
+
+	pthread_cond_destroy( &done );
+	pthread_cond_destroy( &work );
+	pthread_mutex_destroy( &lock );
+	delete [] slots;
+	delete queue_delay;
+}
+
+bool LinuxTxQueue::init
+( int sd, LinuxTimestamper *timestamper )
+{
+	unsigned i;
+
+	this->sd = sd;
+	this->timestamper = timestamper;
+
+	slots = new Slot[TX_QUEUE_SIZE];
+	for( i = 0; i < TX_QUEUE_SIZE; ++i )
+		slots[i].state = TX_SLOT_FREE;
+
+	return true;
+}
+
+bool LinuxTxQueue::start()
+{
+	int err;
+
+	err = pthread_create( &thread, NULL, ownerThread, this );
+	if( err != 0 ) {
+		GPTP_LOG_ERROR
+			( "Failed to start TX queue thread: %s", strerror(err) );
+		return false;
+	}
+	running = true;
+
+	return true;
+}
+
+net_result LinuxTxQueue::submit
+( const struct sockaddr_ll *dest, const uint8_t *payload, size_t length,
+  uint64_t launch_time )
+{
+	uint16_t sequence_id;
+	Slot *slot;
+
+	if( length > TX_QUEUE_FRAME_MAX || length < PTP_COMMON_HDR_LENGTH ) {
+		GPTP_LOG_ERROR( "Event frame of %zu bytes not queued", length );
+		return net_fatal;
+	}
+
+	pthread_mutex_lock( &lock );
+
+	slot = slots + tail;
+	if( slot->state == TX_SLOT_QUEUED || slot->state == TX_SLOT_IN_FLIGHT ) {
+		++stats.full;
+		pthread_mutex_unlock( &lock );
+		GPTP_LOG_ERROR( "TX queue full, event frame dropped" );
+		return net_fatal;
+	}
+	if( slot->state != TX_SLOT_FREE )
+		++stats.evicted;
+
+	slot->message_type = payload
+		[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET)] & 0xF;
+	memcpy
+		( &sequence_id,
+		  payload + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
+		  sizeof( sequence_id ));
+	slot->sequence_id = PLAT_ntohs( sequence_id );
+	slot->dest = *dest;
+	memcpy( slot->frame, payload, length );
+	slot->length = length;
+	slot->launch_time = launch_time;
+	clock_gettime( CLOCK_MONOTONIC, &slot->queued );
+	slot->state = TX_SLOT_QUEUED;
+
+	++stats.submitted;
+	++stats.depth_histogram[depth];
+	if( depth > stats.max_depth )
+		stats.max_depth = depth;
+	++depth;
+	tail = ( tail + 1 ) % TX_QUEUE_SIZE;
+
+	pthread_cond_signal( &work );
+	pthread_mutex_unlock( &lock );
+
+	return net_succeed;
+}
+
+int LinuxTxQueue::wait
+( PTPMessageId messageId, Timestamp &timestamp, unsigned timeout_us,
+  bool last )
+{
+	struct timespec deadline;
+	Slot *slot = NULL;
+	unsigned i;
+	int ret;
+
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	deadline.tv_sec += timeout_us / 1000000;
+	deadline.tv_nsec += ( timeout_us % 1000000 ) * 1000;
+	if( deadline.tv_nsec >= 1000000000 ) {
+		++deadline.tv_sec;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock( &lock );
+
+	for( i = 0; i < TX_QUEUE_SIZE; ++i ) {
+		if( slots[i].state != TX_SLOT_FREE &&
+		    slots[i].message_type == messageId.getMessageType() &&
+		    slots[i].sequence_id == messageId.getSequenceId() ) {
+			slot = slots + i;
+			break;
+		}
+	}
+	if( slot == NULL ) {
+		// Never queued, or overwritten by newer frames
+		pthread_mutex_unlock( &lock );
+		return GPTP_EC_FAILURE;
+	}
+
+	while( slot->state == TX_SLOT_QUEUED ||
+	       slot->state == TX_SLOT_IN_FLIGHT ) {
+		if( timeout_us == 0 ||
+		    pthread_cond_timedwait( &done, &lock, &deadline ) ==
+		    ETIMEDOUT )
+			break;
+	}
+
+	switch( slot->state ) {
+	case TX_SLOT_DONE:
+		timestamp = slot->timestamp;
+		slot->state = TX_SLOT_FREE;
+		++stats.collected;
+		ret = GPTP_EC_SUCCESS;
+		break;
+	case TX_SLOT_FAILED:
+		slot->state = TX_SLOT_FREE;
+		++stats.collected;
+		ret = GPTP_EC_FAILURE;
+		break;
+	default:
+		// The owner still completes the slot, the result is then
+		// dropped when the slot is reused
+		if( last )
+			++stats.abandoned;
+		ret = GPTP_EC_EAGAIN;
+		break;
+	}
+
+	pthread_mutex_unlock( &lock );
+
+	return ret;
+}
+
+void *LinuxTxQueue::ownerThread( void *arg )
+{
+	((LinuxTxQueue *) arg)->run();
+	return NULL;
+}
+
+void LinuxTxQueue::run()
+{
+	struct timespec now;
+	Slot *slot;
+	bool ok;
+
+	pthread_mutex_lock( &lock );
+	while( true ) {
+		while( !stopping && slots[head].state != TX_SLOT_QUEUED )
+			pthread_cond_wait( &work, &lock );
+		if( stopping )
+			break;
+
+		slot = slots + head;
+		slot->state = TX_SLOT_IN_FLIGHT;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		queue_delay->add( elapsedNs( &slot->queued, &now ));
+		pthread_mutex_unlock( &lock );
+
+		// The slot is not touched by callers while in flight
+		ok = transmit( slot );
+
+		pthread_mutex_lock( &lock );
+		slot->state = ok ? TX_SLOT_DONE : TX_SLOT_FAILED;
+		if( ok )
+			++stats.completed;
+		else
+			++stats.failed;
+		head = ( head + 1 ) % TX_QUEUE_SIZE;
+		--depth;
+		pthread_cond_broadcast( &done );
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+bool LinuxTxQueue::transmit( Slot *slot )
+{
+	PTPMessageId messageId
+		(( MessageType ) slot->message_type, slot->sequence_id );
+	unsigned timeout_us = TX_TIMEOUT_TOTAL;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char control_data[CMSG_SPACE(sizeof( uint64_t ))];
+		struct cmsghdr cm;
+	} control;
+	struct cmsghdr *cmsg;
+	struct timespec now;
+	uint64_t tai_now;
+	int err;
+	int ret;
+
+	memset( &msg, 0, sizeof( msg ));
+	iov.iov_base = slot->frame;
+	iov.iov_len = slot->length;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_name = &slot->dest;
+	msg.msg_namelen = sizeof( slot->dest );
+
+	if( slot->launch_time != 0 ) {
+		memset( &control, 0, sizeof( control ));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof( control );
+		cmsg = CMSG_FIRSTHDR( &msg );
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_TXTIME;
+		cmsg->cmsg_len = CMSG_LEN( sizeof( uint64_t ));
+		memcpy( CMSG_DATA( cmsg ), &slot->launch_time, sizeof( uint64_t ));
+
+		// The timestamp cannot arrive before the launch time
+		clock_gettime( CLOCK_TAI, &now );
+		tai_now = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+		if( slot->launch_time > tai_now )
+			timeout_us += ( slot->launch_time - tai_now ) / 1000;
+	}
+
+	// The error queue belongs to this thread and receiving never reads
+	// it, so neither needs the network lock. A pending timestamp does
+	// wake the receiver's select(), its non-blocking recvmsg() then
+	// returns EAGAIN rather than waiting under the lock
+	timestamper->expectTxTimestamp( slot->frame, slot->length );
+	err = sendmsg( sd, &msg, 0 );
+	if( err == -1 ) {
+		timestamper->cancelTxTimestamp();
+		GPTP_LOG_ERROR( "Failed to send: %s(%d)", strerror(errno), errno );
+		++stats.send_errors;
+		return false;
+	}
+	++stats.sent;
+	if( slot->launch_time != 0 )
+		++stats.launched;
+
+	ret = timestamper->collectTxTimestamp
+		( messageId, slot->timestamp, timeout_us );
+
+	return ret == GPTP_EC_SUCCESS;
+}
+
+void LinuxTxQueue::logStatistics()
+{
+	unsigned i;
+
+	GPTP_LOG_STATUS
+		( "TX queue: submitted %llu, sent %llu (%llu at launch time), "
+		  "send errors %llu, completed %llu, failed %llu",
+		  (unsigned long long) stats.submitted,
+		  (unsigned long long) stats.sent,
+		  (unsigned long long) stats.launched,
+		  (unsigned long long) stats.send_errors,
+		  (unsigned long long) stats.completed,
+		  (unsigned long long) stats.failed );
+	GPTP_LOG_STATUS
+		( "TX queue: collected %llu, abandoned %llu, evicted %llu, "
+		  "full %llu, max depth %u",
+		  (unsigned long long) stats.collected,
+		  (unsigned long long) stats.abandoned,
+		  (unsigned long long) stats.evicted,
+		  (unsigned long long) stats.full, stats.max_depth );
+	for( i = 0; i <= TX_QUEUE_SIZE; ++i ) {
+		if( stats.depth_histogram[i] == 0 )
+			continue;
+		GPTP_LOG_STATUS
+			( "TX queue depth %2u : %llu", i,
+			  (unsigned long long) stats.depth_histogram[i] );
+	}
+	queue_delay->logStatistics( "TX queue delay" );
+}
@@ -0,0 +1,190 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+#ifndef LINUX_HAL_TXQUEUE_HPP
+#define LINUX_HAL_TXQUEUE_HPP
+
+/**@file*/
+
+#include "avbts_osnet.hpp"
+#include "ieee1588.hpp"
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define TX_QUEUE_SIZE 16	/*!< Number of event frames queued or awaiting collection */
+#define TX_QUEUE_FRAME_MAX 256	/*!< Largest event frame accepted */
+
+class PTPMessageId;
+class LinuxTimestamper;
+class LinuxLatencyHistogram;
+struct sockaddr_ll;
+
+/**
+ * @brief Statistics collected by LinuxTxQueue
+ */
+typedef struct {
+	uint64_t submitted;		//!< Event frames queued by callers
+	uint64_t sent;			//!< Frames handed to the kernel
+	uint64_t send_errors;		//!< Frames the kernel refused
+	uint64_t completed;		//!< Frames whose timestamp was collected
+	uint64_t failed;		//!< Frames without a timestamp
+	uint64_t collected;		//!< Results taken by the sender
+	uint64_t abandoned;		//!< Senders giving up before completion
+	uint64_t evicted;		//!< Results overwritten before being taken
+	uint64_t full;			//!< Frames refused because the queue was full
+	uint64_t launched;		//!< Frames sent with a launch time
+	unsigned max_depth;		//!< Deepest queue seen by a caller
+	uint64_t depth_histogram[TX_QUEUE_SIZE+1];	//!< Frames ahead of each new frame
+} tx_queue_stats_t;
+
+/**
+ * @brief LinuxTxQueue: per interface queue of event (timestamped)
+ * frames drained by a single owner thread. The owner sends each frame
+ * and collects its TX timestamp before sending the next one, so
+ * "send event frame, collect timestamp" is serialized without callers
+ * holding a lock while the device timestamps the frame. Callers queue a
+ * frame and later wait for their own result only. The owner is the only
+ * reader of the socket error queue, so it shares no lock with the
+ * receive path.
+ */
+class LinuxTxQueue {
+public:
+	/**
+	 * @brief  Default constructor. Call init() and start() before use.
+	 */
+	LinuxTxQueue();
+
+	/**
+	 * @brief  Stops the owner thread and frees the queue
+	 */
+	~LinuxTxQueue();
+
+	/**
+	 * @brief  Allocates the queue
+	 * @param  sd Event socket descriptor
+	 * @param  timestamper [in] Timestamper collecting the TX timestamps
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool init( int sd, LinuxTimestamper *timestamper );
+
+	/**
+	 * @brief  Starts the owner thread
+	 * @return TRUE on success, FALSE otherwise
+	 */
+	bool start();
+
+	/**
+	 * @brief  Queues an event frame. Never waits for the frame to be sent.
+	 * @param  dest [in] Destination address, copied
+	 * @param  payload [in] PTP message, copied
+	 * @param  length Size of the message
+	 * @param  launch_time CLOCK_TAI launch time in nanoseconds passed
+	 * with SCM_TXTIME, 0 to send immediately
+	 * @return net_succeed if queued, net_fatal if the queue is full or
+	 * the frame is too large
+	 */
+	net_result submit
+	( const struct sockaddr_ll *dest, const uint8_t *payload,
+	  size_t length, uint64_t launch_time = 0 );
+
+	/**
+	 * @brief  Waits for the TX timestamp of a queued frame
+	 * @param  messageId Message type and sequence id of the frame
+	 * @param  timestamp [out] TX timestamp
+	 * @param  timeout_us Maximum time to wait in microseconds, 0 to only
+	 * check
+	 * @param  last TRUE if the caller gives up when the frame has not
+	 * completed yet
+	 * @return GPTP_EC_SUCCESS if the timestamp was collected,
+	 * GPTP_EC_EAGAIN if the frame is still queued or in flight,
+	 * GPTP_EC_FAILURE if it could not be sent or timestamped
+	 */
+	int wait
+	( PTPMessageId messageId, Timestamp &timestamp, unsigned timeout_us,
+	  bool last = false );
+
+	/**
+	 * @brief  Gets the queue statistics
+	 * @return Reference to the statistics
+	 */
+	const tx_queue_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the queue statistics
+	 * @return void
+	 */
+	void logStatistics();
+
+private:
+	struct Slot;
+
+	int sd;
+	LinuxTimestamper *timestamper;
+
+	Slot *slots;
+	unsigned head;		// Next slot the owner sends
+	unsigned tail;		// Next slot a caller fills
+	unsigned depth;		// Slots queued or in flight
+
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t thread;
+	bool running;
+	bool stopping;
+
+	tx_queue_stats_t stats;
+	LinuxLatencyHistogram *queue_delay;
+
+	static void *ownerThread( void *arg );
+
+	/**
+	 * @brief  Owner loop, sends queued frames until stopped
+	 * @return void
+	 */
+	void run();
+
+	/**
+	 * @brief  Sends one frame and collects its timestamp
+	 * @param  slot [inout] Frame to send, receives the timestamp
+	 * @return TRUE if the timestamp was collected
+	 */
+	bool transmit( Slot *slot );
+};
+
+#endif/*LINUX_HAL_TXQUEUE_HPP*/
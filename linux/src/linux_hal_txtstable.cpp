@@ -0,0 +1,152 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_txtstable.hpp>
+#include <avbts_message.hpp>
+#include <gptp_log.hpp>
+
+#include <string.h>
+
+#define TX_TS_TABLE_MASK (TX_TS_TABLE_SIZE-1)
+
+LinuxTxTimestampTable::LinuxTxTimestampTable()
+{
+	memset( &stats, 0, sizeof( stats ));
+	clear();
+}
+
+void LinuxTxTimestampTable::clear()
+{
+	unsigned i;
+
+	for( i = 0; i < TX_TS_TABLE_SIZE; ++i )
+		entries[i].state = TX_TS_FREE;
+	next_key = 0;
+}
+
+void LinuxTxTimestampTable::expect( const uint8_t *header, size_t length )
+{
+	Entry *entry = entries + ( next_key & TX_TS_TABLE_MASK );
+	uint16_t sequence_id;
+
+	if( entry->state != TX_TS_FREE )
+		++stats.evictions;
+
+	entry->key = next_key++;
+	entry->state = TX_TS_PENDING;
+	++stats.expected;
+	if( length < PTP_COMMON_HDR_LENGTH ) {
+		// Still consumes a key, but can never be looked up
+		entry->message_type = 0xFF;
+		return;
+	}
+	entry->message_type = header
+		[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET)] & 0xF;
+	memcpy
+		( &sequence_id,
+		  header + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
+		  sizeof( sequence_id ));
+	entry->sequence_id = PLAT_ntohs( sequence_id );
+}
+
+void LinuxTxTimestampTable::cancel()
+{
+	--next_key;
+	entries[next_key & TX_TS_TABLE_MASK].state = TX_TS_FREE;
+	--stats.expected;
+}
+
+bool LinuxTxTimestampTable::complete
+( uint32_t key, const Timestamp &timestamp )
+{
+	Entry *entry = entries + ( key & TX_TS_TABLE_MASK );
+	unsigned i;
+
+	if( entry->state != TX_TS_PENDING || entry->key != key ) {
+		++stats.unknown;
+		return false;
+	}
+
+	// Any older message still pending completes out of order
+	for( i = 1; i < TX_TS_TABLE_SIZE; ++i ) {
+		Entry *older = entries + (( key - i ) & TX_TS_TABLE_MASK );
+		if( older->state == TX_TS_PENDING && older->key == key - i ) {
+			++stats.out_of_order;
+			break;
+		}
+	}
+
+	entry->timestamp = timestamp;
+	entry->state = TX_TS_COMPLETE;
+	++stats.completed;
+
+	return true;
+}
+
+bool LinuxTxTimestampTable::lookup
+( PTPMessageId messageId, Timestamp &timestamp )
+{
+	uint8_t message_type = messageId.getMessageType();
+	uint16_t sequence_id = messageId.getSequenceId();
+	unsigned i;
+
+	// Newest first, the wanted message is almost always the last sent
+	for( i = 1; i <= TX_TS_TABLE_SIZE; ++i ) {
+		Entry *entry = entries + (( next_key - i ) & TX_TS_TABLE_MASK );
+
+		if( entry->state != TX_TS_COMPLETE ||
+		    entry->message_type != message_type ||
+		    entry->sequence_id != sequence_id )
+			continue;
+
+		timestamp = entry->timestamp;
+		entry->state = TX_TS_FREE;
+		++stats.hits;
+		return true;
+	}
+
+	return false;
+}
+
+void LinuxTxTimestampTable::logStatistics() const
+{
+	GPTP_LOG_STATUS
+		( "TX timestamp table: expected %llu, completed %llu, "
+		  "out of order %llu, unknown %llu, evictions %llu, hits %llu",
+		  (unsigned long long) stats.expected,
+		  (unsigned long long) stats.completed,
+		  (unsigned long long) stats.out_of_order,
+		  (unsigned long long) stats.unknown,
+		  (unsigned long long) stats.evictions,
+		  (unsigned long long) stats.hits );
+}
@@ -0,0 +1,147 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_TXTSTABLE_HPP
+#define LINUX_HAL_TXTSTABLE_HPP
+
+/**@file*/
+
+#include "ieee1588.hpp"
+
+#include <stdint.h>
+
+#define TX_TS_TABLE_SIZE 16	/*!< Number of outstanding TX timestamps (power of two) */
+
+class PTPMessageId;
+
+/**
+ * @brief Completion statistics collected by LinuxTxTimestampTable
+ */
+typedef struct {
+	uint64_t expected;	//!< Event messages sent with a timestamp key
+	uint64_t completed;	//!< Completions matched to an outstanding message
+	uint64_t out_of_order;	//!< Completions arriving before an older one
+	uint64_t unknown;	//!< Completions with no outstanding message
+	uint64_t evictions;	//!< Entries reused before being consumed
+	uint64_t hits;		//!< Lookups returning a timestamp
+} tx_ts_table_stats_t;
+
+/**
+ * @brief LinuxTxTimestampTable: correlates TX timestamp completions from
+ * the socket error queue to the event messages they belong to, using the
+ * per socket key assigned by SOF_TIMESTAMPING_OPT_ID. The kernel numbers
+ * every frame sent on the socket, starting at zero, so the table predicts
+ * the key of each message at send time. A completion for another message
+ * than the one being waited for is stored instead of dropped. The entry
+ * for a key is at key % TX_TS_TABLE_SIZE, the oldest outstanding message
+ * is overwritten when more than TX_TS_TABLE_SIZE are in flight.
+ * Not thread safe: only the TX queue owner, or the reactor thread when
+ * there is no queue, sends event frames and reads their timestamps.
+ */
+class LinuxTxTimestampTable {
+public:
+	/**
+	 * @brief  Default constructor, the table starts empty with key zero
+	 */
+	LinuxTxTimestampTable();
+
+	/**
+	 * @brief  Records an event message about to be sent
+	 * @param  header [in] Start of the PTP common header
+	 * @param  length Number of valid bytes at header
+	 * @return void
+	 */
+	void expect( const uint8_t *header, size_t length );
+
+	/**
+	 * @brief  Forgets the message recorded by the last expect() call,
+	 * used when the send failed and the kernel assigned no key
+	 * @return void
+	 */
+	void cancel();
+
+	/**
+	 * @brief  Stores the timestamp of a completion
+	 * @param  key Key reported by the kernel (ee_data)
+	 * @param  timestamp [in] TX timestamp
+	 * @return TRUE if the key belongs to an outstanding message
+	 */
+	bool complete( uint32_t key, const Timestamp &timestamp );
+
+	/**
+	 * @brief  Finds and consumes the timestamp of a message
+	 * @param  messageId Message type and sequence id
+	 * @param  timestamp [out] TX timestamp
+	 * @return TRUE if the message completed, FALSE otherwise
+	 */
+	bool lookup( PTPMessageId messageId, Timestamp &timestamp );
+
+	/**
+	 * @brief  Discards all entries and restarts the key at zero, must be
+	 * called whenever SO_TIMESTAMPING is set on the socket
+	 * @return void
+	 */
+	void clear();
+
+	/**
+	 * @brief  Gets the completion statistics
+	 * @return Reference to the statistics
+	 */
+	const tx_ts_table_stats_t &getStatistics() const
+	{
+		return stats;
+	}
+
+	/**
+	 * @brief  Logs the completion statistics
+	 * @return void
+	 */
+	void logStatistics() const;
+
+private:
+	typedef enum { TX_TS_FREE, TX_TS_PENDING, TX_TS_COMPLETE } tx_ts_state_t;
+
+	struct Entry {
+		uint32_t key;
+		tx_ts_state_t state;
+		uint8_t message_type;
+		uint16_t sequence_id;
+		Timestamp timestamp;
+	};
+
+	Entry entries[TX_TS_TABLE_SIZE];
+	uint32_t next_key;
+	tx_ts_table_stats_t stats;
+};
+
+#endif/*LINUX_HAL_TXTSTABLE_HPP*/
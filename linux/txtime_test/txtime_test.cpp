@@ -0,0 +1,399 @@
+/******************************************************************************
+
+  Copyright (c) 2012 Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  3. Neither the name of the Intel Corporation nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+
+/*
+ * Checks Sync launch time scheduling (SO_TXTIME) end to end, typically on
+ * a veth pair with the ETF qdisc in software mode, see veth_etf.sh.
+ *
+ * Frames are sent the way the daemon sends a scheduled Sync: a launch
+ * time on a multiple of the interval in CLOCK_TAI is passed with
+ * SCM_TXTIME some lead time ahead. Each frame is received on the peer
+ * interface and its kernel receive time compared to its launch time.
+ * A frame arriving earlier than the qdisc delta means the launch time
+ * was not honoured (no ETF qdisc), a launch time error reported on the
+ * error queue means it was dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/timex.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <netpacket/packet.h>
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+// Added in Linux 4.19
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+#define TEST_ETHERTYPE 0x88B5	/* Local experimental EtherType */
+#define TEST_FRAME_LENGTH 64
+#define NS_PER_SEC 1000000000LL
+
+typedef struct {
+	uint64_t sequence;
+	uint64_t launch_time;
+} test_payload_t;
+
+static int64_t tsToNs( const struct timespec *ts )
+{
+	return (int64_t) ts->tv_sec * NS_PER_SEC + ts->tv_nsec;
+}
+
+static int openSocket
+( const char *ifname, unsigned char *mac, int *ifindex )
+{
+	struct sockaddr_ll addr;
+	struct ifreq ifr;
+	int sd;
+
+	sd = socket( AF_PACKET, SOCK_RAW, htons( TEST_ETHERTYPE ));
+	if( sd == -1 ) {
+		fprintf( stderr, "socket(): %s\n", strerror( errno ));
+		return -1;
+	}
+
+	memset( &ifr, 0, sizeof( ifr ));
+	strncpy( ifr.ifr_name, ifname, IFNAMSIZ - 1 );
+	if( ioctl( sd, SIOCGIFINDEX, &ifr ) == -1 ) {
+		fprintf( stderr, "%s: %s\n", ifname, strerror( errno ));
+		close( sd );
+		return -1;
+	}
+	*ifindex = ifr.ifr_ifindex;
+	if( ioctl( sd, SIOCGIFHWADDR, &ifr ) == -1 ) {
+		fprintf( stderr, "%s: %s\n", ifname, strerror( errno ));
+		close( sd );
+		return -1;
+	}
+	memcpy( mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN );
+
+	memset( &addr, 0, sizeof( addr ));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons( TEST_ETHERTYPE );
+	addr.sll_ifindex = *ifindex;
+	if( bind( sd, (struct sockaddr *) &addr, sizeof( addr )) == -1 ) {
+		fprintf( stderr, "bind(): %s\n", strerror( errno ));
+		close( sd );
+		return -1;
+	}
+
+	return sd;
+}
+
+static bool sendAt
+( int sd, int ifindex, const unsigned char *src, const unsigned char *dst,
+  uint64_t sequence, uint64_t launch_time )
+{
+	unsigned char frame[TEST_FRAME_LENGTH];
+	struct ether_header *eh = (struct ether_header *) frame;
+	struct sockaddr_ll addr;
+	test_payload_t payload;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char control_data[CMSG_SPACE(sizeof( uint64_t ))];
+		struct cmsghdr cm;
+	} control;
+	struct cmsghdr *cmsg;
+
+	memset( frame, 0, sizeof( frame ));
+	memcpy( eh->ether_dhost, dst, ETH_ALEN );
+	memcpy( eh->ether_shost, src, ETH_ALEN );
+	eh->ether_type = htons( TEST_ETHERTYPE );
+	payload.sequence = sequence;
+	payload.launch_time = launch_time;
+	memcpy( frame + sizeof( *eh ), &payload, sizeof( payload ));
+
+	memset( &addr, 0, sizeof( addr ));
+	addr.sll_family = AF_PACKET;
+	addr.sll_ifindex = ifindex;
+	addr.sll_halen = ETH_ALEN;
+	memcpy( addr.sll_addr, dst, ETH_ALEN );
+
+	// Same layout as LinuxTxQueue::transmit()
+	memset( &msg, 0, sizeof( msg ));
+	memset( &control, 0, sizeof( control ));
+	iov.iov_base = frame;
+	iov.iov_len = sizeof( frame );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof( addr );
+	msg.msg_control = &control;
+	msg.msg_controllen = sizeof( control );
+	cmsg = CMSG_FIRSTHDR( &msg );
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_TXTIME;
+	cmsg->cmsg_len = CMSG_LEN( sizeof( uint64_t ));
+	memcpy( CMSG_DATA( cmsg ), &launch_time, sizeof( uint64_t ));
+
+	if( sendmsg( sd, &msg, 0 ) == -1 ) {
+		fprintf( stderr, "sendmsg(): %s\n", strerror( errno ));
+		return false;
+	}
+
+	return true;
+}
+
+static unsigned drainLaunchErrors( int sd )
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *serr;
+	union {
+		char control_data[CMSG_SPACE(256)];
+		struct cmsghdr cm;
+	} control;
+	unsigned errors = 0;
+
+	while( true ) {
+		memset( &msg, 0, sizeof( msg ));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof( control );
+		if( recvmsg( sd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT ) == -1 )
+			break;
+		for( cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR( &msg, cmsg )) {
+			serr = (struct sock_extended_err *) CMSG_DATA( cmsg );
+			if( serr->ee_origin != SO_EE_ORIGIN_TXTIME )
+				continue;
+			printf( "launch time %s\n",
+				serr->ee_code == SO_EE_CODE_TXTIME_MISSED ?
+				"missed" : "rejected" );
+			++errors;
+		}
+	}
+
+	return errors;
+}
+
+static bool receive
+( int sd, int timeout_ms, int64_t tai_offset, test_payload_t &payload,
+  int64_t &arrival )
+{
+	unsigned char frame[TEST_FRAME_LENGTH + 64];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct pollfd pfd;
+	union {
+		char control_data[CMSG_SPACE(sizeof( struct timespec ))];
+		struct cmsghdr cm;
+	} control;
+	ssize_t length;
+
+	pfd.fd = sd;
+	pfd.events = POLLIN;
+	if( poll( &pfd, 1, timeout_ms ) != 1 )
+		return false;
+
+	memset( &msg, 0, sizeof( msg ));
+	iov.iov_base = frame;
+	iov.iov_len = sizeof( frame );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control;
+	msg.msg_controllen = sizeof( control );
+	length = recvmsg( sd, &msg, 0 );
+	if( length < (ssize_t)( sizeof( struct ether_header ) +
+				sizeof( payload )))
+		return false;
+	memcpy( &payload, frame + sizeof( struct ether_header ),
+		sizeof( payload ));
+
+	// Kernel receive time is CLOCK_REALTIME, CLOCK_TAI is ahead of it by
+	// exactly the kernel TAI offset
+	for( cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR( &msg, cmsg )) {
+		if( cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMPNS ) {
+			arrival = tsToNs( (struct timespec *) CMSG_DATA( cmsg )) +
+				tai_offset;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int main( int argc, char *argv[] )
+{
+	unsigned char tx_mac[ETH_ALEN], rx_mac[ETH_ALEN];
+	int tx_ifindex, rx_ifindex;
+	int tx_sd, rx_sd;
+	struct sock_txtime txtime;
+	struct timex tmx;
+	struct timespec now, wake;
+	unsigned count = 100;
+	int64_t interval = 125000000;
+	int64_t lead = 2000000;
+	int64_t delta = 200000;
+	int64_t tai_offset;
+	int64_t launch, arrival, lateness, spacing, jitter;
+	int64_t late_min = INT64_MAX, late_max = INT64_MIN, late_total = 0;
+	int64_t jitter_max = 0, jitter_total = 0, last_arrival = 0;
+	unsigned received = 0, early = 0, lost = 0, errors = 0, spacings = 0;
+	test_payload_t payload;
+	int enable = 1;
+	unsigned i;
+
+	if( argc < 3 ) {
+		fprintf( stderr,
+			 "Usage: %s <tx-if> <rx-if> [count] [interval-us] "
+			 "[lead-us] [delta-us]\n", argv[0] );
+		return 2;
+	}
+	if( argc > 3 ) count = strtoul( argv[3], NULL, 0 );
+	if( argc > 4 ) interval = strtoll( argv[4], NULL, 0 ) * 1000;
+	if( argc > 5 ) lead = strtoll( argv[5], NULL, 0 ) * 1000;
+	if( argc > 6 ) delta = strtoll( argv[6], NULL, 0 ) * 1000;
+	if( interval <= lead ) {
+		fprintf( stderr, "The interval must exceed the lead\n" );
+		return 2;
+	}
+
+	tx_sd = openSocket( argv[1], tx_mac, &tx_ifindex );
+	rx_sd = openSocket( argv[2], rx_mac, &rx_ifindex );
+	if( tx_sd == -1 || rx_sd == -1 )
+		return 2;
+
+	// Same options as the daemon's event socket with -TXTIME
+	memset( &txtime, 0, sizeof( txtime ));
+	txtime.clockid = CLOCK_TAI;
+	txtime.flags = SOF_TXTIME_REPORT_ERRORS;
+	if( setsockopt( tx_sd, SOL_SOCKET, SO_TXTIME, &txtime,
+			sizeof( txtime )) == -1 ) {
+		fprintf( stderr, "SO_TXTIME: %s\n", strerror( errno ));
+		return 2;
+	}
+	if( setsockopt( rx_sd, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+			sizeof( enable )) == -1 ) {
+		fprintf( stderr, "SO_TIMESTAMPNS: %s\n", strerror( errno ));
+		return 2;
+	}
+
+	memset( &tmx, 0, sizeof( tmx ));
+	if( adjtimex( &tmx ) == -1 ) {
+		fprintf( stderr, "adjtimex(): %s\n", strerror( errno ));
+		return 2;
+	}
+	tai_offset = (int64_t) tmx.tai * NS_PER_SEC;
+
+	for( i = 0; i < count; ++i ) {
+		// Next multiple of the interval at least lead away, woken up
+		// lead before it like the daemon's Sync timer
+		clock_gettime( CLOCK_TAI, &now );
+		launch = ( tsToNs( &now ) + lead + interval ) / interval *
+			interval;
+		wake.tv_sec = ( launch - lead ) / NS_PER_SEC;
+		wake.tv_nsec = ( launch - lead ) % NS_PER_SEC;
+		clock_nanosleep( CLOCK_TAI, TIMER_ABSTIME, &wake, NULL );
+
+		if( !sendAt( tx_sd, tx_ifindex, tx_mac, rx_mac, i, launch ))
+			return 1;
+
+		if( !receive( rx_sd, (int)(( lead + delta ) / 1000000 ) + 100,
+			      tai_offset, payload, arrival ) ||
+		    payload.sequence != i ) {
+			++lost;
+			errors += drainLaunchErrors( tx_sd );
+			last_arrival = 0;
+			continue;
+		}
+		++received;
+
+		lateness = arrival - (int64_t) payload.launch_time;
+		if( lateness < -delta ) {
+			++early;
+		}
+		if( lateness < late_min ) late_min = lateness;
+		if( lateness > late_max ) late_max = lateness;
+		late_total += lateness;
+
+		if( last_arrival != 0 ) {
+			spacing = arrival - last_arrival;
+			jitter = spacing - interval *
+				(( spacing + interval / 2 ) / interval );
+			if( jitter < 0 ) jitter = -jitter;
+			if( jitter > jitter_max ) jitter_max = jitter;
+			jitter_total += jitter;
+			++spacings;
+		}
+		last_arrival = arrival;
+	}
+	errors += drainLaunchErrors( tx_sd );
+
+	printf( "frames %u, received %u, lost %u, early %u, launch errors %u\n",
+		count, received, lost, early, errors );
+	if( received != 0 ) {
+		printf( "arrival - launch time: min %lld ns, mean %lld ns, "
+			"max %lld ns\n", (long long) late_min,
+			(long long)( late_total / received ),
+			(long long) late_max );
+	}
+	if( spacings != 0 ) {
+		printf( "interval jitter: mean %lld ns, max %lld ns\n",
+			(long long)( jitter_total / spacings ),
+			(long long) jitter_max );
+	}
+
+	close( tx_sd );
+	close( rx_sd );
+
+	if( early != 0 ) {
+		printf( "FAIL: frames left before their launch time, is the "
+			"ETF qdisc installed?\n" );
+		return 1;
+	}
+	if( lost != 0 || errors != 0 ) {
+		printf( "FAIL: frames lost or launch times rejected\n" );
+		return 1;
+	}
+	printf( "PASS\n" );
+
+	return 0;
+}
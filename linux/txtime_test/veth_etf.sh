@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+#  Copyright (c) 2012 Intel Corporation
+#  All rights reserved.
+#
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are met:
+#
+#   1. Redistributions of source code must retain the above copyright notice,
+#      this list of conditions and the following disclaimer.
+#
+#   2. Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#
+#   3. Neither the name of the Intel Corporation nor the names of its
+#      contributors may be used to endorse or promote products derived from
+#      this software without specific prior written permission.
+#
+#  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+#  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+#  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+#  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+#  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+#  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+#  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+#  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+#  POSSIBILITY OF SUCH DAMAGE.
+
+# Runs txtime_test across a veth pair with the ETF qdisc in software mode
+# on the sending side, as the daemon would run with -TXTIME. Needs root
+# and the sch_etf module.
+#
+# Usage: veth_etf.sh [txtime_test] [count] [interval-us] [lead-us]
+
+TEST=${1:-./txtime_test}
+COUNT=${2:-100}
+INTERVAL=${3:-125000}
+LEAD=${4:-2000}
+DELTA=200
+TX=gptp-etf0
+RX=gptp-etf1
+
+cleanup() {
+	ip link del $TX 2>/dev/null
+}
+trap cleanup EXIT
+
+ip link add $TX type veth peer name $RX || exit 2
+ip link set $TX up || exit 2
+ip link set $RX up || exit 2
+# veth is single queue, ETF goes at the root
+tc qdisc add dev $TX root etf clockid CLOCK_TAI delta $((DELTA * 1000)) || {
+	echo "ETF qdisc not available (sch_etf)"
+	exit 2
+}
+
+# Let IPv6 DAD and link setup traffic settle
+sleep 1
+
+$TEST $TX $RX $COUNT $INTERVAL $LEAD $DELTA
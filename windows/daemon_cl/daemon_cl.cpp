@@ -125,6 +125,8 @@ int _tmain(int argc, _TCHAR* argv[])
 	portInit.thread_factory = NULL;
 	portInit.timer_factory = NULL;
 	portInit.lock_factory = NULL;
+	portInit.syncLaunchLead = 0;
+	portInit.delayFilter.type = SAMPLE_FILTER_NONE;
 	portInit.neighborPropDelayThreshold =
 		CommonPort::NEIGHBOR_PROP_DELAY_THRESH;
 
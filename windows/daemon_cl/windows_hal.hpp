@@ -422,6 +422,8 @@ public:
 	bool addEvent( unsigned long micros, int type, ostimerq_handler func, event_descriptor_t *arg, bool rm, unsigned *event ) {
 		WindowsTimerQueueHandlerArg *outer_arg = new WindowsTimerQueueHandlerArg();
 		cleanupRetiredTimers();
+		// Arming an event still pending for the port moves it
+		if( arg != NULL ) cancelEvent( type, arg->port, NULL );
 		if( timerQueueMap.find(type) == timerQueueMap.end() ) {
 			timerQueueMap[type].queue_handle = CreateTimerQueue();
 			InitializeSRWLock( &timerQueueMap[type].lock );
@@ -442,23 +444,34 @@ public:
 	/**
 	 * @brief  Cancels an event from the queue
 	 * @param  type ::Event type
+	 * @param  port Port the event was added for, NULL for all ports
 	 * @param  event [in] Pointer to the event to be removed
 	 * @return Always returns true.
 	 */
-	bool cancelEvent( int type, unsigned *event ) {
+	bool cancelEvent( int type, CommonPort *port, unsigned *event ) {
 		TimerQueueMap_t::iterator iter = timerQueueMap.find( type );
+		TimerArgList_t cancelled;
+		TimerArgList_t::iterator arg;
 		if( iter == timerQueueMap.end() ) return false;
-		AcquireSRWLockExclusive( &timerQueueMap[type].lock );
-		while( ! timerQueueMap[type].arg_list.empty() ) {
-			WindowsTimerQueueHandlerArg *del_arg = timerQueueMap[type].arg_list.front();
-			timerQueueMap[type].arg_list.pop_front();
-			ReleaseSRWLockExclusive( &timerQueueMap[type].lock );
+		AcquireSRWLockExclusive( &iter->second.lock );
+		arg = iter->second.arg_list.begin();
+		while( arg != iter->second.arg_list.end() ) {
+			if( port == NULL ||
+			    ( (*arg)->inner_arg != NULL && (*arg)->inner_arg->port == port )) {
+				cancelled.push_back( *arg );
+				arg = iter->second.arg_list.erase( arg );
+			} else {
+				++arg;
+			}
+		}
+		ReleaseSRWLockExclusive( &iter->second.lock );
+		while( ! cancelled.empty() ) {
+			WindowsTimerQueueHandlerArg *del_arg = cancelled.front();
+			cancelled.pop_front();
 			DeleteTimerQueueTimer( del_arg->queue_handle, del_arg->timer_handle, INVALID_HANDLE_VALUE );
 			if( del_arg->rm ) delete del_arg->inner_arg;
 			delete del_arg;
-			AcquireSRWLockExclusive( &timerQueueMap[type].lock );
 		}
-		ReleaseSRWLockExclusive( &timerQueueMap[type].lock );
 
 		return true;
 	}